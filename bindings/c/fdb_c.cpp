@@ -403,6 +403,16 @@ FDBFuture* fdb_transaction_get_key_v13( FDBTransaction* tr, uint8_t const* key_n
 										 or_equal, offset, false );
 }
 
+extern "C" DLLEXPORT
+FDBFuture* fdb_transaction_get_values( FDBTransaction* tr, uint8_t const* const* key_names,
+									   int const* key_name_lengths, int key_count,
+									   fdb_bool_t snapshot ) {
+	Standalone<VectorRef<KeyRef>> keys;
+	for(int i = 0; i < key_count; i++)
+		keys.push_back( keys.arena(), KeyRef( key_names[i], key_name_lengths[i] ) );
+	return (FDBFuture*)( TXN(tr)->getValues( keys, snapshot ).extractPtr() );
+}
+
 extern "C"
 FDBFuture* fdb_transaction_get_addresses_for_key( FDBTransaction* tr, uint8_t const* key_name,
 									int key_name_length ){
@@ -198,6 +198,12 @@ extern "C" {
                              int offset, fdb_bool_t snapshot );
 #endif
 
+    DLLEXPORT WARN_UNUSED_RESULT FDBFuture*
+    fdb_transaction_get_values( FDBTransaction* tr,
+                                uint8_t const* const* key_names,
+                                int const* key_name_lengths, int key_count,
+                                fdb_bool_t snapshot );
+
     DLLEXPORT WARN_UNUSED_RESULT FDBFuture*
     fdb_transaction_get_addresses_for_key(FDBTransaction* tr, uint8_t const* key_name,
                             int key_name_length);
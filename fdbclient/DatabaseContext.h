@@ -113,6 +113,21 @@ public:
 	};
 	std::map<uint32_t, VersionBatcher> versionBatcher;
 
+	Future<GetReadVersionReply> getBatchedReadVersion( uint32_t flags, Optional<UID> debugID );
+
+	// Cache of the most recent read version, for transactions that accept bounded staleness (USE_CACHED_READ_VERSION).
+	// cachedReadVersionTime is when the request that produced cachedReadVersion was sent; every transaction committed
+	// before then is visible at that version.
+	double readVersionCacheMaxAge;
+	GetReadVersionReply cachedReadVersion;
+	double cachedReadVersionTime;
+	double lastCachedReadVersionUse;
+	Future<Void> readVersionCacheRefresher;
+
+	Optional<GetReadVersionReply> getCachedReadVersion();
+	void updateCachedReadVersion( double requestTime, GetReadVersionReply const& rep );
+	void invalidateCachedReadVersion( Version atOrBelow );
+
 	// Client status updater
 	struct ClientStatusUpdater {
 		std::vector<BinaryWriter> inStatusQ;
@@ -142,6 +157,8 @@ public:
 	int64_t transactionsFutureVersions;
 	int64_t transactionsNotCommitted;
 	int64_t transactionsMaybeCommitted; 
+	int64_t readVersionCacheHits;
+	int64_t readVersionCacheMisses;
 	ContinuousSample<double> latencies, readLatencies, commitLatencies, GRVLatencies, mutationsPerCommit, bytesPerCommit;
 
 	int outstandingWatches;
@@ -469,6 +469,44 @@ struct RangeResultRef : VectorRef<KeyValueRef> {
 	}
 };
 
+// Aggregates over the rows of a key range, computed without reading the rows themselves back to the client
+struct RangeAggregate {
+	int64_t rows;
+	int64_t keyBytes;
+	int64_t valueBytes;
+	Optional<Key> firstKey;  // Present iff rows > 0
+	Optional<Key> lastKey;
+
+	RangeAggregate() : rows(0), keyBytes(0), valueBytes(0) {}
+
+	// Pre: rows are added in ascending key order
+	void add( VectorRef<KeyValueRef> const& data ) {
+		if (!data.size()) return;
+		if (!firstKey.present()) firstKey = Key(data.front().key);
+		lastKey = Key(data.back().key);
+		rows += data.size();
+		for(auto& kv : data) {
+			keyBytes += kv.key.size();
+			valueBytes += kv.value.size();
+		}
+	}
+
+	// Pre: every key in r is after every key in *this
+	void append( RangeAggregate const& r ) {
+		if (!r.rows) return;
+		if (!rows) firstKey = r.firstKey;
+		lastKey = r.lastKey;
+		rows += r.rows;
+		keyBytes += r.keyBytes;
+		valueBytes += r.valueBytes;
+	}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & rows & keyBytes & valueBytes & firstKey & lastKey;
+	}
+};
+
 struct KeyValueStoreType {
 	// These enumerated values are stored in the database configuration, so can NEVER be changed.  Only add new ones just before END.
 	enum StoreType {
@@ -57,12 +57,16 @@ ClientKnobs::ClientKnobs(bool randomize) {
 
 	init( MAX_BATCH_SIZE,                           20 ); if( randomize && BUGGIFY ) MAX_BATCH_SIZE = 1; // Note that SERVER_KNOBS->START_TRANSACTION_MAX_BUDGET_SIZE is set to match this value
 	init( GRV_BATCH_TIMEOUT,                     0.005 ); if( randomize && BUGGIFY ) GRV_BATCH_TIMEOUT = 0.1;
+	init( READ_VERSION_CACHE_MAX_AGE,             0.01 ); if( randomize && BUGGIFY ) READ_VERSION_CACHE_MAX_AGE = g_random->coinflip() ? 0.001 : 1.0;
+	init( READ_VERSION_CACHE_IDLE_TIME,            1.0 );
 
 	init( LOCATION_CACHE_EVICTION_SIZE,         100000 );
 	init( LOCATION_CACHE_EVICTION_SIZE_SIM,         10 ); if( randomize && BUGGIFY ) LOCATION_CACHE_EVICTION_SIZE_SIM = 3;
 
 	init( GET_RANGE_SHARD_LIMIT,                     2 );
 	init( WARM_RANGE_SHARD_LIMIT,                  100 );
+	init( GET_VALUES_KEY_LIMIT,                    500 ); if( randomize && BUGGIFY ) GET_VALUES_KEY_LIMIT = 3;
+	init( GET_RANGE_AGGREGATE_SHARD_LIMIT,         100 ); if( randomize && BUGGIFY ) GET_RANGE_AGGREGATE_SHARD_LIMIT = 2;
 	init( STORAGE_METRICS_SHARD_LIMIT,             100 ); if( randomize && BUGGIFY ) STORAGE_METRICS_SHARD_LIMIT = 3;
 	init( STORAGE_METRICS_UNFAIR_SPLIT_LIMIT,  2.0/3.0 );
 	init( STORAGE_METRICS_TOO_MANY_SHARDS_DELAY,  15.0 );
@@ -55,6 +55,8 @@ public:
 
 	int MAX_BATCH_SIZE;
 	double GRV_BATCH_TIMEOUT;
+	double READ_VERSION_CACHE_MAX_AGE; // Default for the read_version_cache_max_age database option
+	double READ_VERSION_CACHE_IDLE_TIME; // The cache stops refreshing itself when it hasn't been used for this long
 
 	// When locationCache in DatabaseContext gets to be this size, items will be evicted
 	int LOCATION_CACHE_EVICTION_SIZE;
@@ -62,6 +64,8 @@ public:
 
 	int GET_RANGE_SHARD_LIMIT;
 	int WARM_RANGE_SHARD_LIMIT;
+	int GET_VALUES_KEY_LIMIT; // The most keys sent to a storage server in one GetValuesRequest
+	int GET_RANGE_AGGREGATE_SHARD_LIMIT; // The most shards aggregated at once by getRangeAggregate
 	int STORAGE_METRICS_SHARD_LIMIT;
 	double STORAGE_METRICS_UNFAIR_SPLIT_LIMIT;
 	double STORAGE_METRICS_TOO_MANY_SHARDS_DELAY;
@@ -63,24 +63,30 @@ struct MasterProxyInterface {
 struct CommitID {
 	Version version; 			// returns invalidVersion if transaction conflicts
 	uint16_t txnBatchId;
+	Optional<Standalone<VectorRef<int>>> conflictingKeyRanges;	// indices into the request's read_conflict_ranges, if FLAG_REPORT_CONFLICTING_KEYS was set and the transaction conflicted
 
 	template <class Ar>
 	void serialize(Ar& ar) {
 		ar & version & txnBatchId;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & conflictingKeyRanges;
 	}
 
 	CommitID() : version(invalidVersion), txnBatchId(0) {}
 	CommitID( Version version, uint16_t txnBatchId ) : version(version), txnBatchId(txnBatchId) {}
+	CommitID( Version version, uint16_t txnBatchId, Standalone<VectorRef<int>> const& conflictingKeyRanges ) : version(version), txnBatchId(txnBatchId), conflictingKeyRanges(conflictingKeyRanges) {}
 };
 
 struct CommitTransactionRequest {
 	enum { 
 		FLAG_IS_LOCK_AWARE = 0x1,
-		FLAG_FIRST_IN_BATCH = 0x2
+		FLAG_FIRST_IN_BATCH = 0x2,
+		FLAG_REPORT_CONFLICTING_KEYS = 0x4
 	};
 
 	bool isLockAware() const { return flags & FLAG_IS_LOCK_AWARE; }
 	bool firstInBatch() const { return flags & FLAG_FIRST_IN_BATCH; }
+	bool reportConflictingKeys() const { return flags & FLAG_REPORT_CONFLICTING_KEYS; }
 	
 	Arena arena;
 	CommitTransactionRef transaction;
@@ -174,15 +180,38 @@ struct GetKeyServerLocationsRequest {
 	}
 };
 
+// Sent by a proxy to the holders of the GRV leases it has granted whenever its committed version advances or it extends a lease
+struct LeasedCommittedVersionRequest {
+	UID grantor;
+	GetReadVersionReply committed;
+	double leaseStart;  // The leaseStart of the newest request for the lease that the grantor has granted
+	ReplyPromise<Void> reply;
+
+	LeasedCommittedVersionRequest() : leaseStart(0) {}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & grantor & committed & leaseStart & reply;
+	}
+};
+
 struct GetRawCommittedVersionRequest {
 	Optional<UID> debugID;
 	ReplyPromise<GetReadVersionReply> reply;
+	// If present, also asks for a GRV lease: for leaseDuration seconds, the receiving proxy won't report a version committed
+	//   to its clients until leaseUpdates has acknowledged it
+	Optional<RequestStream<LeasedCommittedVersionRequest>> leaseUpdates;
+	UID leaseHolder;
+	double leaseDuration;
+	double leaseStart;  // now() at the holder when it sent the request; the holder times the lease from this once a push confirms it
 
-	explicit GetRawCommittedVersionRequest(Optional<UID> const& debugID = Optional<UID>()) : debugID(debugID) {}
+	explicit GetRawCommittedVersionRequest(Optional<UID> const& debugID = Optional<UID>()) : debugID(debugID), leaseDuration(0), leaseStart(0) {}
 
 	template <class Ar>
 	void serialize( Ar& ar ) {
 		ar & debugID & reply;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & leaseUpdates & leaseHolder & leaseDuration & leaseStart;
 	}
 };
 
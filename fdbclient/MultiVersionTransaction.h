@@ -75,6 +75,7 @@ struct FdbCApi : public ThreadSafeReferenceCounted<FdbCApi> {
 	FDBFuture* (*transactionGetReadVersion)(FDBTransaction *tr);
 	
 	FDBFuture* (*transactionGet)(FDBTransaction *tr, uint8_t const *keyName, int keyNameLength, fdb_bool_t snapshot);
+	FDBFuture* (*transactionGetValues)(FDBTransaction *tr, uint8_t const* const* keyNames, int const* keyNameLengths, int keyCount, fdb_bool_t snapshot);
 	FDBFuture* (*transactionGetKey)(FDBTransaction *tr, uint8_t const *keyName, int keyNameLength, fdb_bool_t orEqual, int offset, fdb_bool_t snapshot);
 	FDBFuture* (*transactionGetAddressesForKey)(FDBTransaction *tr, uint8_t const *keyName, int keyNameLength);
 	FDBFuture* (*transactionGetRange)(FDBTransaction *tr, uint8_t const *beginKeyName, int beginKeyNameLength, fdb_bool_t beginOrEqual, int beginOffset,
@@ -121,6 +122,7 @@ public:
 	ThreadFuture<Version> getReadVersion();
 
 	ThreadFuture<Optional<Value>> get(const KeyRef& key, bool snapshot=false);
+	ThreadFuture<Standalone<RangeResultRef>> getValues(const VectorRef<KeyRef>& keys, bool snapshot=false);
 	ThreadFuture<Key> getKey(const KeySelectorRef& key, bool snapshot=false);
 	ThreadFuture<Standalone<RangeResultRef>> getRange(const KeySelectorRef& begin, const KeySelectorRef& end, int limit, bool snapshot=false, bool reverse=false);
 	ThreadFuture<Standalone<RangeResultRef>> getRange(const KeySelectorRef& begin, const KeySelectorRef& end, GetRangeLimits limits, bool snapshot=false, bool reverse=false);
@@ -228,6 +230,7 @@ public:
 	ThreadFuture<Version> getReadVersion();
 
 	ThreadFuture<Optional<Value>> get(const KeyRef& key, bool snapshot=false);
+	ThreadFuture<Standalone<RangeResultRef>> getValues(const VectorRef<KeyRef>& keys, bool snapshot=false);
 	ThreadFuture<Key> getKey(const KeySelectorRef& key, bool snapshot=false);
 	ThreadFuture<Standalone<RangeResultRef>> getRange(const KeySelectorRef& begin, const KeySelectorRef& end, int limit, bool snapshot=false, bool reverse=false);
 	ThreadFuture<Standalone<RangeResultRef>> getRange(const KeySelectorRef& begin, const KeySelectorRef& end, GetRangeLimits limits, bool snapshot=false, bool reverse=false);
@@ -40,6 +40,7 @@
 #include "flow/Knobs.h"
 #include "fdbclient/Knobs.h"
 #include "fdbrpc/Net2FileSystem.h"
+#include "flow/UnitTest.h"
 
 #include <iterator>
 
@@ -207,8 +208,28 @@ template <> void addref( DatabaseContext* ptr ) { ptr->addref(); }
 template <> void delref( DatabaseContext* ptr ) { ptr->delref(); }
 
 ACTOR Future<Void> databaseLogger( DatabaseContext *cx ) {
+	state int64_t lastRequests = 0;
+	state int64_t lastHedgedRequests = 0;
+	state int64_t lastHedgeWins = 0;
+	state std::vector<int64_t> lastRequestsAtDistance( LBDistance::DISTANT+1 );
+	state int64_t lastDistantForLoad = 0;
 	loop {
 		Void _ = wait( delay( CLIENT_KNOBS->SYSTEM_MONITOR_INTERVAL, cx->taskID ) );
+		int64_t requests = cx->queueModel.requests - lastRequests;
+		int64_t hedgedRequests = cx->queueModel.hedgedRequests - lastHedgedRequests;
+		int64_t hedgeWins = cx->queueModel.hedgeWins - lastHedgeWins;
+		lastRequests = cx->queueModel.requests;
+		lastHedgedRequests = cx->queueModel.hedgedRequests;
+		lastHedgeWins = cx->queueModel.hedgeWins;
+
+		QueueModel const& qm = cx->queueModel;
+		int64_t sameZone = qm.requestsAtDistance[LBDistance::SAME_MACHINE] - lastRequestsAtDistance[LBDistance::SAME_MACHINE];
+		int64_t sameDC = qm.requestsAtDistance[LBDistance::SAME_DC] - lastRequestsAtDistance[LBDistance::SAME_DC];
+		int64_t distant = qm.requestsAtDistance[LBDistance::DISTANT] - lastRequestsAtDistance[LBDistance::DISTANT];
+		int64_t distantForLoad = qm.distantForLoad - lastDistantForLoad;
+		lastRequestsAtDistance.assign( qm.requestsAtDistance, qm.requestsAtDistance + LBDistance::DISTANT+1 );
+		lastDistantForLoad = qm.distantForLoad;
+
 		TraceEvent("TransactionMetrics")
 			.detail("ReadVersions", cx->transactionReadVersions)
 			.detail("LogicalUncachedReads", cx->transactionLogicalReads)
@@ -221,6 +242,8 @@ ACTOR Future<Void> databaseLogger( DatabaseContext *cx ) {
 			.detail("FutureVersions", cx->transactionsFutureVersions)
 			.detail("NotCommitted", cx->transactionsNotCommitted)
 			.detail("MaybeCommitted", cx->transactionsMaybeCommitted)
+			.detail("ReadVersionCacheHits", cx->readVersionCacheHits)
+			.detail("ReadVersionCacheMisses", cx->readVersionCacheMisses)
 			.detail("MeanLatency", 1000 * cx->latencies.mean())
 			.detail("MedianLatency", 1000 * cx->latencies.median())
 			.detail("Latency90", 1000 * cx->latencies.percentile(0.90))
@@ -240,7 +263,16 @@ ACTOR Future<Void> databaseLogger( DatabaseContext *cx ) {
 			.detail("MaxMutationsPerCommit", cx->mutationsPerCommit.max())
 			.detail("MeanBytesPerCommit", cx->bytesPerCommit.mean())
 			.detail("MedianBytesPerCommit", cx->bytesPerCommit.median())
-			.detail("MaxBytesPerCommit", cx->bytesPerCommit.max());
+			.detail("MaxBytesPerCommit", cx->bytesPerCommit.max())
+			.detail("LoadBalancedRequests", requests)
+			.detail("HedgedRequests", hedgedRequests)
+			.detail("HedgeWins", hedgeWins)
+			.detail("HedgeRate", requests ? double(hedgedRequests) / requests : 0.0)
+			.detail("HedgeWinRate", hedgedRequests ? double(hedgeWins) / hedgedRequests : 0.0)
+			.detail("SameZoneRequests", sameZone)
+			.detail("SameDCRequests", sameDC)
+			.detail("DistantRequests", distant)
+			.detail("DistantRequestsForLoad", distantForLoad);
 		cx->latencies.clear();
 		cx->readLatencies.clear();
 		cx->GRVLatencies.clear();
@@ -470,11 +502,14 @@ DatabaseContext::DatabaseContext(
 	int taskID, LocalityData clientLocality, bool enableLocalityLoadBalance, bool lockAware )
   : clientInfo(clientInfo), masterProxiesChangeTrigger(), cluster(cluster), clientInfoMonitor(clientInfoMonitor), dbName(dbName), dbId(dbId),
 	transactionReadVersions(0), transactionLogicalReads(0), transactionPhysicalReads(0), transactionCommittedMutations(0), transactionCommittedMutationBytes(0), transactionsCommitStarted(0), 
-	transactionsCommitCompleted(0), transactionsTooOld(0), transactionsFutureVersions(0), transactionsNotCommitted(0), transactionsMaybeCommitted(0), taskID(taskID),
+	transactionsCommitCompleted(0), transactionsTooOld(0), transactionsFutureVersions(0), transactionsNotCommitted(0), transactionsMaybeCommitted(0), readVersionCacheHits(0), readVersionCacheMisses(0), taskID(taskID),
 	outstandingWatches(0), maxOutstandingWatches(CLIENT_KNOBS->DEFAULT_MAX_OUTSTANDING_WATCHES), clientLocality(clientLocality), enableLocalityLoadBalance(enableLocalityLoadBalance), lockAware(lockAware),
-	latencies(1000), readLatencies(1000), commitLatencies(1000), GRVLatencies(1000), mutationsPerCommit(1000), bytesPerCommit(1000) 
+	latencies(1000), readLatencies(1000), commitLatencies(1000), GRVLatencies(1000), mutationsPerCommit(1000), bytesPerCommit(1000),
+	readVersionCacheMaxAge(CLIENT_KNOBS->READ_VERSION_CACHE_MAX_AGE), cachedReadVersionTime(0), lastCachedReadVersionUse(0)
 {
 	logger = databaseLogger( this );
+	cachedReadVersion.version = invalidVersion;
+	cachedReadVersion.locked = false;
 	locationCacheSize = g_network->isSimulated() ?
 			CLIENT_KNOBS->LOCATION_CACHE_EVICTION_SIZE_SIM :
 			CLIENT_KNOBS->LOCATION_CACHE_EVICTION_SIZE;
@@ -669,6 +704,9 @@ void DatabaseContext::setOption( FDBDatabaseOptions::Option option, Optional<Str
 			ssid_locationInfo.clear();
 			locationCache.insert( allKeys, Reference<LocationInfo>() );
 			break;
+		case FDBDatabaseOptions::READ_VERSION_CACHE_MAX_AGE:
+			readVersionCacheMaxAge = extractIntOption(value, 0, std::numeric_limits<int>::max())/1000.0;
+			break;
 	}
 }
 
@@ -1229,6 +1267,122 @@ ACTOR Future<Optional<Value>> getValue( Future<Version> version, Key key, Databa
 	}
 }
 
+Future<Standalone<RangeResultRef>> getValuesAtVersion( Version const& ver, Standalone<VectorRef<KeyRef>> const& keys, Database const& cx, TransactionInfo const& info );
+
+// Reads keys, which are sorted and all in the shard served by location, with GetValuesRequests of up to
+// REPLY_BYTE_LIMIT each
+ACTOR Future<Standalone<RangeResultRef>> getValuesFromShard( Version ver, Standalone<VectorRef<KeyRef>> keys, Reference<LocationInfo> location, Database cx, TransactionInfo info ) {
+	state Optional<UID> getValuesID;
+	state Standalone<RangeResultRef> result;
+	try {
+		if( info.debugID.present() ) {
+			getValuesID = g_nondeterministic_random->randomUniqueID();
+			g_traceBatch.addAttach("GetValuesAttachID", info.debugID.get().first(), getValuesID.get().first());
+			g_traceBatch.addEvent("GetValuesDebug", getValuesID.get().first(), "NativeAPI.getValues.Before");
+		}
+
+		loop {
+			++cx->transactionPhysicalReads;
+			state double startTime = now();
+			GetValuesReply reply = wait( loadBalance( location, &StorageServerInterface::getValues, GetValuesRequest(keys, ver, BUGGIFY ? g_random->randomInt(1, 1000) : CLIENT_KNOBS->REPLY_BYTE_LIMIT, getValuesID), TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+			cx->readLatencies.addSample(now() - startTime);
+
+			if (reply.keysRead <= 0 || reply.keysRead > keys.size()) {
+				TraceEvent(SevError, "GetValuesReplyInvalid").detail("KeysRead", reply.keysRead).detail("Keys", keys.size());
+				throw internal_error();
+			}
+			result.arena().dependsOn( reply.arena );
+			result.append( result.arena(), reply.data.begin(), reply.data.size() );
+			if (reply.keysRead == keys.size())
+				break;
+			keys = Standalone<VectorRef<KeyRef>>( keys.slice(reply.keysRead, keys.size()), keys.arena() );
+		}
+
+		if( info.debugID.present() )
+			g_traceBatch.addEvent("GetValuesDebug", getValuesID.get().first(), "NativeAPI.getValues.After");
+
+		return result;
+	} catch (Error& e) {
+		if( info.debugID.present() )
+			g_traceBatch.addEvent("GetValuesDebug", getValuesID.get().first(), "NativeAPI.getValues.Error");
+		if (e.code() != error_code_wrong_shard_server && e.code() != error_code_all_alternatives_failed &&
+			(e.code() != error_code_transaction_too_old || ver != latestVersion) )
+			throw;
+
+		cx->invalidateCache( KeyRangeRef( keys.front(), keyAfter(keys.back()) ) );
+		Void _ = wait(delay(CLIENT_KNOBS->WRONG_SHARD_SERVER_DELAY, info.taskID));
+		// The keys may now be in more than one shard
+		Standalone<RangeResultRef> rest = wait( getValuesAtVersion( ver, keys, cx, info ) );
+		result.arena().dependsOn( rest.arena() );
+		result.append( result.arena(), rest.begin(), rest.size() );
+		return result;
+	}
+}
+
+// Reads keys one at a time, for shards with a replica that does not support GetValuesRequest
+ACTOR Future<Standalone<RangeResultRef>> getValuesIndividually( Version ver, Standalone<VectorRef<KeyRef>> keys, Database cx, TransactionInfo info ) {
+	state std::vector<Future<Optional<Value>>> values;
+	for(auto& key : keys)
+		values.push_back( getValue( ver, key, cx, info, Reference<TransactionLogInfo>() ) );
+	Void _ = wait( waitForAll(values) );
+
+	Standalone<RangeResultRef> result;
+	for(int i = 0; i < keys.size(); i++)
+		if (values[i].get().present())
+			result.push_back_deep( result.arena(), KeyValueRef(keys[i], values[i].get().get()) );
+	return result;
+}
+
+ACTOR Future<Standalone<RangeResultRef>> getValuesAtVersion( Version ver, Standalone<VectorRef<KeyRef>> keys, Database cx, TransactionInfo info ) {
+	state Standalone<VectorRef<KeyRef>> sorted;
+	sorted.arena().dependsOn( keys.arena() );
+	sorted.append( sorted.arena(), keys.begin(), keys.size() );
+	std::sort( sorted.begin(), sorted.end() );
+	sorted.resize( sorted.arena(), std::unique( sorted.begin(), sorted.end() ) - sorted.begin() );
+
+	// Split the keys into batches that each fall in one shard
+	state std::vector<Future<Standalone<RangeResultRef>>> batches;
+	state int begin = 0;
+	while (begin < sorted.size()) {
+		state pair<KeyRange, Reference<LocationInfo>> ssi = wait( getKeyLocation(cx, sorted[begin], &StorageServerInterface::getValue, info) );
+		int end = begin + 1;
+		while (end < sorted.size() && end - begin < CLIENT_KNOBS->GET_VALUES_KEY_LIMIT && ssi.first.contains(sorted[end]))
+			end++;
+
+		bool supported = true;
+		for(int i = 0; i < ssi.second->size(); i++)
+			supported = supported && ssi.second->get(i, &StorageServerInterface::getValues).getEndpoint().isValid();
+
+		Standalone<VectorRef<KeyRef>> batch( sorted.slice(begin, end), sorted.arena() );
+		batches.push_back( supported ? getValuesFromShard( ver, batch, ssi.second, cx, info ) : getValuesIndividually( ver, batch, cx, info ) );
+		begin = end;
+	}
+	Void _ = wait( waitForAll(batches) );
+
+	// The batches are in key order, so the values can be looked up for each key in the order requested
+	Standalone<RangeResultRef> found;
+	for(auto& b : batches) {
+		found.arena().dependsOn( b.get().arena() );
+		found.append( found.arena(), b.get().begin(), b.get().size() );
+	}
+	Standalone<RangeResultRef> result;
+	result.arena().dependsOn( found.arena() );
+	for(auto& key : keys) {
+		auto kv = std::lower_bound( found.begin(), found.end(), key, KeyValueRef::OrderByKey() );
+		if (kv != found.end() && kv->key == key)
+			result.push_back( result.arena(), *kv );
+	}
+	return result;
+}
+
+ACTOR Future<Standalone<RangeResultRef>> getValues( Future<Version> version, Standalone<VectorRef<KeyRef>> keys, Database cx, TransactionInfo info ) {
+	state Version ver = wait( version );
+	validateVersion(ver);
+
+	Standalone<RangeResultRef> result = wait( getValuesAtVersion( ver, keys, cx, info ) );
+	return result;
+}
+
 ACTOR Future<Key> getKey( Database cx, KeySelector k, Future<Version> version, TransactionInfo info ) {
 	Version ver = wait(version);
 
@@ -1391,6 +1545,7 @@ ACTOR Future<Standalone<RangeResultRef>> getExactRange( Database cx, Version ver
 
 			//FIXME: buggify byte limits on internal functions that use them, instead of globally
 			req.debugID = info.debugID;
+			req.compressKeys = info.compressRangeKeys || BUGGIFY;
 
 			try {
 				if( info.debugID.present() ) {
@@ -1405,7 +1560,9 @@ ACTOR Future<Standalone<RangeResultRef>> getExactRange( Database cx, Version ver
 					.detail("Servers", locations[shard].second->description());*/
 				}
 				++cx->transactionPhysicalReads;
-				GetKeyValuesReply rep = wait( loadBalance( locations[shard].second, &StorageServerInterface::getKeyValues, req, TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+				GetKeyValuesReply _rep = wait( loadBalance( locations[shard].second, &StorageServerInterface::getKeyValues, req, TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+				GetKeyValuesReply rep = _rep;
+				rep.decodeKeys();
 				if( info.debugID.present() )
 					g_traceBatch.addEvent("TransactionDebug", info.debugID.get().first(), "NativeAPI.getExactRange.After");
 				output.arena().dependsOn( rep.arena );
@@ -1495,6 +1652,87 @@ ACTOR Future<Standalone<RangeResultRef>> getExactRange( Database cx, Version ver
 	}
 }
 
+Future<RangeAggregate> getRangeAggregateAtVersion( Version const& ver, KeyRange const& keys, Database const& cx, TransactionInfo const& info );
+
+// Aggregates keys, which are all in the shard served by location, continuing after each reply until the range is done
+ACTOR Future<RangeAggregate> getRangeAggregateFromShard( Version ver, KeyRange keys, Reference<LocationInfo> location, Database cx, TransactionInfo info ) {
+	state RangeAggregate result;
+	try {
+		loop {
+			if( info.debugID.present() )
+				g_traceBatch.addEvent("TransactionDebug", info.debugID.get().first(), "NativeAPI.getRangeAggregate.Before");
+
+			++cx->transactionPhysicalReads;
+			GetRangeAggregateReply rep = wait( loadBalance( location, &StorageServerInterface::getRangeAggregate, GetRangeAggregateRequest(keys, ver, info.debugID), TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+
+			if( info.debugID.present() )
+				g_traceBatch.addEvent("TransactionDebug", info.debugID.get().first(), "NativeAPI.getRangeAggregate.After");
+
+			result.append( rep.aggregate );
+			if (!rep.more)
+				return result;
+			TEST(true); // GetRangeAggregateReply.more
+			keys = KeyRangeRef( keyAfter( rep.aggregate.lastKey.get() ), keys.end );
+		}
+	} catch (Error& e) {
+		if (e.code() != error_code_wrong_shard_server && e.code() != error_code_all_alternatives_failed)
+			throw;
+
+		cx->invalidateCache( keys );
+		Void _ = wait( delay(CLIENT_KNOBS->WRONG_SHARD_SERVER_DELAY, info.taskID) );
+		// The rest of the range may now be in more than one shard
+		RangeAggregate rest = wait( getRangeAggregateAtVersion( ver, keys, cx, info ) );
+		result.append( rest );
+		return result;
+	}
+}
+
+// Aggregates keys by reading the rows, for shards with a replica that does not support GetRangeAggregateRequest
+ACTOR Future<RangeAggregate> getRangeAggregateByReading( Version ver, KeyRange keys, Database cx, TransactionInfo info ) {
+	state RangeAggregate result;
+	loop {
+		Standalone<RangeResultRef> rows = wait( getExactRange( cx, ver, keys, GetRangeLimits( GetRangeLimits::ROW_LIMIT_UNLIMITED, CLIENT_KNOBS->REPLY_BYTE_LIMIT ), false, info ) );
+		result.add( rows );
+		if (!rows.more)
+			return result;
+		keys = KeyRangeRef( keyAfter( rows.back().key ), keys.end );
+	}
+}
+
+ACTOR Future<RangeAggregate> getRangeAggregateAtVersion( Version ver, KeyRange keys, Database cx, TransactionInfo info ) {
+	state RangeAggregate result;
+	loop {
+		state vector< pair<KeyRange, Reference<LocationInfo>> > locations = wait( getKeyRangeLocations( cx, keys, CLIENT_KNOBS->GET_RANGE_AGGREGATE_SHARD_LIMIT, false, &StorageServerInterface::getRangeAggregate, info ) );
+		ASSERT( locations.size() );
+
+		// The shards are aggregated concurrently and combined in key order
+		state std::vector<Future<RangeAggregate>> shards;
+		for(auto& location : locations) {
+			bool supported = true;
+			for(int i = 0; i < location.second->size(); i++)
+				supported = supported && location.second->get(i, &StorageServerInterface::getRangeAggregate).getEndpoint().isValid();
+
+			shards.push_back( supported ? getRangeAggregateFromShard( ver, location.first, location.second, cx, info ) : getRangeAggregateByReading( ver, location.first, cx, info ) );
+		}
+		Void _ = wait( waitForAll(shards) );
+		for(auto& shard : shards)
+			result.append( shard.get() );
+
+		if (locations.back().first.end >= keys.end)
+			return result;
+		TEST(true); // Multiple requests of key locations in getRangeAggregate
+		keys = KeyRangeRef( locations.back().first.end, keys.end );
+	}
+}
+
+ACTOR Future<RangeAggregate> getRangeAggregate( Future<Version> version, KeyRange keys, Database cx, TransactionInfo info ) {
+	state Version ver = wait( version );
+	validateVersion(ver);
+
+	RangeAggregate result = wait( getRangeAggregateAtVersion( ver, keys, cx, info ) );
+	return result;
+}
+
 Future<Key> resolveKey( Database const& cx, KeySelector const& key, Version const& version, TransactionInfo const& info ) {
 	if( key.isFirstGreaterOrEqual() )
 		return Future<Key>( key.getKey() );
@@ -1657,6 +1895,7 @@ ACTOR Future<Standalone<RangeResultRef>> getRange( Database cx, Reference<Transa
 			ASSERT(req.limitBytes > 0 && req.limit != 0 && req.limit < 0 == reverse);
 
 			req.debugID = info.debugID;
+			req.compressKeys = info.compressRangeKeys || BUGGIFY;
 			try {
 				if( info.debugID.present() ) {
 					g_traceBatch.addEvent("TransactionDebug", info.debugID.get().first(), "NativeAPI.getRange.Before");
@@ -1677,7 +1916,9 @@ ACTOR Future<Standalone<RangeResultRef>> getRange( Database cx, Reference<Transa
 				}
 
 				++cx->transactionPhysicalReads;
-				GetKeyValuesReply rep = wait( loadBalance(beginServer.second, &StorageServerInterface::getKeyValues, req, TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+				GetKeyValuesReply _rep = wait( loadBalance(beginServer.second, &StorageServerInterface::getKeyValues, req, TaskDefaultPromiseEndpoint, false, cx->enableLocalityLoadBalance ? &cx->queueModel : NULL ) );
+				GetKeyValuesReply rep = _rep;
+				rep.decodeKeys();
 
 				if( info.debugID.present() ) {
 					g_traceBatch.addEvent("TransactionDebug", info.debugID.get().first(), "NativeAPI.getRange.After");//.detail("SizeOf", rep.data.size());
@@ -1833,6 +2074,7 @@ void Transaction::operator=(Transaction&& r) noexcept(true) {
 	numErrors = r.numErrors;
 	committedVersion = r.committedVersion;
 	versionstampPromise = std::move(r.versionstampPromise);
+	conflictingKeyRanges = std::move(r.conflictingKeyRanges);
 	watches = r.watches;
 	trLogInfo = std::move(r.trLogInfo);
 }
@@ -1873,6 +2115,36 @@ Future<Optional<Value>> Transaction::get( const Key& key, bool snapshot ) {
 	return getValue( ver, key, cx, info, trLogInfo );
 }
 
+Future< Standalone<RangeResultRef> > Transaction::getValues( VectorRef<KeyRef> const& keys, bool snapshot ) {
+	cx->transactionLogicalReads += keys.size();
+
+	//There are no keys in the database with size greater than KEY_SIZE_LIMIT
+	Standalone<VectorRef<KeyRef>> readKeys;
+	for(auto& key : keys) {
+		if(key.size() > (key.startsWith(systemKeys.begin) ? CLIENT_KNOBS->SYSTEM_KEY_SIZE_LIMIT : CLIENT_KNOBS->KEY_SIZE_LIMIT))
+			continue;
+		readKeys.push_back_deep( readKeys.arena(), key );
+		if( !snapshot )
+			tr.transaction.read_conflict_ranges.push_back(tr.arena, singleKeyRange(key, tr.arena));
+	}
+	if (readKeys.empty())
+		return Standalone<RangeResultRef>();
+
+	return ::getValues( getReadVersion(), readKeys, cx, info );
+}
+
+Future< RangeAggregate > Transaction::getRangeAggregate( KeyRange const& keys, bool snapshot ) {
+	++cx->transactionLogicalReads;
+
+	if( keys.empty() )
+		return RangeAggregate();
+
+	if( !snapshot )
+		tr.transaction.read_conflict_ranges.push_back_deep( tr.arena, keys );
+
+	return ::getRangeAggregate( getReadVersion(), keys, cx, info );
+}
+
 void Watch::setWatch(Future<Void> watchFuture) {
 	this->watchFuture = watchFuture;
 
@@ -2186,6 +2458,7 @@ void Transaction::reset() {
 
 	if(apiVersionAtLeast(16)) {
 		options.reset();
+		info.compressRangeKeys = false;
 		setPriority(GetReadVersionRequest::PRIORITY_DEFAULT);
 		if(cx->lockAware)
 			options.lockAware = true;
@@ -2195,6 +2468,7 @@ void Transaction::reset() {
 void Transaction::fullReset() {
 	reset();
 	backoff = CLIENT_KNOBS->DEFAULT_BACKOFF;
+	conflictingKeyRanges = Standalone<VectorRef<KeyRangeRef>>();
 }
 
 int Transaction::apiVersionAtLeast(int minVersion) const {
@@ -2401,6 +2675,14 @@ ACTOR static Future<Void> tryCommit( Database cx, Reference<TransactionLogInfo>
 
 					tr->numErrors = 0;
 					cx->transactionsCommitCompleted++;
+					// Later transactions that use the read version cache must see this commit.  A commit that isn't lock
+					// aware also shows that the database was unlocked.
+					if (!options.lockAware) {
+						GetReadVersionReply committed;
+						committed.version = v;
+						committed.locked = false;
+						cx->updateCachedReadVersion(startTime, committed);
+					}
 					cx->transactionCommittedMutations += req.transaction.mutations.size();
 					cx->transactionCommittedMutationBytes += req.transaction.mutations.expectedSize();
 
@@ -2420,6 +2702,18 @@ ACTOR static Future<Void> tryCommit( Database cx, Reference<TransactionLogInfo>
 					if(info.debugID.present())
 						g_traceBatch.addEvent("CommitDebug", commitID.get().first(), "NativeAPI.commit.After");
 
+					if (ci.conflictingKeyRanges.present()) {
+						Standalone<VectorRef<KeyRangeRef>> conflicting;
+						for (int i : ci.conflictingKeyRanges.get()) {
+							if (i < 0 || i >= req.transaction.read_conflict_ranges.size()) {
+								TraceEvent(SevError, "ConflictingKeyRangeInvalid").detail("Index", i).detail("ReadConflictRanges", req.transaction.read_conflict_ranges.size());
+								throw internal_error();
+							}
+							conflicting.push_back_deep(conflicting.arena(), req.transaction.read_conflict_ranges[i]);
+						}
+						tr->conflictingKeyRanges = conflicting;
+					}
+
 					throw not_committed();
 				}
 			}
@@ -2520,6 +2814,10 @@ Future<Void> Transaction::commitMutations() {
 		if(options.firstInBatch) {
 			tr.flags = tr.flags | CommitTransactionRequest::FLAG_FIRST_IN_BATCH;
 		}
+		conflictingKeyRanges = Standalone<VectorRef<KeyRangeRef>>();
+		if(options.reportConflictingKeys) {
+			tr.flags = tr.flags | CommitTransactionRequest::FLAG_REPORT_CONFLICTING_KEYS;
+		}
 
 		Future<Void> commitResult = tryCommit( cx, trLogInfo, tr, readVersion, info, &this->committedVersion, this, options );
 
@@ -2589,6 +2887,16 @@ void Transaction::setOption( FDBTransactionOptions::Option option, Optional<Stri
 			options.getReadVersionFlags |= GetReadVersionRequest::FLAG_CAUSAL_READ_RISKY;
 			break;
 
+		case FDBTransactionOptions::USE_CACHED_READ_VERSION:
+			validateOptionValue(value, false);
+			options.useCachedReadVersion = true;
+			break;
+
+		case FDBTransactionOptions::COMPRESS_RANGE_KEYS:
+			validateOptionValue(value, false);
+			info.compressRangeKeys = true;
+			break;
+
 		case FDBTransactionOptions::PRIORITY_SYSTEM_IMMEDIATE:
 			validateOptionValue(value, false);
 			setPriority(GetReadVersionRequest::PRIORITY_SYSTEM_IMMEDIATE);
@@ -2665,6 +2973,11 @@ void Transaction::setOption( FDBTransactionOptions::Option option, Optional<Stri
 			options.firstInBatch = true;
 			break;
 
+		case FDBTransactionOptions::REPORT_CONFLICTING_KEYS:
+			validateOptionValue(value, false);
+			options.reportConflictingKeys = true;
+			break;
+
 		default:
 			break;
 	}
@@ -2753,12 +3066,60 @@ ACTOR Future<Void> readVersionBatcher( DatabaseContext *cx, FutureStream< std::p
 	}
 }
 
-ACTOR Future<Version> extractReadVersion(DatabaseContext* cx, Reference<TransactionLogInfo> trLogInfo, Future<GetReadVersionReply> f, bool lockAware, double startTime) {
+Future<GetReadVersionReply> DatabaseContext::getBatchedReadVersion( uint32_t flags, Optional<UID> debugID ) {
+	auto& batcher = versionBatcher[ flags ];
+	if (!batcher.actor.isValid()) {
+		batcher.actor = readVersionBatcher( this, batcher.stream.getFuture(), flags );
+	}
+	Promise<GetReadVersionReply> p;
+	batcher.stream.send( std::make_pair( p, debugID ) );
+	return p.getFuture();
+}
+
+// Keeps the read version cache fresh while it is in use, so that transactions using it rarely have to wait for a GRV
+ACTOR Future<Void> refreshReadVersionCache( DatabaseContext* cx ) {
+	loop {
+		Void _ = wait( delay( std::max( 0.0, cx->cachedReadVersionTime + cx->readVersionCacheMaxAge / 2 - now() ), cx->taskID ) );
+		if( now() - cx->lastCachedReadVersionUse > CLIENT_KNOBS->READ_VERSION_CACHE_IDLE_TIME || cx->readVersionCacheMaxAge == 0 )
+			return Void();
+		state double requestTime = now();
+		GetReadVersionReply rep = wait( cx->getBatchedReadVersion( GetReadVersionRequest::PRIORITY_DEFAULT, Optional<UID>() ) );
+		cx->updateCachedReadVersion( requestTime, rep );
+	}
+}
+
+Optional<GetReadVersionReply> DatabaseContext::getCachedReadVersion() {
+	lastCachedReadVersionUse = now();
+	if( !readVersionCacheRefresher.isValid() || readVersionCacheRefresher.isReady() )
+		readVersionCacheRefresher = refreshReadVersionCache( this );
+	if( cachedReadVersion.version != invalidVersion && now() - cachedReadVersionTime <= readVersionCacheMaxAge ) {
+		readVersionCacheHits++;
+		return cachedReadVersion;
+	}
+	readVersionCacheMisses++;
+	return Optional<GetReadVersionReply>();
+}
+
+void DatabaseContext::updateCachedReadVersion( double requestTime, GetReadVersionReply const& rep ) {
+	if( rep.version >= cachedReadVersion.version ) {
+		cachedReadVersion = rep;
+		cachedReadVersionTime = std::max( cachedReadVersionTime, requestTime );
+	}
+}
+
+void DatabaseContext::invalidateCachedReadVersion( Version atOrBelow ) {
+	if( cachedReadVersion.version <= atOrBelow )
+		cachedReadVersionTime = 0;
+}
+
+ACTOR Future<Version> extractReadVersion(DatabaseContext* cx, Reference<TransactionLogInfo> trLogInfo, Future<GetReadVersionReply> f, bool lockAware, bool cacheable, double startTime) {
 	GetReadVersionReply rep = wait(f);
 	double latency = now() - startTime;
 	cx->GRVLatencies.addSample(latency);
 	if (trLogInfo)
 		trLogInfo->addLog(FdbClientLogEvents::EventGetVersion(startTime, latency));
+	if (cacheable)
+		cx->updateCachedReadVersion(startTime, rep);
 	if(rep.locked && !lockAware)
 		throw database_locked();
 
@@ -2769,15 +3130,21 @@ Future<Version> Transaction::getReadVersion(uint32_t flags) {
 	cx->transactionReadVersions++;
 	flags |= options.getReadVersionFlags;
 
-	auto& batcher = cx->versionBatcher[ flags ];
-	if (!batcher.actor.isValid()) {
-		batcher.actor = readVersionBatcher( cx.getPtr(), batcher.stream.getFuture(), flags );
-	}
 	if (!readVersion.isValid()) {
-		Promise<GetReadVersionReply> p;
-		batcher.stream.send( std::make_pair( p, info.debugID ) );
 		startTime = now();
-		readVersion = extractReadVersion( cx.getPtr(), trLogInfo, p.getFuture(), options.lockAware, startTime);
+		// Batch and system priority transactions always ask the proxies, so that ratekeeper can still hold them back
+		bool defaultPriority = (flags & GetReadVersionRequest::FLAG_PRIORITY_MASK) == GetReadVersionRequest::PRIORITY_DEFAULT;
+		if (options.useCachedReadVersion && defaultPriority && cx->readVersionCacheMaxAge > 0 && !info.debugID.present()) {
+			Optional<GetReadVersionReply> cached = cx->getCachedReadVersion();
+			if (cached.present()) {
+				if (cached.get().locked && !options.lockAware)
+					return database_locked();
+				readVersion = cached.get().version;
+				return readVersion;
+			}
+		}
+		readVersion = extractReadVersion( cx.getPtr(), trLogInfo, cx->getBatchedReadVersion( flags, info.debugID ), options.lockAware,
+			!(flags & GetReadVersionRequest::FLAG_CAUSAL_READ_RISKY), startTime );
 	}
 	return readVersion;
 }
@@ -2794,6 +3161,12 @@ Future<Void> Transaction::onError( Error const& e ) {
 	{
 		return client_invalid_operation();
 	}
+	// Don't hand a cached read version that has already proven too stale to the retry
+	if ((e.code() == error_code_not_committed || e.code() == error_code_transaction_too_old) && options.useCachedReadVersion &&
+		readVersion.isReady() && !readVersion.isError())
+	{
+		cx->invalidateCachedReadVersion(readVersion.get());
+	}
 	if (e.code() == error_code_not_committed ||
 		e.code() == error_code_commit_unknown_result ||
 		e.code() == error_code_database_locked)
@@ -3019,3 +3392,71 @@ void enableClientInfoLogging() {
 	networkOptions.logClientInfo = true;
 	TraceEvent(SevInfo, "ClientInfoLoggingEnabled");
 }
+
+// Decodes reply, whose encodedData may have been damaged, and checks that it either decodes or is rejected
+static void decodeDamagedKeys( GetKeyValuesReply& reply ) {
+	try {
+		reply.decodeKeys();
+	} catch (Error& e) {
+		ASSERT( e.code() == error_code_incompatible_protocol_version );
+	}
+}
+
+TEST_CASE("fdbclient/GetKeyValuesReply/compressKeys") {
+	for(int i = 0; i < 100; i++) {
+		// Tuple-like keys: a long common prefix, then a few components of varying length
+		Standalone<VectorRef<KeyValueRef>> rows;
+		std::string prefix( g_random->randomInt(0, 60), 'p' );
+		std::set<std::string> keys;
+		int n = g_random->randomInt(0, 200);
+		while (keys.size() < n) {
+			std::string key = prefix;
+			for(int c = g_random->randomInt(0, 4); c > 0; c--)
+				key += g_random->randomAlphaNumeric( g_random->randomInt(0, 5) ) + '\x00';
+			keys.insert( key );
+		}
+		for(auto& k : keys)
+			rows.push_back_deep( rows.arena(), KeyValueRef( StringRef(k), StringRef( g_random->randomAlphaNumeric( g_random->randomInt(0, 20) ) ) ) );
+		if (g_random->coinflip())
+			std::reverse( rows.begin(), rows.end() );
+
+		GetKeyValuesReply reply;
+		reply.arena.dependsOn( rows.arena() );
+		reply.data = rows;
+		reply.version = 1;
+		reply.more = g_random->coinflip();
+		int plainSize = BinaryWriter::toValue( reply, AssumeVersion(currentProtocolVersion) ).size();
+		reply.encodeKeys();
+		ASSERT( !reply.data.size() );
+
+		Standalone<StringRef> packet = BinaryWriter::toValue( reply, AssumeVersion(currentProtocolVersion) );
+		if (prefix.size() >= 30 && rows.size() >= 10)
+			ASSERT( packet.size() * 2 < plainSize );
+
+		GetKeyValuesReply received;
+		ArenaReader reader( packet.arena(), packet, AssumeVersion(currentProtocolVersion) );
+		reader >> received;
+		received.decodeKeys();
+		ASSERT( received.data.size() == rows.size() && received.more == reply.more );
+		for(int r = 0; r < rows.size(); r++)
+			ASSERT( received.data[r].key == rows[r].key && received.data[r].value == rows[r].value );
+
+		// Damaged data is rejected, not trusted
+		if (reply.encodedData.size()) {
+			GetKeyValuesReply damaged;
+			damaged.arena.dependsOn( reply.arena );
+			damaged.encodedData = reply.encodedData;
+			if (g_random->coinflip()) {
+				damaged.encodedData = damaged.encodedData.substr( 0, g_random->randomInt(0, damaged.encodedData.size()) );
+			} else {
+				uint8_t* bytes = new (damaged.arena) uint8_t[ damaged.encodedData.size() ];
+				memcpy( bytes, damaged.encodedData.begin(), damaged.encodedData.size() );
+				bytes[ g_random->randomInt(0, damaged.encodedData.size()) ] = g_random->randomInt(0, 256);
+				damaged.encodedData = StringRef( bytes, damaged.encodedData.size() );
+			}
+			decodeDamagedKeys( damaged );
+		}
+	}
+
+	return Void();
+}
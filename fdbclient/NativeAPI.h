@@ -152,6 +152,8 @@ struct TransactionOptions {
 	bool lockAware : 1;
 	bool readOnly : 1;
 	bool firstInBatch : 1;
+	bool reportConflictingKeys : 1;
+	bool useCachedReadVersion : 1;
 
 	TransactionOptions() {
 		reset();
@@ -169,8 +171,9 @@ struct TransactionOptions {
 struct TransactionInfo {
 	Optional<UID> debugID;
 	int taskID;
+	bool compressRangeKeys;  // Ask storage servers to front code the keys of range reads
 
-	explicit TransactionInfo( int taskID ) : taskID( taskID ) {}
+	explicit TransactionInfo( int taskID ) : taskID( taskID ), compressRangeKeys( false ) {}
 };
 
 struct TransactionLogInfo : public ReferenceCounted<TransactionLogInfo>, NonCopyable {
@@ -234,6 +237,10 @@ public:
 	Future<Version> getReadVersion() { return getReadVersion(0); }
 
 	Future< Optional<Value> > get( const Key& key, bool snapshot = false );
+	// Returns the keys that are present, with their values, in the order they were given
+	Future< Standalone<RangeResultRef> > getValues( VectorRef<KeyRef> const& keys, bool snapshot = false );
+	// Counts and sizes the rows of keys on the storage servers, without reading the rows back
+	Future< RangeAggregate > getRangeAggregate( KeyRange const& keys, bool snapshot = false );
 	Future< Void > watch( Reference<Watch> watch );
 	Future< Key > getKey( const KeySelector& key, bool snapshot = false );
 	//Future< Optional<KeyValue> > get( const KeySelectorRef& key );
@@ -274,6 +281,7 @@ public:
 	Future<Standalone<StringRef>> getVersionstamp(); // Will be fulfilled only after commit() returns success
 
 	Promise<Standalone<StringRef>> versionstampPromise;
+	Standalone<VectorRef<KeyRangeRef>> conflictingKeyRanges; // Read conflict ranges that caused the last commit() to fail, if REPORT_CONFLICTING_KEYS was set; kept across reset() until the next commit or fullReset()
 
 	Future<Void> onError( Error const& e );
 	void flushTrLogsIfEnabled();
@@ -49,6 +49,12 @@ public:
 		typedef Optional<Value> Result;
 	};
 
+	struct GetValuesReq {
+		explicit GetValuesReq( Standalone<VectorRef<KeyRef>> keys ) : keys(keys) {}
+		Standalone<VectorRef<KeyRef>> keys;
+		typedef Standalone<RangeResultRef> Result;
+	};
+
 	struct GetKeyReq {
 		explicit GetKeyReq( KeySelector key ) : key(key) {}
 		KeySelector key;
@@ -99,6 +105,42 @@ public:
 		}
 	}
 
+	ACTOR template<class Iter> static Future< Standalone<RangeResultRef> > read( ReadYourWritesTransaction *ryw, GetValuesReq read, Iter* it ) {
+		// The keys that can't be answered from the snapshot cache and write map are read from the database together
+		state Standalone<VectorRef<KeyRef>> unknown;
+		for(auto& key : read.keys) {
+			it->skip(key);
+			if( !it->is_kv() && !it->is_empty_range() )
+				unknown.push_back( unknown.arena(), key );
+		}
+		unknown.arena().dependsOn( read.keys.arena() );
+
+		if( unknown.size() ) {
+			Standalone<RangeResultRef> res = wait( ryw->tr.getValues( unknown, true ) );
+			auto kv = res.begin();
+			for(auto& key : unknown) {
+				KeyRef k( ryw->arena, key );
+				if( kv != res.end() && kv->key == key ) {
+					if( ryw->cache.insert( k, kv->value ) )
+						ryw->arena.dependsOn( res.arena() );
+					++kv;
+				} else {
+					ryw->cache.insert( k, Optional<ValueRef>() );
+				}
+			}
+		}
+
+		// Keys with dependent writes have to be looked up again now that their values are in the cache
+		Standalone<RangeResultRef> result;
+		for(auto& key : read.keys) {
+			it->skip(key);
+			ASSERT( it->is_kv() || it->is_empty_range() );
+			if( it->is_kv() )
+				result.push_back_deep( result.arena(), KeyValueRef( key, it->kv(ryw->arena).value ) );
+		}
+		return result;
+	}
+
 	ACTOR template<class Iter> static Future< Key > read( ReadYourWritesTransaction* ryw, GetKeyReq read, Iter* it ) {
 		if( read.key.offset > 0 ) {
 			Standalone<RangeResultRef> result = wait( getRangeValue( ryw, read.key, firstGreaterOrEqual(ryw->getMaxReadKey()), GetRangeLimits(1), it ) );
@@ -133,6 +175,10 @@ public:
 		return ryw->tr.get( read.key, snapshot );
 	}
 
+	static Future<Standalone<RangeResultRef>> readThrough( ReadYourWritesTransaction *ryw, GetValuesReq read, bool snapshot ) {
+		return ryw->tr.getValues( read.keys, snapshot );
+	}
+
 	ACTOR static Future<Key> readThrough( ReadYourWritesTransaction *ryw, GetKeyReq read, bool snapshot ) {
 		Key key = wait( ryw->tr.getKey( read.key, snapshot ) );
 		if (ryw->getMaxReadKey() < key) return ryw->getMaxReadKey();  // Filter out results in the system keys if they are not accessible
@@ -171,6 +217,13 @@ public:
 		ryw->updateConflictMap(read.key, it);
 	}
 
+	static void addConflictRange( ReadYourWritesTransaction* ryw, GetValuesReq read, WriteMap::iterator& it, Standalone<RangeResultRef> const& result ) {
+		for(auto& key : read.keys) {
+			it.skip( key );
+			ryw->updateConflictMap( key, it );
+		}
+	}
+
 	static void addConflictRange( ReadYourWritesTransaction* ryw, GetKeyReq read, WriteMap::iterator& it, Key result ) {
 		KeyRangeRef readRange;
 		if( read.key.offset <= 0 )
@@ -1158,6 +1211,46 @@ ACTOR Future<Standalone<RangeResultRef>> getWorkerInterfaces (Reference<ClusterC
 	}
 }
 
+// Each conflicting range [b, e) is returned as prefix+b -> "1" and prefix+e -> "0", so that a key k is in a conflicting
+// range exactly when the last returned key less than or equal to prefix+k has the value "1"
+static Standalone<RangeResultRef> getConflictingKeys( VectorRef<KeyRangeRef> conflicting, KeySelector begin, KeySelector end, GetRangeLimits limits, bool reverse ) {
+	const KeyRef prefix = LiteralStringRef("\xff\xff/conflicting_keys/");
+	std::vector<KeyRangeRef> ranges( conflicting.begin(), conflicting.end() );
+	std::sort( ranges.begin(), ranges.end(), []( KeyRangeRef const& a, KeyRangeRef const& b ) { return a.begin < b.begin; } );
+
+	Standalone<RangeResultRef> all;
+	for( int i = 0; i < ranges.size(); ) {
+		KeyRef rangeBegin = ranges[i].begin, rangeEnd = ranges[i].end;
+		for( i++; i < ranges.size() && ranges[i].begin <= rangeEnd; i++ )
+			rangeEnd = std::max( rangeEnd, ranges[i].end );
+		all.push_back( all.arena(), KeyValueRef( rangeBegin.withPrefix( prefix, all.arena() ), LiteralStringRef("1") ) );
+		all.push_back( all.arena(), KeyValueRef( rangeEnd.withPrefix( prefix, all.arena() ), LiteralStringRef("0") ) );
+	}
+
+	// Selectors resolve against these keys as they would against the database's, stopping at either end of them
+	auto resolve = [&all]( KeySelector const& sel ) {
+		auto base = sel.orEqual ? std::upper_bound( all.begin(), all.end(), sel.getKey(), KeyValueRef::OrderByKey() )
+		                        : std::lower_bound( all.begin(), all.end(), sel.getKey(), KeyValueRef::OrderByKey() );
+		int64_t index = ( base - all.begin() ) + (int64_t)sel.offset - 1;
+		return (int)std::max<int64_t>( 0, std::min<int64_t>( index, all.size() ) );
+	};
+	int beginIndex = resolve( begin );
+	int endIndex = resolve( end );
+
+	Standalone<RangeResultRef> result;
+	result.arena().dependsOn( all.arena() );
+	for( int i = 0; i < endIndex - beginIndex; i++ ) {
+		if( limits.isReached() ) {
+			result.more = true;
+			break;
+		}
+		KeyValueRef const& kv = all[ reverse ? endIndex - 1 - i : beginIndex + i ];
+		result.push_back( result.arena(), kv );
+		limits.decrement( kv );
+	}
+	return result;
+}
+
 Future< Optional<Value> > ReadYourWritesTransaction::get( const Key& key, bool snapshot ) {
 	TEST(true);
 	
@@ -1216,6 +1309,31 @@ Future< Optional<Value> > ReadYourWritesTransaction::get( const Key& key, bool s
 	return result;
 }
 
+Future< Standalone<RangeResultRef> > ReadYourWritesTransaction::getValues( VectorRef<KeyRef> const& keys, bool snapshot ) {
+	if(checkUsedDuringCommit()) {
+		return used_during_commit();
+	}
+
+	if( resetPromise.isSet() )
+		return resetPromise.getFuture().getError();
+
+	Standalone<VectorRef<KeyRef>> readKeys;
+	for(auto& key : keys) {
+		if(key >= getMaxReadKey())
+			return key_outside_legal_range();
+
+		//There are no keys in the database with size greater than KEY_SIZE_LIMIT
+		if(key.size() <= (key.startsWith(systemKeys.begin) ? CLIENT_KNOBS->SYSTEM_KEY_SIZE_LIMIT : CLIENT_KNOBS->KEY_SIZE_LIMIT))
+			readKeys.push_back_deep( readKeys.arena(), key );
+	}
+	if( readKeys.empty() )
+		return Standalone<RangeResultRef>();
+
+	Future< Standalone<RangeResultRef> > result = RYWImpl::readWithConflictRange( this, RYWImpl::GetValuesReq(readKeys), snapshot );
+	reading.add( success( result ) );
+	return result;
+}
+
 Future< Key > ReadYourWritesTransaction::getKey( const KeySelector& key, bool snapshot ) {
 	if(checkUsedDuringCommit()) {
 		return used_during_commit();
@@ -1247,13 +1365,20 @@ Future< Standalone<RangeResultRef> > ReadYourWritesTransaction::getRange(
 			return Standalone<RangeResultRef>();
 		}
 	}
-	
+
 	if(checkUsedDuringCommit()) {
 		return used_during_commit();
 	}
 
 	if( resetPromise.isSet() )
 		return resetPromise.getFuture().getError();
+
+	// The ranges that made the last commit fail are kept by the reset in onError(), so they are read after it
+	if (begin.getKey().startsWith(LiteralStringRef("\xff\xff/conflicting_keys/"))) {
+		if( !limits.isValid() )
+			return range_limits_invalid();
+		return getConflictingKeys(tr.conflictingKeyRanges, begin, end, limits, reverse);
+	}
 	
 	KeyRef maxKey = getMaxReadKey();
 	if(begin.getKey() > maxKey || end.getKey() > maxKey)
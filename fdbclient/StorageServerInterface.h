@@ -27,6 +27,7 @@
 #include "fdbrpc/QueueModel.h"
 #include "fdbrpc/fdbrpc.h"
 #include "fdbrpc/LoadBalance.actor.h"
+#include "flow/StringCompare.h"
 
 struct StorageServerInterface {
 	enum { 
@@ -44,6 +45,14 @@ struct StorageServerInterface {
 	RequestStream<struct GetValueRequest> getValue;
 	RequestStream<struct GetKeyRequest> getKey;
 
+	// Reads many keys at one version.  Throws a wrong_shard_server if any of the keys are not readable on this server.
+	// Interfaces from servers that predate this request have an invalid endpoint here.
+	RequestStream<struct GetValuesRequest> getValues;
+
+	// Aggregates the rows of a key range at one version.  Throws a wrong_shard_server if any of the range is not readable
+	// on this server.  Interfaces from servers that predate this request have an invalid endpoint here.
+	RequestStream<struct GetRangeAggregateRequest> getRangeAggregate;
+
 	// Throws a wrong_shard_server if the keys in the request or result depend on data outside this server OR if a large selector offset prevents
 	// all data from being read in one range read
 	RequestStream<struct GetKeyValuesRequest> getKeyValues;
@@ -72,6 +81,16 @@ struct StorageServerInterface {
 
 		if( ar.protocolVersion() >= 0x0FDB00A200090001LL )
 			ar & watchValue;
+
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & getValues;
+		else if( Ar::isDeserializing )
+			getValues = RequestStream<struct GetValuesRequest>( Endpoint() );
+
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & getRangeAggregate;
+		else if( Ar::isDeserializing )
+			getRangeAggregate = RequestStream<struct GetRangeAggregateRequest>( Endpoint() );
 	}
 	bool operator == (StorageServerInterface const& s) const { return uniqueID == s.uniqueID; }
 	bool operator < (StorageServerInterface const& s) const { return uniqueID < s.uniqueID; }
@@ -79,6 +98,8 @@ struct StorageServerInterface {
 		getValue.getEndpoint( TaskLoadBalancedEndpoint );
 		getKey.getEndpoint( TaskLoadBalancedEndpoint );
 		getKeyValues.getEndpoint( TaskLoadBalancedEndpoint );
+		getValues.getEndpoint( TaskLoadBalancedEndpoint );
+		getRangeAggregate.getEndpoint( TaskLoadBalancedEndpoint );
 	}
 };
 
@@ -121,6 +142,36 @@ struct GetValueRequest {
 	}
 };
 
+struct GetValuesReply : public LoadBalancedReply {
+	Arena arena;
+	VectorRef<KeyValueRef> data;  // The requested keys that are present, in the order they were requested
+	int keysRead;  // The reply covers this many of the requested keys, at least one; the rest were over limitBytes
+
+	GetValuesReply() : keysRead(0) {}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & *(LoadBalancedReply*)this & data & keysRead & arena;
+	}
+};
+
+struct GetValuesRequest {
+	Arena arena;
+	VectorRef<KeyRef> keys;
+	Version version;
+	int limitBytes;
+	Optional<UID> debugID;
+	ReplyPromise<GetValuesReply> reply;
+
+	GetValuesRequest() {}
+	GetValuesRequest(VectorRef<KeyRef> const& keys, Version ver, int limitBytes, Optional<UID> debugID) : keys(arena, keys), version(ver), limitBytes(limitBytes), debugID(debugID) {}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & keys & version & limitBytes & debugID & reply & arena;
+	}
+};
+
 struct WatchValueRequest {
 	Key key;
 	Optional<Value> value;
@@ -143,9 +194,98 @@ struct GetKeyValuesReply : public LoadBalancedReply {
 	Version version; // useful when latestVersion was requested
 	bool more;
 
+	// When the request sets compressKeys, the storage server sends data front coded in encodedData, and data is empty
+	// until decodeKeys().  Each key is sent as the length of the prefix it shares with the previous key and the rest of
+	// its bytes, and each length as a varint.
+	StringRef encodedData;
+
+	void encodeKeys() {
+		if (!data.size()) return;
+		int bound = 5;
+		for(auto& kv : data)
+			bound += 15 + kv.key.size() + kv.value.size();
+		uint8_t* begin = new (arena) uint8_t[bound];
+		uint8_t* p = begin;
+		putVarint( p, data.size() );
+		KeyRef prev;
+		for(auto& kv : data) {
+			int shared = commonPrefixLength( prev.begin(), kv.key.begin(), std::min(prev.size(), kv.key.size()) );
+			putVarint( p, shared );
+			putBytes( p, kv.key.substr(shared) );
+			putBytes( p, kv.value );
+			prev = kv.key;
+		}
+		ASSERT( p - begin <= bound );
+		encodedData = StringRef( begin, p - begin );
+		data = VectorRef<KeyValueRef>();
+	}
+
+	// Rebuilds data from encodedData in arena.  The values are not copied, since encodedData is already in arena.  Throws
+	// incompatible_protocol_version if encodedData is not valid.
+	void decodeKeys() {
+		if (!encodedData.size()) return;
+		const uint8_t* p = encodedData.begin();
+		const uint8_t* end = encodedData.end();
+		uint32_t rows = getVarint( p, end );
+		check( rows <= (end - p) / 3 );  // Each row takes at least three bytes
+		data.resize( arena, rows );
+		KeyRef prev;
+		for(auto& kv : data) {
+			uint32_t shared = getVarint( p, end );
+			StringRef suffix = getBytes( p, end );
+			check( shared <= prev.size() );
+			uint8_t* key = new (arena) uint8_t[shared + suffix.size()];
+			memcpy( key, prev.begin(), shared );
+			memcpy( key + shared, suffix.begin(), suffix.size() );
+			kv.key = KeyRef( key, shared + suffix.size() );
+			kv.value = getBytes( p, end );
+			prev = kv.key;
+		}
+		check( p == end );
+		encodedData = StringRef();
+	}
+
 	template <class Ar>
 	void serialize( Ar& ar ) {
 		ar & *(LoadBalancedReply*)this & data & version & more & arena;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & encodedData;
+	}
+
+private:
+	static void putVarint( uint8_t*& p, uint32_t v ) {
+		while (v >= 0x80) {
+			*p++ = uint8_t(v) | 0x80;
+			v >>= 7;
+		}
+		*p++ = uint8_t(v);
+	}
+	static void putBytes( uint8_t*& p, StringRef s ) {
+		putVarint( p, s.size() );
+		memcpy( p, s.begin(), s.size() );
+		p += s.size();
+	}
+	static void check( bool valid ) {
+		if (!valid) {
+			TraceEvent(SevWarnAlways, "GetKeyValuesReplyInvalidEncoding");
+			throw incompatible_protocol_version();
+		}
+	}
+	static uint32_t getVarint( const uint8_t*& p, const uint8_t* end ) {
+		uint32_t v = 0;
+		for(int shift = 0; ; shift += 7) {
+			check( p < end && shift < 32 );
+			uint8_t b = *p++;
+			v |= uint32_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) return v;
+		}
+	}
+	static StringRef getBytes( const uint8_t*& p, const uint8_t* end ) {
+		uint32_t size = getVarint( p, end );
+		check( size <= end - p );
+		StringRef s( p, size );
+		p += size;
+		return s;
 	}
 };
 
@@ -155,13 +295,43 @@ struct GetKeyValuesRequest {
 	Version version;		// or latestVersion
 	int limit, limitBytes;
 	Optional<UID> debugID;
+	bool compressKeys;		// If true, the reply may front code its keys (see GetKeyValuesReply::encodedData)
 	ReplyPromise<GetKeyValuesReply> reply;
 
-	GetKeyValuesRequest() {}
+	GetKeyValuesRequest() : compressKeys(false) {}
 //	GetKeyValuesRequest(const KeySelectorRef& begin, const KeySelectorRef& end, Version version, int limit, int limitBytes, Optional<UID> debugID) : begin(begin), end(end), version(version), limit(limit), limitBytes(limitBytes) {}
 	template <class Ar>
 	void serialize( Ar& ar ) {
 		ar & begin & end & version & limit & limitBytes & debugID & reply & arena;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & compressKeys;
+	}
+};
+
+struct GetRangeAggregateReply : public LoadBalancedReply {
+	RangeAggregate aggregate;
+	bool more;  // If true, only the rows through aggregate.lastKey were aggregated and the rest of the range remains
+
+	GetRangeAggregateReply() : more(false) {}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & *(LoadBalancedReply*)this & aggregate & more;
+	}
+};
+
+struct GetRangeAggregateRequest {
+	KeyRange keys;
+	Version version;
+	Optional<UID> debugID;
+	ReplyPromise<GetRangeAggregateReply> reply;
+
+	GetRangeAggregateRequest() {}
+	GetRangeAggregateRequest(KeyRangeRef const& keys, Version ver, Optional<UID> debugID) : keys(keys), version(ver), debugID(debugID) {}
+
+	template <class Ar>
+	void serialize( Ar& ar ) {
+		ar & keys & version & debugID & reply;
 	}
 };
 
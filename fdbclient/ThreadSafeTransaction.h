@@ -80,6 +80,7 @@ public:
 	ThreadFuture<Version> getReadVersion();
 
 	ThreadFuture< Optional<Value> > get( const KeyRef& key, bool snapshot = false );
+	ThreadFuture< Standalone<RangeResultRef> > getValues( const VectorRef<KeyRef>& keys, bool snapshot = false );
 	ThreadFuture< Key > getKey( const KeySelectorRef& key, bool snapshot = false );
 	ThreadFuture< Standalone<RangeResultRef> > getRange( const KeySelectorRef& begin, const KeySelectorRef& end, int limit, bool snapshot = false, bool reverse = false );
 	ThreadFuture< Standalone<RangeResultRef> > getRange( const KeySelectorRef& begin, const KeySelectorRef& end, GetRangeLimits limits, bool snapshot = false, bool reverse = false );
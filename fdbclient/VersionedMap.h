@@ -109,9 +109,9 @@ namespace PTreeImpl {
 	template<class T, class X>
 	bool contains(const Reference<PTree<T>>& p, Version at, const X& x) {
 		if (!p) return false;
-		bool less = x < p->data;
-		if (!less && !(p->data<x)) return true;  // x == p->data
-		return contains(p->child(!less, at), at, x);
+		int c = threeWayCompare(x, p->data);
+		if (c == 0) return true;  // x == p->data
+		return contains(p->child(c > 0, at), at, x);
 	}
 
 	template<class T, class X>
@@ -122,9 +122,9 @@ namespace PTreeImpl {
 			return;
 		}
 		f.push_back(p.getPtr());
-		bool less = x < p->data;
-		if (!less && !(p->data<x)) return;  // x == p->data
-		lower_bound(p->child(!less, at), at, x, f);
+		int c = threeWayCompare(x, p->data);
+		if (c == 0) return;  // x == p->data
+		lower_bound(p->child(c > 0, at), at, x, f);
 	}
 
 	template<class T, class X>
@@ -272,11 +272,12 @@ namespace PTreeImpl {
 	template<class T, class X>
 	void remove(Reference<PTree<T>>& p, Version at, const X& x) {
 		if (!p) ASSERT(false); // attempt to remove item not present in PTree
-		if (x < p->data) {
+		int c = threeWayCompare(x, p->data);
+		if (c < 0) {
 			Reference<PTree<T>> child = p->child(0, at);
 			remove(child, at, x);
 			p = update(p, 0, child, at);
-		} else if (p->data < x) {
+		} else if (c > 0) {
 			Reference<PTree<T>> child = p->child(1, at);
 			remove(child, at, x);
 			p = update(p, 1, child, at);
@@ -19,6 +19,7 @@
  */
 
 #include "AsyncFileCached.actor.h"
+#include "flow/UnitTest.h"
 
 //Page caches used in non-simulated environments
 Optional<Reference<EvictablePageCache>> pc4k, pc64k;
@@ -34,18 +35,54 @@ EvictablePage::~EvictablePage() {
 			aligned_free(data);
 	}
 	if (index > -1) {
-		pageCache->pages[index] = pageCache->pages.back();
-		pageCache->pages[index]->index = index;
-		pageCache->pages.pop_back();
+		pageCache->remove(this);
 	}
 }
 
+CacheEvictionType evictionPolicyStringToEnum(const std::string &policy) {
+	std::string cep = policy;
+	std::transform(cep.begin(), cep.end(), cep.begin(), ::tolower);
+	if (cep == "2q")
+		return TWO_Q;
+	if (cep != "random")
+		TraceEvent(SevWarnAlways, "UnknownCacheEvictionPolicy").detail("Policy", policy);
+	return RANDOM;
+}
+
 std::map< std::string, OpenFileInfo > AsyncFileCached::openFiles;
 
 void AsyncFileCached::remove_page( AFCPage* page ) {
 	pages.erase( page->pageOffset );
 }
 
+std::string AsyncFileCached::fileType( std::string const& filename ) {
+	size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos || filename.find_first_of("/\\", dot) != std::string::npos)
+		return "none";
+	return filename.substr(dot + 1);
+}
+
+AFCPage* AsyncFileCached::findPage( int64_t pageOffset, bool reading ) {
+	++countFileCacheFinds;
+	++countCacheFinds;
+	auto p = pages.find( pageOffset );
+	if ( p == pages.end() ) {
+		if (reading) {
+			++pageCache->misses;
+			++countCachePageMisses;
+		}
+		AFCPage* page = new AFCPage( this, pageOffset );
+		p = pages.insert( std::make_pair(pageOffset, page) ).first;
+	} else {
+		if (reading) {
+			++pageCache->hits;
+			++countCachePageHits;
+		}
+		pageCache->touch( p->second );
+	}
+	return p->second;
+}
+
 Future<Reference<IAsyncFile>> AsyncFileCached::open_impl( std::string filename, int flags, int mode ) {
 	Reference<EvictablePageCache> pageCache;
 
@@ -91,19 +128,13 @@ Future<Void> AsyncFileCached::read_write_impl( AsyncFileCached* self, void* data
 	int remaining = length;
 
 	while (remaining) {
-		++self->countFileCacheFinds;
-		++self->countCacheFinds;
-		auto p = self->pages.find( pageOffset );
-		if ( p == self->pages.end() ) {
-			AFCPage* page = new AFCPage( self, pageOffset );
-			p = self->pages.insert( std::make_pair(pageOffset, page) ).first;
-		}
+		AFCPage* page = self->findPage( pageOffset, !writing );
 
 		int bytesInPage = std::min(self->pageCache->pageSize - offsetInPage, remaining);
 
 		auto w = writing
-			? p->second->write( cdata, bytesInPage, offsetInPage )
-			: p->second->read( cdata, bytesInPage, offsetInPage );
+			? page->write( cdata, bytesInPage, offsetInPage )
+			: page->read( cdata, bytesInPage, offsetInPage );
 		if (!w.isReady() || w.isError())
 			actors.push_back( w );
 
@@ -129,15 +160,11 @@ Future<Void> AsyncFileCached::readZeroCopy( void** data, int* length, int64_t of
 	if (*length != pageCache->pageSize || (offset & (pageCache->pageSize-1)) || offset + *length > this->length)
 		return io_error();
 
-	auto p = pages.find( offset );
-	if ( p == pages.end() ) {
-		AFCPage* page = new AFCPage( this, offset );
-		p = pages.insert( std::make_pair(offset, page) ).first;
-	}
+	AFCPage* page = findPage( offset, true );
 
-	*data = p->second->data;
+	*data = page->data;
 
-	return p->second->readZeroCopy();
+	return page->readZeroCopy();
 }
 void AsyncFileCached::releaseZeroCopy( void* data, int length, int64_t offset ) {
 	ASSERT( length == pageCache->pageSize && !(offset & (pageCache->pageSize-1)) && offset + length <= this->length);
@@ -237,3 +264,77 @@ AsyncFileCached::~AsyncFileCached() {
 	}
 	openFiles.erase( filename );
 }
+
+// A page with no contents, for replaying traces of page accesses against an EvictablePageCache
+struct TracePage : EvictablePage, FastAllocated<TracePage> {
+	std::unordered_map<int64_t, TracePage*>* resident;
+	int64_t id;
+
+	TracePage( Reference<EvictablePageCache> pageCache, std::unordered_map<int64_t, TracePage*>* resident, int64_t id ) : EvictablePage(pageCache), resident(resident), id(id) {
+		ghostKey = id;
+		this->pageCache->allocate(this);
+		(*resident)[id] = this;
+	}
+
+	virtual bool evict() {
+		resident->erase(id);
+		delete this;
+		return true;
+	}
+};
+
+// Replays trace, a sequence of (page, isScan) accesses, against a cache of cachePages pages and returns the hit rate of the point reads
+static double replayCacheTrace( CacheEvictionType type, std::vector<std::pair<int64_t, bool>> const& trace, int64_t cachePages ) {
+	Reference<EvictablePageCache> pageCache( new EvictablePageCache(4096, cachePages * 4096, type) );
+	std::unordered_map<int64_t, TracePage*> resident;
+	int64_t pointReads = 0, pointHits = 0;
+	double start = timer();
+
+	for(auto& access : trace) {
+		auto p = resident.find(access.first);
+		bool hit = p != resident.end();
+		if (hit) {
+			++pageCache->hits;
+			pageCache->touch(p->second);
+		} else {
+			++pageCache->misses;
+			new TracePage(pageCache, &resident, access.first);
+		}
+		ASSERT( pageCache->pages.size() <= cachePages );
+		if (!access.second) {
+			++pointReads;
+			pointHits += hit;
+		}
+	}
+
+	printf("%-6s: point read hit rate %.3f, overall hit rate %.3f, %lld evictions, %.1f M accesses/sec\n", type == TWO_Q ? "2q" : "random", double(pointHits) / pointReads,
+		double(pageCache->hits) / trace.size(), (long long)pageCache->evictions, trace.size() / (timer() - start) / 1e6);
+
+	while (!resident.empty())
+		resident.begin()->second->evict();
+	return double(pointHits) / pointReads;
+}
+
+TEST_CASE("fdbrpc/AsyncFileCached/ScanResistance") {
+	// Point reads of a working set that fits in the cache (like the interior pages of a B-tree), interleaved with scans of pages that are
+	// not read again (like a range read or fetchKeys)
+	int64_t cachePages = 10000;
+	int64_t hotPages = cachePages / 2;
+	int64_t nextScanPage = hotPages;
+	std::vector<std::pair<int64_t, bool>> trace;
+	for(int round = 0; round < 200; round++) {
+		for(int i = 0; i < 10000; i++)
+			trace.push_back( std::make_pair( int64_t(g_random->randomInt(0, hotPages)), false ) );
+		if (round >= 10 && g_random->random01() < 0.2) {
+			int64_t scanPages = g_random->randomInt(cachePages / 10, cachePages * 3);
+			for(int64_t i = 0; i < scanPages; i++)
+				trace.push_back( std::make_pair( nextScanPage++, true ) );
+		}
+	}
+
+	double randomHitRate = replayCacheTrace( RANDOM, trace, cachePages );
+	double twoQHitRate = replayCacheTrace( TWO_Q, trace, cachePages );
+	ASSERT( twoQHitRate > randomHitRate );
+
+	return Void();
+}
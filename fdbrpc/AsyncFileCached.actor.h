@@ -32,36 +32,111 @@
 #include "flow/Knobs.h"
 #include "flow/TDMetric.actor.h"
 #include "flow/network.h"
+#include "flow/Hash3.h"
+#include <unordered_set>
+
+enum CacheEvictionType { RANDOM = 0, TWO_Q = 1 };
+
+CacheEvictionType evictionPolicyStringToEnum(const std::string &policy);
 
 struct EvictablePage {
 	void* data;
 	int index;
 	class Reference<struct EvictablePageCache> pageCache;
+	int64_t ghostKey; // identifies the page's contents when it is remembered after eviction
+	int queue; // EvictablePageCache::Queue the page is in
+	EvictablePage* prev; // toward the most recently used end of queue
+	EvictablePage* next;
 
 	virtual bool evict() = 0; // true if page was evicted, false if it isn't immediately evictable (but will be evicted regardless if possible)
 
-	EvictablePage(Reference<EvictablePageCache> pageCache) : data(0), index(-1), pageCache(pageCache) {}
+	EvictablePage(Reference<EvictablePageCache> pageCache) : data(0), index(-1), pageCache(pageCache), ghostKey(0), queue(-1), prev(0), next(0) {}
 	virtual ~EvictablePage();
 };
 
+// An intrusive LRU list of pages, most recently used first
+struct EvictablePageQueue {
+	EvictablePage* head;
+	EvictablePage* tail;
+	int64_t size;
+
+	EvictablePageQueue() : head(0), tail(0), size(0) {}
+
+	void push_front(EvictablePage* page) {
+		page->prev = 0;
+		page->next = head;
+		if (head) head->prev = page;
+		else tail = page;
+		head = page;
+		++size;
+	}
+	void remove(EvictablePage* page) {
+		if (page->prev) page->prev->next = page->next;
+		else head = page->next;
+		if (page->next) page->next->prev = page->prev;
+		else tail = page->prev;
+		page->prev = page->next = 0;
+		--size;
+	}
+};
+
+// With CacheEvictionType RANDOM, evicts a random page when the cache is full.  With TWO_Q, uses the 2Q policy (Johnson and Shasha, VLDB '94),
+// so that pages which are only read once, such as by a range scan, don't push out pages which are read repeatedly: pages start in the
+// in queue and are evicted from it first, in FIFO order; pages which are reread after eviction from it, while they are still remembered
+// by the out queue, are brought into the main queue, which is LRU.
 struct EvictablePageCache : ReferenceCounted<EvictablePageCache> {
-	EvictablePageCache() : pageSize(0), maxPages(0) {}
-	explicit EvictablePageCache(int pageSize, int64_t maxSize) : pageSize(pageSize), maxPages(maxSize / pageSize) {}
+	enum Queue { IN = 0, MAIN = 1 };
+
+	EvictablePageCache() : pageSize(0), maxPages(0), cacheEvictionType(RANDOM), hits(0), misses(0), evictions(0) {}
+	explicit EvictablePageCache(int pageSize, int64_t maxSize) : pageSize(pageSize), maxPages(maxSize / pageSize), cacheEvictionType(evictionPolicyStringToEnum(FLOW_KNOBS->CACHE_EVICTION_POLICY)), hits(0), misses(0), evictions(0) {}
+	explicit EvictablePageCache(int pageSize, int64_t maxSize, CacheEvictionType cacheEvictionType) : pageSize(pageSize), maxPages(maxSize / pageSize), cacheEvictionType(cacheEvictionType), hits(0), misses(0), evictions(0) {}
 
+	// page->ghostKey must be set
 	void allocate(EvictablePage* page) {
 		try_evict();
 		try_evict();
 		page->data = pageSize == 4096 ? FastAllocator<4096>::allocate() : aligned_alloc(4096,pageSize);
 		page->index = pages.size();
 		pages.push_back(page);
+		if (cacheEvictionType == TWO_Q) {
+			page->queue = ghosts.count(page->ghostKey) ? MAIN : IN;
+			queues[page->queue].push_front(page);
+		}
+	}
+
+	// Called when a page that is already in the cache is used
+	void touch(EvictablePage* page) {
+		if (cacheEvictionType == TWO_Q && page->queue == MAIN) {
+			queues[MAIN].remove(page);
+			queues[MAIN].push_front(page);
+		}
+	}
+
+	// Called by ~EvictablePage
+	void remove(EvictablePage* page) {
+		pages[page->index] = pages.back();
+		pages[page->index]->index = page->index;
+		pages.pop_back();
+		if (page->queue != -1)
+			queues[page->queue].remove(page);
 	}
 
 	void try_evict() {
 		if (pages.size() >= (uint64_t)maxPages && !pages.empty()) {
+			if (cacheEvictionType == TWO_Q) {
+				int attempts = FLOW_KNOBS->MAX_EVICT_ATTEMPTS;
+				if (queues[IN].size > maxPages * FLOW_KNOBS->CACHE_2Q_IN_FRACTION && evictFrom(IN, attempts))
+					return;
+				if (!evictFrom(MAIN, attempts))
+					evictFrom(IN, attempts);
+				return;
+			}
 			for (int i = 0; i < FLOW_KNOBS->MAX_EVICT_ATTEMPTS; i++) { // If we don't manage to evict anything, just go ahead and exceed the cache limit
 				int toEvict = g_random->randomInt(0, pages.size());
-				if (pages[toEvict]->evict())
+				if (pages[toEvict]->evict()) {
+					++evictions;
 					break;
+				}
 			}
 		}
 	}
@@ -69,6 +144,41 @@ struct EvictablePageCache : ReferenceCounted<EvictablePageCache> {
 	std::vector<EvictablePage*> pages;
 	int pageSize;
 	int64_t maxPages;
+	CacheEvictionType cacheEvictionType;
+	int64_t hits, misses, evictions; // Counted by the users of the cache, except for evictions
+
+private:
+	EvictablePageQueue queues[2];
+	std::unordered_set<int64_t> ghosts; // ghostKeys of pages evicted from the in queue
+	std::deque<int64_t> ghostOrder;
+
+	// Evicts the least recently used page of queue that can be evicted.  A page that can't be evicted (because it is being read or written)
+	// is moved to the front, so that evict() can start whatever it needs to become evictable without being retried immediately.
+	bool evictFrom(int queue, int& attempts) {
+		while (queues[queue].tail && attempts-- > 0) {
+			EvictablePage* page = queues[queue].tail;
+			int64_t ghostKey = page->ghostKey;
+			if (page->evict()) {
+				++evictions;
+				if (queue == IN)
+					remember(ghostKey);
+				return true;
+			}
+			queues[queue].remove(page);
+			queues[queue].push_front(page);
+		}
+		return false;
+	}
+
+	void remember(int64_t ghostKey) {
+		if (!ghosts.insert(ghostKey).second)
+			return;
+		ghostOrder.push_back(ghostKey);
+		while (ghostOrder.size() > std::max<int64_t>(1, maxPages * FLOW_KNOBS->CACHE_2Q_OUT_FRACTION)) {
+			ghosts.erase(ghostOrder.front());
+			ghostOrder.pop_front();
+		}
+	}
 };
 
 struct OpenFileInfo : NonCopyable {
@@ -203,8 +313,15 @@ private:
 	Int64MetricHandle countCachePageReadsMerged;
 	Int64MetricHandle countCacheReadBytes;
 
+	// Aggregated by the type of file (see fileType())
+	Int64MetricHandle countCachePageHits;
+	Int64MetricHandle countCachePageMisses;
+	Int64MetricHandle countCachePageEvictions;
+
+	int64_t fileId; // Distinguishes the pages of this file from those of other files in the page cache
+
 	AsyncFileCached( Reference<IAsyncFile> uncached, const std::string& filename, int64_t length, Reference<EvictablePageCache> pageCache ) 
-		: uncached(uncached), filename(filename), length(length), prevLength(length), pageCache(pageCache) {
+		: uncached(uncached), filename(filename), length(length), prevLength(length), pageCache(pageCache), fileId(hashlittle(filename.c_str(), filename.size(), 0)) {
 		if( !g_network->isSimulated() ) {
 			countFileCacheWrites.init(         LiteralStringRef("AsyncFile.CountFileCacheWrites"), filename);
 			countFileCacheReads.init(          LiteralStringRef("AsyncFile.CountFileCacheReads"), filename);
@@ -222,11 +339,21 @@ private:
 			countCacheFinds.init(          LiteralStringRef("AsyncFile.CountCacheFinds"));
 			countCacheReadBytes.init(      LiteralStringRef("AsyncFile.CountCacheReadBytes"));
 
+			std::string type = fileType(filename);
+			countCachePageHits.init(       LiteralStringRef("AsyncFile.CountCachePageHits"), type);
+			countCachePageMisses.init(     LiteralStringRef("AsyncFile.CountCachePageMisses"), type);
+			countCachePageEvictions.init(  LiteralStringRef("AsyncFile.CountCachePageEvictions"), type);
 		}
 	}
 
 	static Future<Reference<IAsyncFile>> open_impl( std::string filename, int flags, int mode );
 
+	// The extension of filename, such as "sqlite" or "sqlite-wal"
+	static std::string fileType( std::string const& filename );
+
+	// Finds or creates the page at pageOffset, counting it as a cache hit or miss if reading
+	struct AFCPage* findPage( int64_t pageOffset, bool reading );
+
 	ACTOR static Future<Reference<IAsyncFile>> open_impl( std::string filename, int flags, int mode, Reference<EvictablePageCache> pageCache ) {
 		try {
 			TraceEvent("AFCUnderlyingOpenBegin").detail("filename", filename);
@@ -269,6 +396,7 @@ private:
 struct AFCPage : public EvictablePage, public FastAllocated<AFCPage> {
 	virtual bool evict() {
 		if ( notReading.isReady() && notFlushing.isReady() && !dirty && !zeroCopyRefCount && !truncated ) {
+			++owner->countCachePageEvictions;
 			owner->remove_page( this );
 			delete this;
 			return true;
@@ -445,6 +573,7 @@ struct AFCPage : public EvictablePage, public FastAllocated<AFCPage> {
 	}
 
 	AFCPage( AsyncFileCached* owner, int64_t offset ) : EvictablePage(owner->pageCache), owner(owner), pageOffset(offset), dirty(false), valid(false), truncated(false), notReading(Void()), notFlushing(Void()), zeroCopyRefCount(0), flushableIndex(-1), writeThroughCount(0) {
+		ghostKey = (owner->fileId << 32) ^ (offset / pageCache->pageSize);
 		pageCache->allocate(this);
 	}
 
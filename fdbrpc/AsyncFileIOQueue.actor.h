@@ -0,0 +1,212 @@
+/*
+ * AsyncFileIOQueue.actor.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#ifdef __linux__
+
+// When actually compiled (NO_INTELLISENSE), include the generated version of this file.  In intellisense use the source version.
+#if defined(NO_INTELLISENSE) && !defined(FLOW_ASYNCFILEIOQUEUE_ACTOR_G_H)
+	#define FLOW_ASYNCFILEIOQUEUE_ACTOR_G_H
+	#include "AsyncFileIOQueue.actor.g.h"
+#elif !defined(FLOW_ASYNCFILEIOQUEUE_ACTOR_H)
+	#define FLOW_ASYNCFILEIOQUEUE_ACTOR_H
+
+#include "IAsyncFile.h"
+#include <fcntl.h>
+#include <queue>
+#include <vector>
+
+// The request handling shared by the kernel asynchronous I/O files (AsyncFileKAIO and AsyncFileIOUring).  I/Os wait in a queue ordered by
+// the priority of the task that issued them until the file's run loop hook submits them in a batch.  Submitted I/Os are kept in a list,
+// oldest first, so that they can be timed out.
+
+ACTOR static void deliverAsyncFileIOResult( Promise<int> result, bool failed, int r, int task ) {
+	Void _ = wait( delay(0, task) );
+	if (failed) result.sendError(io_timeout());
+	else if (r < 0) result.sendError(io_error());
+	else result.send(r);
+}
+
+// A base for each file's IOBlock, which must also have a bool owner->failed
+template <class IOBlock, class File>
+struct AsyncFileIORequest {
+	Promise<int> result;
+	Reference<File> owner;
+	int64_t prio;
+	IOBlock *prev;
+	IOBlock *next;
+	double startTime;
+
+	struct indirect_order_by_priority { bool operator () ( IOBlock* a, IOBlock* b ) { return a->prio < b->prio; } };
+
+	AsyncFileIORequest() : prev(nullptr), next(nullptr), startTime(0) {}
+
+	int getTask() const { return (prio>>32)+1; }
+
+	// Completes the I/O with r (a byte count, or a negative errno) at the priority of the task that issued it
+	void deliver( int r ) {
+		deliverAsyncFileIOResult( result, owner->failed, r, getTask() );
+	}
+};
+
+template <class IOBlock>
+struct AsyncFileIOQueue {
+	int outstanding;
+	double ioStallBegin;
+	bool fallocateSupported;
+	bool fallocateZeroSupported;
+	std::priority_queue<IOBlock*, std::vector<IOBlock*>, typename IOBlock::indirect_order_by_priority> queue;
+
+	double ioTimeout;
+	bool timeoutWarnOnly;
+	IOBlock *submittedRequestList;
+
+	uint32_t opsIssued;
+	AsyncFileIOQueue() : outstanding(0), ioStallBegin(0), fallocateSupported(true), fallocateZeroSupported(true), submittedRequestList(nullptr), opsIssued(0) {
+		setIOTimeout(0);
+	}
+
+	void setIOTimeout(double timeout) {
+		ioTimeout = fabs(timeout);
+		timeoutWarnOnly = timeout < 0;
+	}
+
+	// Queues io behind any queued I/Os from tasks of the same or higher priority
+	void push( IOBlock* io ) {
+		io->prio = (int64_t(g_network->getCurrentTask())<<32) - (++opsIssued);
+		queue.push(io);
+	}
+
+	// Called with the number of completions that are about to be delivered; times out the I/Os which have been submitted for too long
+	void collected( int n ) {
+		if (n) {
+			double t = timer_monotonic();
+			double elapsed = t - ioStallBegin;
+			ioStallBegin = t;
+			g_network->networkMetrics.secSquaredDiskStall += elapsed*elapsed/2;
+		}
+
+		outstanding -= n;
+
+		if(ioTimeout > 0) {
+			double currentTime = now();
+			while(submittedRequestList && currentTime - submittedRequestList->startTime > ioTimeout) {
+				submittedRequestList->timeout(timeoutWarnOnly);
+				removeFromRequestList(submittedRequestList);
+			}
+		}
+	}
+
+	void appendToRequestList(IOBlock *io) {
+		ASSERT(!io->next && !io->prev);
+
+		if(submittedRequestList) {
+			io->prev = submittedRequestList->prev;
+			io->prev->next = io;
+
+			submittedRequestList->prev = io;
+			io->next = submittedRequestList;
+		}
+		else {
+			submittedRequestList = io;
+			io->next = io->prev = io;
+		}
+	}
+
+	void removeFromRequestList(IOBlock *io) {
+		if(io->next == nullptr) {
+			ASSERT(io->prev == nullptr);
+			return;
+		}
+
+		ASSERT(io->prev != nullptr);
+
+		if(io == io->next) {
+			ASSERT(io == submittedRequestList && io == io->prev);
+			submittedRequestList = nullptr;
+		}
+		else {
+			io->next->prev = io->prev;
+			io->prev->next = io->next;
+
+			if(submittedRequestList == io) {
+				submittedRequestList = io->next;
+			}
+		}
+
+		io->next = io->prev = nullptr;
+	}
+};
+
+// The kernel I/O backends share the network's eventfd and its run loop hook, so that more than one of them can be active in a process
+// (the io_uring unit test brings a ring up next to KAIO).  Each registers a function that submits its queued I/Os, called once per run
+// loop cycle, and one that delivers its completions, called whenever the eventfd is signalled.  Since every backend's collect function
+// runs on each signal, it must not block when the backend has nothing to deliver.
+struct AsyncFileIOBackends {
+	typedef void (*Hook)();
+	struct Backend {
+		Hook launch;
+		Hook collect;
+	};
+
+	static std::vector<Backend>& backends() {
+		static std::vector<Backend> b;
+		return b;
+	}
+
+	static void add( Reference<IEventFD> ev, Hook launch, Hook collect ) {
+		if (backends().empty()) {
+			poll( ev );
+			g_network->setGlobal(INetwork::enRunCycleFunc, (flowGlobalType) &AsyncFileIOBackends::launch);
+		}
+		backends().push_back( Backend{ launch, collect } );
+	}
+
+	static void launch() {
+		for(auto& b : backends())
+			b.launch();
+	}
+
+	ACTOR static void poll( Reference<IEventFD> ev ) {
+		loop {
+			int64_t evfd_count = wait( ev->read() );
+
+			Void _ = wait(delay(0, TaskDiskIOComplete));
+
+			for(auto& b : backends())
+				b.collect();
+		}
+	}
+};
+
+// The open(2) flags for the given IAsyncFile::OPEN_* flags, not including O_DIRECT
+inline int asyncFileIOOpenFlags(int flags) {
+	int oflags = 0;
+	ASSERT( bool(flags & IAsyncFile::OPEN_READONLY) != bool(flags & IAsyncFile::OPEN_READWRITE) );  // readonly xor readwrite
+	if( flags & IAsyncFile::OPEN_EXCLUSIVE ) oflags |= O_EXCL;
+	if( flags & IAsyncFile::OPEN_CREATE )    oflags |= O_CREAT;
+	if( flags & IAsyncFile::OPEN_READONLY )  oflags |= O_RDONLY;
+	if( flags & IAsyncFile::OPEN_READWRITE ) oflags |= O_RDWR;
+	if( flags & IAsyncFile::OPEN_ATOMIC_WRITE_AND_CREATE ) oflags |= O_TRUNC;
+	return oflags;
+}
+
+#endif
+#endif
@@ -0,0 +1,519 @@
+/*
+ * AsyncFileIOUring.actor.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#ifdef __linux__
+
+// When actually compiled (NO_INTELLISENSE), include the generated version of this file.  In intellisense use the source version.
+#if defined(NO_INTELLISENSE) && !defined(FLOW_ASYNCFILEIOURING_ACTOR_G_H)
+	#define FLOW_ASYNCFILEIOURING_ACTOR_G_H
+	#include "AsyncFileIOUring.actor.g.h"
+#elif !defined(FLOW_ASYNCFILEIOURING_ACTOR_H)
+	#define FLOW_ASYNCFILEIOURING_ACTOR_H
+
+#include "IAsyncFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include "fdbrpc/linux_uring.h"
+#include "fdbrpc/AsyncFileIOQueue.actor.h"
+#include "flow/Knobs.h"
+#include "flow/UnitTest.h"
+#include "flow/genericactors.actor.h"
+
+// An unbuffered file which does its I/O, including fdatasync, through a single io_uring shared by all files.  Like AsyncFileKAIO, I/Os are
+// queued by priority and submitted in a batch once per run loop cycle (see launch()), and completions are signalled through the network's
+// eventfd.
+class AsyncFileIOUring : public IAsyncFile, public ReferenceCounted<AsyncFileIOUring> {
+public:
+	static Future<Reference<IAsyncFile>> open( std::string filename, int flags, int mode, void* ignore ) {
+		ASSERT( flags & OPEN_UNBUFFERED );
+
+		if (flags & OPEN_LOCK)
+			mode |= 02000;  // Enable mandatory locking for this file if it is supported by the filesystem
+
+		std::string open_filename = filename;
+		if (flags & OPEN_ATOMIC_WRITE_AND_CREATE) {
+			ASSERT( (flags & OPEN_CREATE) && (flags & OPEN_READWRITE) && !(flags & OPEN_EXCLUSIVE) );
+			open_filename = filename + ".part";
+		}
+
+		int fd = ::open( open_filename.c_str(), asyncFileIOOpenFlags(flags) | O_DIRECT, mode );
+		if (fd<0) {
+			Error e = errno==ENOENT ? file_not_found() : io_error();
+			TraceEvent("AsyncFileIOUringOpenFailed").detail("Filename", filename).detailf("Flags", "%x", flags)
+				.detailf("OSFlags", "%x", asyncFileIOOpenFlags(flags) | O_DIRECT).detailf("mode", "0%o", mode).error(e).GetLastError();
+			return e;
+		} else {
+			TraceEvent("AsyncFileIOUringOpen")
+				.detail("Filename", filename)
+				.detail("Flags", flags)
+				.detail("mode", mode)
+				.detail("fd", fd);
+		}
+
+		Reference<AsyncFileIOUring> r(new AsyncFileIOUring( fd, flags, filename ));
+
+		if (flags & OPEN_LOCK) {
+			// Acquire a "write" lock for the entire file
+			flock lockDesc;
+			lockDesc.l_type = F_WRLCK;
+			lockDesc.l_whence = SEEK_SET;
+			lockDesc.l_start = 0;
+			lockDesc.l_len = 0;
+			lockDesc.l_pid = 0;
+			if (fcntl(fd, F_SETLK, &lockDesc) == -1) {
+				TraceEvent(SevError, "UnableToLockFile").detail("filename", filename).GetLastError();
+				return io_error();
+			}
+		}
+
+		struct stat buf;
+		if (fstat( fd, &buf )) {
+			TraceEvent("AsyncFileIOUringFStatError").detail("fd",fd).detail("filename", filename).GetLastError();
+			return io_error();
+		}
+
+		r->lastFileSize = r->nextFileSize = buf.st_size;
+		return Reference<IAsyncFile>(std::move(r));
+	}
+
+	// Sets up the ring.  Returns false if the kernel does not support io_uring, in which case the caller should use AsyncFileKAIO instead.
+	static bool init( Reference<IEventFD> ev, double ioTimeout ) {
+		linux_io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		int fd = io_uring_setup( FLOW_KNOBS->IO_URING_QUEUE_DEPTH, &params );
+		if (fd < 0) {
+			TraceEvent(SevWarnAlways, "IOUringSetupError").detail("QueueDepth", FLOW_KNOBS->IO_URING_QUEUE_DEPTH).GetLastError();
+			return false;
+		}
+
+		size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(linux_io_uring_cqe);
+		if (params.features & LINUX_IORING_FEAT_SINGLE_MMAP)
+			sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+		uint8_t* sqRing = (uint8_t*)mmap( NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, LINUX_IORING_OFF_SQ_RING );
+		uint8_t* cqRing = sqRing;
+		if (sqRing != MAP_FAILED && !(params.features & LINUX_IORING_FEAT_SINGLE_MMAP))
+			cqRing = (uint8_t*)mmap( NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, LINUX_IORING_OFF_CQ_RING );
+		void* sqes = MAP_FAILED;
+		if (sqRing != MAP_FAILED && cqRing != MAP_FAILED)
+			sqes = mmap( NULL, params.sq_entries * sizeof(linux_io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, LINUX_IORING_OFF_SQES );
+		if (sqes == MAP_FAILED) {
+			TraceEvent(SevWarnAlways, "IOUringMapError").GetLastError();
+			::close(fd);
+			return false;
+		}
+
+		int evfd = ev->getFD();
+		if (io_uring_register( fd, LINUX_IORING_REGISTER_EVENTFD, &evfd, 1 ) < 0) {
+			TraceEvent(SevWarnAlways, "IOUringRegisterEventFDError").GetLastError();
+			::close(fd);
+			return false;
+		}
+
+		ctx.ringfd = fd;
+		ctx.sqHead = (uint32_t*)(sqRing + params.sq_off.head);
+		ctx.sqTail = (uint32_t*)(sqRing + params.sq_off.tail);
+		ctx.sqMask = *(uint32_t*)(sqRing + params.sq_off.ring_mask);
+		ctx.sqEntries = params.sq_entries;
+		ctx.sqArray = (uint32_t*)(sqRing + params.sq_off.array);
+		ctx.sqes = (linux_io_uring_sqe*)sqes;
+		ctx.cqHead = (uint32_t*)(cqRing + params.cq_off.head);
+		ctx.cqTail = (uint32_t*)(cqRing + params.cq_off.tail);
+		ctx.cqMask = *(uint32_t*)(cqRing + params.cq_off.ring_mask);
+		ctx.cqes = (linux_io_uring_cqe*)(cqRing + params.cq_off.cqes);
+		ctx.depth = std::min<int>( FLOW_KNOBS->IO_URING_QUEUE_DEPTH, params.sq_entries );
+		ctx.evfd = evfd;
+
+		if( !g_network->isSimulated() ) {
+			ctx.countSubmit.init(LiteralStringRef("AsyncFile.CountIOUringSubmit"));
+			ctx.countCollect.init(LiteralStringRef("AsyncFile.CountIOUringCollect"));
+			ctx.submitMetric.init(LiteralStringRef("AsyncFile.Submit"));
+		}
+
+		TraceEvent("IOUringInit").detail("QueueDepth", ctx.depth).detail("SQEntries", params.sq_entries).detail("CQEntries", params.cq_entries);
+
+		setTimeout(ioTimeout);
+		AsyncFileIOBackends::add( ev, &AsyncFileIOUring::launch, &AsyncFileIOUring::collect );
+		return true;
+	}
+
+	static bool isInitialized() { return ctx.ringfd >= 0; }
+	static void setTimeout(double ioTimeout) { ctx.setIOTimeout(ioTimeout); }
+
+	virtual void addref() { ReferenceCounted<AsyncFileIOUring>::addref(); }
+	virtual void delref() { ReferenceCounted<AsyncFileIOUring>::delref(); }
+
+	virtual Future<int> read( void* data, int length, int64_t offset ) {
+		++countFileLogicalReads;
+		++countLogicalReads;
+
+		if(failed) {
+			return io_timeout();
+		}
+
+		IOBlock *io = new IOBlock(IOBlock::READ, fd);
+		io->buf = data;
+		io->nbytes = length;
+		io->offset = offset;
+
+		enqueue(io, this);
+		return io->result.getFuture();
+	}
+	virtual Future<Void> write( void const* data, int length, int64_t offset ) {
+		++countFileLogicalWrites;
+		++countLogicalWrites;
+
+		if(failed) {
+			return io_timeout();
+		}
+
+		IOBlock *io = new IOBlock(IOBlock::WRITE, fd);
+		io->buf = (void*)data;
+		io->nbytes = length;
+		io->offset = offset;
+
+		nextFileSize = std::max( nextFileSize, offset+length );
+
+		enqueue(io, this);
+		return success(io->result.getFuture());
+	}
+#ifndef FALLOC_FL_ZERO_RANGE
+#define FALLOC_FL_ZERO_RANGE 0x10
+#endif
+	virtual Future<Void> zeroRange( int64_t offset, int64_t length ) override {
+		bool success = false;
+		if (ctx.fallocateZeroSupported) {
+			int rc = fallocate( fd, FALLOC_FL_ZERO_RANGE, offset, length );
+			if (rc == EOPNOTSUPP) {
+				ctx.fallocateZeroSupported = false;
+			}
+			if (rc == 0) {
+				success = true;
+			}
+		}
+		return success ? Void() : IAsyncFile::zeroRange(offset, length);
+	}
+	virtual Future<Void> truncate( int64_t size ) {
+		++countFileLogicalWrites;
+		++countLogicalWrites;
+
+		if(failed) {
+			return io_timeout();
+		}
+
+		int result = -1;
+		bool completed = false;
+		if( ctx.fallocateSupported && size >= lastFileSize ) {
+			result = fallocate( fd, 0, 0, size);
+			if (result != 0) {
+				int fallocateErrCode = errno;
+				TraceEvent("AsyncFileIOUringAllocateError").detail("fd",fd).detail("filename", filename).GetLastError();
+				if ( fallocateErrCode == EOPNOTSUPP ) {
+					// Mark fallocate as unsupported. Try again with truncate.
+					ctx.fallocateSupported = false;
+				} else {
+					return io_error();
+				}
+			} else {
+				completed = true;
+			}
+		}
+		if ( !completed )
+			result = ftruncate(fd, size);
+
+		if(result != 0) {
+			TraceEvent("AsyncFileIOUringTruncateError").detail("fd",fd).detail("filename", filename).GetLastError();
+			return io_error();
+		}
+
+		lastFileSize = nextFileSize = size;
+
+		return Void();
+	}
+
+	ACTOR static Future<Void> throwErrorIfFailed( Reference<AsyncFileIOUring> self, Future<Void> sync ) {
+		Void _ = wait( sync );
+		if(self->failed) {
+			throw io_timeout();
+		}
+		return Void();
+	}
+
+	virtual Future<Void> sync() {
+		++countFileLogicalWrites;
+		++countLogicalWrites;
+
+		if(failed) {
+			return io_timeout();
+		}
+
+		// Unlike KAIO, the ring does fdatasync asynchronously in the kernel, so there is no need for a thread pool
+		IOBlock *io = new IOBlock(IOBlock::SYNC, fd);
+		enqueue(io, this);
+		Future<Void> fsync = throwErrorIfFailed(Reference<AsyncFileIOUring>::addRef(this), success(io->result.getFuture()));
+
+		if (flags & OPEN_ATOMIC_WRITE_AND_CREATE) {
+			flags &= ~OPEN_ATOMIC_WRITE_AND_CREATE;
+
+			return AsyncFileEIO::waitAndAtomicRename( fsync, filename+".part", filename );
+		}
+
+		return fsync;
+	}
+	virtual Future<int64_t> size() { return nextFileSize; }
+	virtual int64_t debugFD() {
+		return fd;
+	}
+	virtual std::string getFilename() {
+		return filename;
+	}
+	~AsyncFileIOUring() {
+		close(fd);
+	}
+
+	// Moves as many queued I/Os as the queue depth allows into the submission ring, and submits everything in it with one system call
+	static void launch() {
+		if ((ctx.queue.size() && ctx.outstanding < ctx.depth) || ctx.unsubmitted) {
+			ctx.submitMetric = true;
+
+			double begin = timer_monotonic();
+			if (!ctx.outstanding) ctx.ioStallBegin = begin;
+
+			uint32_t tail = *ctx.sqTail;
+			uint32_t head = __atomic_load_n( ctx.sqHead, __ATOMIC_ACQUIRE );
+			int n = std::min<int64_t>( std::min<int64_t>( ctx.depth - ctx.outstanding, ctx.queue.size() ), ctx.sqEntries - (tail - head) );
+
+			for(int i=0; i<n; i++) {
+				IOBlock* io = ctx.queue.top();
+				ctx.queue.pop();
+				io->startTime = now();
+
+				if(ctx.ioTimeout > 0) {
+					ctx.appendToRequestList(io);
+				}
+
+				if (io->owner->lastFileSize != io->owner->nextFileSize) {
+					ASSERT(io->owner->nextFileSize > io->owner->lastFileSize);
+					io->owner->truncate(io->owner->nextFileSize);
+				}
+
+				uint32_t index = tail & ctx.sqMask;
+				io->prepare( &ctx.sqes[index] );
+				ctx.sqArray[index] = index;
+				tail++;
+			}
+			__atomic_store_n( ctx.sqTail, tail, __ATOMIC_RELEASE );
+			ctx.outstanding += n;
+			ctx.unsubmitted += n;
+
+			int rc;
+			loop {
+				rc = io_uring_enter( ctx.ringfd, ctx.unsubmitted, 0, 0 );
+				if (rc>=0 || errno!=EINTR) break;
+			}
+			if (rc<0) {
+				// The entries stay in the submission ring, so they are submitted on the next cycle
+				if (errno != EAGAIN && errno != EBUSY) {
+					TraceEvent(SevError, "IOUringSubmitError").detail("Unsubmitted", ctx.unsubmitted).GetLastError();
+					throw io_error();
+				}
+			} else {
+				ctx.unsubmitted -= rc;
+			}
+
+			ctx.submitMetric = false;
+			++ctx.countSubmit;
+
+			double elapsed = timer_monotonic() - begin;
+			g_network->networkMetrics.secSquaredSubmit += elapsed*elapsed/2;
+		}
+	}
+
+	bool failed;
+private:
+	int fd, flags;
+	int64_t lastFileSize, nextFileSize;
+	std::string filename;
+	Int64MetricHandle countFileLogicalWrites;
+	Int64MetricHandle countFileLogicalReads;
+
+	Int64MetricHandle countLogicalWrites;
+	Int64MetricHandle countLogicalReads;
+
+	struct IOBlock : AsyncFileIORequest<IOBlock, AsyncFileIOUring>, FastAllocated<IOBlock> {
+		enum EOperation { READ = 1, WRITE = 2, SYNC = 3 };
+		int op;
+		int fd;
+		void* buf;
+		int64_t nbytes;
+		int64_t offset;
+		iovec iov;
+
+		IOBlock(int op, int fd) : op(op), fd(fd), buf(NULL), nbytes(0), offset(0) {}
+
+		void prepare( linux_io_uring_sqe* sqe ) {
+			memset(sqe, 0, sizeof(linux_io_uring_sqe));
+			sqe->fd = fd;
+			sqe->user_data = (uint64_t)this;
+			if (op == SYNC) {
+				sqe->opcode = LINUX_IORING_OP_FSYNC;
+				sqe->op_flags = LINUX_IORING_FSYNC_DATASYNC;
+				return;
+			}
+			iov.iov_base = buf;
+			iov.iov_len = nbytes;
+			sqe->opcode = op == READ ? LINUX_IORING_OP_READV : LINUX_IORING_OP_WRITEV;
+			sqe->off = offset;
+			sqe->addr = (uint64_t)&iov;
+			sqe->len = 1;
+		}
+
+		void setResult( int r ) {
+			if (r<0) {
+				struct stat fst;
+				fstat( fd, &fst );
+
+				errno = -r;
+				TraceEvent("AsyncFileIOUringIOError").GetLastError().detail("fd", fd).detail("op", op).detail("nbytes", nbytes).detail("offset", offset).detail("ptr", int64_t(buf))
+					.detail("Size", fst.st_size).detail("filename", owner->filename);
+			}
+			deliver( r );
+			delete this;
+		}
+
+		void timeout(bool warnOnly) {
+			TraceEvent(SevWarnAlways, "AsyncFileIOUringTimeout").detail("fd", fd).detail("op", op).detail("nbytes", nbytes).detail("offset", offset).detail("ptr", int64_t(buf))
+				.detail("filename", owner->filename);
+			g_network->setGlobal(INetwork::enASIOTimedOut, (flowGlobalType)true);
+
+			if(!warnOnly)
+				owner->failed = true;
+		}
+	};
+
+	struct Context : AsyncFileIOQueue<IOBlock> {
+		int ringfd;
+		int evfd;
+		uint32_t *sqHead, *sqTail, *sqArray;
+		uint32_t sqMask, sqEntries;
+		linux_io_uring_sqe* sqes;
+		uint32_t *cqHead, *cqTail;
+		uint32_t cqMask;
+		linux_io_uring_cqe* cqes;
+
+		int depth;
+		int unsubmitted;  // I/Os in the submission ring that the kernel has not consumed; outstanding also counts them
+
+		Int64MetricHandle countSubmit;
+		Int64MetricHandle countCollect;
+		Int64MetricHandle submitMetric;
+
+		Context() : ringfd(-1), evfd(-1), depth(0), unsubmitted(0) {}
+	};
+	static Context ctx;
+
+	explicit AsyncFileIOUring(int fd, int flags, std::string const& filename) : fd(fd), flags(flags), filename(filename), failed(false) {
+		if( !g_network->isSimulated() ) {
+			countFileLogicalWrites.init(LiteralStringRef("AsyncFile.CountFileLogicalWrites"), filename);
+			countFileLogicalReads.init( LiteralStringRef("AsyncFile.CountFileLogicalReads"), filename);
+			countLogicalWrites.init(LiteralStringRef("AsyncFile.CountLogicalWrites"));
+			countLogicalReads.init( LiteralStringRef("AsyncFile.CountLogicalReads"));
+		}
+	}
+
+	void enqueue( IOBlock* io, AsyncFileIOUring* owner ) {
+		ASSERT( io->op == IOBlock::SYNC || (int64_t(io->buf) % 4096 == 0 && io->offset % 4096 == 0 && io->nbytes % 4096 == 0) );
+
+		io->owner = Reference<AsyncFileIOUring>::addRef(owner);
+
+		ctx.push(io);
+	}
+
+	// Delivers the completed I/Os; called by AsyncFileIOBackends when the eventfd is signalled
+	static void collect() {
+		uint32_t head = *ctx.cqHead;
+		uint32_t tail = __atomic_load_n( ctx.cqTail, __ATOMIC_ACQUIRE );
+		int n = tail - head;
+
+		++ctx.countCollect;
+		ctx.collected(n);
+
+		for(; head != tail; head++) {
+			linux_io_uring_cqe* cqe = &ctx.cqes[head & ctx.cqMask];
+			IOBlock* iob = (IOBlock*)cqe->user_data;
+			int res = cqe->res;
+
+			if(ctx.ioTimeout > 0) {
+				ctx.removeFromRequestList(iob);
+			}
+
+			iob->setResult( res );
+		}
+		__atomic_store_n( ctx.cqHead, head, __ATOMIC_RELEASE );
+	}
+};
+
+TEST_CASE("fdbrpc/AsyncFileIOUring/ReadWrite") {
+	// Simulation doesn't support AsyncFileIOUring.  Otherwise the test runs whenever the kernel supports io_uring (5.1 and later), bringing
+	// a ring up next to KAIO if the process didn't choose io_uring for its files.
+	if(!g_network->isSimulated() && (AsyncFileIOUring::isInitialized() ||
+			AsyncFileIOUring::init( Reference<IEventFD>::addRef( (IEventFD*)g_network->global(INetwork::enEventFD) ), 0 ))) {
+		state Reference<IAsyncFile> f = wait(AsyncFileIOUring::open("/tmp/__IOURING_TEST_FILE__", IAsyncFile::OPEN_UNBUFFERED | IAsyncFile::OPEN_READWRITE | IAsyncFile::OPEN_CREATE, 0666, nullptr));
+		state int pages = 64;
+		state uint8_t* buf = (uint8_t*)aligned_alloc(4096, pages*4096);
+		state uint8_t* readBuf = (uint8_t*)aligned_alloc(4096, pages*4096);
+		state int i;
+		try {
+			for(i = 0; i < pages*4096; i++)
+				buf[i] = g_random->randomInt(0, 256);
+
+			// Issue the writes together so that they are submitted in one batch
+			state std::vector<Future<Void>> writes;
+			for(i = 0; i < pages; i++)
+				writes.push_back(f->write(buf + i*4096, 4096, i*4096));
+			Void _ = wait(waitForAll(writes));
+			Void _ = wait(f->sync());
+
+			int bytesRead = wait(f->read(readBuf, pages*4096, 0));
+			ASSERT(bytesRead == pages*4096 && !memcmp(buf, readBuf, pages*4096));
+		}
+		catch(Error &e) {
+			state Error err = e;
+			Void _ = wait(AsyncFileEIO::deleteFile(f->getFilename(), true));
+			throw err;
+		}
+
+		aligned_free(buf);
+		aligned_free(readBuf);
+		Void _ = wait(AsyncFileEIO::deleteFile(f->getFilename(), true));
+	}
+
+	return Void();
+}
+
+AsyncFileIOUring::Context AsyncFileIOUring::ctx;
+
+#endif
+#endif
@@ -34,6 +34,7 @@
 #include <sys/eventfd.h>
 #include <sys/syscall.h>
 #include "fdbrpc/linux_kaio.h"
+#include "fdbrpc/AsyncFileIOQueue.actor.h"
 #include "flow/Knobs.h"
 #include "flow/UnitTest.h"
 #include <stdio.h>
@@ -107,13 +108,13 @@ public:
 			open_filename = filename + ".part";
 		}
 
-		int fd = ::open( open_filename.c_str(), openFlags(flags) | O_DIRECT, mode );
+		int fd = ::open( open_filename.c_str(), asyncFileIOOpenFlags(flags) | O_DIRECT, mode );
 		if (fd<0) {
 			Error e = errno==ENOENT ? file_not_found() : io_error();
 			int ecode = errno;  // Save errno in case it is modified before it is used below
 			TraceEvent ev("AsyncFileKAIOOpenFailed");
 			ev.detail("Filename", filename).detailf("Flags", "%x", flags)
-			  .detailf("OSFlags", "%x", openFlags(flags) | O_DIRECT).detailf("mode", "0%o", mode).error(e).GetLastError();
+			  .detailf("OSFlags", "%x", asyncFileIOOpenFlags(flags) | O_DIRECT).detailf("mode", "0%o", mode).error(e).GetLastError();
 			if(ecode == EINVAL)
 				ev.detail("Description", "Invalid argument - Does the target filesystem support KAIO?");
 			return e;
@@ -168,9 +169,7 @@ public:
 		}
 		setTimeout(ioTimeout);
 		ctx.evfd = ev->getFD();
-		poll(ev);
-
-		g_network->setGlobal(INetwork::enRunCycleFunc, (flowGlobalType) &AsyncFileKAIO::launch);
+		AsyncFileIOBackends::add( ev, &AsyncFileKAIO::launch, &AsyncFileKAIO::collect );
 	}
 
 	static int get_eventfd() { return ctx.evfd; }
@@ -441,20 +440,12 @@ private:
 	Int64MetricHandle countLogicalWrites;
 	Int64MetricHandle countLogicalReads;
 
-	struct IOBlock : linux_iocb, FastAllocated<IOBlock> {
-		Promise<int> result;
-		Reference<AsyncFileKAIO> owner;
-		int64_t prio;
-		IOBlock *prev;
-		IOBlock *next;
-		double startTime;
+	struct IOBlock : linux_iocb, AsyncFileIORequest<IOBlock, AsyncFileKAIO>, FastAllocated<IOBlock> {
 #if KAIO_LOGGING
 		int32_t iolog_id;
 #endif
 
-		struct indirect_order_by_priority { bool operator () ( IOBlock* a, IOBlock* b ) { return a->prio < b->prio; } };
-
-		IOBlock(int op, int fd) : prev(nullptr), next(nullptr), startTime(0) {
+		IOBlock(int op, int fd) {
 			memset((linux_iocb*)this, 0, sizeof(linux_iocb));
 			aio_lio_opcode = op;
 			aio_fildes = fd;
@@ -463,15 +454,6 @@ private:
 #endif
 		}
 
-		int getTask() const { return (prio>>32)+1; }
-
-		ACTOR static void deliver( Promise<int> result, bool failed, int r, int task ) {
-			Void _ = wait( delay(0, task) );
-			if (failed) result.sendError(io_timeout());
-			else if (r < 0) result.sendError(io_error());
-			else result.send(r);
-		}
-
 		void setResult( int r ) {
 			if (r<0) {
 				struct stat fst;
@@ -481,7 +463,7 @@ private:
 				TraceEvent("AsyncFileKAIOIOError").GetLastError().detail("fd", aio_fildes).detail("op", aio_lio_opcode).detail("nbytes", nbytes).detail("offset", offset).detail("ptr", int64_t(buf))
 					.detail("Size", fst.st_size).detail("filename", owner->filename);
 			}
-			deliver( result, owner->failed, r, getTask() );
+			deliver( r );
 			delete this;
 		}
 
@@ -495,76 +477,19 @@ private:
 		}
 	};
 
-	struct Context {
+	struct Context : AsyncFileIOQueue<IOBlock> {
 		io_context_t iocx;
 		int evfd;
-		int outstanding;
-		double ioStallBegin;
-		bool fallocateSupported;
-		bool fallocateZeroSupported;
-		std::priority_queue<IOBlock*, std::vector<IOBlock*>, IOBlock::indirect_order_by_priority> queue;
 		Int64MetricHandle countAIOSubmit;
 		Int64MetricHandle countAIOCollect;
 		Int64MetricHandle submitMetric;
-		
-		double ioTimeout;
-		bool timeoutWarnOnly;
-		IOBlock *submittedRequestList;
 
 		Int64MetricHandle countPreSubmitTruncate;
 		Int64MetricHandle preSubmitTruncateBytes;
 
 		EventMetricHandle<SlowAioSubmit> slowAioSubmitMetric;
 
-		uint32_t opsIssued;
-		Context() : iocx(0), evfd(-1), outstanding(0), opsIssued(0), ioStallBegin(0), fallocateSupported(true), fallocateZeroSupported(true), submittedRequestList(nullptr) {
-			setIOTimeout(0);
-		}
-
-		void setIOTimeout(double timeout) {
-			ioTimeout = fabs(timeout);
-			timeoutWarnOnly = timeout < 0;
-		}
-
-		void appendToRequestList(IOBlock *io) {
-			ASSERT(!io->next && !io->prev);
-
-			if(submittedRequestList) {
-				io->prev = submittedRequestList->prev;
-				io->prev->next = io;
-
-				submittedRequestList->prev = io;
-				io->next = submittedRequestList;
-			}
-			else {
-				submittedRequestList = io;
-				io->next = io->prev = io;
-			}
-		}
-
-		void removeFromRequestList(IOBlock *io) {
-			if(io->next == nullptr) {
-				ASSERT(io->prev == nullptr);
-				return;
-			}
-
-			ASSERT(io->prev != nullptr);
-
-			if(io == io->next) {
-				ASSERT(io == submittedRequestList && io == io->prev);
-				submittedRequestList = nullptr;
-			}
-			else {
-				io->next->prev = io->prev;
-				io->prev->next = io->next;
-
-				if(submittedRequestList == io) {
-					submittedRequestList = io->next;
-				}
-			}
-
-			io->next = io->prev = nullptr;
-		}
+		Context() : iocx(0), evfd(-1) {}
 	};
 	static Context ctx;
 
@@ -618,75 +543,42 @@ private:
 
 		io->flags |= 1;
 		io->eventfd = ctx.evfd;
-		io->prio = (int64_t(g_network->getCurrentTask())<<32) - (++ctx.opsIssued);
-		//io->prio = - (++ctx.opsIssued);
 		io->owner = Reference<AsyncFileKAIO>::addRef(owner);
 
-		ctx.queue.push(io);
-	}
-
-	static int openFlags(int flags) {
-		int oflags = 0;
-		ASSERT( bool(flags & OPEN_READONLY) != bool(flags & OPEN_READWRITE) );  // readonly xor readwrite
-		if( flags & OPEN_EXCLUSIVE ) oflags |= O_EXCL;
-		if( flags & OPEN_CREATE )    oflags |= O_CREAT;
-		if( flags & OPEN_READONLY )  oflags |= O_RDONLY;
-		if( flags & OPEN_READWRITE ) oflags |= O_RDWR;
-		if( flags & OPEN_ATOMIC_WRITE_AND_CREATE ) oflags |= O_TRUNC;
-		return oflags;
+		ctx.push(io);
 	}
 
-	ACTOR static void poll( Reference<IEventFD> ev ) {
-		loop {
-			int64_t evfd_count = wait( ev->read() );
+	// Delivers the completed I/Os; called by AsyncFileIOBackends when the eventfd is signalled
+	static void collect() {
+		linux_ioresult ev[FLOW_KNOBS->MAX_OUTSTANDING];
+		timespec tm; tm.tv_sec = 0; tm.tv_nsec = 0;
 
-			Void _ = wait(delay(0, TaskDiskIOComplete));
+		int n;
 
-			linux_ioresult ev[FLOW_KNOBS->MAX_OUTSTANDING];
-			timespec tm; tm.tv_sec = 0; tm.tv_nsec = 0;
-
-			int n;
+		while (true) {
+			n = io_getevents( ctx.iocx, 0, FLOW_KNOBS->MAX_OUTSTANDING, ev, &tm );
+			if (n>=0 || errno!=EINTR) break;
+		}
 
-			loop {
-				n = io_getevents( ctx.iocx, 0, FLOW_KNOBS->MAX_OUTSTANDING, ev, &tm );
-				if (n>=0 || errno!=EINTR) break;
-			}
+		++ctx.countAIOCollect;
+		// printf("io_getevents: collected %d/%d in %f us (%d queued)\n", n, ctx.outstanding, (timer()-before)*1e6, ctx.queue.size());
+		if (n<0) {
+			// printf("io_getevents failed: %d\n", errno);
+			TraceEvent("IOGetEventsError").GetLastError();
+			throw io_error();
+		}
+		ctx.collected(n);
 
-			++ctx.countAIOCollect;
-			// printf("io_getevents: collected %d/%d in %f us (%d queued)\n", n, ctx.outstanding, (timer()-before)*1e6, ctx.queue.size());
-			if (n<0) {
-				// printf("io_getevents failed: %d\n", errno);
-				TraceEvent("IOGetEventsError").GetLastError();
-				throw io_error();
-			}
-			if (n) {
-				double t = timer_monotonic();
-				double elapsed = t - ctx.ioStallBegin;
-				ctx.ioStallBegin = t;
-				g_network->networkMetrics.secSquaredDiskStall += elapsed*elapsed/2;
-			}
+		for(int i=0; i<n; i++) {
+			IOBlock* iob = static_cast<IOBlock*>(ev[i].iocb);
 
-			ctx.outstanding -= n;
+			KAIOLogBlockEvent(iob, OpLogEntry::COMPLETE, ev[i].result);
 
 			if(ctx.ioTimeout > 0) {
-				double currentTime = now();
-				while(ctx.submittedRequestList && currentTime - ctx.submittedRequestList->startTime > ctx.ioTimeout) {
-					ctx.submittedRequestList->timeout(ctx.timeoutWarnOnly);
-					ctx.removeFromRequestList(ctx.submittedRequestList);
-				}
+				ctx.removeFromRequestList(iob);
 			}
 
-			for(int i=0; i<n; i++) {
-				IOBlock* iob = static_cast<IOBlock*>(ev[i].iocb);
-
-				KAIOLogBlockEvent(iob, OpLogEntry::COMPLETE, ev[i].result);
-
-				if(ctx.ioTimeout > 0) {
-					ctx.removeFromRequestList(iob);
-				}
-
-				iob->setResult( ev[i].result );
-			}
+			iob->setResult( ev[i].result );
 		}
 	}
 };
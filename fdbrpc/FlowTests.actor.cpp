@@ -1023,6 +1023,49 @@ TEST_CASE("flow/flow/perf/actor patterns")
 	return Void();
 }
 
+ACTOR static Future<Void> delayZeroLoop( int n, int taskID, int64_t* count ) {
+	state int i;
+	for(i = 0; i < n; i++) {
+		Void _ = wait( delay(0, taskID) );
+		++*count;
+	}
+	return Void();
+}
+
+ACTOR static Future<Void> randomDelayLoop( double maxDelay, double until, int64_t* count ) {
+	loop {
+		Void _ = wait( delay( g_random->random01() * maxDelay ) );
+		++*count;
+		if (now() >= until)
+			return Void();
+	}
+}
+
+// Measures the run loop itself: how many ready tasks it dispatches per second, and how many delays it can fire
+TEST_CASE("flow/perf/run loop")
+{
+	state int64_t tasks = 0;
+	state int64_t timers = 0;
+	state std::vector<Future<Void>> actors;
+	state double start = timer();
+	state int i;
+
+	static const int taskIDs[] = { TaskDefaultDelay, TaskDefaultEndpoint, TaskDiskRead, TaskUpdateStorage };
+	for(i = 0; i < 1000; i++)
+		actors.push_back( delayZeroLoop( 1000, taskIDs[i%4], &tasks ) );
+	Void _ = wait( waitForAll(actors) );
+	printf("delay(0) tasks: %0.2f M/sec\n", tasks / 1e6 / (timer() - start));
+
+	actors.clear();
+	start = timer();
+	for(i = 0; i < 10000; i++)
+		actors.push_back( randomDelayLoop( 0.01, now() + 2.0, &timers ) );
+	Void _ = wait( waitForAll(actors) );
+	printf("delay(<10ms) timers: %0.2f M/sec\n", timers / 1e6 / (timer() - start));
+
+	return Void();
+}
+
 template <class YAM>
 struct YAMRandom {
 	YAM yam;
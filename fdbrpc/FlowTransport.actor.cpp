@@ -24,9 +24,12 @@
 #include "flow/Net2Packet.h"
 #include "flow/ActorCollection.h"
 #include "flow/TDMetric.actor.h"
+#include "flow/UnitTest.h"
 #include "FailureMonitor.h"
 #include "crc32c.h"
+#include "Smoother.h"
 #include "simulator.h"
+#include "zlib/zlib.h"
 
 #if VALGRIND
 #include <memcheck.h>
@@ -137,6 +140,141 @@ struct PingReceiver : NetworkMessageReceiver {
 	}
 };
 
+// Packets to peers at or after this protocol version may be compressed.  A compressed packet has COMPRESSED_PACKET_FLAG
+// set in its length, and its data is a PacketCompressor header followed by the compressed bytes; the checksum covers
+// the data as sent.
+#define PACKET_COMPRESSION_PROTOCOL_VERSION 0x0FDB00A560020001LL
+const uint32_t COMPRESSED_PACKET_FLAG = 0x80000000;
+
+class PacketCompressor : NonCopyable {
+public:
+	enum Algorithm { ZLIB = 1 };  // Raw deflate; the packet checksum makes zlib's own checksum redundant
+	enum { HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t) };  // algorithm, then uncompressed length
+	enum { MAX_RETAINED_OUTPUT = 256<<10 };  // Scratch space for compressing larger packets is freed after each one
+
+	PacketCompressor() : deflaterReady(false), inflaterReady(false) {}
+	~PacketCompressor() {
+		if (deflaterReady) deflateEnd(&deflater);
+		if (inflaterReady) inflateEnd(&inflater);
+	}
+
+	// Compresses in place the len bytes of packet data that begin at offset begin of first and continue through its
+	// successors.  Returns the length of the compressed data, including the header, and sets last to the last
+	// PacketBuffer still in use, releasing any after it.  Returns 0 and changes nothing if compression would not save at
+	// least PACKET_COMPRESSION_MIN_SAVINGS of the packet.
+	int compress( PacketBuffer* first, int begin, int len, PacketBuffer*& last ) {
+		int compressedLen = deflatePacket( first, begin, len, last );
+		if (output.size() > MAX_RETAINED_OUTPUT)
+			std::vector<uint8_t>().swap(output);
+		return compressedLen;
+	}
+
+	// Decompresses the len bytes of compressed packet data at p into arena.  Returns false if the data is not valid.
+	bool decompress( Arena& arena, const uint8_t* p, int len, StringRef& result ) {
+		if (len < HEADER_SIZE || p[0] != ZLIB)
+			return false;
+		uint32_t uncompressedLength;
+		memcpy(&uncompressedLength, p + 1, sizeof(uncompressedLength));
+		if (uncompressedLength > FLOW_KNOBS->PACKET_LIMIT)
+			return false;
+
+		if (!inflaterReady) {
+			memset(&inflater, 0, sizeof(inflater));
+			if (inflateInit2(&inflater, -MAX_WBITS) != Z_OK)
+				return false;
+			inflaterReady = true;
+		} else {
+			inflateReset(&inflater);
+		}
+
+		uint8_t* data = new (arena) uint8_t[uncompressedLength];
+		inflater.next_in = (Bytef*)p + HEADER_SIZE;
+		inflater.avail_in = len - HEADER_SIZE;
+		inflater.next_out = data;
+		inflater.avail_out = uncompressedLength;
+		if (inflate(&inflater, Z_FINISH) != Z_STREAM_END || inflater.total_out != uncompressedLength || inflater.avail_in)
+			return false;
+		result = StringRef(data, uncompressedLength);
+		return true;
+	}
+
+private:
+	z_stream deflater, inflater;
+	bool deflaterReady, inflaterReady;
+	std::vector<uint8_t> output;
+
+	int deflatePacket( PacketBuffer* first, int begin, int len, PacketBuffer*& last ) {
+		int limit = len - int(len * FLOW_KNOBS->PACKET_COMPRESSION_MIN_SAVINGS) - HEADER_SIZE;
+		if (limit <= 0)
+			return 0;
+
+		if (!deflaterReady) {
+			memset(&deflater, 0, sizeof(deflater));
+			if (deflateInit2(&deflater, FLOW_KNOBS->PACKET_COMPRESSION_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+				return 0;
+			deflaterReady = true;
+		} else {
+			deflateReset(&deflater);
+		}
+
+		if (output.size() < limit)
+			output.resize(limit);
+		deflater.next_out = &output[0];
+		deflater.avail_out = limit;
+
+		PacketBuffer* b = first;
+		int offset = begin, remaining = len, r = Z_OK;
+		while (remaining) {
+			int n = std::min(remaining, b->bytes_written - offset);
+			deflater.next_in = b->data + offset;
+			deflater.avail_in = n;
+			remaining -= n;
+			r = deflate(&deflater, remaining ? Z_NO_FLUSH : Z_FINISH);
+			if (r == Z_STREAM_ERROR || deflater.avail_in)
+				return 0;  // Out of output space
+			b = b->nextPacketBuffer();
+			offset = 0;
+		}
+		if (r != Z_STREAM_END)
+			return 0;
+
+		uint8_t header[HEADER_SIZE];
+		header[0] = ZLIB;
+		uint32_t uncompressedLength = len;
+		memcpy(header + 1, &uncompressedLength, sizeof(uncompressedLength));
+
+		b = first;
+		offset = begin;
+		write(b, offset, header, HEADER_SIZE);
+		write(b, offset, &output[0], deflater.total_out);
+
+		b->bytes_written = offset;
+		PacketBuffer* unused = b->nextPacketBuffer();
+		b->next = 0;
+		while (unused) {
+			PacketBuffer* n = unused->nextPacketBuffer();
+			unused->delref();
+			unused = n;
+		}
+		last = b;
+		return HEADER_SIZE + deflater.total_out;
+	}
+
+	static void write( PacketBuffer*& b, int& offset, const uint8_t* data, int len ) {
+		while (len) {
+			if (offset == PacketBuffer::DATA_SIZE) {
+				b = b->nextPacketBuffer();
+				offset = 0;
+			}
+			int n = std::min(len, PacketBuffer::DATA_SIZE - offset);
+			memcpy(b->data + offset, data, n);
+			offset += n;
+			data += n;
+			len -= n;
+		}
+	}
+};
+
 class TransportData {
 public:
 	TransportData(uint64_t transportId) 
@@ -155,6 +293,14 @@ public:
 		countConnEstablished.init(LiteralStringRef("Net2.CountConnEstablished"));
 		countConnClosedWithError.init(LiteralStringRef("Net2.CountConnClosedWithError"));
 		countConnClosedWithoutError.init(LiteralStringRef("Net2.CountConnClosedWithoutError"));
+		countWriteBatches.init(LiteralStringRef("Net2.CountWriteBatches"));
+		countWriteBatchesFull.init(LiteralStringRef("Net2.CountWriteBatchesFull"));
+		countPacketsCompressed.init(LiteralStringRef("Net2.CountPacketsCompressed"));
+		countPacketsIncompressible.init(LiteralStringRef("Net2.CountPacketsIncompressible"));
+		countPacketsDecompressed.init(LiteralStringRef("Net2.CountPacketsDecompressed"));
+		bytesSavedByCompression.init(LiteralStringRef("Net2.BytesSavedByCompression"));
+		compressionMicroseconds.init(LiteralStringRef("Net2.CompressionMicroseconds"));
+		decompressionMicroseconds.init(LiteralStringRef("Net2.DecompressionMicroseconds"));
 	}
 
 	struct Peer* getPeer( NetworkAddress const& address, bool doConnect = true );
@@ -176,6 +322,16 @@ public:
 	Int64MetricHandle countConnEstablished;
 	Int64MetricHandle countConnClosedWithError;
 	Int64MetricHandle countConnClosedWithoutError;
+	Int64MetricHandle countWriteBatches;
+	Int64MetricHandle countWriteBatchesFull;
+	Int64MetricHandle countPacketsCompressed;
+	Int64MetricHandle countPacketsIncompressible;  // Packets that were large enough to compress but didn't compress well
+	Int64MetricHandle countPacketsDecompressed;
+	Int64MetricHandle bytesSavedByCompression;
+	Int64MetricHandle compressionMicroseconds;
+	Int64MetricHandle decompressionMicroseconds;
+
+	PacketCompressor compressor;
 
 	std::map<NetworkAddress, std::pair<uint64_t, double>> incompatiblePeers;
 	uint32_t numIncompatibleConnections;
@@ -222,6 +378,12 @@ struct Peer : NonCopyable {
 	UnsentPacketQueue unsent;
 	ReliablePacketList reliable;
 	AsyncTrigger dataToSend;  // Triggered when unsent.empty() becomes false
+	AsyncTrigger unsentFull;  // Triggered when unsentBytes reaches COALESCE_MAX_BYTES
+	int64_t unsentBytes;      // Approximately the number of bytes in unsent
+	Smoother packetRate;      // Packets sent to this peer per second, updated once per write
+	int64_t packetsSinceRateUpdate;  // Packets sent since packetRate was last updated
+	double pingRTT;           // Smoothed round trip time of connectionMonitor's pings, or 0 if there hasn't been one yet
+	uint64_t protocolVersion; // The protocol version of the peer on the current connection, or 0 if it isn't known yet
 	Future<Void> connect;
 	AsyncTrigger incompatibleDataRead;
 	bool compatible;
@@ -230,17 +392,41 @@ struct Peer : NonCopyable {
 	double reconnectionDelay;
 
 	explicit Peer( TransportData* transport, NetworkAddress const& destination, bool doConnect = true ) 
-		: transport(transport), destination(destination), outgoingConnectionIdle(!doConnect), lastConnectTime(0.0), reconnectionDelay(FLOW_KNOBS->INITIAL_RECONNECTION_TIME), compatible(true)
+		: transport(transport), destination(destination), outgoingConnectionIdle(!doConnect), lastConnectTime(0.0), reconnectionDelay(FLOW_KNOBS->INITIAL_RECONNECTION_TIME), compatible(true),
+		  unsentBytes(0), packetRate(FLOW_KNOBS->COALESCE_RATE_FOLDING_TIME), packetsSinceRateUpdate(0), pingRTT(0), protocolVersion(0)
 	{
 		if(doConnect) {
 			connect = connectionKeeper(this);
 		}
 	}
 
-	void send(PacketBuffer* pb, ReliablePacket* rp, bool firstUnsent) {
+	void send(PacketBuffer* pb, ReliablePacket* rp, bool firstUnsent, int bytes) {
 		unsent.setWriteBuffer(pb);
 		if (rp) reliable.insert(rp);
+		packetsSinceRateUpdate++;
+		unsentBytes += bytes;
 		if (firstUnsent) dataToSend.trigger();
+		else if (unsentBytes >= FLOW_KNOBS->COALESCE_MAX_BYTES && unsentBytes - bytes < FLOW_KNOBS->COALESCE_MAX_BYTES) unsentFull.trigger();
+	}
+
+	// How long connectionWriter should wait after a write for more packets to coalesce into the next one.  When packets
+	// are sparse, waiting longer than MIN_COALESCE_DELAY would only add latency.  When they arrive quickly enough for a
+	// wait to gather several, wait for about COALESCE_TARGET_PACKETS of them, but no longer than a small fraction of the
+	// round trip time that they will see anyway.  On a LAN that fraction is below MAX_COALESCE_DELAY, which remains the
+	// limit; over longer links the wait grows with the RTT, up to MAX_ADAPTIVE_COALESCE_DELAY.
+	double coalesceDelay() {
+		if (!FLOW_KNOBS->COALESCE_ADAPTIVE)
+			return FLOW_KNOBS->MAX_COALESCE_DELAY;
+
+		double maxDelay = FLOW_KNOBS->MAX_COALESCE_DELAY;
+		if (pingRTT > 0)
+			maxDelay = std::min(FLOW_KNOBS->MAX_ADAPTIVE_COALESCE_DELAY, std::max(maxDelay, pingRTT * FLOW_KNOBS->COALESCE_RTT_FRACTION));
+		packetRate.addDelta(packetsSinceRateUpdate);
+		packetsSinceRateUpdate = 0;
+		double rate = packetRate.smoothRate();
+		if (rate * maxDelay < 1)
+			return FLOW_KNOBS->MIN_COALESCE_DELAY;
+		return std::max(FLOW_KNOBS->MIN_COALESCE_DELAY, std::min(maxDelay, FLOW_KNOBS->COALESCE_TARGET_PACKETS / rate));
 	}
 
 	void prependConnectPacket() {
@@ -267,6 +453,7 @@ struct Peer : NonCopyable {
 	void discardUnreliablePackets() {
 		// Throw away the current unsent list, dropping the reference count on each PacketBuffer that accounts for presence in the unsent list
 		unsent.discardAll();
+		unsentBytes = 0;
 
 		// Compact reliable packets into a new unsent range
 		PacketBuffer* pb = unsent.getWriteBuffer();
@@ -312,11 +499,15 @@ struct Peer : NonCopyable {
 			// SOMEDAY: Stop monitoring and close the connection after a long period of inactivity with no reliable or onDisconnect requests outstanding
 
 			state ReplyPromise<Void> reply;
+			state double pingStart = now();
 			FlowTransport::transport().sendUnreliable( SerializeSource<ReplyPromise<Void>>(reply), remotePing.getEndpoint() );
 
 			choose {
 				when (Void _ = wait( delay( FLOW_KNOBS->CONNECTION_MONITOR_TIMEOUT ) )) { TraceEvent("ConnectionTimeout").detail("WithAddr", peer->destination); throw connection_failed(); }
-				when (Void _ = wait( reply.getFuture() )) {}
+				when (Void _ = wait( reply.getFuture() )) {
+					double rtt = now() - pingStart;
+					peer->pingRTT = peer->pingRTT > 0 ? 0.8 * peer->pingRTT + 0.2 * rtt : rtt;
+				}
 				when (Void _ = wait( peer->incompatibleDataRead.onTrigger())) {}
 			}
 		}
@@ -325,10 +516,20 @@ struct Peer : NonCopyable {
 	ACTOR static Future<Void> connectionWriter( Peer* self, Reference<IConnection> conn ) {
 		state double lastWriteTime = now();
 		loop {
-			//Void _ = wait( delay(0, TaskWriteSocket) );
-			Void _ = wait( delayJittered(std::max<double>(FLOW_KNOBS->MIN_COALESCE_DELAY, FLOW_KNOBS->MAX_COALESCE_DELAY - (now() - lastWriteTime)), TaskWriteSocket) );
-			//Void _ = wait( delay(500e-6, TaskWriteSocket) );
-			//Void _ = wait( yield(TaskWriteSocket) );
+			// Give other packets a chance to join this write, unless enough bytes are already waiting to fill one
+			state bool full = self->unsentBytes >= FLOW_KNOBS->COALESCE_MAX_BYTES;
+			if (!full) {
+				choose {
+					when( Void _ = wait( delayJittered(std::max<double>(FLOW_KNOBS->MIN_COALESCE_DELAY, self->coalesceDelay() - (now() - lastWriteTime)), TaskWriteSocket) ) ) {}
+					when( Void _ = wait( self->unsentFull.onTrigger() ) ) { full = true; }
+				}
+			}
+			if (full) {
+				TEST(true); // Stopped coalescing because enough bytes were queued
+				++self->transport->countWriteBatchesFull;
+				Void _ = wait( delay(0, TaskWriteSocket) );
+			}
+			++self->transport->countWriteBatches;
 
 			// Send until there is nothing left to send
 			loop {
@@ -339,7 +540,10 @@ struct Peer : NonCopyable {
 					self->transport->bytesSent += sent;
 					self->unsent.sent(sent);
 				}
-				if (self->unsent.empty()) break;
+				if (self->unsent.empty()) {
+					self->unsentBytes = 0;
+					break;
+				}
 
 				TEST(true); // We didn't write everything, so apparently the write buffer is full.  Wait for it to be nonfull.
 				Void _ = wait( conn->onWritable() );
@@ -405,6 +609,7 @@ struct Peer : NonCopyable {
 					self->reconnectionDelay = std::min(FLOW_KNOBS->MAX_RECONNECTION_TIME, self->reconnectionDelay * FLOW_KNOBS->RECONNECTION_TIME_GROWTH_RATE);
 				}
 				self->discardUnreliablePackets();
+				self->protocolVersion = 0;
 				reader = Future<Void>();
 				bool ok = e.code() == error_code_connection_failed || e.code() == error_code_actor_cancelled || ( g_network->isSimulated() && e.code() == error_code_checksum_failed );
 
@@ -470,6 +675,8 @@ static void scanPackets( TransportData* transport, uint8_t*& unprocessed_begin,
 		checksumEnabled = false;
 	}
 
+	bool compressionEnabled = peerProtocolVersion >= PACKET_COMPRESSION_PROTOCOL_VERSION;
+
 	loop {
 		uint32_t packetLen, packetChecksum;
 
@@ -483,13 +690,17 @@ static void scanPackets( TransportData* transport, uint8_t*& unprocessed_begin,
 			packetLen = *(uint32_t*)p; p += sizeof(uint32_t);
 		}
 
+		bool compressed = compressionEnabled && (packetLen & COMPRESSED_PACKET_FLAG);
+		if (compressed)
+			packetLen &= ~COMPRESSED_PACKET_FLAG;
+
 		if (packetLen > FLOW_KNOBS->PACKET_LIMIT) {
 			TraceEvent(SevError, "Net2_PacketLimitExceeded").detail("FromPeer", peerAddress.toString()).detail("Length", (int)packetLen);
 			throw platform_error();
 		}
 
 		if (e-p<packetLen) break;
-		ASSERT( packetLen >= sizeof(UID) );
+		ASSERT( compressed || packetLen >= sizeof(UID) );
 
 		if (checksumEnabled) {
 			bool isBuggifyEnabled = false;
@@ -531,15 +742,27 @@ static void scanPackets( TransportData* transport, uint8_t*& unprocessed_begin,
 #if VALGRIND
 		VALGRIND_CHECK_MEM_IS_DEFINED(p, packetLen);
 #endif
-		ArenaReader reader( arena, StringRef(p, packetLen), AssumeVersion(peerProtocolVersion) );
+		StringRef packet(p, packetLen);
+		if (compressed) {
+			TEST(true);  // Received a compressed packet
+			double start = timer();
+			if (!transport->compressor.decompress(arena, p, packetLen, packet)) {
+				TraceEvent(SevError, "Net2_DecompressionFailed").detail("FromPeer", peerAddress.toString()).detail("Length", (int)packetLen);
+				throw platform_error();
+			}
+			transport->decompressionMicroseconds += int64_t((timer() - start) * 1e6);
+			++transport->countPacketsDecompressed;
+		}
+
+		ArenaReader reader( arena, packet, AssumeVersion(peerProtocolVersion) );
 		UID token; reader >> token;
 
 		++transport->countPacketsReceived;
 
-		if (packetLen > FLOW_KNOBS->PACKET_WARNING) {
+		if (packet.size() > FLOW_KNOBS->PACKET_WARNING) {
 			TraceEvent(transport->warnAlwaysForLargePacket ? SevWarnAlways : SevWarn, "Net2_LargePacket")
 				.detail("FromPeer", peerAddress.toString())
-				.detail("Length", (int)packetLen)
+				.detail("Length", packet.size())
 				.detail("Token", token)
 				.suppressFor(1.0);
 
@@ -553,6 +776,19 @@ static void scanPackets( TransportData* transport, uint8_t*& unprocessed_begin,
 	}
 }
 
+// Returns the size, including its length and checksum, of the packet that begins at p if enough of it has arrived to tell,
+// or 0.  Leaves it to scanPackets() to reject invalid lengths.
+static int getPacketSize( TransportData* transport, NetworkAddress const& peerAddress, uint8_t* p, uint8_t* e ) {
+	int packetInfoSize = sizeof(uint32_t);
+	if (!transport->localAddress.isTLS() && !peerAddress.isTLS())
+		packetInfoSize += sizeof(uint32_t);
+
+	if (e-p < packetInfoSize) return 0;
+	uint32_t packetLen = *(uint32_t*)p & ~COMPRESSED_PACKET_FLAG;
+	if (packetLen > FLOW_KNOBS->PACKET_LIMIT) return 0;
+	return packetInfoSize + packetLen;
+}
+
 ACTOR static Future<Void> connectionReader(
 		TransportData* transport,
 		Reference<IConnection> conn, 
@@ -579,10 +815,19 @@ ACTOR static Future<Void> connectionReader(
 		loop {
 			loop {
 				int readAllBytes = buffer_end - unprocessed_end;
-				if (readAllBytes < 4096) {
+				if (readAllBytes < FLOW_KNOBS->MIN_PACKET_BUFFER_FREE_BYTES) {
 					Arena newArena;
 					int unproc_len = unprocessed_end - unprocessed_begin;
-					int len = std::max( 65536, unproc_len*2 );
+					int len = std::max( FLOW_KNOBS->MIN_PACKET_BUFFER_BYTES, unproc_len*2 );
+					if (!expectConnectPacket) {
+						// Make room for all of the packet that has begun to arrive, so that the rest of it is read into place
+						// rather than copied into ever larger buffers.  The length is only the peer's word, so a larger packet
+						// gets at most MAX_PACKET_BUFFER_PRESIZE_BYTES up front and the buffer keeps doubling as its bytes arrive.
+						int packetBytes = getPacketSize( transport, peerAddress, unprocessed_begin, unprocessed_end );
+						if (packetBytes)
+							len = std::max( FLOW_KNOBS->MIN_PACKET_BUFFER_BYTES,
+								std::min( packetBytes + FLOW_KNOBS->MIN_PACKET_BUFFER_FREE_BYTES, std::max( len, FLOW_KNOBS->MAX_PACKET_BUFFER_PRESIZE_BYTES ) ) );
+					}
 					uint8_t* newBuffer = new (newArena) uint8_t[ len ];
 					memcpy( newBuffer, unprocessed_begin, unproc_len );
 					arena = newArena;
@@ -657,6 +902,7 @@ ACTOR static Future<Void> connectionReader(
 							if (!compatible)
 								peer->transport->numIncompatibleConnections++;
 							ASSERT( p->canonicalRemotePort == peerAddress.port );
+							peer->protocolVersion = peerProtocolVersion;
 						} else {
 							if (p->canonicalRemotePort) {
 								peerAddress = NetworkAddress( p->canonicalRemoteIp, p->canonicalRemotePort, true, peerAddress.isTLS() );
@@ -667,6 +913,7 @@ ACTOR static Future<Void> connectionReader(
 								peer->transport->numIncompatibleConnections++;
 							onConnected.send( peer );
 							Void _ = wait( delay(0) );  // Check for cancellation
+							peer->protocolVersion = peerProtocolVersion;  // Now that peer has adopted this connection
 						}
 					}
 				}
@@ -876,15 +1123,37 @@ static PacketID sendPacket( TransportData* self, ISerializeSource const& what, c
 		what.serializePacketWriter(wr);
 		pb = wr.finish();
 		len = wr.size() - packetInfoSize;
+		uint32_t uncompressedLen = len;
+
+		// Find where the packet's data begins
+		prevBytesWritten += packetInfoSize;
+		if (prevBytesWritten >= PacketBuffer::DATA_SIZE) {
+			prevBytesWritten -= PacketBuffer::DATA_SIZE;
+			checksumPb = checksumPb->nextPacketBuffer();
+		}
+
+		// Unreliable packets are never resent on a later connection, so they can be compressed for this one
+		bool compressed = false;
+		if (!reliable && peer->compatible && peer->protocolVersion >= PACKET_COMPRESSION_PROTOCOL_VERSION &&
+			FLOW_KNOBS->PACKET_COMPRESSION_ENABLED && len >= FLOW_KNOBS->PACKET_COMPRESSION_MIN_BYTES && len <= FLOW_KNOBS->PACKET_COMPRESSION_MAX_BYTES)
+		{
+			double start = timer();
+			int compressedLen = self->compressor.compress(checksumPb, prevBytesWritten, len, pb);
+			self->compressionMicroseconds += int64_t((timer() - start) * 1e6);
+			if (compressedLen) {
+				TEST(true);  // Compressed a packet
+				++self->countPacketsCompressed;
+				self->bytesSavedByCompression += len - compressedLen;
+				len = compressedLen;
+				compressed = true;
+			} else {
+				TEST(true);  // Packet didn't compress well enough to send compressed
+				++self->countPacketsIncompressible;
+			}
+		}
 
 		if (checksumEnabled) {
-			// Find the correct place to start calculating checksum
 			uint32_t checksumUnprocessedLength = len;
-			prevBytesWritten += packetInfoSize;
-			if (prevBytesWritten >= PacketBuffer::DATA_SIZE) {
-				prevBytesWritten -= PacketBuffer::DATA_SIZE;
-				checksumPb = checksumPb->nextPacketBuffer();
-			}
 
 			// Checksum calculation
 			while (checksumUnprocessedLength > 0) {
@@ -897,19 +1166,20 @@ static PacketID sendPacket( TransportData* self, ISerializeSource const& what, c
 		}
 
 		// Write packet length and checksum into packet buffer
-		packetInfoBuffer.write(&len, sizeof(len));
+		uint32_t wireLen = compressed ? len | COMPRESSED_PACKET_FLAG : len;
+		packetInfoBuffer.write(&wireLen, sizeof(wireLen));
 		if (checksumEnabled) {
 			packetInfoBuffer.write(&checksum, sizeof(checksum), sizeof(len));
 		}
 
-		if (len > FLOW_KNOBS->PACKET_LIMIT) {
-			TraceEvent(SevError, "Net2_PacketLimitExceeded").detail("ToPeer", destination.address).detail("Length", (int)len);
+		if (uncompressedLen > FLOW_KNOBS->PACKET_LIMIT) {
+			TraceEvent(SevError, "Net2_PacketLimitExceeded").detail("ToPeer", destination.address).detail("Length", (int)uncompressedLen);
 			// throw platform_error();  // FIXME: How to recover from this situation?
 		} 
-		else if (len > FLOW_KNOBS->PACKET_WARNING) {
+		else if (uncompressedLen > FLOW_KNOBS->PACKET_WARNING) {
 			TraceEvent(self->warnAlwaysForLargePacket ? SevWarnAlways : SevWarn, "Net2_LargePacket")
 				.detail("ToPeer", destination.address)
-				.detail("Length", (int)len)
+				.detail("Length", (int)uncompressedLen)
 				.detail("Token", destination.token)
 				.backtrace()
 				.suppressFor(1.0);
@@ -928,7 +1198,7 @@ static PacketID sendPacket( TransportData* self, ISerializeSource const& what, c
 		}
 #endif
 
-		peer->send(pb, rp, firstUnsent);
+		peer->send(pb, rp, firstUnsent, len + packetInfoSize);
 
 		return (PacketID)rp;
 	}
@@ -962,3 +1232,114 @@ void FlowTransport::createInstance( uint64_t transportId )
 	g_network->setGlobal(INetwork::enFlowTransport, (flowGlobalType) new FlowTransport(transportId));
 	g_network->setGlobal(INetwork::enNetworkAddressFunc, (flowGlobalType) &FlowTransport::getGlobalLocalAddress);
 }
+
+// A chain of PacketBuffers like the one sendPacket() serializes a packet into, holding data after begin bytes of some other
+// packets
+static PacketBuffer* packetBufferChain( const std::string& data, int begin, PacketBuffer*& last ) {
+	PacketBuffer* first = new PacketBuffer;
+	memset(first->data, 0xee, begin);
+	first->bytes_written = begin;
+	last = first;
+	for(int j=0; j<data.size(); j++) {
+		if (last->bytes_written == PacketBuffer::DATA_SIZE) {
+			last->next = new PacketBuffer;
+			last = last->nextPacketBuffer();
+		}
+		last->data[last->bytes_written++] = data[j];
+	}
+	return first;
+}
+
+static void freePacketBufferChain( PacketBuffer* first ) {
+	while (first) {
+		PacketBuffer* n = first->nextPacketBuffer();
+		first->delref();
+		first = n;
+	}
+}
+
+TEST_CASE("fdbrpc/FlowTransport/PacketCompressor") {
+	PacketCompressor compressor;
+	for(int i=0; i<200; i++) {
+		bool compressible = g_random->random01() < 0.8;
+		int begin = g_random->randomInt(0, PacketBuffer::DATA_SIZE);
+		int len = g_random->randomInt(1, 5 * PacketBuffer::DATA_SIZE);
+		std::string data;
+		for(int j=0; j<len; j++)
+			data += compressible ? "abcdefgh"[g_random->randomInt(0, g_random->randomInt(1, 9))] : (char)g_random->randomInt(0, 256);
+
+		PacketBuffer* last;
+		PacketBuffer* first = packetBufferChain(data, begin, last);
+
+		int compressedLen = compressor.compress(first, begin, len, last);
+		if (compressible && len >= 1000)
+			ASSERT( compressedLen );
+
+		std::string sent;
+		for(PacketBuffer* b = first; b; b = b->nextPacketBuffer()) {
+			int from = b == first ? begin : 0;
+			sent.append((const char*)b->data + from, b->bytes_written - from);
+			if (!b->next) ASSERT( b == last );
+		}
+		for(int j=0; j<begin; j++)
+			ASSERT( first->data[j] == 0xee );
+
+		if (compressedLen) {
+			ASSERT( sent.size() == compressedLen && compressedLen < len );
+			Arena arena;
+			StringRef uncompressed;
+			ASSERT( compressor.decompress(arena, (const uint8_t*)sent.data(), sent.size(), uncompressed) );
+			ASSERT( uncompressed == StringRef(data) );
+		} else {
+			ASSERT( sent == data );
+		}
+
+		freePacketBufferChain(first);
+	}
+
+	return Void();
+}
+
+TEST_CASE("fdbrpc/FlowTransport/PacketCompressor/performance") {
+	// A range read reply's worth of keys sharing long prefixes with short values, and the same amount of random bytes
+	std::string rangeData, randomData;
+	while (rangeData.size() < 1<<20) {
+		rangeData += format("\x15\x01/account/%08d/history/%016lld", g_random->randomInt(0, 1000000), g_random->randomInt64(0, 1LL<<40));
+		rangeData += std::string(g_random->randomInt(8, 64), 'a' + g_random->randomInt(0, 4));
+	}
+	for(int i=0; i<rangeData.size(); i++)
+		randomData += (char)g_random->randomInt(0, 256);
+
+	PacketCompressor compressor;
+	for(auto data : { &rangeData, &randomData }) {
+		const int runs = 20;
+		double compressTime = 0, decompressTime = 0;
+		int compressedLen = 0;
+		for(int r=0; r<runs; r++) {
+			PacketBuffer* last;
+			PacketBuffer* first = packetBufferChain(*data, 0, last);
+			double start = timer();
+			compressedLen = compressor.compress(first, 0, data->size(), last);
+			compressTime += timer() - start;
+
+			if (compressedLen) {
+				std::string sent;
+				for(PacketBuffer* b = first; b; b = b->nextPacketBuffer())
+					sent.append((const char*)b->data, b->bytes_written);
+				Arena arena;
+				StringRef uncompressed;
+				start = timer();
+				ASSERT( compressor.decompress(arena, (const uint8_t*)sent.data(), sent.size(), uncompressed) );
+				decompressTime += timer() - start;
+				ASSERT( uncompressed == StringRef(*data) );
+			}
+			freePacketBufferChain(first);
+		}
+		double mb = runs * data->size() / 1e6;
+		printf("%s: %d -> %d bytes, compress %0.2f ms/MB (%0.1f MB/sec), decompress %0.2f ms/MB\n",
+			data == &rangeData ? "range data" : "random data", (int)data->size(), compressedLen ? compressedLen : (int)data->size(),
+			compressTime * 1e3 / mb, mb / compressTime, decompressTime * 1e3 / mb);
+	}
+
+	return Void();
+}
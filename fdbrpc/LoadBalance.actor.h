@@ -182,6 +182,8 @@ Future< REPLY_TYPE(Request) > loadBalance(
 		nextAlt++;
 
 	if(model) {
+		model->requests++;
+
 		double bestMetric = 1e9;
 		double nextMetric = 1e9;
 		double bestTime = 1e9;
@@ -215,6 +217,36 @@ Future< REPLY_TYPE(Request) > loadBalance(
 				}
 			}
 		}
+		// Use a more distant alternative instead of the closest ones only when they are much busier than it
+		if( bestMetric < 1e8 && bestMetric > FLOW_KNOBS->LOAD_BALANCE_DISTANT_LOAD_MARGIN && bestAlt < alternatives->countBest() ) {
+			for(int i=alternatives->countBest(); i<alternatives->size(); i++) {
+				RequestStream<Request> const* thisStream = &alternatives->get( i, channel );
+				if (!IFailureMonitor::failureMonitor().getState( thisStream->getEndpoint() ).failed) {
+					auto& qd = model->getMeasurement(thisStream->getEndpoint().token.first());
+					if(now() > qd.failedUntil) {
+						double thisMetric = qd.smoothOutstanding.smoothTotal() + FLOW_KNOBS->LOAD_BALANCE_DISTANT_LOAD_MARGIN;
+						double thisTime = qd.latency;
+
+						if(thisMetric < bestMetric) {
+							// The nearby alternative stays second choice; a distant one beaten by a later one is dropped
+							if(bestAlt < alternatives->countBest()) {
+								nextAlt = bestAlt;
+								nextMetric = bestMetric;
+								nextTime = bestTime;
+							}
+							bestAlt = i;
+							bestMetric = thisMetric;
+							bestTime = thisTime;
+						}
+					}
+				}
+			}
+			if(bestAlt >= alternatives->countBest()) {
+				TEST(true); // Load balancing chose a more distant alternative because the closest ones were busy
+				model->distantForLoad++;
+			}
+		}
+
 		if( nextMetric > 1e8 ) {
 			for(int i=alternatives->countBest(); i<alternatives->size(); i++) {
 				RequestStream<Request> const* thisStream = &alternatives->get( i, channel );
@@ -234,7 +266,18 @@ Future< REPLY_TYPE(Request) > loadBalance(
 			}
 		}
 
-		if(nextTime < 1e9) {
+		// Send a second request once the first has taken longer than most requests to the same endpoint.  Until there are
+		// enough samples of its latency, fall back to comparing the two endpoints' most recent latencies.
+		double hedgeTime = -1;
+		if(nextTime < 1e9 && FLOW_KNOBS->HEDGE_LATENCY_PERCENTILE > 0) {
+			auto& qd = model->getMeasurement(alternatives->get( bestAlt, channel ).getEndpoint().token.first());
+			hedgeTime = qd.latencies.percentile(FLOW_KNOBS->HEDGE_LATENCY_PERCENTILE);
+		}
+
+		if(hedgeTime >= 0) {
+			secondDelay = delay( hedgeTime );
+		}
+		else if(nextTime < 1e9) {
 			if(bestTime > FLOW_KNOBS->INSTANT_SECOND_REQUEST_MULTIPLIER*(model->secondMultiplier*(nextTime) + FLOW_KNOBS->BASE_SECOND_REQUEST_TIME)) {
 				secondDelay = Void();
 			} else {
@@ -252,6 +295,7 @@ Future< REPLY_TYPE(Request) > loadBalance(
 	state int numAttempts = 0;
 	state double backoff = 0;
 	state bool triedAllOptions = false;
+	state bool hedged = false;
 	loop {
 		// Find an alternative, if any, that is not failed, starting with nextAlt
 		state RequestStream<Request> const* stream = NULL;
@@ -263,8 +307,10 @@ Future< REPLY_TYPE(Request) > loadBalance(
 				useAlt = (nextAlt+alternatives->size()-1) % alternatives->size();
 			
 			stream = &alternatives->get( useAlt, channel );
-			if (!IFailureMonitor::failureMonitor().getState( stream->getEndpoint() ).failed && (!firstRequestEndpoint.present() || stream->getEndpoint().token.first() != firstRequestEndpoint.get()))
+			if (!IFailureMonitor::failureMonitor().getState( stream->getEndpoint() ).failed && (!firstRequestEndpoint.present() || stream->getEndpoint().token.first() != firstRequestEndpoint.get())) {
+				if(model) model->requestsAtDistance[alternatives->getDistance(useAlt)]++;
 				break;
+			}
 			nextAlt = (nextAlt+1) % alternatives->size();
 			if(nextAlt == startAlt) triedAllOptions = true;
 			stream=NULL;
@@ -319,6 +365,8 @@ Future< REPLY_TYPE(Request) > loadBalance(
 			firstRequestEndpoint = Optional<uint64_t>();
 		} else if( firstRequest.isValid() ) {
 			//Issue a second request, the first one is taking a long time.
+			if(model && !hedged) model->hedgedRequests++;
+			hedged = true;
 			secondRequest = makeRequest(stream, request, backoff, requestFinished.getFuture(), model, false, atMostOnce, triedAllOptions);
 			state bool firstFinished = false;
 
@@ -343,6 +391,8 @@ Future< REPLY_TYPE(Request) > loadBalance(
 						if(result.isError() || result.get().present()) {
 							if(!firstFinished) {
 								addLaggingRequest(firstRequest, requestFinished, model);
+								if(model && result.present())
+									model->hedgeWins++;
 							}
 							if(result.isError()) {
 								throw result.getError();
@@ -67,6 +67,9 @@ public:
 			return LBDistance::DISTANT;
 		return (LBDistance::Type) alternatives[0].k;
 	}
+	LBDistance::Type getDistance( int index ) const {
+		return (LBDistance::Type) alternatives[index].k;
+	}
 
 	template <class F>
 	F const& get( int index, F T::*member ) const {
@@ -43,6 +43,7 @@ public:
 #ifdef __linux__
 	dev_t fileSystemDeviceId;
 	bool checkFileSystem;
+	bool useIOUring;  // Whether unbuffered files use AsyncFileIOUring rather than AsyncFileKAIO
 #endif
 };
 
@@ -20,6 +20,8 @@
 
 #include "QueueModel.h"
 #include "LoadBalance.h"
+#include "flow/UnitTest.h"
+#include <cmath>
 
 void QueueModel::endRequest( uint64_t id, double latency, double penalty, double delta, bool clean, bool futureVersion ) {
 	auto& d = data[id];
@@ -27,6 +29,8 @@ void QueueModel::endRequest( uint64_t id, double latency, double penalty, double
 
 	if(clean) {
 		d.latency = latency;
+		if(!futureVersion)
+			d.latencies.addSample(latency);
 	} else {
 		d.latency = std::max(d.latency, latency);
 	}
@@ -47,6 +51,54 @@ void QueueModel::endRequest( uint64_t id, double latency, double penalty, double
 	}
 }
 
+const double LatencyHistogram::MIN_LATENCY = 1e-5;
+
+void LatencyHistogram::addSample( double latency ) {
+	int b = 0;
+	if(latency > MIN_LATENCY)
+		b = std::min<int>(BUCKETS-1, 1 + log2(latency / MIN_LATENCY) * BUCKETS_PER_DOUBLING);
+	counts[b]++;
+	if(++total >= FLOW_KNOBS->HEDGE_MAX_LATENCY_SAMPLES) {
+		total = 0;
+		for(int i=0; i<BUCKETS; i++) {
+			counts[i] /= 2;
+			total += counts[i];
+		}
+	}
+}
+
+double LatencyHistogram::percentile( double p ) const {
+	if(total < FLOW_KNOBS->HEDGE_MIN_LATENCY_SAMPLES)
+		return -1;
+	uint32_t rank = ceil(p * total);
+	uint32_t seen = 0;
+	for(int b=0; b<BUCKETS-1; b++) {
+		seen += counts[b];
+		if(seen >= rank)
+			return MIN_LATENCY * pow(2.0, double(b) / BUCKETS_PER_DOUBLING);
+	}
+	return MIN_LATENCY * pow(2.0, double(BUCKETS-1) / BUCKETS_PER_DOUBLING);
+}
+
+TEST_CASE("fdbrpc/QueueModel/LatencyHistogram") {
+	LatencyHistogram h;
+	ASSERT( h.percentile(0.95) == -1 );
+
+	std::vector<double> latencies;
+	for(int i=0; i<FLOW_KNOBS->HEDGE_MAX_LATENCY_SAMPLES - 1; i++) {
+		latencies.push_back( g_random->random01() < 0.9 ? g_random->random01() * 1e-3 : g_random->random01() );
+		h.addSample( latencies.back() );
+	}
+	std::sort( latencies.begin(), latencies.end() );
+	for(double p : { 0.5, 0.9, 0.95, 0.99 }) {
+		double actual = latencies[ ceil(p * latencies.size()) - 1 ];
+		double estimate = h.percentile(p);
+		ASSERT( estimate >= actual && estimate <= std::max(actual, LatencyHistogram::MIN_LATENCY) * 1.2 );
+	}
+
+	return Void();
+}
+
 QueueData& QueueModel::getMeasurement( uint64_t id ) {
 	return data[id];
 }
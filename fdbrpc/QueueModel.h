@@ -26,8 +26,28 @@
 #include "Smoother.h"
 #include "flow/Knobs.h"
 #include "flow/ActorCollection.h"
+#include "Locality.h"
 
 
+// Recent reply latencies from one endpoint, in buckets that grow by a factor of 2^(1/4) starting at MIN_LATENCY.  The counts
+// are halved whenever there are HEDGE_MAX_LATENCY_SAMPLES of them, so percentiles follow recent behavior.
+class LatencyHistogram {
+public:
+	enum { BUCKETS = 80, BUCKETS_PER_DOUBLING = 4 };
+	static const double MIN_LATENCY;
+
+	LatencyHistogram() : total(0) { memset(counts, 0, sizeof(counts)); }
+
+	void addSample( double latency );
+
+	// Returns an upper bound on the given percentile of the recent latencies, or -1 if there are too few samples
+	double percentile( double p ) const;
+
+private:
+	uint32_t counts[BUCKETS];
+	uint32_t total;
+};
+
 struct QueueData {
 	Smoother smoothOutstanding;
 	double latency;
@@ -35,6 +55,7 @@ struct QueueData {
 	double failedUntil;
 	double futureVersionBackoff;
 	double increaseBackoffTime;
+	LatencyHistogram latencies;
 	QueueData() : latency(0.001), penalty(1.0), smoothOutstanding(FLOW_KNOBS->QUEUE_MODEL_SMOOTHING_AMOUNT), failedUntil(0), futureVersionBackoff(FLOW_KNOBS->FUTURE_VERSION_INITIAL_BACKOFF), increaseBackoffTime(0) {}
 };
 
@@ -47,11 +68,23 @@ public:
 	double addRequest( uint64_t id );
 	double secondMultiplier;
 	double secondBudget;
+
+	// Counts of load balanced requests, of those for which loadBalance() sent a second request while the first was still
+	// outstanding, and of those that the second request answered first
+	int64_t requests;
+	int64_t hedgedRequests;
+	int64_t hedgeWins;
+
+	// Counts of requests sent to alternatives at each LBDistance from the client, and of the requests sent to a more
+	// distant alternative because the closest ones were too busy
+	int64_t requestsAtDistance[LBDistance::DISTANT+1];
+	int64_t distantForLoad;
 	PromiseStream< Future<Void> > addActor;
 	Future<Void> laggingRequests; // requests for which a different recipient already answered
 	int laggingRequestCount;
 
-	QueueModel() : secondMultiplier(1.0), secondBudget(0), laggingRequestCount(0) {
+	QueueModel() : secondMultiplier(1.0), secondBudget(0), requests(0), hedgedRequests(0), hedgeWins(0), distantForLoad(0), laggingRequestCount(0) {
+		memset(requestsAtDistance, 0, sizeof(requestsAtDistance));
 		laggingRequests = actorCollection( addActor.getFuture(), &laggingRequestCount );
 	}
 
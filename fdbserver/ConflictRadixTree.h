@@ -0,0 +1,586 @@
+/*
+ * ConflictRadixTree.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FDBSERVER_CONFLICTRADIXTREE_H
+#define FDBSERVER_CONFLICTRADIXTREE_H
+#pragma once
+
+#include "fdbclient/FDBTypes.h"
+
+// An alternative representation of the resolver's version history (see SkipList in SkipList.cpp).
+// Like the SkipList, it stores a set of boundary keys, each holding the version of the last write
+// to [key, next boundary key).  The empty key is always present.
+//
+// The keys are held in an adaptive, path compressed radix tree.  Shared key prefixes (such as tuple
+// encoded subspaces) are stored once, inner nodes grow from sorted arrays of 4, 16 and 48 children
+// to a directly indexed array of 256, and every node stores the maximum version in its subtree so
+// that range queries only descend along the two boundary paths.
+class ConflictRadixTree : NonCopyable {
+public:
+	explicit ConflictRadixTree( Version version = 0 ) : root( newNode( NULL, 0 ) ) {
+		root->hasValue = true;
+		root->value = root->maxVersion = version;
+	}
+	~ConflictRadixTree() {
+		destroy( root );
+	}
+	void swap( ConflictRadixTree& other ) {
+		std::swap( root, other.root );
+	}
+
+	// Returns true if any key in [begin, end) was last written at a version greater than version
+	bool anyNewer( StringRef begin, StringRef end, Version version ) const {
+		if (root->maxVersion <= version)
+			return false;
+		if (floor( begin )->value > version)
+			return true;
+		return anyNewer( root, 0, begin, true, end, true, version );
+	}
+
+	// Records a write to [begin, end) at version, which must be at least as large as any version already present
+	void addRange( StringRef begin, StringRef end, Version version ) {
+		if (!(begin < end)) return;
+		Version endVersion = floor( end )->value;
+		insert( root, 0, end, endVersion, false );
+		eraseRange( root, 0, begin, true, end, true );
+		insert( root, 0, begin, version, true );
+	}
+
+	// Visits up to nodeCount boundary keys in order, starting at resumeKey, and removes each one that is
+	//   older than version and follows another such key.  Versions older than the oldest version a
+	//   transaction may read at are indistinguishable, so this doesn't change the result of any valid
+	//   conflict check.  resumeKey is set to the first unvisited key, or to the empty key to start
+	//   again from the beginning.
+	int removeBefore( Version version, Key& resumeKey, int nodeCount ) {
+		std::string cursor = resumeKey.toString();
+		std::string key;
+		bool strict = false;
+		bool wasAbove = true;
+		int removedCount = 0;
+		while (nodeCount--) {
+			const Node* n = ceiling( cursor, strict, key );
+			if (!n) {
+				resumeKey = Key();
+				return removedCount;
+			}
+			bool isAbove = n->value >= version;
+			if (!isAbove && !wasAbove) {
+				erase( root, 0, StringRef(key) );
+				removedCount++;
+			}
+			wasAbove = isAbove;
+			cursor.swap( key );
+			strict = true;
+		}
+
+		resumeKey = ceiling( cursor, true, key ) ? Key( StringRef(key) ) : Key();
+		return removedCount;
+	}
+
+	int count() const {
+		return count( root );
+	}
+
+private:
+	struct Node : FastAllocated<Node> {
+		Version maxVersion;		// Of value (if hasValue) and of all children
+		Version value;			// Of [key of this node, next key)
+		Node** children;		// Sorted by keys[] when capacity < 256, indexed by byte otherwise
+		uint8_t* keys;
+		uint8_t* prefix;		// Key bytes following the byte which selected this node in its parent
+		int prefixLength;
+		int16_t childCount, capacity;
+		bool hasValue;
+	};
+
+	Node* root;
+
+	// Node allocation and child arrays.  Nodes, child arrays and prefixes all come from the FastAllocator pools,
+	//   since the tree allocates and frees them on every batch.
+
+	static Node* newNode( const uint8_t* prefix, int prefixLength ) {
+		Node* n = new Node;
+		n->children = NULL;
+		n->keys = NULL;
+		n->prefix = NULL;
+		n->childCount = n->capacity = 0;
+		n->hasValue = false;
+		n->value = n->maxVersion = 0;
+		setPrefix( n, prefix, prefixLength );
+		return n;
+	}
+
+	static void setPrefix( Node* n, const uint8_t* prefix, int prefixLength ) {
+		uint8_t* p = prefixLength ? (uint8_t*)allocateFast( prefixLength ) : NULL;
+		if (prefixLength)
+			memcpy( p, prefix, prefixLength );
+		if (n->prefix)
+			freeFast( n->prefixLength, n->prefix );
+		n->prefix = p;
+		n->prefixLength = prefixLength;
+	}
+
+	static void freeChildren( Node* n ) {
+		if (n->children)
+			freeFast( n->capacity*sizeof(Node*), n->children );
+		if (n->keys)
+			freeFast( n->capacity, n->keys );
+		n->children = NULL;
+		n->keys = NULL;
+	}
+
+	static void freeNode( Node* n ) {
+		freeChildren( n );
+		if (n->prefix)
+			freeFast( n->prefixLength, n->prefix );
+		delete n;
+	}
+
+	static void destroy( Node* n ) {
+		for(int i = 0; i < slots(n); i++)
+			if (Node* c = childAt(n, i))
+				destroy(c);
+		freeNode(n);
+	}
+
+	// Children are addressed by slot: slots() of them, some of which may be empty when the node is direct indexed
+	static int slots( const Node* n ) { return n->capacity == 256 ? 256 : n->childCount; }
+	static Node* childAt( const Node* n, int slot ) { return n->children[slot]; }
+	static uint8_t byteAt( const Node* n, int slot ) { return n->capacity == 256 ? slot : n->keys[slot]; }
+
+	// Returns the first slot whose byte is >= b (slots(n) if there is none)
+	static int lowerSlot( const Node* n, uint8_t b ) {
+		if (n->capacity == 256) return b;
+		return std::lower_bound( n->keys, n->keys + n->childCount, b ) - n->keys;
+	}
+
+	static Node* getChild( const Node* n, uint8_t b ) {
+		if (n->capacity == 256) return n->children ? n->children[b] : NULL;
+		int i = lowerSlot( n, b );
+		return (i < n->childCount && n->keys[i] == b) ? n->children[i] : NULL;
+	}
+
+	static int capacityFor( int childCount ) {
+		if (childCount <= 4) return 4;
+		if (childCount <= 16) return 16;
+		if (childCount <= 48) return 48;
+		return 256;
+	}
+
+	static void resize( Node* n, int capacity ) {
+		Node** children = (Node**)allocateFast( capacity*sizeof(Node*) );
+		uint8_t* keys = capacity == 256 ? NULL : (uint8_t*)allocateFast( capacity );
+		if (capacity == 256) memset( children, 0, 256*sizeof(Node*) );
+		int count = 0;
+		for(int i = 0; i < slots(n); i++) {
+			if (Node* c = childAt(n, i)) {
+				if (capacity == 256) {
+					children[byteAt(n,i)] = c;
+				} else {
+					keys[count] = byteAt(n,i);
+					children[count] = c;
+				}
+				count++;
+			}
+		}
+		freeChildren( n );
+		n->children = children;
+		n->keys = keys;
+		n->capacity = capacity;
+		ASSERT( count == n->childCount );
+	}
+
+	static void addChild( Node* n, uint8_t b, Node* child ) {
+		if (n->childCount == n->capacity)
+			resize( n, capacityFor( n->childCount+1 ) );
+		if (n->capacity == 256) {
+			n->children[b] = child;
+		} else {
+			int i = lowerSlot( n, b );
+			memmove( &n->keys[i+1], &n->keys[i], n->childCount-i );
+			memmove( &n->children[i+1], &n->children[i], (n->childCount-i)*sizeof(Node*) );
+			n->keys[i] = b;
+			n->children[i] = child;
+		}
+		n->childCount++;
+	}
+
+	static void setChild( Node* n, uint8_t b, Node* child ) {
+		if (n->capacity == 256) {
+			n->children[b] = child;
+		} else {
+			int i = lowerSlot( n, b );
+			ASSERT( i < n->childCount && n->keys[i] == b );
+			n->children[i] = child;
+		}
+	}
+
+	static void removeChild( Node* n, int slot ) {
+		if (n->capacity == 256) {
+			n->children[slot] = NULL;
+		} else {
+			memmove( &n->keys[slot], &n->keys[slot+1], n->childCount-slot-1 );
+			memmove( &n->children[slot], &n->children[slot+1], (n->childCount-slot-1)*sizeof(Node*) );
+		}
+		n->childCount--;
+		// Shrink with some hysteresis so that a node at a size boundary doesn't resize on every change
+		if (n->childCount == 0) {
+			freeChildren( n );
+			n->capacity = 0;
+		} else if (n->capacity > 4 && capacityFor( n->childCount + n->childCount/2 ) < n->capacity) {
+			resize( n, capacityFor( n->childCount + n->childCount/2 ) );
+		}
+	}
+
+	static void recomputeMaxVersion( Node* n ) {
+		Version v = n->hasValue ? n->value : std::numeric_limits<Version>::min();
+		for(int i = 0; i < slots(n); i++)
+			if (Node* c = childAt(n, i))
+				v = std::max( v, c->maxVersion );
+		n->maxVersion = v;
+	}
+
+	// Restores the invariants of a (non-root) node after a removal: every node has a value or at least one
+	//   child, and a node without a value has at least two children.  Returns the node which now occupies
+	//   n's place in its parent, or NULL.
+	static Node* normalize( Node* n ) {
+		if (!n->hasValue && n->childCount == 0) {
+			freeNode( n );
+			return NULL;
+		}
+		if (!n->hasValue && n->childCount == 1) {
+			int slot = 0;
+			while (!childAt(n, slot)) slot++;
+			Node* c = childAt(n, slot);
+			std::string prefix( (const char*)n->prefix, n->prefixLength );
+			prefix.push_back( byteAt(n, slot) );
+			prefix.append( (const char*)c->prefix, c->prefixLength );
+			setPrefix( c, (const uint8_t*)prefix.data(), prefix.size() );
+			n->childCount = 0;
+			freeNode( n );
+			return c;
+		}
+		recomputeMaxVersion( n );
+		return n;
+	}
+
+	// Compares n's prefix with key starting at depth.  Returns the number of matching bytes; if that is less than
+	//   the prefix length, cmp is set to <0 if the key is smaller than the prefix (or ends first) and >0 otherwise.
+	static int matchPrefix( const Node* n, int depth, StringRef key, int& cmp ) {
+		int i = 0;
+		cmp = 0;
+		for(; i < n->prefixLength; i++) {
+			if (depth+i >= key.size()) { cmp = -1; break; }
+			if (key[depth+i] != n->prefix[i]) { cmp = key[depth+i] < n->prefix[i] ? -1 : 1; break; }
+		}
+		return i;
+	}
+
+	// Lookups
+
+	static const Node* leftmost( const Node* n ) {
+		while (!n->hasValue) {
+			int slot = 0;
+			while (!childAt(n, slot)) slot++;
+			n = childAt(n, slot);
+		}
+		return n;
+	}
+
+	static const Node* rightmost( const Node* n ) {
+		while (n->childCount) {
+			int slot = slots(n)-1;
+			while (!childAt(n, slot)) slot--;
+			n = childAt(n, slot);
+		}
+		return n;
+	}
+
+	// Returns the node holding the greatest key <= key
+	const Node* floor( StringRef key ) const {
+		const Node* n = floor( root, 0, key );
+		ASSERT( n );  // The root always holds the empty key
+		return n;
+	}
+
+	static const Node* floor( const Node* n, int depth, StringRef key ) {
+		int cmp;
+		int matched = matchPrefix( n, depth, key, cmp );
+		if (matched < n->prefixLength)
+			return cmp > 0 ? rightmost(n) : NULL;
+		depth += n->prefixLength;
+		if (key.size() == depth)
+			return n->hasValue ? n : NULL;
+
+		uint8_t b = key[depth];
+		if (const Node* c = getChild(n, b))
+			if (const Node* f = floor( c, depth+1, key ))
+				return f;
+		for(int slot = lowerSlot(n, b)-1; slot >= 0; slot--)
+			if (const Node* c = childAt(n, slot))
+				return rightmost(c);
+		return n->hasValue ? n : NULL;
+	}
+
+	// Returns the node holding the smallest key >= key (> key if strict), and sets foundKey to that key
+	const Node* ceiling( StringRef key, bool strict, std::string& foundKey ) const {
+		foundKey.clear();
+		return ceiling( root, 0, key, strict, foundKey );
+	}
+
+	static const Node* leftmost( const Node* n, std::string& path ) {
+		while (!n->hasValue) {
+			int slot = 0;
+			while (!childAt(n, slot)) slot++;
+			path.push_back( byteAt(n, slot) );
+			n = childAt(n, slot);
+			path.append( (const char*)n->prefix, n->prefixLength );
+		}
+		return n;
+	}
+
+	static const Node* ceiling( const Node* n, int depth, StringRef key, bool strict, std::string& path ) {
+		int cmp;
+		int matched = matchPrefix( n, depth, key, cmp );
+		int pathSize = path.size();
+		path.append( (const char*)n->prefix, n->prefixLength );
+		if (matched < n->prefixLength) {
+			if (cmp < 0) return leftmost( n, path );
+			path.resize( pathSize );
+			return NULL;
+		}
+		depth += n->prefixLength;
+
+		int slot = 0;
+		if (key.size() == depth) {
+			if (n->hasValue && !strict) return n;
+		} else {
+			uint8_t b = key[depth];
+			if (const Node* c = getChild(n, b)) {
+				path.push_back( b );
+				if (const Node* f = ceiling( c, depth+1, key, strict, path ))
+					return f;
+				path.resize( depth );
+			}
+			slot = b == 255 ? slots(n) : lowerSlot(n, b+1);
+		}
+		for(; slot < slots(n); slot++) {
+			if (const Node* c = childAt(n, slot)) {
+				path.push_back( byteAt(n, slot) );
+				path.append( (const char*)c->prefix, c->prefixLength );
+				return leftmost( c, path );
+			}
+		}
+		path.resize( pathSize );
+		return NULL;
+	}
+
+	// Checks keys in the open interval (lo, hi).  loActive/hiActive are true while the path to n equals
+	//   the first depth bytes of lo/hi; once the path departs from a bound, that bound no longer constrains
+	//   the subtree.
+	static bool anyNewer( const Node* n, int depth, StringRef lo, bool loActive, StringRef hi, bool hiActive, Version version ) {
+		if (n->maxVersion <= version)
+			return false;
+		if (!loActive && !hiActive)
+			return true;
+
+		int cmp;
+		if (loActive && matchPrefix( n, depth, lo, cmp ) < n->prefixLength) {
+			if (cmp > 0) return false;		// Subtree is entirely below lo
+			loActive = false;
+		}
+		if (hiActive && matchPrefix( n, depth, hi, cmp ) < n->prefixLength) {
+			if (cmp < 0) return false;		// Subtree is entirely at or above hi
+			hiActive = false;
+		}
+		depth += n->prefixLength;
+		if (hiActive && hi.size() == depth)
+			return false;					// Every key in the subtree is >= hi
+		if (!loActive && !hiActive)
+			return true;
+
+		if (n->hasValue && !loActive && n->value > version)
+			return true;
+
+		int slot = loActive && lo.size() > depth ? lowerSlot( n, lo[depth] ) : 0;
+		int lastSlot = hiActive ? lowerSlot( n, hi[depth] ) : slots(n)-1;
+		if (hiActive && (lastSlot == slots(n) || byteAt(n, lastSlot) != hi[depth])) lastSlot--;
+		for(; slot <= lastSlot; slot++) {
+			if (const Node* c = childAt(n, slot)) {
+				uint8_t b = byteAt(n, slot);
+				bool childLo = loActive && lo.size() > depth && b == lo[depth];
+				bool childHi = hiActive && b == hi[depth];
+				if (anyNewer( c, depth+1, lo, childLo, hi, childHi, version ))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	// Updates
+
+	// Sets the value at key, or only adds it if overwrite is false and the key is already present.
+	//   Returns the node which now occupies n's place in its parent.
+	static Node* insert( Node* n, int depth, StringRef key, Version version, bool overwrite ) {
+		int cmp;
+		int matched = matchPrefix( n, depth, key, cmp );
+		if (matched < n->prefixLength) {
+			// Split the prefix: a new node takes the matched part, and n becomes its child
+			Node* parent = newNode( n->prefix, matched );
+			uint8_t edge = n->prefix[matched];
+			setPrefix( n, n->prefix + matched + 1, n->prefixLength - matched - 1 );
+			addChild( parent, edge, n );
+			parent->maxVersion = n->maxVersion;
+			if (depth + matched == key.size()) {
+				parent->hasValue = true;
+				parent->value = version;
+			} else {
+				int rest = depth + matched + 1;
+				Node* leaf = newNode( key.begin() + rest, key.size() - rest );
+				leaf->hasValue = true;
+				leaf->value = leaf->maxVersion = version;
+				addChild( parent, key[depth+matched], leaf );
+			}
+			parent->maxVersion = std::max( parent->maxVersion, version );
+			return parent;
+		}
+		depth += n->prefixLength;
+
+		if (key.size() == depth) {
+			if (n->hasValue && !overwrite)
+				return n;
+			bool decreased = n->hasValue && version < n->value;
+			n->hasValue = true;
+			n->value = version;
+			if (decreased)
+				recomputeMaxVersion( n );
+			else
+				n->maxVersion = std::max( n->maxVersion, version );
+			return n;
+		}
+
+		uint8_t b = key[depth];
+		if (Node* c = getChild(n, b)) {
+			Version oldMaxVersion = c->maxVersion;
+			Node* r = insert( c, depth+1, key, version, overwrite );
+			if (r != c)
+				setChild( n, b, r );
+			if (r->maxVersion >= oldMaxVersion)
+				n->maxVersion = std::max( n->maxVersion, r->maxVersion );
+			else
+				recomputeMaxVersion( n );
+		} else {
+			Node* leaf = newNode( key.begin() + depth + 1, key.size() - depth - 1 );
+			leaf->hasValue = true;
+			leaf->value = leaf->maxVersion = version;
+			addChild( n, b, leaf );
+			n->maxVersion = std::max( n->maxVersion, version );
+		}
+		return n;
+	}
+
+	// Removes the value at key, if present.  Returns the node which now occupies n's place in its parent.
+	Node* erase( Node* n, int depth, StringRef key ) {
+		int cmp;
+		if (matchPrefix( n, depth, key, cmp ) < n->prefixLength)
+			return n;
+		depth += n->prefixLength;
+
+		if (key.size() == depth) {
+			if (n == root) return n;		// The empty key is never removed
+			n->hasValue = false;
+		} else {
+			uint8_t b = key[depth];
+			Node* c = getChild(n, b);
+			if (!c) return n;
+			Node* r = erase( c, depth+1, key );
+			if (!r)
+				removeChild( n, lowerSlot(n, b) );
+			else if (r != c)
+				setChild( n, b, r );
+		}
+		if (n == root) {
+			recomputeMaxVersion( n );
+			return n;
+		}
+		return normalize( n );
+	}
+
+	// Removes the values of all keys in [lo, hi).  loActive/hiActive are as for anyNewer().
+	//   Returns the node which now occupies n's place in its parent, or NULL if the subtree is now empty.
+	Node* eraseRange( Node* n, int depth, StringRef lo, bool loActive, StringRef hi, bool hiActive ) {
+		int cmp;
+		if (loActive && matchPrefix( n, depth, lo, cmp ) < n->prefixLength) {
+			if (cmp > 0) return n;
+			loActive = false;
+		}
+		if (hiActive && matchPrefix( n, depth, hi, cmp ) < n->prefixLength) {
+			if (cmp < 0) return n;
+			hiActive = false;
+		}
+		if (!loActive && !hiActive && n != root) {
+			destroy( n );
+			return NULL;
+		}
+		depth += n->prefixLength;
+		if (hiActive && hi.size() == depth)
+			return n;
+
+		if (n->hasValue && n != root && (!loActive || lo.size() == depth))
+			n->hasValue = false;
+
+		// Removing children may change the node's layout, so find the affected children first
+		uint8_t affected[256];
+		int affectedCount = 0;
+		for(int slot = loActive && lo.size() > depth ? lowerSlot( n, lo[depth] ) : 0; slot < slots(n); slot++) {
+			if (!childAt(n, slot)) continue;
+			uint8_t b = byteAt(n, slot);
+			if (hiActive && b > hi[depth]) break;
+			affected[affectedCount++] = b;
+		}
+		for(int i = 0; i < affectedCount; i++) {
+			uint8_t b = affected[i];
+			Node* c = getChild(n, b);
+			bool childLo = loActive && lo.size() > depth && b == lo[depth];
+			bool childHi = hiActive && b == hi[depth];
+			Node* r = eraseRange( c, depth+1, lo, childLo, hi, childHi );
+			if (!r)
+				removeChild( n, lowerSlot(n, b) );
+			else if (r != c)
+				setChild( n, b, r );
+		}
+
+		if (n == root) {
+			recomputeMaxVersion( n );
+			return n;
+		}
+		return normalize( n );
+	}
+
+	static int count( const Node* n ) {
+		int c = n->hasValue;
+		for(int i = 0; i < slots(n); i++)
+			if (const Node* child = childAt(n, i))
+				c += count( child );
+		return c;
+	}
+};
+
+#endif
@@ -25,7 +25,9 @@
 #include "fdbclient/CommitTransaction.h"
 
 struct ConflictSet;
-ConflictSet* newConflictSet();
+// threadCount > 1 partitions conflict detection for each batch across that many worker threads.
+// useRadixTree stores the version history in a radix tree instead of a SkipList (and runs on one thread).
+ConflictSet* newConflictSet( int threadCount, bool useRadixTree );
 void clearConflictSet( ConflictSet*, Version );
 void destroyConflictSet(ConflictSet*);
 
@@ -39,8 +41,10 @@ struct ConflictBatch {
 		TransactionCommitted,
 	};
 
-	void addTransaction( const CommitTransactionRef& transaction );
-	void detectConflicts(Version now, Version newOldestVersion, vector<int>& nonConflicting, vector<int>* tooOldTransactions = NULL);
+	// If reportConflictingKeys, detectConflicts() finds which of the transaction's read conflict ranges conflicted
+	void addTransaction( const CommitTransactionRef& transaction, bool reportConflictingKeys = false );
+	// conflictingReadRanges maps each conflicting transaction that asked for it to the (sorted) indices of its conflicting read ranges
+	void detectConflicts(Version now, Version newOldestVersion, vector<int>& nonConflicting, vector<int>* tooOldTransactions = NULL, std::map<int, vector<int>>* conflictingReadRanges = NULL);
 	void GetTooOldTransactions(vector<int>& tooOldTransactions);
 
 private:
@@ -51,10 +55,12 @@ private:
 	vector< pair<StringRef,StringRef> > combinedWriteConflictRanges;
 	vector< struct ReadConflictRange > combinedReadConflictRanges;
 	bool* transactionConflictStatus;
+	std::map<int, vector<int>>* conflictingReadRanges;
 
 	void checkIntraBatchConflicts();
 	void combineWriteConflictRanges();
 	void checkReadConflictRanges();
+	void findConflictingReadRanges();
 	void mergeWriteConflictRanges(Version now);
 	void addConflictRanges(Version now, vector< pair<StringRef,StringRef> >::iterator begin, vector< pair<StringRef,StringRef> >::iterator end, class SkipList* part);
 };
@@ -23,6 +23,7 @@
 #include "fdbrpc/IAsyncFile.h"
 #include "Knobs.h"
 #include "fdbrpc/simulator.h"
+#include "flow/UnitTest.h"
 
 typedef bool(*compare_pages)(void*,void*);
 typedef int64_t loc_t;
@@ -114,7 +115,7 @@ public:
 	RawDiskQueue_TwoFiles( std::string basename, UID dbgid, int64_t fileSizeWarningLimit )
 		: basename(basename), onError(delayed(error.getFuture())), onStopped(stopped.getFuture()),
 		readingFile(-1), readingPage(-1), writingPos(-1), dbgid(dbgid),
-		dbg_file0BeginSeq(0), fileExtensionBytes(10<<20), readingBuffer( dbgid ),
+		file0BeginSeq(0), fileExtensionBytes(10<<20), readingBuffer( dbgid ),
 		readyToPush(Void()), fileSizeWarningLimit(fileSizeWarningLimit), lastCommit(Void()), isFirstCommit(true)
 	{
 		if(BUGGIFY)
@@ -144,7 +145,10 @@ public:
 	Future<Void> setPoppedPage( int file, int64_t page, int64_t debugSeq ) { return setPoppedPage(this, file, page, debugSeq); }
 
 	Future<Standalone<StringRef>> readNextPage() { return readNextPage(this); }
-	Future<Void> truncateBeforeLastReadPage() { return truncateBeforeLastReadPage(this); }
+	Future<bool> truncateBeforeLastReadPage() { return truncateBeforeLastReadPage(this); }
+
+	// Reads whole pages, by their position in the sequence of all pages ever pushed
+	Future<Standalone<StringRef>> readPages( int64_t seq, int bytes ) { return readPages(this, seq, bytes); }
 
 	Future<Void> getError() { return onError; }
 	Future<Void> onClosed() { return onStopped; }
@@ -183,7 +187,7 @@ public:
 	std::string filename(int i) const { return basename + format("%d.fdq", i); }
 
 	UID dbgid;
-	int64_t dbg_file0BeginSeq;
+	int64_t file0BeginSeq;  // The sequence number of the first byte of files[0]; files[1] begins file0BeginSeq + files[0].size
 	int64_t fileSizeWarningLimit;
 
 	Promise<Void> error, stopped;
@@ -240,7 +244,7 @@ public:
 					pageData = pageData.substr( p );
 				}
 
-				dbg_file0BeginSeq += files[0].size;
+				file0BeginSeq += files[0].size;
 				std::swap(files[0], files[1]);
 				files[1].popped = 0;
 				writingPos = 0;
@@ -313,7 +317,7 @@ public:
 
 			self->updatePopped( poppedPages*sizeof(Page) );
 
-			/*TraceEvent("RDQCommitEnd", self->dbgid).detail("DeltaPopped", poppedPages*sizeof(Page)).detail("PoppedCommitted", self->dbg_file0BeginSeq + self->files[0].popped + self->files[1].popped)
+			/*TraceEvent("RDQCommitEnd", self->dbgid).detail("DeltaPopped", poppedPages*sizeof(Page)).detail("PoppedCommitted", self->file0BeginSeq + self->files[0].popped + self->files[1].popped)
 				.detail("File0Size", self->files[0].size).detail("File1Size", self->files[1].size)
 				.detail("File0Name", self->files[0].dbgFilename).detail("SyncedFiles", syncFiles.size());*/
 
@@ -344,7 +348,7 @@ public:
 		self->files[file].popped = page*sizeof(Page);
 		if (file) self->files[0].popped = self->files[0].size;
 		else self->files[1].popped = 0;
-		self->dbg_file0BeginSeq = debugSeq - self->files[1].popped - self->files[0].popped;
+		self->file0BeginSeq = debugSeq - self->files[1].popped - self->files[0].popped;
 
 		//If we are starting in file 1, we truncate file 0 in case it has been corrupted.
 		//  In particular, we are trying to avoid a dropped or corrupted write to the first page of file 0 causing it to be sequenced before file 1,
@@ -492,6 +496,7 @@ public:
 
 				self->files[0].popped = self->files[0].size;
 				self->files[1].popped = 0;
+				self->file0BeginSeq = -self->files[0].size;
 				self->writingPos = 0;
 				self->readingFile = 2;
 				return Standalone<StringRef>();
@@ -594,6 +599,45 @@ public:
 		}
 	}
 
+	ACTOR static Future<Standalone<StringRef>> readPages( RawDiskQueue_TwoFiles* self, int64_t seq, int bytes ) {
+		ASSERT( self->readingFile == 2 );
+		ASSERT( seq % sizeof(Page) == 0 && bytes % sizeof(Page) == 0 );
+		StringBuffer buffer( self->dbgid );
+		buffer.alignReserve( sizeof(Page), bytes );
+		uint8_t* buf = (uint8_t*)buffer.append( bytes );
+		state Standalone<StringRef> result = buffer.str;
+
+		// Hold references to the files, in case they are swapped while the reads are outstanding
+		state Reference<IAsyncFile> file0 = self->files[0].f;
+		state Reference<IAsyncFile> file1 = self->files[1].f;
+		state std::vector<Future<int>> reads;
+		state std::vector<int> lengths;
+		int64_t file1BeginSeq = self->file0BeginSeq + self->files[0].size;
+		if (seq < file1BeginSeq) {
+			ASSERT( seq >= self->file0BeginSeq );
+			int len = std::min<int64_t>( bytes, file1BeginSeq - seq );
+			reads.push_back( file0->read( buf, len, seq - self->file0BeginSeq ) );
+			lengths.push_back( len );
+			buf += len;
+			seq += len;
+			bytes -= len;
+		}
+		if (bytes) {
+			ASSERT( seq + bytes <= file1BeginSeq + self->files[1].size );
+			reads.push_back( file1->read( buf, bytes, seq - file1BeginSeq ) );
+			lengths.push_back( bytes );
+		}
+
+		Void _ = wait( waitForAll(reads) );
+		for(int i = 0; i < reads.size(); i++) {
+			if (reads[i].get() != lengths[i]) {
+				TraceEvent(SevError, "RDQReadPagesShort", self->dbgid).detail("Expected", lengths[i]).detail("Read", reads[i].get()).detail("file0name", self->files[0].dbgFilename);
+				throw io_error();
+			}
+		}
+		return result;
+	}
+
 	ACTOR static UNCANCELLABLE Future<Void> truncateFile(RawDiskQueue_TwoFiles* self, int file, int64_t pos) {
 		state TrackMe trackMe(self);
 		TraceEvent("DQTruncateFile", self->dbgid).detail("File", file).detail("Pos", pos).detail("File0Name", self->files[0].dbgFilename);
@@ -604,7 +648,8 @@ public:
 		return Void();
 	}
 
-	ACTOR static Future<Void> truncateBeforeLastReadPage( RawDiskQueue_TwoFiles* self ) {
+	// Returns true if files[0] and files[1] were swapped
+	ACTOR static Future<bool> truncateBeforeLastReadPage( RawDiskQueue_TwoFiles* self ) {
 		try {
 			state int file = self->readingFile;
 			state int64_t pos = (self->readingPage - self->readingBuffer.size()/sizeof(Page) - 1) * sizeof(Page);
@@ -631,7 +676,7 @@ public:
 				self->files[0].popped = self->files[0].size;
 			}
 
-			return Void();
+			return swap;
 		} catch (Error& e) {
 			TraceEvent(SevError, "RDQ_tblrp_Error", self->dbgid).detail("file0name", self->files[0].dbgFilename).error(e);
 			if (!self->error.isSet()) self->error.sendError(e);
@@ -665,6 +710,12 @@ public:
 		}
 		return endLocation();
 	}
+	virtual location getNextPushLocation() {
+		ASSERT( recovered );
+		return endLocation();
+	}
+	virtual Future<Standalone<StringRef>> read( location from, location to ) { return read(this, from, to); }
+
 	virtual void pop( location upTo ) {
 		ASSERT( !upTo.hi );
 		ASSERT( !recovered || upTo.lo <= endLocation() );
@@ -751,7 +802,7 @@ public:
 			.detail("lastPoppedSeq", lastPoppedSeq)
 			.detail("poppedSeq", poppedSeq)
 			.detail("nextPageSeq", nextPageSeq)
-			.detail("poppedCommitted", rawQueue->dbg_file0BeginSeq + rawQueue->files[0].popped + rawQueue->files[1].popped)
+			.detail("poppedCommitted", rawQueue->file0BeginSeq + rawQueue->files[0].popped + rawQueue->files[1].popped)
 			.detail("file0name", rawQueue->files[0].dbgFilename);
 		rawQueue->close();
 		delete this;
@@ -883,7 +934,12 @@ private:
 			if (!self->readBufPage->checkHash() || self->readBufPage->seq < self->nextReadLocation/sizeof(Page)*sizeof(Page)) {
 				TraceEvent("DQRecInvalidPage", self->dbgid).detail("nextReadLocation", self->nextReadLocation).detail("hashCheck", self->readBufPage->checkHash())
 					.detail("seq", self->readBufPage->seq).detail("expect", self->nextReadLocation/sizeof(Page)*sizeof(Page)).detail("file0name", self->rawQueue->files[0].dbgFilename);
-				Void _ = wait( self->rawQueue->truncateBeforeLastReadPage() );
+				bool swapped = wait( self->rawQueue->truncateBeforeLastReadPage() );
+				if (swapped) {
+					// Keep the first pages in the same order as the files, for findPhysicalLocation()
+					Page* firstPages = (Page*)self->recoveryFirstPages.begin();
+					std::swap( firstPages[0], firstPages[1] );
+				}
 				break;
 			}
 			//TraceEvent("DQRecPage", self->dbgid).detail("nextReadLoc", self->nextReadLocation).detail("Seq", self->readBufPage->seq).detail("Pop", self->readBufPage->popped).detail("Payload", self->readBufPage->payloadSize).detail("file0name", self->rawQueue->files[0].dbgFilename);
@@ -916,6 +972,38 @@ private:
 		return result.str;
 	}
 
+	ACTOR static Future<Standalone<StringRef>> read( DiskQueue* self, location from, location to ) {
+		ASSERT( self->recovered );
+		ASSERT( !from.hi && !to.hi && from.lo <= to.lo );
+		ASSERT( to.lo <= self->lastCommittedSeq );
+		if (from.lo == to.lo) return Standalone<StringRef>();
+
+		state int64_t firstPageSeq = from.lo / sizeof(Page) * sizeof(Page);
+		state int64_t lastPageSeq = (to.lo - 1) / sizeof(Page) * sizeof(Page);
+		state Standalone<StringRef> pages = wait( self->rawQueue->readPages( firstPageSeq, lastPageSeq - firstPageSeq + sizeof(Page) ) );
+
+		Standalone<StringRef> result;
+		uint8_t* out = new (result.arena()) uint8_t[to.lo - from.lo];
+		int length = 0;
+		for(Page* p = (Page*)pages.begin(); p != (Page*)pages.end(); ++p) {
+			int64_t expectedSeq = firstPageSeq + (p - (Page*)pages.begin()) * sizeof(Page);
+			if (!p->checkHash() || p->seq != expectedSeq) {
+				TraceEvent(SevError, "DQReadInvalidPage", self->dbgid).detail("From", from.lo).detail("To", to.lo).detail("ExpectedSeq", expectedSeq)
+					.detail("Seq", p->seq).detail("HashCheck", p->checkHash()).detail("PoppedSeq", self->poppedSeq).detail("file0name", self->rawQueue->files[0].dbgFilename);
+				throw io_error();
+			}
+			int64_t payloadSeq = p->seq + sizeof(PageHeader);
+			int64_t begin = std::max<int64_t>( from.lo, payloadSeq );
+			int64_t end = std::min<int64_t>( to.lo, payloadSeq + p->payloadSize );
+			if (end > begin) {
+				memcpy( out + length, p->payload + (begin - payloadSeq), end - begin );
+				length += end - begin;
+			}
+		}
+		((StringRef&)result) = StringRef( out, length );
+		return result;
+	}
+
 	ACTOR static Future<bool> findStart( DiskQueue* self ) {
 		Standalone<StringRef> epbuf = wait( self->rawQueue->readFirstAndLastPages( &comparePages ) );
 		ASSERT( epbuf.size() % sizeof(Page) == 0 );
@@ -1053,6 +1141,9 @@ public:
 		return pushed;
 	}
 
+	virtual location getNextPushLocation() { return queue->getNextPushLocation(); }
+	virtual Future<Standalone<StringRef>> read( location from, location to ) { return queue->read(from, to); }
+
 	virtual void pop( location upTo ) {
 		popped = std::max(popped, upTo);
 		ASSERT_WE_THINK(committed >= popped);
@@ -1106,3 +1197,83 @@ private:
 IDiskQueue* openDiskQueue( std::string basename, UID dbgid, int64_t fileSizeWarningLimit ) {
 	return new DiskQueue_PopUncommitted( basename, dbgid, fileSizeWarningLimit );
 }
+
+// A push that the test below expects to read back
+struct DiskQueueTestEntry {
+	IDiskQueue::location from, to;
+	Standalone<StringRef> data;
+};
+
+ACTOR static Future<Void> recoverDiskQueue( IDiskQueue* queue ) {
+	loop {
+		Standalone<StringRef> data = wait( queue->readNext( 1<<20 ) );
+		if (data.size() < 1<<20) return Void();
+	}
+}
+
+ACTOR static Future<Void> checkDiskQueueRead( IDiskQueue* queue, DiskQueueTestEntry entry ) {
+	Standalone<StringRef> data = wait( queue->read( entry.from, entry.to ) );
+	ASSERT( data == entry.data );
+	return Void();
+}
+
+// Reads back committed pushes by location, as TLog peeks of data spilled by reference do, while pops move the queue between its two
+// files and after the queue is reopened
+TEST_CASE("fdbserver/DiskQueue/read") {
+	// Named like a simulated machine's folder, which is what simulation expects to find in its data folder
+	state std::string folder = "simfdb/" + g_random->randomUniqueID().toString() + "/";
+	platform::createDirectory( folder );
+	state std::string basename = folder + "diskqueue-";
+	state IDiskQueue* queue = openDiskQueue( basename, UID() );
+	state std::deque<DiskQueueTestEntry> committed;  // In order, and not popped
+	state std::vector<DiskQueueTestEntry> pushed;    // Since the last commit
+	state bool canPop;  // The queue only permits pops up to what it has committed since it was opened
+	state int reopen;
+	state int i;
+
+	for(reopen = 0; reopen < 4; reopen++) {
+		Void _ = wait( recoverDiskQueue( queue ) );
+		canPop = false;
+		for(i = 0; i < committed.size(); i++) {
+			Void _ = wait( checkDiskQueueRead( queue, committed[i] ) );
+		}
+
+		for(i = 0; i < 2000; i++) {
+			DiskQueueTestEntry entry;
+			entry.data = Standalone<StringRef>( g_random->randomAlphaNumeric( g_random->random01() < 0.1 ? g_random->randomInt(1, 50000) : g_random->randomInt(1, 200) ) );
+			entry.from = queue->getNextPushLocation();
+			entry.to = queue->push( entry.data );
+			pushed.push_back( entry );
+
+			if (g_random->random01() < 0.1) {
+				Void _ = wait( queue->commit() );
+				committed.insert( committed.end(), pushed.begin(), pushed.end() );
+				pushed.clear();
+				canPop = true;
+			}
+			if (canPop && committed.size() > 100 && g_random->random01() < 0.1) {
+				int popped = g_random->randomInt(1, committed.size() - 50);
+				queue->pop( committed[popped].from );
+				committed.erase( committed.begin(), committed.begin() + popped );
+			}
+			if (committed.size() && g_random->random01() < 0.2) {
+				Void _ = wait( checkDiskQueueRead( queue, committed[ g_random->randomInt(0, committed.size()) ] ) );
+			}
+		}
+
+		Void _ = wait( queue->commit() );
+		committed.insert( committed.end(), pushed.begin(), pushed.end() );
+		pushed.clear();
+
+		state Future<Void> closed = queue->onClosed();
+		queue->close();
+		Void _ = wait( closed );
+		queue = openDiskQueue( basename, UID() );
+	}
+
+	Void _ = wait( recoverDiskQueue( queue ) );
+	state Future<Void> disposed = queue->onClosed();
+	queue->dispose();
+	Void _ = wait( disposed );
+	return Void();
+}
@@ -35,6 +35,26 @@ public:
 	virtual void close() = 0;     // invalidate this interface, but do not delete the data.  Outstanding operations may or may not take effect in the background.
 };
 
+// Reads a range of an IKeyValueStore a piece at a time.  The cursor has a position: next() returns rows at or after it
+// in ascending order and prev() returns rows before it in descending order, and both move the position past the rows
+// they return.  The limits are as for readRange(), and an empty result means there are no more rows in that direction.
+// Only one next() or prev() may be outstanding at a time.
+//
+// A cursor may read rows before they are asked for and may keep rows it has already returned, so the rows it returns
+// are as of a read that began when the cursor was created and has not ended yet.
+class IKeyValueCursor : public ReferenceCounted<IKeyValueCursor> {
+public:
+	virtual void seek( KeyRef key ) = 0;
+	virtual Future<Standalone<VectorRef<KeyValueRef>>> next( int rowLimit, int byteLimit = 1<<30 ) = 0;
+	virtual Future<Standalone<VectorRef<KeyValueRef>>> prev( int rowLimit, int byteLimit = 1<<30 ) = 0;
+
+	// Hints that the next call from the current position will be next() (or prev(), if reverse) with about these limits,
+	// so the cursor may start reading those rows now
+	virtual void readAhead( bool reverse, int rowLimit, int byteLimit ) = 0;
+
+	virtual ~IKeyValueCursor() {}
+};
+
 class IKeyValueStore : public IClosable {
 public:
 	virtual KeyValueStoreType getType() = 0;
@@ -51,6 +71,9 @@ public:
 	// The total size of the returned value (less the last entry) will be less than byteLimit
 	virtual Future<Standalone<VectorRef<KeyValueRef>>> readRange( KeyRangeRef keys, int rowLimit = 1<<30, int byteLimit = 1<<30 ) = 0;
 
+	// Returns a cursor over keys, positioned at keys.begin
+	virtual Reference<IKeyValueCursor> readCursor( KeyRangeRef keys ) = 0;
+
 	//Returns the amount of free and total space for this store, in bytes
 	virtual StorageBytes getStorageBytes() = 0;
 
@@ -80,6 +103,10 @@ extern IKeyValueStore* keyValueStoreSQLite( std::string const& filename, UID log
 extern IKeyValueStore* keyValueStoreMemory( std::string const& basename, UID logID, int64_t memoryLimit );
 extern IKeyValueStore* keyValueStoreLogSystem( class IDiskQueue* queue, UID logID, int64_t memoryLimit, bool disableSnapshot, bool replaceContent );
 
+// A cursor that reads from store->readRange(), only what each call asks for.  If readsAhead, readAhead() starts the
+// read for the call it is told about; otherwise it does nothing.
+extern Reference<IKeyValueCursor> readAheadCursor( IKeyValueStore* store, KeyRangeRef keys, bool readsAhead );
+
 inline IKeyValueStore* openKVStore( KeyValueStoreType storeType, std::string const& filename, UID logID, int64_t memoryLimit, bool checkChecksums=false, bool checkIntegrity=false ) {
 	switch( storeType ) {
 	case KeyValueStoreType::SSD_BTREE_V1:
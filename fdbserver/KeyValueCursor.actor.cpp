@@ -0,0 +1,267 @@
+/*
+ * KeyValueCursor.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/actorcompiler.h"
+#include "flow/UnitTest.h"
+#include "fdbclient/SystemData.h"
+#include "IKeyValueStore.h"
+
+// All of the rows of the store in covers, sorted ascending
+struct CursorChunk {
+	Standalone<VectorRef<KeyValueRef>> rows;
+	KeyRange covers;
+};
+
+class ReadAheadCursor : public IKeyValueCursor {
+public:
+	ReadAheadCursor( IKeyValueStore* store, KeyRangeRef keys, bool readsAhead )
+		: store(store), range(keys), position(keys.begin), readsAhead(readsAhead), aheadReverse(false) {}
+
+	virtual void seek( KeyRef key ) {
+		if (key < range.begin) position = range.begin;
+		else if (key > range.end) position = range.end;
+		else position = key;
+	}
+
+	virtual Future<Standalone<VectorRef<KeyValueRef>>> next( int rowLimit, int byteLimit ) {
+		return read( Reference<ReadAheadCursor>::addRef(this), false, rowLimit, byteLimit );
+	}
+
+	virtual Future<Standalone<VectorRef<KeyValueRef>>> prev( int rowLimit, int byteLimit ) {
+		return read( Reference<ReadAheadCursor>::addRef(this), true, rowLimit, byteLimit );
+	}
+
+	virtual void readAhead( bool reverse, int rowLimit, int byteLimit ) {
+		if (!readsAhead || rowLimit <= 0 || byteLimit <= 0) return;
+
+		// The rows of current past the position will be returned first, so the read starts after them
+		Key from = position;
+		if (reverse ? position > current.covers.begin && position <= current.covers.end : position >= current.covers.begin && position < current.covers.end)
+			from = reverse ? current.covers.begin : current.covers.end;
+		if (from == (reverse ? range.begin : range.end) || (ahead.isValid() && aheadReverse == reverse && aheadFrom == from))
+			return;
+
+		ahead = readChunk( store, range, from, reverse, rowLimit, byteLimit );
+		aheadFrom = from;
+		aheadReverse = reverse;
+	}
+
+private:
+	IKeyValueStore* store;
+	KeyRange range;
+	Key position;
+	bool readsAhead;
+
+	CursorChunk current;			// the chunk most recently read
+	Future<CursorChunk> ahead;		// the chunk readAhead() started, if the next call has not used or abandoned it yet
+	Key aheadFrom;
+	bool aheadReverse;
+
+	// Appends the rows of current from the position onward (or before it, if reverse) to result until the limits are
+	// reached, and moves the position past them.  Returns true if the limits were reached.
+	// Pre: the limits have not been reached
+	bool take( bool reverse, Standalone<VectorRef<KeyValueRef>>& result, int rowLimit, int byteLimit, int& bytes ) {
+		auto& rows = current.rows;
+		auto r = std::lower_bound( rows.begin(), rows.end(), position, KeyValueRef::OrderByKey() );
+		if (!reverse) {
+			if (position < current.covers.begin || position >= current.covers.end) return false;
+			if (r != rows.end()) result.arena().dependsOn( rows.arena() );
+			for(; r != rows.end(); ++r) {
+				if (result.size() >= rowLimit || bytes >= byteLimit) {
+					position = r->key;
+					return true;
+				}
+				result.push_back( result.arena(), *r );
+				bytes += sizeof(KeyValueRef) + r->expectedSize();
+			}
+			position = current.covers.end;
+		} else {
+			if (position <= current.covers.begin || position > current.covers.end) return false;
+			if (r != rows.begin()) result.arena().dependsOn( rows.arena() );
+			for(; r != rows.begin(); --r) {
+				if (result.size() >= rowLimit || bytes >= byteLimit) {
+					position = r->key;
+					return true;
+				}
+				result.push_back( result.arena(), r[-1] );
+				bytes += sizeof(KeyValueRef) + r[-1].expectedSize();
+			}
+			position = current.covers.begin;
+		}
+		return result.size() >= rowLimit || bytes >= byteLimit;
+	}
+
+	ACTOR static Future<CursorChunk> readChunk( IKeyValueStore* store, KeyRange range, Key from, bool reverse, int rowLimit, int byteLimit ) {
+		ASSERT( rowLimit > 0 && byteLimit > 0 );
+		Standalone<VectorRef<KeyValueRef>> rows = wait( store->readRange( reverse ? KeyRangeRef(range.begin, from) : KeyRangeRef(from, range.end), reverse ? -rowLimit : rowLimit, byteLimit ) );
+
+		// Unless the read stopped at a limit, it found every row between from and the end of the range
+		int bytes = 0;
+		for(auto& kv : rows)
+			bytes += sizeof(KeyValueRef) + kv.expectedSize();
+		bool limited = rows.size() >= rowLimit || bytes >= byteLimit;
+
+		CursorChunk chunk;
+		if (reverse) {
+			chunk.rows.arena().dependsOn( rows.arena() );
+			for(int i = rows.size() - 1; i >= 0; i--)
+				chunk.rows.push_back( chunk.rows.arena(), rows[i] );
+			chunk.covers = KeyRangeRef( limited ? rows.back().key : range.begin, from );
+		} else {
+			chunk.rows = rows;
+			chunk.covers = KeyRangeRef( from, limited ? keyAfter(rows.back().key) : range.end );
+		}
+		return chunk;
+	}
+
+	ACTOR static Future<Standalone<VectorRef<KeyValueRef>>> read( Reference<ReadAheadCursor> self, bool reverse, int rowLimit, int byteLimit ) {
+		state Standalone<VectorRef<KeyValueRef>> result;
+		state int bytes = 0;
+		if (rowLimit <= 0 || byteLimit <= 0)
+			return result;
+		loop {
+			if (self->take( reverse, result, rowLimit, byteLimit, bytes ) || self->position == (reverse ? self->range.begin : self->range.end))
+				return result;
+
+			state Future<CursorChunk> chunk;
+			if (self->ahead.isValid() && self->aheadReverse == reverse && self->aheadFrom == self->position)
+				chunk = self->ahead;
+			else
+				chunk = readChunk( self->store, self->range, self->position, reverse, rowLimit - result.size(), byteLimit - bytes );
+			self->ahead = Future<CursorChunk>();
+
+			CursorChunk c = wait( chunk );
+			self->current = c;
+		}
+	}
+};
+
+Reference<IKeyValueCursor> readAheadCursor( IKeyValueStore* store, KeyRangeRef keys, bool readsAhead ) {
+	return Reference<IKeyValueCursor>( new ReadAheadCursor( store, keys, readsAhead ) );
+}
+
+// An IKeyValueStore holding a std::map, which reads the way KeyValueStoreSQLite does
+struct MapKeyValueStore : IKeyValueStore {
+	std::map<Key, Value> data;
+	int reads;
+
+	MapKeyValueStore() : reads(0) {}
+
+	virtual Future<Void> getError() { return Never(); }
+	virtual Future<Void> onClosed() { return Void(); }
+	virtual void dispose() {}
+	virtual void close() {}
+
+	virtual KeyValueStoreType getType() { return KeyValueStoreType::MEMORY; }
+	virtual StorageBytes getStorageBytes() { return StorageBytes(); }
+
+	virtual void set( KeyValueRef keyValue, const Arena* arena = NULL ) { data[keyValue.key] = keyValue.value; }
+	virtual void clear( KeyRangeRef range, const Arena* arena = NULL ) { data.erase( data.lower_bound(range.begin), data.lower_bound(range.end) ); }
+	virtual Future<Void> commit(bool sequential = false) { return Void(); }
+
+	virtual Future<Optional<Value>> readValue( KeyRef key, Optional<UID> debugID = Optional<UID>() ) {
+		auto it = data.find(key);
+		if (it == data.end()) return Optional<Value>();
+		return Optional<Value>( it->second );
+	}
+	virtual Future<Optional<Value>> readValuePrefix( KeyRef key, int maxLength, Optional<UID> debugID = Optional<UID>() ) { UNREACHABLE(); }
+
+	virtual Future<Standalone<VectorRef<KeyValueRef>>> readRange( KeyRangeRef keys, int rowLimit = 1<<30, int byteLimit = 1<<30 ) {
+		++reads;
+		Standalone<VectorRef<KeyValueRef>> result;
+		int bytes = 0;
+		bool reverse = rowLimit < 0;
+		rowLimit = std::abs(rowLimit);
+		auto it = reverse ? data.lower_bound(keys.end) : data.lower_bound(keys.begin);
+		while (result.size() < rowLimit && bytes < byteLimit) {
+			if (reverse ? it == data.begin() || (--it)->first < keys.begin : it == data.end() || it->first >= keys.end)
+				break;
+			result.push_back_deep( result.arena(), KeyValueRef(it->first, it->second) );
+			bytes += sizeof(KeyValueRef) + result.back().expectedSize();
+			if (!reverse) ++it;
+		}
+		return result;
+	}
+
+	virtual Reference<IKeyValueCursor> readCursor( KeyRangeRef keys ) { return readAheadCursor( this, keys, false ); }
+};
+
+// Returns the rows a cursor at position should return for next() (or prev(), if reverse), and moves position past them
+static Standalone<VectorRef<KeyValueRef>> expectedRows( MapKeyValueStore& store, KeyRangeRef range, Key& position, bool reverse, int rowLimit, int byteLimit ) {
+	Standalone<VectorRef<KeyValueRef>> rows = reverse ?
+		store.readRange( KeyRangeRef(range.begin, std::max<KeyRef>(range.begin, position)), -rowLimit, byteLimit ).get() :
+		store.readRange( KeyRangeRef(std::min<KeyRef>(range.end, position), range.end), rowLimit, byteLimit ).get();
+	if (rows.size())
+		position = reverse ? Key(rows.back().key) : keyAfter(rows.back().key);
+	return rows;
+}
+
+TEST_CASE("fdbserver/KeyValueCursor/readAhead") {
+	state MapKeyValueStore store;
+	state int i;
+	for(i = 0; i < 1000; i++)
+		store.set( KeyValueRef( StringRef(format("%06d", g_random->randomInt(0, 100000))), std::string( g_random->randomInt(0, 100), 'v' ) ) );
+
+	state int test;
+	for(test = 0; test < 100; test++) {
+		state Key a = StringRef(format("%06d", g_random->randomInt(0, 100000)));
+		state Key b = StringRef(format("%06d", g_random->randomInt(0, 100000)));
+		state KeyRange range = KeyRangeRef( std::min(a, b), std::max(a, b) );
+		state Reference<IKeyValueCursor> cursor = readAheadCursor( &store, range, g_random->coinflip() );
+		state Key position = range.begin;
+
+		for(i = 0; i < 50; i++) {
+			if (g_random->random01() < 0.2) {
+				Key k = StringRef(format("%06d", g_random->randomInt(0, 100000)));
+				cursor->seek( k );
+				position = std::max<KeyRef>( range.begin, std::min<KeyRef>( range.end, k ) );
+			}
+			state bool reverse = g_random->coinflip();
+			state int rowLimit = g_random->randomInt(1, 100);
+			state int byteLimit = g_random->randomInt(1, 5000);
+			if (g_random->random01() < 0.5)  // Sometimes for a different call than the one that follows
+				cursor->readAhead( g_random->random01() < 0.8 ? reverse : !reverse, g_random->randomInt(0, 100), g_random->randomInt(0, 5000) );
+			state Standalone<VectorRef<KeyValueRef>> expected = expectedRows( store, range, position, reverse, rowLimit, byteLimit );
+			Standalone<VectorRef<KeyValueRef>> rows = wait( reverse ? cursor->prev( rowLimit, byteLimit ) : cursor->next( rowLimit, byteLimit ) );
+			ASSERT( rows == expected );
+		}
+	}
+
+	// A scan reads each row from the store once, with one read per call whether or not it announces each call with
+	// readAhead() (plus one to find that there are no more rows)
+	state int announced;
+	for(announced = 0; announced < 2; announced++) {
+		store.reads = 0;
+		state Reference<IKeyValueCursor> scan = readAheadCursor( &store, allKeys, true );
+		state int rowsRead = 0;
+		state int calls = 0;
+		loop {
+			Standalone<VectorRef<KeyValueRef>> rows = wait( scan->next( 10 ) );
+			if (!rows.size()) break;
+			rowsRead += rows.size();
+			calls++;
+			if (announced)
+				scan->readAhead( false, 10, 1<<30 );
+		}
+		ASSERT( rowsRead == store.data.size() && store.reads <= calls + 1 );
+	}
+
+	return Void();
+}
@@ -77,10 +77,10 @@ struct KeyValueStoreCompressTestData : IKeyValueStore {
 	// If rowLimit>=0, reads first rows sorted ascending, otherwise reads last rows sorted descending
 	// The total size of the returned value (less the last entry) will be less than byteLimit
 	virtual Future<Standalone<VectorRef<KeyValueRef>>> readRange( KeyRangeRef keys, int rowLimit = 1<<30, int byteLimit = 1<<30 ) {
-		return doReadRange(store, keys, rowLimit, byteLimit);
+		return unpackRange( store->readRange(keys, rowLimit, byteLimit) );
 	}
-	ACTOR Future<Standalone<VectorRef<KeyValueRef>>> doReadRange( IKeyValueStore* store, KeyRangeRef keys, int rowLimit, int byteLimit ) {
-		Standalone<VectorRef<KeyValueRef>> _vs = wait( store->readRange(keys, rowLimit, byteLimit) );
+	ACTOR static Future<Standalone<VectorRef<KeyValueRef>>> unpackRange( Future<Standalone<VectorRef<KeyValueRef>>> read ) {
+		Standalone<VectorRef<KeyValueRef>> _vs = wait( read );
 		Standalone<VectorRef<KeyValueRef>> vs = _vs; // Get rid of implicit const& from wait statement
 		Arena& a = vs.arena();
 		for(int i=0; i<vs.size(); i++)
@@ -88,6 +88,19 @@ struct KeyValueStoreCompressTestData : IKeyValueStore {
 		return vs;
 	}
 
+	virtual Reference<IKeyValueCursor> readCursor( KeyRangeRef keys ) {
+		return Reference<IKeyValueCursor>( new Cursor( store->readCursor(keys) ) );
+	}
+	struct Cursor : IKeyValueCursor {
+		Reference<IKeyValueCursor> cursor;
+		explicit Cursor( Reference<IKeyValueCursor> const& cursor ) : cursor(cursor) {}
+
+		virtual void seek( KeyRef key ) { cursor->seek(key); }
+		virtual Future<Standalone<VectorRef<KeyValueRef>>> next( int rowLimit, int byteLimit ) { return unpackRange( cursor->next(rowLimit, byteLimit) ); }
+		virtual Future<Standalone<VectorRef<KeyValueRef>>> prev( int rowLimit, int byteLimit ) { return unpackRange( cursor->prev(rowLimit, byteLimit) ); }
+		virtual void readAhead( bool reverse, int rowLimit, int byteLimit ) { cursor->readAhead(reverse, rowLimit, byteLimit); }
+	};
+
 private:
 	// These implement the actual "compression" scheme
 	static Value pack( Value val ) {
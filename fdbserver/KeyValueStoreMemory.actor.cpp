@@ -52,6 +52,14 @@ bool operator<(KeyValueMapPair const& l, CompatibleWithKey const& r) { return l.
 template <class CompatibleWithKey>
 bool operator<(CompatibleWithKey const& l, KeyValueMapPair const& r) { return l < r.key; }
 
+inline int compare(KeyValueMapPair const& l, KeyValueMapPair const& r) { return threeWayCompare(l.key, r.key); }
+
+template <class CompatibleWithKey>
+int compare(KeyValueMapPair const& l, CompatibleWithKey const& r) { return threeWayCompare(l.key, r); }
+
+template <class CompatibleWithKey>
+int compare(CompatibleWithKey const& l, KeyValueMapPair const& r) { return threeWayCompare(l, r.key); }
+
 extern bool noUnseed;
 
 class KeyValueStoreMemory : public IKeyValueStore, NonCopyable {
@@ -250,6 +258,9 @@ public:
 		return result;
 	}
 
+	// Reads are served from memory without waiting, so there is nothing to gain by reading ahead
+	virtual Reference<IKeyValueCursor> readCursor( KeyRangeRef keys ) { return readAheadCursor( this, keys, false ); }
+
 	virtual void resyncLog() {
 		ASSERT( recovering.isReady() );
 		resetSnapshot = true;
@@ -53,6 +53,9 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 	init( PEEK_TRACKER_EXPIRATION_TIME,                          600 ); if( randomize && BUGGIFY ) PEEK_TRACKER_EXPIRATION_TIME = g_random->coinflip() ? 0.1 : 60;
 	init( PARALLEL_GET_MORE_REQUESTS,                             32 ); if( randomize && BUGGIFY ) PARALLEL_GET_MORE_REQUESTS = 2;
 	init( MAX_QUEUE_COMMIT_BYTES,                               15e6 ); if( randomize && BUGGIFY ) MAX_QUEUE_COMMIT_BYTES = 5000;
+	init( TLOG_SPILL_REFERENCE,                                    0 ); if( randomize && BUGGIFY ) TLOG_SPILL_REFERENCE = 1; // Only affects TLogs recruited afterwards; the spill type is persisted with each generation's data
+	init( TLOG_SPILL_REFERENCE_MAX_BATCHES_PER_PEEK,              100 ); if( randomize && BUGGIFY ) TLOG_SPILL_REFERENCE_MAX_BATCHES_PER_PEEK = 1;
+	init( TLOG_SPILL_REFERENCE_MAX_PINNED_BYTES,                  2e9 ); if( randomize && BUGGIFY ) TLOG_SPILL_REFERENCE_MAX_PINNED_BYTES = 1e5; // A tag whose references keep more of the queue than this from being popped is spilled by value
 
 	// Versions
 	init( MAX_VERSIONS_IN_FLIGHT,                          100000000 );
@@ -238,6 +241,7 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 	init( RESOLVER_COALESCE_TIME,                                1.0 );
 	init( BUGGIFIED_ROW_LIMIT,                  APPLY_MUTATION_BYTES ); if( randomize && BUGGIFY ) BUGGIFIED_ROW_LIMIT = g_random->randomInt(3, 30);
 	init( PROXY_SPIN_DELAY,                                     0.01 );
+	init( PROXY_GRV_LEASE_DURATION,                              0.0 ); if( randomize && BUGGIFY ) PROXY_GRV_LEASE_DURATION = g_random->random01() < 0.5 ? 0.05 : 2.0; // 0 asks every other proxy for its committed version on each GRV batch
 
 	// Master Server
 	init( MASTER_LOGGING_DELAY,                                  1.0 );
@@ -246,6 +250,10 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 	init( COMMIT_SLEEP_TIME,								  0.0001 ); if( randomize && BUGGIFY ) COMMIT_SLEEP_TIME = 0;
 	init( MIN_BALANCE_TIME,                                      0.2 );
 	init( MIN_BALANCE_DIFFERENCE,                              10000 );
+	init( MIN_BALANCE_CPU_DIFFERENCE,                          50000 ); if( randomize && BUGGIFY ) MIN_BALANCE_CPU_DIFFERENCE = 200; // Microseconds of conflict detection per SAMPLE_EXPIRATION_TIME
+	init( RESOLUTION_BALANCE_ON_CPU,                               1 ); if( randomize && BUGGIFY ) RESOLUTION_BALANCE_ON_CPU = 0;
+	init( RESOLUTION_BALANCE_CPU_SMOOTHING,                      5.0 ); if( randomize && BUGGIFY ) RESOLUTION_BALANCE_CPU_SMOOTHING = 0.5; // e-folding time of each resolver's conflict detection time
+	init( RESOLUTION_BALANCE_CPU_HOLD_TIME,                     10.0 ); if( randomize && BUGGIFY ) RESOLUTION_BALANCE_CPU_HOLD_TIME = 1.0; // Seconds after a move on conflict detection time before the next one
 	init( SECONDS_BEFORE_NO_FAILURE_DELAY,                  8 * 3600 );
 	init( MAX_TXS_SEND_MEMORY,                                   1e7 ); if( randomize && BUGGIFY ) MAX_TXS_SEND_MEMORY = 1e5;
 
@@ -253,7 +261,10 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 	init( SAMPLE_OFFSET_PER_KEY,                                 100 );
 	init( SAMPLE_EXPIRATION_TIME,                                1.0 );
 	init( SAMPLE_POLL_TIME,                                      0.1 );
+	init( RESOLVER_CPU_UNITS_PER_SAMPLE,                          10 ); // Microseconds
 	init( RESOLVER_STATE_MEMORY_LIMIT,                           1e6 );
+	init( CONFLICT_SET_THREADS,                                    0 ); // Values > 1 run conflict detection on that many worker threads (ignored in simulation)
+	init( CONFLICT_SET_RADIX_TREE,                                 0 ); if( randomize && BUGGIFY ) CONFLICT_SET_RADIX_TREE = 1;
 	init( LAST_LIMITED_RATIO,                                    0.6 );
 
 	//Cluster Controller
@@ -340,6 +351,11 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 	init( BYTE_SAMPLING_FACTOR,                                  250 ); //cannot buggify because of differences in restarting tests
 	init( BYTE_SAMPLING_OVERHEAD,                                100 );
 	init( MAX_STORAGE_SERVER_WATCH_BYTES,                      100e6 ); if( randomize && BUGGIFY ) MAX_STORAGE_SERVER_WATCH_BYTES = 10e3;
+	init( STORAGE_ROW_CACHE_BYTES,                                 0 ); if( randomize && BUGGIFY ) STORAGE_ROW_CACHE_BYTES = g_random->coinflip() ? 1e6 : 2000;
+	init( STORAGE_CURSOR_CACHE_SIZE,                              32 ); if( randomize && BUGGIFY ) STORAGE_CURSOR_CACHE_SIZE = g_random->randomInt(0, 3);
+	init( STORAGE_AGGREGATE_LIMIT_BYTES,                         5e6 ); if( randomize && BUGGIFY ) STORAGE_AGGREGATE_LIMIT_BYTES = 1000;
+	init( STORAGE_GET_VALUES_MAX_KEYS,                          1000 ); if( randomize && BUGGIFY ) STORAGE_GET_VALUES_MAX_KEYS = g_random->randomInt(1, 10);
+	init( STORAGE_GET_VALUES_READ_WINDOW,                        100 ); if( randomize && BUGGIFY ) STORAGE_GET_VALUES_READ_WINDOW = g_random->randomInt(1, 4);
 	init( MAX_BYTE_SAMPLE_CLEAR_MAP_SIZE,                        1e9 ); if( randomize && BUGGIFY ) MAX_BYTE_SAMPLE_CLEAR_MAP_SIZE = 1e3;
 	init( LONG_BYTE_SAMPLE_RECOVERY_DELAY,                      60.0 );
 
@@ -354,6 +370,8 @@ ServerKnobs::ServerKnobs(bool randomize, ClientKnobs* clientKnobs) {
 
 	// Test harness
 	init( WORKER_POLL_DELAY,                                     1.0 );
+	init( NETWORK_TEST_REPLY_SIZE,                            600e3 );
+	init( NETWORK_TEST_REQUEST_COUNT,                            30 );
 
 	// Coordination
 	init( COORDINATED_STATE_ONCONFLICT_POLL_INTERVAL,            1.0 ); if( randomize && BUGGIFY ) COORDINATED_STATE_ONCONFLICT_POLL_INTERVAL = 10.0;
@@ -58,6 +58,9 @@ public:
 	double PEEK_TRACKER_EXPIRATION_TIME;
 	int PARALLEL_GET_MORE_REQUESTS;
 	int64_t MAX_QUEUE_COMMIT_BYTES;
+	int TLOG_SPILL_REFERENCE; // If nonzero, spill only the DiskQueue locations of messages to persistentData, rather than the messages themselves
+	int TLOG_SPILL_REFERENCE_MAX_BATCHES_PER_PEEK;
+	int64_t TLOG_SPILL_REFERENCE_MAX_PINNED_BYTES;
 
 	// Versions
 	int MAX_VERSIONS_IN_FLIGHT;
@@ -183,12 +186,17 @@ public:
 	double RESOLVER_COALESCE_TIME;
 	int BUGGIFIED_ROW_LIMIT;
 	double PROXY_SPIN_DELAY;
+	double PROXY_GRV_LEASE_DURATION;
 
 	// Master Server
 	double MASTER_LOGGING_DELAY;
 	double COMMIT_SLEEP_TIME;
 	double MIN_BALANCE_TIME;
 	int64_t MIN_BALANCE_DIFFERENCE;
+	int64_t MIN_BALANCE_CPU_DIFFERENCE;
+	int RESOLUTION_BALANCE_ON_CPU;
+	double RESOLUTION_BALANCE_CPU_SMOOTHING;
+	double RESOLUTION_BALANCE_CPU_HOLD_TIME;
 	double SECONDS_BEFORE_NO_FAILURE_DELAY;
 	int64_t MAX_TXS_SEND_MEMORY;
 
@@ -196,7 +204,10 @@ public:
 	int64_t SAMPLE_OFFSET_PER_KEY;
 	double SAMPLE_EXPIRATION_TIME;
 	double SAMPLE_POLL_TIME;
+	int64_t RESOLVER_CPU_UNITS_PER_SAMPLE;
 	int64_t RESOLVER_STATE_MEMORY_LIMIT;
+	int CONFLICT_SET_THREADS;
+	int CONFLICT_SET_RADIX_TREE;
 
 	//Cluster Controller
 	double MASTER_FAILURE_REACTION_TIME;
@@ -281,6 +292,11 @@ public:
 	int BYTE_SAMPLING_FACTOR;
 	int BYTE_SAMPLING_OVERHEAD;
 	int MAX_STORAGE_SERVER_WATCH_BYTES;
+	int64_t STORAGE_ROW_CACHE_BYTES; // Memory for rows read by getValue, or 0 to disable the row cache
+	int STORAGE_CURSOR_CACHE_SIZE; // Cursors kept for range reads that may be continued, or 0 to disable
+	int64_t STORAGE_AGGREGATE_LIMIT_BYTES; // Bytes of rows aggregated by one GetRangeAggregateRequest before the client has to continue
+	int STORAGE_GET_VALUES_MAX_KEYS; // Keys read for one GetValuesRequest, however many it sends; the client asks again for the rest
+	int STORAGE_GET_VALUES_READ_WINDOW; // Keys of a GetValuesRequest whose storage engine reads are in flight together
 	int MAX_BYTE_SAMPLE_CLEAR_MAP_SIZE;
 	double LONG_BYTE_SAMPLE_RECOVERY_DELAY;
 
@@ -295,6 +311,8 @@ public:
 
 	// Test harness
 	double WORKER_POLL_DELAY;
+	int NETWORK_TEST_REPLY_SIZE;     // Reply size and number of outstanding requests for fdbserver -r networktestclient
+	int NETWORK_TEST_REQUEST_COUNT;
 
 	// Coordination
 	double COORDINATED_STATE_ONCONFLICT_POLL_INTERVAL;
@@ -536,12 +536,17 @@ struct CompareFirst {
 
 struct LogPushData : NonCopyable {
 	// Log subsequences have to start at 1 (the MergedPeekCursor relies on this to make sure we never have !hasMessage() in the middle of data for a version
+	//
+	// Each message is serialized once, into allMessages.  A location (TLog) that has been sent every message so far pushes
+	// allMessages itself, so when every mutation goes to every TLog they all share one buffer.  A location is given its own
+	// copy, in the arena, from the first message it isn't sent.
 
-	explicit LogPushData(Reference<ILogSystem> logSystem) : logSystem(logSystem), subsequence(1) {
+	explicit LogPushData(Reference<ILogSystem> logSystem) : logSystem(logSystem), subsequence(1), allMessages( AssumeVersion(currentProtocolVersion) ),
+		messageBytes(0), copiedBytes(0) {
 		for(auto& log : logSystem->getLogSystemConfig().tLogs) {
 			if(log.isLocal) {
 				for(int i = 0; i < log.tLogs.size(); i++) {
-					messagesWriter.push_back( BinaryWriter( AssumeVersion(currentProtocolVersion) ) );
+					locations.push_back( LocationMessages() );
 				}
 			}
 		}
@@ -554,65 +559,101 @@ struct LogPushData : NonCopyable {
 
 	void addMessage( StringRef rawMessageWithoutLength, bool usePreviousLocations = false ) {
 		if( !usePreviousLocations ) {
-			prev_tags.clear();
-			if(logSystem->hasRemoteLogs()) {
-				prev_tags.push_back( logSystem->getRandomRouterTag() );
-			}
-			for(auto& tag : next_message_tags) {
-				prev_tags.push_back(tag);
-			}
-			msg_locations.clear();
-			logSystem->getPushLocations( prev_tags, msg_locations );
-			next_message_tags.clear();
+			setLocationsForNextMessage();
 		}
 		uint32_t subseq = this->subsequence++;
-		for(int loc : msg_locations) {
-			messagesWriter[loc] << uint32_t(rawMessageWithoutLength.size() + sizeof(subseq) + sizeof(uint16_t) + sizeof(Tag)*prev_tags.size()) << subseq << uint16_t(prev_tags.size());
-			for(auto& tag : prev_tags)
-				messagesWriter[loc] << tag;
-			messagesWriter[loc].serializeBytes(rawMessageWithoutLength);
-		}
+		int offset = allMessages.getLength();
+		allMessages << uint32_t(rawMessageWithoutLength.size() + sizeof(subseq) + sizeof(uint16_t) + sizeof(Tag)*prev_tags.size()) << subseq << uint16_t(prev_tags.size());
+		for(auto& tag : prev_tags)
+			allMessages << tag;
+		allMessages.serializeBytes(rawMessageWithoutLength);
+		copyToLocations( offset, subseq );
 	}
 
 	template <class T>
 	void addTypedMessage( T const& item ) {
-		prev_tags.clear();
-		if(logSystem->hasRemoteLogs()) {
-			prev_tags.push_back( logSystem->getRandomRouterTag() );
-		}
-		for(auto& tag : next_message_tags) {
-			prev_tags.push_back(tag);
-		}
-		msg_locations.clear();
-		logSystem->getPushLocations( prev_tags, msg_locations );
-		
+		setLocationsForNextMessage();
+
 		uint32_t subseq = this->subsequence++;
-		for(int loc : msg_locations) {
-			// FIXME: memcpy after the first time
-			BinaryWriter& wr = messagesWriter[loc];
-			int offset = wr.getLength();
-			wr << uint32_t(0) << subseq << uint16_t(prev_tags.size());
-			for(auto& tag : prev_tags)
-				wr << tag;
-			wr << item;
-			*(uint32_t*)((uint8_t*)wr.getData() + offset) = wr.getLength() - offset - sizeof(uint32_t);
-		}
-		next_message_tags.clear();
+		int offset = allMessages.getLength();
+		allMessages << uint32_t(0) << subseq << uint16_t(prev_tags.size());
+		for(auto& tag : prev_tags)
+			allMessages << tag;
+		allMessages << item;
+		*(uint32_t*)((uint8_t*)allMessages.getData() + offset) = allMessages.getLength() - offset - sizeof(uint32_t);
+		copyToLocations( offset, subseq );
 	}
 
 	Arena getArena() { return arena; }
 	StringRef getMessages(int loc) {
-		return StringRef( arena, messagesWriter[loc].toStringRef() );  // FIXME: Unnecessary copy!
+		if( !locations[loc].all )
+			return StringRef( locations[loc].messages.begin(), locations[loc].messages.size() );
+		if( sharedMessages.size() != allMessages.getLength() ) {
+			sharedMessages = StringRef( arena, allMessages.toStringRef() );
+			copiedBytes += sharedMessages.size();
+		}
+		return sharedMessages;
 	}
 
+	// The bytes of messages destined for all locations together, and the bytes actually written or copied to produce them
+	int64_t getMessageBytes() const { return messageBytes; }
+	int64_t getCopiedBytes() const { return copiedBytes; }
+
 private:
+	struct LocationMessages {
+		bool all;	// This location has been sent every message so far, and pushes allMessages
+		uint32_t lastSubsequence;
+		VectorRef<uint8_t> messages;	// Otherwise, its messages
+
+		LocationMessages() : all(true), lastSubsequence(0) {}
+	};
+
 	Reference<ILogSystem> logSystem;
 	Arena arena;
 	vector<Tag> next_message_tags;
 	vector<Tag> prev_tags;
-	vector<BinaryWriter> messagesWriter;
+	vector<LocationMessages> locations;
 	vector<int> msg_locations;
 	uint32_t subsequence;
+	BinaryWriter allMessages;
+	StringRef sharedMessages;
+	int64_t messageBytes, copiedBytes;
+
+	void setLocationsForNextMessage() {
+		prev_tags.clear();
+		if(logSystem->hasRemoteLogs()) {
+			prev_tags.push_back( logSystem->getRandomRouterTag() );
+		}
+		for(auto& tag : next_message_tags) {
+			prev_tags.push_back(tag);
+		}
+		msg_locations.clear();
+		logSystem->getPushLocations( prev_tags, msg_locations );
+		next_message_tags.clear();
+	}
+
+	// Gives the message serialized at allMessages[offset..] to the locations in msg_locations
+	void copyToLocations( int offset, uint32_t subseq ) {
+		const uint8_t* message = (const uint8_t*)allMessages.getData() + offset;
+		int length = allMessages.getLength() - offset;
+		copiedBytes += length;
+		messageBytes += int64_t(length) * msg_locations.size();
+
+		for(int loc : msg_locations)
+			locations[loc].lastSubsequence = subseq;
+		for(auto& l : locations) {
+			if( l.lastSubsequence == subseq ) {
+				if( !l.all ) {
+					l.messages.append( arena, message, length );
+					copiedBytes += length;
+				}
+			} else if( l.all ) {
+				l.all = false;
+				l.messages.append( arena, (const uint8_t*)allMessages.getData(), offset );
+				copiedBytes += offset;
+			}
+		}
+	}
 };
 
 #endif
@@ -41,10 +41,13 @@
 #include "RecoveryState.h"
 #include "fdbclient/Atomic.h"
 #include "flow/TDMetric.actor.h"
+#include "fdbrpc/ContinuousSample.h"
+
+Future<Void> logCommitMetrics( struct ProxyStats* const& stats, UID const& id );
 
 struct ProxyStats {
 	CounterCollection cc;
-	Counter txnStartIn, txnStartOut, txnStartBatch;
+	Counter txnStartIn, txnStartOut, txnStartBatch, txnStartBatchLeased;
 	Counter txnSystemPriorityStartIn, txnSystemPriorityStartOut;
 	Counter txnBatchPriorityStartIn, txnBatchPriorityStartOut;
 	Counter txnDefaultPriorityStartIn, txnDefaultPriorityStartOut;
@@ -56,21 +59,58 @@ struct ProxyStats {
 	Counter conflictRanges;
 	Version lastCommitVersionAssigned;
 
+	// CPU time spent in commitBatch (the time between its waits), split by whether the batch was holding its place in the
+	// commit order at the time, the latency of commit batches, and the bytes of TLog messages they produced and copied to do so
+	// (see LogPushData).  Logged and cleared by logCommitMetrics().
+	double commitCpuOrdered, commitCpuUnordered;
+	int64_t commitCpuTransactions;
+	ContinuousSample<double> commitBatchLatency;
+	int64_t logPushes, logMessageBytes, logCopiedBytes;
+
 	Future<Void> logger;
+	Future<Void> commitMetricsLogger;
 
 	explicit ProxyStats(UID id, Version* pVersion, NotifiedVersion* pCommittedVersion)
 	  : cc("ProxyStats", id.toString()),
-		txnStartIn("txnStartIn", cc), txnStartOut("txnStartOut", cc), txnStartBatch("txnStartBatch", cc), txnSystemPriorityStartIn("txnSystemPriorityStartIn", cc), txnSystemPriorityStartOut("txnSystemPriorityStartOut", cc), txnBatchPriorityStartIn("txnBatchPriorityStartIn", cc), txnBatchPriorityStartOut("txnBatchPriorityStartOut", cc),
+		txnStartIn("txnStartIn", cc), txnStartOut("txnStartOut", cc), txnStartBatch("txnStartBatch", cc), txnStartBatchLeased("txnStartBatchLeased", cc), txnSystemPriorityStartIn("txnSystemPriorityStartIn", cc), txnSystemPriorityStartOut("txnSystemPriorityStartOut", cc), txnBatchPriorityStartIn("txnBatchPriorityStartIn", cc), txnBatchPriorityStartOut("txnBatchPriorityStartOut", cc),
 		txnDefaultPriorityStartIn("txnDefaultPriorityStartIn", cc), txnDefaultPriorityStartOut("txnDefaultPriorityStartOut", cc), txnCommitIn("txnCommitIn", cc),	txnCommitVersionAssigned("txnCommitVersionAssigned", cc), txnCommitResolving("txnCommitResolving", cc), txnCommitResolved("txnCommitResolved", cc), txnCommitOut("txnCommitOut", cc),
-		txnCommitOutSuccess("txnCommitOutSuccess", cc), txnConflicts("txnConflicts", cc), commitBatchIn("commitBatchIn", cc), commitBatchOut("commitBatchOut", cc), mutationBytes("mutationBytes", cc), mutations("mutations", cc), conflictRanges("conflictRanges", cc), lastCommitVersionAssigned(0)
+		txnCommitOutSuccess("txnCommitOutSuccess", cc), txnConflicts("txnConflicts", cc), commitBatchIn("commitBatchIn", cc), commitBatchOut("commitBatchOut", cc), mutationBytes("mutationBytes", cc), mutations("mutations", cc), conflictRanges("conflictRanges", cc), lastCommitVersionAssigned(0),
+		commitCpuOrdered(0), commitCpuUnordered(0), commitCpuTransactions(0), commitBatchLatency(1000), logPushes(0), logMessageBytes(0), logCopiedBytes(0)
 	{
 		specialCounter(cc, "lastAssignedCommitVersion", [this](){return this->lastCommitVersionAssigned;});
 		specialCounter(cc, "version", [pVersion](){return *pVersion; });
 		specialCounter(cc, "committedVersion", [pCommittedVersion](){ return pCommittedVersion->get(); });
 		logger = traceCounters("ProxyMetrics", id, SERVER_KNOBS->WORKER_LOGGING_INTERVAL, &cc, "ProxyMetrics");
+		commitMetricsLogger = logCommitMetrics(this, id);
 	}
 };
 
+ACTOR Future<Void> logCommitMetrics( ProxyStats* stats, UID id ) {
+	loop {
+		Void _ = wait( delay( SERVER_KNOBS->WORKER_LOGGING_INTERVAL ) );
+		int64_t transactions = std::max<int64_t>( stats->commitCpuTransactions, 1 );
+		int64_t pushes = std::max<int64_t>( stats->logPushes, 1 );
+		TraceEvent("ProxyCommitMetrics", id)
+			.detail("Transactions", stats->commitCpuTransactions)
+			.detail("CpuMicrosPerTransaction", 1e6 * (stats->commitCpuOrdered + stats->commitCpuUnordered) / transactions)
+			.detail("OrderedCpuMicrosPerTransaction", 1e6 * stats->commitCpuOrdered / transactions)
+			.detail("MeanCommitBatchLatency", 1000 * stats->commitBatchLatency.mean())
+			.detail("MedianCommitBatchLatency", 1000 * stats->commitBatchLatency.median())
+			.detail("CommitBatchLatency99", 1000 * stats->commitBatchLatency.percentile(0.99))
+			.detail("MaxCommitBatchLatency", 1000 * stats->commitBatchLatency.max())
+			.detail("LogPushes", stats->logPushes)
+			.detail("LogMessageBytesPerPush", stats->logMessageBytes / pushes)
+			.detail("LogCopiedBytesPerPush", stats->logCopiedBytes / pushes);
+		stats->commitCpuOrdered = 0;
+		stats->commitCpuUnordered = 0;
+		stats->commitCpuTransactions = 0;
+		stats->commitBatchLatency.clear();
+		stats->logPushes = 0;
+		stats->logMessageBytes = 0;
+		stats->logCopiedBytes = 0;
+	}
+}
+
 ACTOR template <class T>
 Future<Void> forwardValue(Promise<T> out, Future<T> in)
 {
@@ -165,6 +205,21 @@ DESCR struct SingleKeyMutation {
 	int64_t tag3;
 };
 
+// A GRV lease this proxy has granted to another proxy (see PROXY_GRV_LEASE_DURATION)
+struct GrvLeaseGrant : ReferenceCounted<GrvLeaseGrant> {
+	UID holderID;
+	RequestStream<LeasedCommittedVersionRequest> holder;
+	double expiry;	// By our clock
+	double leaseStart;	// By the holder's clock, from the newest request that extended the lease
+	double acknowledgedLeaseStart;
+	NotifiedVersion acknowledged;	// The holder knows that this version is committed
+	AsyncTrigger extended;
+	bool updating;
+	bool revoked;	// The holder failed.  The lease is no longer extended or updated, and is forgotten once it expires
+
+	GrvLeaseGrant( UID holderID, RequestStream<LeasedCommittedVersionRequest> const& holder ) : holderID(holderID), holder(holder), expiry(0), leaseStart(0), acknowledgedLeaseStart(0), acknowledged(0), updating(false), revoked(false) {}
+};
+
 struct ProxyCommitData {
 	UID dbgid;
 	ProxyStats stats;
@@ -201,6 +256,32 @@ struct ProxyCommitData {
 	std::map<UID, Reference<StorageInfo>> storageCache;
 	std::map<Tag, Version> tag_popped;
 
+	// GRV leases.  A proxy holding an unexpired lease from every other proxy answers read versions from the committed
+	//   versions they push to it, instead of asking each of them per batch; in exchange a grantor does not reply to a
+	//   commit until each holder has acknowledged its version (or its lease has expired).
+	// Strict serializability then depends on the proxies' clocks running at the same rate: a holder times a lease by its own
+	//   clock from before it asked for it, and the grantor by its clock from when it granted it, so the holder stops
+	//   trusting a lease before the grantor stops honoring it only as long as neither clock runs faster than the other by
+	//   more than the network delay in between.  now() is monotonic on each process, which is all that can be checked here.
+	std::map<UID, Reference<GrvLeaseGrant>> grvLeaseGrants;	// Leases granted, by holder
+	std::map<UID, double> grvLeaseExpiry;	// Leases held, by grantor, as far as the grantor's pushes have confirmed them
+	GetReadVersionReply leasedCommittedVersion;	// The highest version pushed to us by a grantor
+	RequestStream<LeasedCommittedVersionRequest> leasedVersionUpdates;
+
+	void updateLeasedCommittedVersion( GetReadVersionReply const& rep ) {
+		if( rep.version > leasedCommittedVersion.version )
+			leasedCommittedVersion = rep;
+	}
+
+	bool hasGrvLeases( vector<MasterProxyInterface> const& otherProxies ) {
+		for( auto& p : otherProxies ) {
+			auto expiry = grvLeaseExpiry.find( p.id() );
+			if( expiry == grvLeaseExpiry.end() || expiry->second <= now() )
+				return false;
+		}
+		return true;
+	}
+
 	//The tag related to a storage server rarely change, so we keep a vector of tags for each key range to be slightly more CPU efficient.
 	//When a tag related to a storage server does change, we empty out all of these vectors to signify they must be repopulated.
 	//We do not repopulate them immediately to avoid a slow task.
@@ -228,13 +309,17 @@ struct ProxyCommitData {
 			getConsistentReadVersion(getConsistentReadVersion), commit(commit), lastCoalesceTime(0),
 			localCommitBatchesStarted(0), locked(false), firstProxy(firstProxy),
 			cx(openDBOnServer(db, TaskDefaultEndpoint, true, true)), singleKeyMutationEvent(LiteralStringRef("SingleKeyMutation"))
-	{}
+	{
+		leasedCommittedVersion.version = 0;
+		leasedCommittedVersion.locked = false;
+	}
 };
 
 struct ResolutionRequestBuilder {
 	ProxyCommitData* self;
 	vector<ResolveTransactionBatchRequest> requests;
 	vector<vector<int>> transactionResolverMap;
+	std::map<int, vector<vector<int>>> readRangeResolverMap;	// transactionNumberInBatch -> [resolver][read range # sent to that resolver] -> read range # in the original transaction, for transactions reporting conflicting keys
 	vector<CommitTransactionRef*> outTr;
 
 	ResolutionRequestBuilder( ProxyCommitData* self, Version version, Version prevVersion, Version lastReceivedVersion) : self(self), requests(self->resolvers.size()) {
@@ -256,7 +341,7 @@ struct ResolutionRequestBuilder {
 		return *out;
 	}
 
-	void addTransaction(CommitTransactionRef& trIn, int transactionNumberInBatch) {
+	void addTransaction(CommitTransactionRef& trIn, int transactionNumberInBatch, bool reportConflictingKeys) {
 		// SOMEDAY: There are a couple of unnecessary O( # resolvers ) steps here
 		outTr.assign(requests.size(), NULL);
 		ASSERT( transactionNumberInBatch >= 0 && transactionNumberInBatch < 32768 );
@@ -274,7 +359,13 @@ struct ResolutionRequestBuilder {
 				getOutTransaction(0, trIn.read_snapshot).mutations.push_back(requests[0].arena, m);
 			}
 		}
-		for(auto& r : trIn.read_conflict_ranges) {
+		vector<vector<int>>* readRangeMap = NULL;
+		if (reportConflictingKeys) {
+			readRangeMap = &readRangeResolverMap[transactionNumberInBatch];
+			readRangeMap->resize(requests.size());
+		}
+		for(int rr = 0; rr < trIn.read_conflict_ranges.size(); rr++) {
+			auto& r = trIn.read_conflict_ranges[rr];
 			auto ranges = self->keyResolvers.intersectingRanges( r );
 			std::set<int> resolvers;
 			for(auto &ir : ranges) {
@@ -286,8 +377,11 @@ struct ResolutionRequestBuilder {
 				}
 			}
 			ASSERT(resolvers.size());
-			for(int resolver : resolvers)
+			for(int resolver : resolvers) {
 				getOutTransaction( resolver, trIn.read_snapshot ).read_conflict_ranges.push_back( requests[resolver].arena, r );
+				if (readRangeMap)
+					(*readRangeMap)[resolver].push_back(rr);
+			}
 		}
 		for(auto& r : trIn.write_conflict_ranges) {
 			auto ranges = self->keyResolvers.intersectingRanges( r );
@@ -306,12 +400,60 @@ struct ResolutionRequestBuilder {
 
 		vector<int> resolversUsed;
 		for (int r = 0; r<outTr.size(); r++)
-			if (outTr[r])
+			if (outTr[r]) {
 				resolversUsed.push_back(r);
+				if (reportConflictingKeys)
+					requests[r].reportConflictingKeys.push_back(requests[r].arena, outTr[r] - requests[r].transactions.begin());
+			}
 		transactionResolverMap.push_back(std::move(resolversUsed));
 	}
 };
 
+ACTOR Future<Void> waitForGrvLeaseHolder( Reference<GrvLeaseGrant> grant, Version version ) {
+	// The lease may be renewed while we wait, so its expiry is checked again each time it passes
+	loop {
+		if( grant->acknowledged.get() >= version || now() >= grant->expiry )
+			return Void();
+		choose {
+			when( Void _ = wait( grant->acknowledged.whenAtLeast( version ) ) ) {}
+			when( Void _ = wait( delayUntil( grant->expiry ) ) ) {}
+		}
+	}
+}
+
+Future<Void> waitForGrvLeaseHolders( ProxyCommitData* self, Version version ) {
+	std::vector<Future<Void>> holders;
+	for( auto& g : self->grvLeaseGrants )
+		if( g.second->acknowledged.get() < version && now() < g.second->expiry )
+			holders.push_back( waitForGrvLeaseHolder( g.second, version ) );
+	return waitForAll( holders );
+}
+
+// The mutations of a commit batch and the tags they are destined for.  The tags depend on keyInfo, so they must be found while
+// the batch holds its place in the commit order; serializing the mutations for the logs can wait until it has given that up.
+struct TaggedMutations {
+	Arena arena;
+	vector<MutationRef> mutations;
+	vector<Tag> tags;
+	vector<int> tagsEnd;	// The tags of mutations[i] are tags[tagsEnd[i-1]..tagsEnd[i])
+
+	// Same interface as LogPushData.  Mutations are not copied unless deep is set, so they must outlive this.
+	void addTag( Tag tag ) { tags.push_back( tag ); }
+	void addTypedMessage( MutationRef const& m, bool deep = false ) {
+		mutations.push_back( deep ? MutationRef( arena, m ) : m );
+		tagsEnd.push_back( tags.size() );
+	}
+
+	void writeTo( LogPushData& toCommit ) {
+		int t = 0;
+		for(int m = 0; m < mutations.size(); m++) {
+			for(; t < tagsEnd[m]; t++)
+				toCommit.addTag( tags[t] );
+			toCommit.addTypedMessage( mutations[m] );
+		}
+	}
+};
+
 ACTOR Future<Void> commitBatch(
 	ProxyCommitData* self,
 	vector<CommitTransactionRequest> trs,
@@ -322,14 +464,18 @@ ACTOR Future<Void> commitBatch(
 	state double t1 = now();
 	state Optional<UID> debugID;
 	state bool forceRecovery = false;
+	state double cpuStart = timer_monotonic();
 
 	ASSERT(SERVER_KNOBS->MAX_READ_TRANSACTION_LIFE_VERSIONS <= SERVER_KNOBS->MAX_VERSIONS_IN_FLIGHT);  // since we are using just the former to limit the number of versions actually in flight!
 
 	self->lastVersionTime = t1;
 
 	++self->stats.commitBatchIn;
+	self->stats.commitCpuTransactions += trs.size();
 
+	state int conflictRangeCount = 0;
 	for (int t = 0; t<trs.size(); t++) {
+		conflictRangeCount += trs[t].transaction.read_conflict_ranges.size() + trs[t].transaction.write_conflict_ranges.size();
 		if (trs[t].debugID.present()) {
 			if (!debugID.present())
 				debugID = g_nondeterministic_random->randomUniqueID();
@@ -351,6 +497,8 @@ ACTOR Future<Void> commitBatch(
 	}
 
 	/////// Phase 1: Pre-resolution processing (CPU bound except waiting for a version # which is separately pipelined and *should* be available by now (unless empty commit); ordered; currently atomic but could yield)
+	// Anything that doesn't depend on the commit version or on keyResolvers is done above, before taking our place in line
+	self->stats.commitCpuUnordered += timer_monotonic() - cpuStart;
 	TEST(self->latestLocalCommitBatchResolving.get() < localBatchNumber-1); // Queuing pre-resolution commit processing 
 	Void _ = wait(self->latestLocalCommitBatchResolving.whenAtLeast(localBatchNumber-1));
 	Void _ = wait(yield());
@@ -367,6 +515,7 @@ ACTOR Future<Void> commitBatch(
 
 	state Version commitVersion = versionReply.version;
 	state Version prevVersion = versionReply.prevVersion;
+	cpuStart = timer_monotonic();
 
 	for(auto it : versionReply.resolverChanges) {
 		auto rs = self->keyResolvers.modify(it.range);
@@ -380,10 +529,8 @@ ACTOR Future<Void> commitBatch(
 		g_traceBatch.addEvent("CommitDebug", debugID.get().first(), "MasterProxyServer.commitBatch.GotCommitVersion");
 
 	ResolutionRequestBuilder requests( self, commitVersion, prevVersion, self->version );
-	int conflictRangeCount = 0;
 	for (int t = 0; t<trs.size(); t++) {
-		requests.addTransaction(trs[t].transaction, t);
-		conflictRangeCount += trs[t].transaction.read_conflict_ranges.size() + trs[t].transaction.write_conflict_ranges.size();
+		requests.addTransaction(trs[t].transaction, t, trs[t].reportConflictingKeys());
 		//TraceEvent("MPTransactionDump", self->dbgid).detail("Snapshot", trs[t].transaction.read_snapshot);
 		//for(auto& m : trs[t].transaction.mutations)
 		//	TraceEvent("MPTransactionsDump", self->dbgid).detail("Mutation", m.toString());
@@ -402,20 +549,62 @@ ACTOR Future<Void> commitBatch(
 	}
 
 	state vector<vector<int>> transactionResolverMap = std::move( requests.transactionResolverMap );
+	state std::map<int, vector<vector<int>>> readRangeResolverMap = std::move( requests.readRangeResolverMap );
 
 	ASSERT(self->latestLocalCommitBatchResolving.get() == localBatchNumber-1);
 	self->latestLocalCommitBatchResolving.set(localBatchNumber);
+	self->stats.commitCpuOrdered += timer_monotonic() - cpuStart;
 
 	/////// Phase 2: Resolution (waiting on the network; pipelined)
 	state vector<ResolveTransactionBatchReply> resolution = wait( getAll(replies) );
+	cpuStart = timer_monotonic();
 
 	if (debugID.present())
 		g_traceBatch.addEvent("CommitDebug", debugID.get().first(), "MasterProxyServer.commitBatch.AfterResolution");
 
-	////// Phase 3: Post-resolution processing (CPU bound except for very rare situations; ordered; currently atomic but doesn't need to be)
+	// Determine which transactions actually committed (conservatively) by combining results from the resolvers.  This depends
+	// only on our own resolution, so it is done before waiting for the previous batch to finish post-resolution processing.
+	state vector<uint8_t> committed(trs.size());
+	ASSERT(transactionResolverMap.size() == committed.size());
+	vector<int> nextTr(resolution.size());
+	vector<int> nextReport(resolution.size());
+	state std::map<int, Standalone<VectorRef<int>>> conflictingKeyRanges;
+	for (int t = 0; t<trs.size(); t++) {
+		uint8_t commit = ConflictBatch::TransactionCommitted;
+		for (int r : transactionResolverMap[t])
+		{
+			commit = std::min(resolution[r].committed[nextTr[r]++], commit);
+		}
+		committed[t] = commit;
+
+		auto readRangeMap = readRangeResolverMap.find(t);
+		if (readRangeMap != readRangeResolverMap.end()) {
+			// Translate each resolver's conflicting read range indices back into indices into the client's transaction
+			std::set<int> conflicting;
+			for (int r : transactionResolverMap[t]) {
+				int report = nextReport[r]++;
+				// A resolver running an older protocol version doesn't report anything
+				if (report < resolution[r].conflictingReadRanges.size())
+					for (int rr : resolution[r].conflictingReadRanges[report])
+						conflicting.insert(readRangeMap->second[r][rr]);
+			}
+			if (commit == ConflictBatch::TransactionConflict) {
+				Standalone<VectorRef<int>>& ranges = conflictingKeyRanges[t];
+				for (int rr : conflicting)
+					ranges.push_back(ranges.arena(), rr);
+			}
+		}
+	}
+	for (int r = 0; r<resolution.size(); r++)
+		ASSERT(nextTr[r] == resolution[r].committed.size());
+
+	////// Phase 3: Post-resolution processing (CPU bound except for very rare situations; ordered; atomic from applying metadata
+	// mutations until every mutation has its tags, since both depend on the txnStateStore and keyInfo as of this version)
+	self->stats.commitCpuUnordered += timer_monotonic() - cpuStart;
 	TEST(self->latestLocalCommitBatchLogging.get() < localBatchNumber-1); // Queuing post-resolution commit processing 
 	Void _ = wait(self->latestLocalCommitBatchLogging.whenAtLeast(localBatchNumber-1));
 	Void _ = wait(yield());
+	cpuStart = timer_monotonic();
 
 	self->stats.txnCommitResolved += trs.size();
 
@@ -478,21 +667,6 @@ ACTOR Future<Void> commitBatch(
 		}
 	}
 
-	// Determine which transactions actually committed (conservatively) by combining results from the resolvers
-	state vector<uint8_t> committed(trs.size());
-	ASSERT(transactionResolverMap.size() == committed.size());
-	vector<int> nextTr(resolution.size());
-	for (int t = 0; t<trs.size(); t++) {
-		uint8_t commit = ConflictBatch::TransactionCommitted;
-		for (int r : transactionResolverMap[t])
-		{
-			commit = std::min(resolution[r].committed[nextTr[r]++], commit);
-		}
-		committed[t] = commit;
-	}
-	for (int r = 0; r<resolution.size(); r++)
-		ASSERT(nextTr[r] == resolution[r].committed.size());
-
 	self->logAdapter->setNextVersion(commitVersion);
 
 	state Optional<Key> lockedKey = self->txnStateStore->readValue(databaseLockedKey).get();
@@ -539,6 +713,7 @@ ACTOR Future<Void> commitBatch(
 
 	// This second pass through committed transactions assigns the actual mutations to the appropriate storage servers' tags
 	int mutationCount = 0, mutationBytes = 0;
+	state TaggedMutations tagged;
 	
 	state std::map<Key, MutationListRef> logRangeMutations;
 	state Arena logRangeMutationsArena;
@@ -570,8 +745,8 @@ ACTOR Future<Void> commitBatch(
 					if (debugMutation("ProxyCommit", commitVersion, m))
 						TraceEvent("ProxyCommitTo", self->dbgid).detail("To", describe(tags)).detail("Mutation", m.toString()).detail("Version", commitVersion);
 					for (auto& tag : tags)
-						toCommit.addTag(tag);
-					toCommit.addTypedMessage(m);
+						tagged.addTag(tag);
+					tagged.addTypedMessage(m);
 				}
 				else if (m.type == MutationRef::ClearRange) {
 					auto ranges = self->keyInfo.intersectingRanges(KeyRangeRef(m.param1, m.param2));
@@ -594,7 +769,7 @@ ACTOR Future<Void> commitBatch(
 						}
 						
 						for (auto& tag : tags)
-							toCommit.addTag(tag);
+							tagged.addTag(tag);
 					}
 					else {
 						TEST(true); //A clear range extends past a shard boundary
@@ -615,9 +790,9 @@ ACTOR Future<Void> commitBatch(
 						if (debugMutation("ProxyCommit", commitVersion, m))
 							TraceEvent("ProxyCommitTo", self->dbgid).detail("To", describe(allSources)).detail("Mutation", m.toString()).detail("Version", commitVersion);
 						for (auto& tag : allSources)
-							toCommit.addTag(tag);
+							tagged.addTag(tag);
 					}
-					toCommit.addTypedMessage(m);
+					tagged.addTypedMessage(m);
 				}
 				else
 					UNREACHABLE();
@@ -725,8 +900,8 @@ ACTOR Future<Void> commitBatch(
 					
 				auto& tags = self->tagsForKey(backupMutation.param1);
 				for (auto& tag : tags)
-					toCommit.addTag(tag);
-				toCommit.addTypedMessage(backupMutation);
+					tagged.addTag(tag);
+				tagged.addTypedMessage(backupMutation, true);
 
 //				if (debugMutation("BackupProxyCommit", commitVersion, backupMutation)) {
 //					TraceEvent("BackupProxyCommitTo", self->dbgid).detail("To", describe(tags)).detail("BackupMutation", backupMutation.toString())
@@ -739,6 +914,20 @@ ACTOR Future<Void> commitBatch(
 
 	self->stats.mutations += mutationCount;
 	self->stats.mutationBytes += mutationBytes;
+	self->stats.commitCpuOrdered += timer_monotonic() - cpuStart;
+
+	// The txnStateStore commit above must reach the log adapter before a later batch sets its next version
+	state LogSystemDiskQueueAdapter::CommitMessage msg = wait(storeCommits.back().first); // Should just be doing yields
+
+	if (debugID.present())
+		g_traceBatch.addEvent("CommitDebug", debugID.get().first(), "MasterProxyServer.commitBatch.AfterStoreCommits");
+
+	// Nothing below depends on the state left by earlier batches, so the next batch can start post-resolution processing.
+	// The TLogs put pushes in order by prevVersion, so pushes needn't be sent in order.
+	if (!forceRecovery) {
+		ASSERT(self->latestLocalCommitBatchLogging.get() == localBatchNumber-1);
+		self->latestLocalCommitBatchLogging.set(localBatchNumber);
+	}
 
 	// Storage servers mustn't make durable versions which are not fully committed (because then they are impossible to roll back)
 	// We prevent this by limiting the number of versions which are semi-committed but not fully committed to be less than the MVCC window
@@ -763,10 +952,8 @@ ACTOR Future<Void> commitBatch(
 		}
 	}
 
-	state LogSystemDiskQueueAdapter::CommitMessage msg = wait(storeCommits.back().first); // Should just be doing yields
-
-	if (debugID.present())
-		g_traceBatch.addEvent("CommitDebug", debugID.get().first(), "MasterProxyServer.commitBatch.AfterStoreCommits");
+	cpuStart = timer_monotonic();
+	tagged.writeTo(toCommit);
 
 	// txnState (transaction subsystem state) tag: message extracted from log adapter
 	bool firstMessage = true;
@@ -789,15 +976,15 @@ ACTOR Future<Void> commitBatch(
 
 	Future<Void> loggingComplete = self->logSystem->push( prevVersion, commitVersion, self->committedVersion.get(), toCommit, debugID ) 
 		|| self->committedVersion.whenAtLeast( commitVersion+1 );
-
-	if (!forceRecovery) {
-		ASSERT(self->latestLocalCommitBatchLogging.get() == localBatchNumber-1);
-		self->latestLocalCommitBatchLogging.set(localBatchNumber);
-	}
+	self->stats.logPushes++;
+	self->stats.logMessageBytes += toCommit.getMessageBytes();
+	self->stats.logCopiedBytes += toCommit.getCopiedBytes();
+	self->stats.commitCpuUnordered += timer_monotonic() - cpuStart;
 
 	/////// Phase 4: Logging (network bound; pipelined up to MAX_READ_TRANSACTION_LIFE_VERSIONS (limited by loop above))
 	Void _ = wait(loggingComplete);
 	Void _ = wait(yield());
+	cpuStart = timer_monotonic();
 
 	self->logSystem->pop(msg.popTo, txsTag);
 
@@ -826,6 +1013,13 @@ ACTOR Future<Void> commitBatch(
 		throw worker_removed();
 	}
 
+	// Proxies holding a GRV lease from us hand out read versions without asking, so they must know about this version before any client does
+	if( !self->grvLeaseGrants.empty() ) {
+		self->stats.commitCpuUnordered += timer_monotonic() - cpuStart;
+		Void _ = wait( waitForGrvLeaseHolders( self, commitVersion ) );
+		cpuStart = timer_monotonic();
+	}
+
 	// Send replies to clients
 	for (int t = 0; t < trs.size(); t++)
 	{
@@ -835,6 +1029,8 @@ ACTOR Future<Void> commitBatch(
 		}
 		else if (committed[t] == ConflictBatch::TransactionTooOld)
 			trs[t].reply.sendError(transaction_too_old());
+		else if (conflictingKeyRanges.count(t))
+			trs[t].reply.send(CommitID(invalidVersion, t, conflictingKeyRanges[t]));
 		else
 			trs[t].reply.sendError(not_committed());
 	}
@@ -860,6 +1056,9 @@ ACTOR Future<Void> commitBatch(
 			TraceEvent("KeyResolverSize", self->dbgid).detail("size", self->keyResolvers.size());
 	}
 
+	self->stats.commitBatchLatency.addSample(now() - t1);
+	self->stats.commitCpuUnordered += timer_monotonic() - cpuStart;
+
 	// Dynamic batching for commits
 	double target_latency = (now() - t1) * SERVER_KNOBS->COMMIT_TRANSACTION_BATCH_INTERVAL_LATENCY_FRACTION;
 	*commitBatchTime = 
@@ -878,11 +1077,17 @@ ACTOR Future<GetReadVersionReply> getLiveCommittedVersion(ProxyCommitData* commi
 	// (1) The version returned is the committedVersion of some proxy at some point before the request returns, so it is committed.
 	// (2) No proxy on our list reported committed a higher version before this request was received, because then its committedVersion would have been higher,
 	//     and no other proxy could have already committed anything without first ending the epoch
+	// With a GRV lease from every other proxy, (2) holds without asking them: none of them can have reported a version committed that it hasn't pushed to us
 	++commitData->stats.txnStartBatch;
 
+	state bool leased = SERVER_KNOBS->PROXY_GRV_LEASE_DURATION > 0 && commitData->hasGrvLeases(*otherProxies);
 	state vector<Future<GetReadVersionReply>> proxyVersions;
-	for (auto const& p : *otherProxies)
-		proxyVersions.push_back(brokenPromiseToNever(p.getRawCommittedVersion.getReply(GetRawCommittedVersionRequest(debugID), TaskTLogConfirmRunningReply)));
+	if (leased)
+		++commitData->stats.txnStartBatchLeased;
+	else {
+		for (auto const& p : *otherProxies)
+			proxyVersions.push_back(brokenPromiseToNever(p.getRawCommittedVersion.getReply(GetRawCommittedVersionRequest(debugID), TaskTLogConfirmRunningReply)));
+	}
 
 	if (!(flags&GetReadVersionRequest::FLAG_CAUSAL_READ_RISKY))
 	{
@@ -902,6 +1107,8 @@ ACTOR Future<GetReadVersionReply> getLiveCommittedVersion(ProxyCommitData* commi
 			rep = v;
 		}
 	}
+	if (leased && commitData->leasedCommittedVersion.version > rep.version)
+		rep = commitData->leasedCommittedVersion;
 
 	if (debugID.present())
 		g_traceBatch.addEvent("TransactionDebug", debugID.get().first(), "MasterProxyServer.getLiveCommittedVersion.After");
@@ -914,6 +1121,69 @@ ACTOR Future<GetReadVersionReply> getLiveCommittedVersion(ProxyCommitData* commi
 	return rep;
 }
 
+ACTOR Future<Void> renewGrvLease(ProxyCommitData* commitData, UID holder, MasterProxyInterface grantor) {
+	loop {
+		// The lease is timed from before the request was sent, so it expires here no later than at the grantor.  It only
+		// counts once the grantor's push has confirmed it, since the grantor stops extending it if it believes we failed.
+		GetRawCommittedVersionRequest req;
+		req.leaseUpdates = commitData->leasedVersionUpdates;
+		req.leaseHolder = holder;
+		req.leaseDuration = SERVER_KNOBS->PROXY_GRV_LEASE_DURATION;
+		req.leaseStart = now();
+		ErrorOr<GetReadVersionReply> rep = wait( grantor.getRawCommittedVersion.tryGetReply(req, TaskTLogConfirmRunningReply) );
+		if (rep.present())
+			commitData->updateLeasedCommittedVersion(rep.get());
+		Void _ = wait( delay(SERVER_KNOBS->PROXY_GRV_LEASE_DURATION / 3) );
+	}
+}
+
+// Pushes our committed version, and each extension of the lease, to the holder of a lease until it expires
+ACTOR Future<Void> updateGrvLeaseHolder(ProxyCommitData* commitData, Reference<GrvLeaseGrant> grant) {
+	state Future<Void> holderFailed = IFailureMonitor::failureMonitor().onFailed( grant->holder.getEndpoint() );
+	loop {
+		if (now() >= grant->expiry)
+			break;
+		if (holderFailed.isReady()) {
+			grant->revoked = true;
+			break;
+		}
+		if (commitData->committedVersion.get() <= grant->acknowledged.get() && grant->leaseStart <= grant->acknowledgedLeaseStart) {
+			choose {
+				when( Void _ = wait( commitData->committedVersion.whenAtLeast(grant->acknowledged.get() + 1) ) ) {}
+				when( Void _ = wait( grant->extended.onTrigger() ) ) {}
+				when( Void _ = wait( delayUntil(grant->expiry) ) ) {}
+				when( Void _ = wait( holderFailed ) ) {}
+			}
+			continue;
+		}
+
+		state LeasedCommittedVersionRequest req;
+		req.grantor = commitData->dbgid;
+		req.committed.version = commitData->committedVersion.get();
+		req.committed.locked = commitData->locked;
+		req.leaseStart = grant->leaseStart;
+		ErrorOr<Void> rep = wait( grant->holder.tryGetReply(req, TaskProxyGetRawCommittedVersion) );
+		if (!rep.present()) {
+			grant->revoked = true;
+			break;
+		}
+		if (req.committed.version > grant->acknowledged.get())
+			grant->acknowledged.set(req.committed.version);
+		grant->acknowledgedLeaseStart = std::max(grant->acknowledgedLeaseStart, req.leaseStart);
+	}
+	grant->updating = false;
+
+	// A revoked holder might still be answering read versions until its lease expires, so commits keep waiting for it until then
+	if (grant->revoked) {
+		TraceEvent("GrvLeaseRevoked", commitData->dbgid).detail("Holder", grant->holderID).detail("Expiry", grant->expiry);
+		Void _ = wait( delayUntil(grant->expiry) );
+	}
+	auto g = commitData->grvLeaseGrants.find(grant->holderID);
+	if (!grant->updating && now() >= grant->expiry && g != commitData->grvLeaseGrants.end() && g->second == grant)
+		commitData->grvLeaseGrants.erase(g);
+	return Void();
+}
+
 ACTOR Future<Void> fetchVersions(ProxyCommitData *commitData) {
 	loop {
 		Void _ = waitNext(commitData->commitBatchStartNotifications.getFuture());
@@ -948,8 +1218,11 @@ ACTOR static Future<Void> transactionStarter(
 	while (std::find(db->get().client.proxies.begin(), db->get().client.proxies.end(), proxy) == db->get().client.proxies.end())
 		Void _ = wait(db->onChange());
 	for (MasterProxyInterface mp : db->get().client.proxies) {
-		if (mp != proxy)
+		if (mp != proxy) {
 			otherProxies.push_back(mp);
+			if (SERVER_KNOBS->PROXY_GRV_LEASE_DURATION > 0)
+				addActor.send(renewGrvLease(commitData, proxy.id(), mp));
+		}
 	}
 
 	ASSERT(db->get().recoveryState >= RecoveryState::FULLY_RECOVERED);  // else potentially we could return uncommitted read versions (since self->committedVersion is only a committed version if this recovery succeeds)
@@ -1230,11 +1503,32 @@ ACTOR Future<Void> masterProxyServerCore(
 			//TraceEvent("ProxyGetRCV", proxy.id());
 			if (req.debugID.present())
 				g_traceBatch.addEvent("TransactionDebug", req.debugID.get().first(), "MasterProxyServer.masterProxyServerCore.GetRawCommittedVersion");
+			if (req.leaseUpdates.present()) {
+				Reference<GrvLeaseGrant>& grant = commitData.grvLeaseGrants[req.leaseHolder];
+				if (!grant)
+					grant = Reference<GrvLeaseGrant>(new GrvLeaseGrant(req.leaseHolder, req.leaseUpdates.get()));
+				if (!grant->revoked) {
+					grant->expiry = std::max(grant->expiry, now() + req.leaseDuration);
+					grant->leaseStart = std::max(grant->leaseStart, req.leaseStart);
+					grant->extended.trigger();
+					if (!grant->updating) {
+						grant->updating = true;
+						addActor.send(updateGrvLeaseHolder(&commitData, grant));
+					}
+				}
+			}
 			GetReadVersionReply rep;
 			rep.locked = commitData.locked;
 			rep.version = commitData.committedVersion.get();
 			req.reply.send(rep);
 		}
+		when(LeasedCommittedVersionRequest req = waitNext(commitData.leasedVersionUpdates.getFuture())) {
+			ASSERT(req.leaseStart <= now());  // leaseStart came from our own clock, which must not go backwards
+			double& expiry = commitData.grvLeaseExpiry[req.grantor];
+			expiry = std::max(expiry, req.leaseStart + SERVER_KNOBS->PROXY_GRV_LEASE_DURATION);
+			commitData.updateLeasedCommittedVersion(req.committed);
+			req.reply.send(Void());
+		}
 		when(TxnStateRequest req = waitNext(proxy.txnState.getFuture())) {
 			state ReplyPromise<Void> reply = req.reply;
 			if(req.last) maxSequence = req.sequence + 1;
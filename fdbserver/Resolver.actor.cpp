@@ -44,7 +44,7 @@ struct ProxyRequestsInfo {
 namespace{
 struct Resolver : ReferenceCounted<Resolver> {
 	Resolver( UID dbgid, int proxyCount, int resolverCount )
-		: dbgid(dbgid), proxyCount(proxyCount), resolverCount(resolverCount), version(-1), conflictSet( newConflictSet() ), iopsSample( SERVER_KNOBS->IOPS_UNITS_PER_SAMPLE ), debugMinRecentStateVersion(0)
+		: dbgid(dbgid), proxyCount(proxyCount), resolverCount(resolverCount), version(-1), conflictSet( newConflictSet( g_network->isSimulated() ? 0 : SERVER_KNOBS->CONFLICT_SET_THREADS, SERVER_KNOBS->CONFLICT_SET_RADIX_TREE ) ), iopsSample( SERVER_KNOBS->IOPS_UNITS_PER_SAMPLE ), cpuSample( SERVER_KNOBS->RESOLVER_CPU_UNITS_PER_SAMPLE ), debugMinRecentStateVersion(0)
 	{
 	}
 	~Resolver() {
@@ -63,6 +63,7 @@ struct Resolver : ReferenceCounted<Resolver> {
 	std::map<NetworkAddress, ProxyRequestsInfo> proxyInfoMap;
 	ConflictSet *conflictSet;
 	TransientStorageMetricSample iopsSample;
+	TransientStorageMetricSample cpuSample;	// Microseconds of conflict detection, charged to the begin keys of the conflict ranges
 
 	Version debugMinRecentStateVersion;
 };
@@ -138,20 +139,36 @@ ACTOR Future<Void> resolveBatch(
 		double expire = now() + SERVER_KNOBS->SAMPLE_EXPIRATION_TIME;
 		double tstart = timer();
 		ConflictBatch conflictBatch( self->conflictSet );
+		std::map<int, vector<int>> conflictingReadRanges;
 		int keys = 0;
+		int nextReport = 0;
 		for(int t=0; t<req.transactions.size(); t++) {
-			conflictBatch.addTransaction( req.transactions[t] );
+			bool report = nextReport < req.reportConflictingKeys.size() && req.reportConflictingKeys[nextReport] == t;
+			if (report) nextReport++;
+			conflictBatch.addTransaction( req.transactions[t], report );
 			keys += req.transactions[t].write_conflict_ranges.size()*2 + req.transactions[t].read_conflict_ranges.size()*2;
-			
-			if(self->resolverCount > 1) {
-				for(auto it : req.transactions[t].write_conflict_ranges)
+		}
+		ASSERT( nextReport == req.reportConflictingKeys.size() );
+		conflictBatch.detectConflicts( req.version, req.version - SERVER_KNOBS->MAX_WRITE_TRANSACTION_LIFE_VERSIONS, commitList, &tooOldList, req.reportConflictingKeys.size() ? &conflictingReadRanges : NULL );
+		double conflictTime = timer() - tstart;
+		g_counters.conflictTime += conflictTime;
+
+		if(self->resolverCount > 1) {
+			// Each conflict range is charged an equal share of the batch's time.  Measured time would make simulation
+			//   nondeterministic, so there it is modeled as a microsecond per key.
+			double batchMicroseconds = g_network->isSimulated() ? keys : conflictTime * 1e6;
+			int64_t rangeCost = std::max<int64_t>( 1, 2 * batchMicroseconds / std::max( keys, 1 ) );
+			for(auto& tr : req.transactions) {
+				for(auto& it : tr.write_conflict_ranges) {
 					self->iopsSample.addAndExpire( it.begin, SERVER_KNOBS->SAMPLE_OFFSET_PER_KEY + it.begin.size(), expire );
-				for(auto it : req.transactions[t].read_conflict_ranges)
+					self->cpuSample.addAndExpire( it.begin, rangeCost, expire );
+				}
+				for(auto& it : tr.read_conflict_ranges) {
 					self->iopsSample.addAndExpire( it.begin, SERVER_KNOBS->SAMPLE_OFFSET_PER_KEY + it.begin.size(), expire );
+					self->cpuSample.addAndExpire( it.begin, rangeCost, expire );
+				}
 			}
 		}
-		conflictBatch.detectConflicts( req.version, req.version - SERVER_KNOBS->MAX_WRITE_TRANSACTION_LIFE_VERSIONS, commitList, &tooOldList);
-		g_counters.conflictTime += timer() - tstart;
 		++g_counters.conflictBatches;
 		g_counters.conflictTransactions += req.transactions.size();
 		g_counters.conflictKeys += keys;
@@ -165,6 +182,13 @@ ACTOR Future<Void> resolveBatch(
 		for (int c = 0; c<tooOldList.size(); c++)
 			reply.committed[tooOldList[c]] = ConflictBatch::TransactionTooOld;
 
+		reply.conflictingReadRanges.resize( reply.arena, req.reportConflictingKeys.size() );
+		for(int i=0; i<req.reportConflictingKeys.size(); i++) {
+			auto r = conflictingReadRanges.find( req.reportConflictingKeys[i] );
+			if (r != conflictingReadRanges.end())
+				reply.conflictingReadRanges[i] = VectorRef<int>( reply.arena, VectorRef<int>( r->second.data(), r->second.size() ) );
+		}
+
 		ASSERT(req.prevVersion >= 0 || req.txnStateTransactions.size() == 0); // The master's request should not have any state transactions
 
 		auto& stateTransactions = self->recentStateTransactions[ req.version ];
@@ -274,17 +298,19 @@ ACTOR Future<Void> resolverCore(
 			actors.add( resolveBatch(self, batch) );
 		}
 		when ( ResolutionMetricsRequest req = waitNext( resolver.metrics.getFuture() ) ) {
-			req.reply.send(self->iopsSample.getEstimate(allKeys));
+			req.reply.send(ResolutionMetricsReply(self->iopsSample.getEstimate(allKeys), self->cpuSample.getEstimate(allKeys)));
 		}
 		when ( ResolutionSplitRequest req = waitNext( resolver.split.getFuture() ) ) {
+			TransientStorageMetricSample& sample = req.cpu ? self->cpuSample : self->iopsSample;
 			ResolutionSplitReply rep;
-			rep.key = self->iopsSample.splitEstimate(req.range, req.offset, req.front);
-			rep.used = self->iopsSample.getEstimate(req.front ? KeyRangeRef(req.range.begin, rep.key) : KeyRangeRef(rep.key, req.range.end));
+			rep.key = sample.splitEstimate(req.range, req.offset, req.front);
+			rep.used = sample.getEstimate(req.front ? KeyRangeRef(req.range.begin, rep.key) : KeyRangeRef(rep.key, req.range.end));
 			req.reply.send(rep);
 		}
 		when ( Void _ = wait( actors.getResult() ) ) {}
 		when (Void _ = wait(doPollMetrics) ) {
 			self->iopsSample.poll();
+			self->cpuSample.poll();
 			doPollMetrics = delay(SERVER_KNOBS->SAMPLE_POLL_TIME);
 		}
 	}
@@ -72,10 +72,13 @@ struct ResolveTransactionBatchReply {
 	VectorRef<uint8_t> committed;
 	Optional<UID> debugID;
 	VectorRef<VectorRef<StateTransactionRef>> stateMutations;  // [version][transaction#] -> (committed, [mutation#])
+	VectorRef<VectorRef<int>> conflictingReadRanges;  // [i] -> indices of the read conflict ranges of request.transactions[request.reportConflictingKeys[i]] that conflicted
 
 	template <class Archive>
 	void serialize(Archive& ar) {
 		ar & committed & stateMutations & arena & debugID;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & conflictingReadRanges;
 	}
 
 };
@@ -88,17 +91,35 @@ struct ResolveTransactionBatchRequest {
 	Version lastReceivedVersion;
 	VectorRef<CommitTransactionRef> transactions;
 	VectorRef<int> txnStateTransactions;   // Offsets of elements of transactions that have (transaction subsystem state) mutations
+	VectorRef<int> reportConflictingKeys;   // Offsets of elements of transactions that want to know which of their read conflict ranges conflicted
 	ReplyPromise<ResolveTransactionBatchReply> reply;
 	Optional<UID> debugID;
 
 	template <class Archive>
 	void serialize(Archive& ar) {
 		ar & prevVersion & version & lastReceivedVersion & transactions & txnStateTransactions & reply & arena & debugID;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & reportConflictingKeys;
+	}
+};
+
+struct ResolutionMetricsReply {
+	int64_t value;	// Estimated SAMPLE_OFFSET_PER_KEY + key bytes of the conflict ranges resolved in the last SAMPLE_EXPIRATION_TIME
+	int64_t cpu;	// Estimated microseconds spent detecting conflicts over the same ranges
+
+	ResolutionMetricsReply() : value(0), cpu(0) {}
+	ResolutionMetricsReply( int64_t value, int64_t cpu ) : value(value), cpu(cpu) {}
+
+	template <class Archive>
+	void serialize(Archive& ar) {
+		ar & value;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & cpu;
 	}
 };
 
 struct ResolutionMetricsRequest {
-	ReplyPromise<int64_t> reply;
+	ReplyPromise<ResolutionMetricsReply> reply;
 
 	template <class Archive>
 	void serialize(Archive& ar) {
@@ -120,11 +141,16 @@ struct ResolutionSplitRequest {
 	KeyRange range;
 	int64_t offset;
 	bool front;
+	bool cpu;	// offset and the reply's used are measured in ResolutionMetricsReply::cpu rather than ::value
 	ReplyPromise<ResolutionSplitReply> reply;
 
+	ResolutionSplitRequest() : offset(0), front(false), cpu(false) {}
+
 	template <class Archive>
 	void serialize(Archive& ar) {
 		ar & range & offset & front & reply;
+		if( ar.protocolVersion() >= 0x0FDB00A560020001LL )
+			ar & cpu;
 	}
 };
 
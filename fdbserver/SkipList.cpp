@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <numeric>
 #include <string>
+#include <memory>
 
 /*
 #ifdef __GNUG__
@@ -32,15 +33,15 @@
 */
 
 #include "flow/Platform.h"
+#include "flow/StringCompare.h"
 #include "fdbrpc/fdbrpc.h"
 #include "fdbrpc/PerfMetric.h"
 #include "fdbclient/FDBTypes.h"
 #include "fdbclient/KeyRangeMap.h"
 #include "fdbclient/SystemData.h"
+#include "flow/UnitTest.h"
 #include "Knobs.h"
 
-#define PARALLEL_THREAD_COUNT 0	// FIXME: When >1, program execution (e.g. random numbers) is/was nondeterministic.  Why?
-
 using std::min;
 using std::max;
 using std::make_pair;
@@ -110,15 +111,6 @@ PerfDoubleCounter
 	g_removeBefore("D.RemoveBefore", skc)
 	;
 
-static force_inline int compare( const StringRef& a, const StringRef& b ) {
-	int c = memcmp( a.begin(), b.begin(), min(a.size(), b.size()) );
-	if (c<0) return -1;
-	if (c>0) return +1;
-	if (a.size() < b.size()) return -1;
-	if (a.size() == b.size()) return 0;
-	return +1;
-}
-
 struct ReadConflictRange {
 	StringRef begin, end;
 	Version version;
@@ -178,8 +170,8 @@ force_inline bool getCharacter(const KeyInfo& ki, int character, int &outputChar
 
 bool operator < ( const KeyInfo& lhs, const KeyInfo& rhs ) {
 	int i = min(lhs.key.size(), rhs.key.size());
-	int c = memcmp( lhs.key.begin(), rhs.key.begin(), i );
-	if (c!=0) return c<0;
+	int prefix = commonPrefixLength( lhs.key.begin(), rhs.key.begin(), i );
+	if (prefix < i) return lhs.key[prefix] < rhs.key[prefix];
 
 	// SOMEDAY: This is probably not very fast.  Slows D.Sort by ~20% relative to previous (incorrect) version.
 
@@ -377,17 +369,7 @@ private:
 	};
 
 	static force_inline bool less( const uint8_t* a, int aLen, const uint8_t* b, int bLen ) {
-		int len = min(aLen, bLen);
-		for(int i=0; i<len; i++)
-			if (a[i] < b[i])
-				return true;
-			else if (a[i] > b[i])
-				return false;
-
-		/*int c = memcmp(a,b,min(aLen,bLen));
-		if (c<0) return true;
-		if (c>0) return false;*/
-		return aLen < bLen;
+		return lessBytes( a, aLen, b, bLen );
 	}
 
 	Node *header;
@@ -880,57 +862,80 @@ PAction action( F && f ) {
 	return new FAction( std::move(f) );
 };
 
-void workerThread( PAction* nextAction, Event* nextActionReady, int index, Event* whenFinished ) {
-	ASSERT(false);
-	/*
-	inThread<Void>( [nextAction,nextActionReady,index,whenFinished]()->Void {
-		g_seed = index*123; fastrand();
-		setAffinity( index );
-		while (true) {
-			try {
-				nextActionReady->block();   // auto-reset
-				Action* action = *nextAction;
-				*nextAction = 0;
-				if (!action) break;
-
-				(*action)();
-			} catch (Error& e) {
-				fprintf(stderr, "Error in worker thread: %s\n", e.what());
-			} catch (...) {
-				fprintf(stderr, "Error in worker thread: %s\n", unknown_error().what());
-			}
+struct WorkerThreadArgs {
+	PAction* nextAction;
+	Event* nextActionReady;
+	int index;
+	Event* whenFinished;
+};
+
+THREAD_FUNC workerThreadMain( void* p ) {
+	WorkerThreadArgs args = *(WorkerThreadArgs*)p;
+	delete (WorkerThreadArgs*)p;
+
+	// Each worker has its own skiplist level generator, seeded by index so that a given partition
+	//   always builds the same shape.  The shape never affects conflict detection results.
+	g_seed = args.index*123; skfastrand();
+	while (true) {
+		try {
+			args.nextActionReady->block();   // auto-reset
+			Action* action = *args.nextAction;
+			*args.nextAction = 0;
+			if (!action) break;
+
+			(*action)();
+		} catch (Error& e) {
+			fprintf(stderr, "Error in worker thread: %s\n", e.what());
+		} catch (...) {
+			fprintf(stderr, "Error in worker thread: %s\n", unknown_error().what());
 		}
-		//cout << "Worker thread finished" << endl;
-		whenFinished->set();
-		return Void();
-	});*/
+	}
+	args.whenFinished->set();
+	THREAD_RETURN;
 }
 
-StringRef setK( Arena& arena, int i ) {
+void workerThread( PAction* nextAction, Event* nextActionReady, int index, Event* whenFinished ) {
+	WorkerThreadArgs* args = new WorkerThreadArgs;
+	args->nextAction = nextAction;
+	args->nextActionReady = nextActionReady;
+	args->index = index;
+	args->whenFinished = whenFinished;
+	startThread( &workerThreadMain, args );
+}
+
+StringRef setK( Arena& arena, int i, StringRef prefix = StringRef() ) {
 	char t[ sizeof(i) ];
 	*(int*)t = i;
 
 	const int keySize = 16;
 
-	char* ss = new (arena) char[ keySize ];
+	char* ss = new (arena) char[ prefix.size() + keySize ];
+	if (prefix.size())
+		memcpy( ss, prefix.begin(), prefix.size() );
+	ss += prefix.size();
 	for(int c=0; c<keySize-sizeof(i); c++)
 		ss[c] = '.';
 	for(int c=0; c<sizeof(i); c++)
 		ss[c+keySize-sizeof(i)] = t[sizeof(i)-1-c];
 
-	return StringRef( (const uint8_t*)ss, keySize );
+	return StringRef( (const uint8_t*)ss - prefix.size(), prefix.size() + keySize );
 }
 
 #include "ConflictSet.h"
+#include "ConflictRadixTree.h"
 
 struct ConflictSet {
-	ConflictSet() : oldestVersion(0) {
-		static_assert(PARALLEL_THREAD_COUNT == 0, "workerThread() not implemented");
-		static_assert(PARALLEL_THREAD_COUNT == 0 || FASTALLOC_THREAD_SAFE, "Thread safe fast allocator required for multithreaded conflict set");
-		for (int i = 0; i < PARALLEL_THREAD_COUNT; i++) {
-			worker_nextAction.push_back( NULL );
-			worker_ready.push_back( new Event );
-			worker_finished.push_back( new Event );
+	ConflictSet( int threadCount, bool useRadixTree ) : oldestVersion(0), useRadixTree(useRadixTree) {
+		static_assert(FASTALLOC_THREAD_SAFE, "Thread safe fast allocator required for multithreaded conflict set");
+		// A single worker would only add handoff latency, so anything less than two threads runs on the caller
+		if (threadCount > 1 && !useRadixTree) {
+			// Reserve up front: workers hold pointers into worker_nextAction
+			worker_nextAction.reserve( threadCount );
+			for (int i = 0; i < threadCount; i++) {
+				worker_nextAction.push_back( NULL );
+				worker_ready.push_back( new Event );
+				worker_finished.push_back( new Event );
+			}
 		}
 		for(int t=0; t<worker_nextAction.size(); t++)
 			workerThread( &worker_nextAction[t], worker_ready[t], (t)*2, worker_finished[t] );
@@ -943,9 +948,17 @@ struct ConflictSet {
 		// Wait for workers to terminate; otherwise can get crashes at shutdown time
 		for(int i=0; i<worker_finished.size(); i++)
 			worker_finished[i]->block();
+		for(int i=0; i<worker_ready.size(); i++) {
+			delete worker_ready[i];
+			delete worker_finished[i];
+		}
 	}
 
+	int threadCount() const { return worker_nextAction.size(); }
+
 	SkipList versionHistory;
+	ConflictRadixTree radixHistory;		// Used in place of versionHistory if useRadixTree
+	bool useRadixTree;
 	Key removalKey;
 	Version oldestVersion;
 	vector<PAction> worker_nextAction;
@@ -953,16 +966,17 @@ struct ConflictSet {
 	vector<Event*> worker_finished;
 };
 
-ConflictSet* newConflictSet() { return new ConflictSet; }
+ConflictSet* newConflictSet( int threadCount, bool useRadixTree ) { return new ConflictSet( threadCount, useRadixTree ); }
 void clearConflictSet( ConflictSet* cs, Version v ) {
 	SkipList(v).swap( cs->versionHistory );
+	ConflictRadixTree(v).swap( cs->radixHistory );
 }
 void destroyConflictSet(ConflictSet* cs) {
 	delete cs;
 }
 
 ConflictBatch::ConflictBatch( ConflictSet* cs )
-	: cs(cs), transactionCount(0)
+	: cs(cs), transactionCount(0), conflictingReadRanges(NULL)
 {
 }
 
@@ -974,13 +988,17 @@ struct TransactionInfo {
 	VectorRef< std::pair<int,int> > readRanges;
 	VectorRef< std::pair<int,int> > writeRanges;
 	bool tooOld;
+	bool reportConflictingKeys;
+	const CommitTransactionRef* transaction;	// Only kept if reportConflictingKeys
 };
 
-void ConflictBatch::addTransaction( const CommitTransactionRef& tr ) {
+void ConflictBatch::addTransaction( const CommitTransactionRef& tr, bool reportConflictingKeys ) {
 	int t = transactionCount++;
 
 	Arena& arena = transactionInfo.arena();
 	TransactionInfo* info = new (arena) TransactionInfo;
+	info->reportConflictingKeys = reportConflictingKeys;
+	info->transaction = reportConflictingKeys ? &tr : NULL;
 
 	if (tr.read_snapshot < cs->oldestVersion && tr.read_conflict_ranges.size()) {
 		info->tooOld = true;
@@ -1138,6 +1156,11 @@ void ConflictBatch::checkIntraBatchConflicts() {
 	MiniConflictSet mcs( index );
 	for(int t=0; t<transactionInfo.size(); t++) {
 		const TransactionInfo& tr = *transactionInfo[t];
+		if (tr.reportConflictingKeys && conflictingReadRanges && !tr.tooOld) {
+			for(int i=0; i<tr.readRanges.size(); i++)
+				if ( mcs.any( tr.readRanges[i].first, tr.readRanges[i].second ) )
+					(*conflictingReadRanges)[t].push_back(i);
+		}
 		if (transactionConflictStatus[t]) continue;
 		bool conflict = tr.tooOld;
 		for(int i=0; i<tr.readRanges.size(); i++)
@@ -1160,7 +1183,8 @@ void ConflictBatch::GetTooOldTransactions(vector<int>& tooOldTransactions) {
 	}
 }
 
-void ConflictBatch::detectConflicts(Version now, Version newOldestVersion, vector<int>& nonConflicting, vector<int>* tooOldTransactions) {
+void ConflictBatch::detectConflicts(Version now, Version newOldestVersion, vector<int>& nonConflicting, vector<int>* tooOldTransactions, std::map<int, vector<int>>* conflictingReadRanges) {
+	this->conflictingReadRanges = conflictingReadRanges;
 	double t = timer();
 	sortPoints( points );
 	//std::sort( combinedReadConflictRanges.begin(), combinedReadConflictRanges.end() );
@@ -1177,6 +1201,9 @@ void ConflictBatch::detectConflicts(Version now, Version newOldestVersion, vecto
 	checkIntraBatchConflicts();
 	g_checkBatch += timer()-t;
 
+	if (conflictingReadRanges)
+		findConflictingReadRanges();
+
 	t = timer();
 	combineWriteConflictRanges();
 	g_combine += timer()-t;
@@ -1198,11 +1225,15 @@ void ConflictBatch::detectConflicts(Version now, Version newOldestVersion, vecto
 	t = timer();
 	if (newOldestVersion > cs->oldestVersion) {
 		cs->oldestVersion = newOldestVersion;
-		SkipList::Finger finger; 
-		int temp;
-		cs->versionHistory.find( &cs->removalKey, &finger, &temp, 1 );
-		cs->versionHistory.removeBefore( cs->oldestVersion, finger, combinedWriteConflictRanges.size()*3 + 10 );
-		cs->removalKey = finger.getValue();
+		if (cs->useRadixTree) {
+			cs->radixHistory.removeBefore( cs->oldestVersion, cs->removalKey, combinedWriteConflictRanges.size()*3 + 10 );
+		} else {
+			SkipList::Finger finger; 
+			int temp;
+			cs->versionHistory.find( &cs->removalKey, &finger, &temp, 1 );
+			cs->versionHistory.removeBefore( cs->oldestVersion, finger, combinedWriteConflictRanges.size()*3 + 10 );
+			cs->removalKey = finger.getValue();
+		}
 	}
 	g_removeBefore += timer()-t;
 }
@@ -1211,27 +1242,66 @@ void ConflictBatch::checkReadConflictRanges() {
 	if (!combinedReadConflictRanges.size()) 
 		return;
 
-	if (PARALLEL_THREAD_COUNT) {
-		Event done[PARALLEL_THREAD_COUNT?PARALLEL_THREAD_COUNT:1];
-		for(int t=0; t<PARALLEL_THREAD_COUNT; t++) {
+	if (cs->useRadixTree) {
+		for(auto& r : combinedReadConflictRanges)
+			if (!transactionConflictStatus[r.transaction] && cs->radixHistory.anyNewer( r.begin, r.end, r.version ))
+				transactionConflictStatus[r.transaction] = true;
+		return;
+	}
+
+	// Read checks never modify the version history, so the workers share it and each takes a slice of the
+	//   read ranges.  A transaction's ranges can land in several slices, so each worker records conflicts in
+	//   its own status array and they are combined once all of the workers are done.
+	int threads = std::min<int>( cs->threadCount(), combinedReadConflictRanges.size() );
+	if (threads > 1) {
+		std::unique_ptr<bool[]> workerConflictStatus( new bool[ threads*transactionCount ]() );
+		vector<Event> done( threads );
+		for(int t=0; t<threads; t++) {
 			cs->worker_nextAction[t] = action( [&,t] {
-#pragma GCC diagnostic push
-DISABLE_ZERO_DIVISION_FLAG
-				auto begin = &combinedReadConflictRanges[0] + t*combinedReadConflictRanges.size()/PARALLEL_THREAD_COUNT;
-				auto end = &combinedReadConflictRanges[0] + (t+1)*combinedReadConflictRanges.size()/PARALLEL_THREAD_COUNT;
-#pragma GCC diagnostic pop
-				cs->versionHistory.detectConflicts( begin, end-begin, transactionConflictStatus );
+				auto begin = &combinedReadConflictRanges[0] + t*combinedReadConflictRanges.size()/threads;
+				auto end = &combinedReadConflictRanges[0] + (t+1)*combinedReadConflictRanges.size()/threads;
+				cs->versionHistory.detectConflicts( begin, end-begin, &workerConflictStatus[t*transactionCount] );
 				done[t].set();
 			});
 			cs->worker_ready[t]->set();
 		}
-		for(int i=0; i<PARALLEL_THREAD_COUNT; i++)
+		for(int i=0; i<threads; i++)
 			done[i].block();
+		for(int t=0; t<threads; t++)
+			for(int i=0; i<transactionCount; i++)
+				transactionConflictStatus[i] |= workerConflictStatus[t*transactionCount + i];
 	} else {
 		cs->versionHistory.detectConflicts( &combinedReadConflictRanges[0], combinedReadConflictRanges.size(), transactionConflictStatus );
 	}
 }
 
+// The read checks above stop at a transaction's first conflict and only record a status per transaction.  For the
+//   (rare) conflicting transactions that asked which of their read ranges conflicted, check each range against the
+//   version history again.  This has to happen before this batch's writes are merged into the history.
+void ConflictBatch::findConflictingReadRanges() {
+	for(int t=0; t<transactionInfo.size(); t++) {
+		const TransactionInfo& tr = *transactionInfo[t];
+		if (!tr.reportConflictingKeys || tr.tooOld || !transactionConflictStatus[t])
+			continue;
+
+		vector<int>& conflicting = (*conflictingReadRanges)[t];
+		const VectorRef<KeyRangeRef>& ranges = tr.transaction->read_conflict_ranges;
+		for(int i=0; i<ranges.size(); i++) {
+			bool conflict = false;
+			if (cs->useRadixTree) {
+				conflict = cs->radixHistory.anyNewer( ranges[i].begin, ranges[i].end, tr.transaction->read_snapshot );
+			} else {
+				ReadConflictRange range( ranges[i].begin, ranges[i].end, tr.transaction->read_snapshot, 0 );
+				cs->versionHistory.detectConflicts( &range, 1, &conflict );
+			}
+			if (conflict)
+				conflicting.push_back(i);
+		}
+		std::sort( conflicting.begin(), conflicting.end() );
+		conflicting.resize( std::unique( conflicting.begin(), conflicting.end() ) - conflicting.begin() );
+	}
+}
+
 void ConflictBatch::addConflictRanges(Version now, vector< pair<StringRef,StringRef> >::iterator begin, vector< pair<StringRef,StringRef> >::iterator end,SkipList* part) {
 	int count = end-begin;
 #if 0
@@ -1261,24 +1331,45 @@ void ConflictBatch::mergeWriteConflictRanges(Version now) {
 	if (!combinedWriteConflictRanges.size()) 
 		return;
 
-	if (PARALLEL_THREAD_COUNT) {
+	if (cs->useRadixTree) {
+		for(auto& w : combinedWriteConflictRanges)
+			cs->radixHistory.addRange( w.first, w.second, now );
+		return;
+	}
+
+	int threads = std::min<int>( cs->threadCount(), combinedWriteConflictRanges.size() );
+	if (threads > 1) {
+		// Split the write ranges into contiguous groups of roughly equal size, one per worker.  A range
+		//   [a,k) inserts an entry at k, so a group may not start at the end of the previous group's last
+		//   range (see SkipList::partition); such split points are moved right or dropped.
+		vector<int> splitIndex;
+		for(int s=1; s<threads; s++) {
+			int i = std::max<int>( s*combinedWriteConflictRanges.size()/threads, splitIndex.size() ? splitIndex.back()+1 : 1 );
+			while (i < combinedWriteConflictRanges.size() && combinedWriteConflictRanges[i-1].second == combinedWriteConflictRanges[i].first)
+				i++;
+			if (i >= combinedWriteConflictRanges.size())
+				break;
+			splitIndex.push_back(i);
+		}
+		splitIndex.push_back( combinedWriteConflictRanges.size() );
+
 		vector<SkipList> parts;
-		for (int i = 0; i < PARALLEL_THREAD_COUNT; i++)
+		for (int i = 0; i < splitIndex.size(); i++)
 			parts.push_back(SkipList());
 
 		vector<StringRef> splits( parts.size()-1 );
 		for(int s=0; s<splits.size(); s++)
-			splits[s] = combinedWriteConflictRanges[ (s+1)*combinedWriteConflictRanges.size()/parts.size() ].first;
+			splits[s] = combinedWriteConflictRanges[ splitIndex[s] ].first;
 
 		cs->versionHistory.partition( splits.size() ? &splits[0] : NULL, splits.size(), &parts[0] );
-		vector<double> tstart(PARALLEL_THREAD_COUNT), tend(PARALLEL_THREAD_COUNT);
-		Event done[PARALLEL_THREAD_COUNT ? PARALLEL_THREAD_COUNT : 1];
+		vector<double> tstart(parts.size()), tend(parts.size());
+		vector<Event> done( parts.size() );
 		double before = timer();
 		for(int t=0; t<parts.size(); t++) {
 			cs->worker_nextAction[t] = action( [&,t] {
 				tstart[t] = timer();
-				auto begin = combinedWriteConflictRanges.begin() + (t*combinedWriteConflictRanges.size()/parts.size());
-				auto end = combinedWriteConflictRanges.begin() + ((t+1)*combinedWriteConflictRanges.size()/parts.size());
+				auto begin = combinedWriteConflictRanges.begin() + (t ? splitIndex[t-1] : 0);
+				auto end = combinedWriteConflictRanges.begin() + splitIndex[t];
 
 				addConflictRanges(now, begin, end, &parts[t]);
 
@@ -1288,7 +1379,7 @@ void ConflictBatch::mergeWriteConflictRanges(Version now) {
 			cs->worker_ready[t]->set();
 		}
 		double launch = timer();
-		for(int i=0; i<PARALLEL_THREAD_COUNT; i++)
+		for(int i=0; i<parts.size(); i++)
 			done[i].block();
 		double after = timer();
 
@@ -1338,59 +1429,6 @@ void ConflictBatch::combineWriteConflictRanges()
 
 //void showNumaStatus();
 
-/*
-bool sse4Less( const uint8_t* a, int aLen, const uint8_t* b, int bLen ) {
-	while (true) {
-		int res = _mm_cmpestri(*(__m128i*)a, aLen, *(__m128i*)b, bLen, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT );
-		printf("%d ", res);
-		if (res == 16) {
-			if (bLen < 16) return false;
-			a += 16; b += 16; aLen -= 16; bLen -= 16;
-		}
-		if (res == bLen) return false;
-		if (res == aLen) return true;
-
-		return a[res] < b[res];
-	}
-}
-
-void tless( const char* a, const char* b ) {
-	bool x = sse4Less( (const uint8_t*)a, strlen(a), (const uint8_t*)b, strlen(b) );
-	if (x)
-		printf("%s < %s\n", a, b);
-	else
-		printf("%s >= %s\n", a, b);
-}
-
-void sse4Test(){
-
-	tless("hello", "world");
-	tless("a", "a");
-	tless("world", "hello");
-	tless("world", "worry");
-	tless("worry", "world");
-	tless("hello", "hello1");
-	tless("hello1", "hello");
-
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworld");
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworld", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello");
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworld", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworry");
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworry", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaworld");
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello1");
-	tless("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello1", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaahello");
-
-	char *a = "hello1worldthisisalonglonglongstring";
-	char *b = "hello";
-	__m128i aa = *(__m128i*)a;
-	__m128i bb = *(__m128i*)a;
-
-	int res = _mm_cmpestri(aa, 2, bb, 2, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT );
-
-	cout << res << endl;
-
-}
-*/
-
 void miniConflictSetTest() {
 	for(int i=0; i<2000000; i++) {
 		int size = 64*5;		// Also run 64*64*5 to test multiple words of andValues and orValues
@@ -1409,52 +1447,12 @@ void miniConflictSetTest() {
 	printf("miniConflictSetTest complete\n");
 }
 
-void skipListTest() {
-	printf("Skip list test\n");
-
-	//sse4Test();
-
-	//A test case that breaks the old operator<
-	//KeyInfo a( LiteralStringRef("hello"), true, false, true, -1 );
-	//KeyInfo b( LiteralStringRef("hello\0"), false, false, false, 0 );
-
-	miniConflictSetTest();
-
-
-	setAffinity(0);
-	//showNumaStatus();
-
-	double start;
-
-	ConflictSet* cs = newConflictSet();
-
-	Arena testDataArena;
-	VectorRef< VectorRef<KeyRangeRef> > testData;
-	testData.resize(testDataArena, 500);
-	vector<vector<uint8_t>> success( testData.size() );
-	vector<vector<uint8_t>> success2( testData.size() );
-	for(int i=0; i<testData.size(); i++) {
-		testData[i].resize(testDataArena, 5000);
-		success[i].assign( testData[i].size(), false );
-		success2[i].assign( testData[i].size(), false );
-		for(int j=0; j<testData[i].size(); j++) {
-			int key = g_random->randomInt(0, 20000000);
-			int key2 = key + 1 + g_random->randomInt(0, 10);
-			testData[i][j] = KeyRangeRef(
-				setK( testDataArena, key ),
-				setK( testDataArena, key2 ) );
-		}
-	}
-	printf("Test data generated (%d)\n", g_random->randomInt(0,100000));
-	printf("  %d threads, %d batches, %d/batch\n", PARALLEL_THREAD_COUNT, testData.size(), testData[0].size());
-
-	printf("Running\n");
+double runConflictSetBatches( int threadCount, bool useRadixTree, const VectorRef< VectorRef<KeyRangeRef> >& testData, vector<vector<int>>& nonConflict, int& tcount, int& cranges, int& entries ) {
+	ConflictSet* cs = newConflictSet( threadCount, useRadixTree );
 
 	int readCount = 1, writeCount = 1;
-	int cranges = 0, tcount = 0;
 
-	start = timer();
-	vector<vector<int>> nonConflict( testData.size() );
+	double start = timer();
 	for(int i=0; i<testData.size(); i++) {
 		Arena buf;
 		vector<CommitTransactionRef> trs;
@@ -1487,28 +1485,98 @@ void skipListTest() {
 		g_detectConflicts += timer()-t;
 	}
 	double elapsed = timer()-start;
-	printf("New conflict set: %0.3f sec\n", elapsed);
-	printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
-	printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
 
-	elapsed = g_detectConflicts.getValue();
-	printf("Detect only:      %0.3f sec\n", elapsed);
-	printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
-	printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
+	entries = useRadixTree ? cs->radixHistory.count() : cs->versionHistory.count();
+	destroyConflictSet( cs );
+	return elapsed;
+}
 
-	elapsed = g_checkRead.getValue() + g_merge.getValue();
-	printf("Skiplist only:    %0.3f sec\n", elapsed);
-	printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
-	printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
+void skipListTest() {
+	printf("Skip list test\n");
 
-	printf("Performance counters:\n");
-	for(int c=0; c<skc.size(); c++) {
-		printf("%20s: %s\n", skc[c]->getMetric().name().c_str(), skc[c]->getMetric().formatted().c_str());
-	}
+	//A test case that breaks the old operator<
+	//KeyInfo a( LiteralStringRef("hello"), true, false, true, -1 );
+	//KeyInfo b( LiteralStringRef("hello\0"), false, false, false, 0 );
+
+	miniConflictSetTest();
 
+
+	setAffinity(0);
 	//showNumaStatus();
 
-	printf("%d entries in version history\n", cs->versionHistory.count());
+	// Each data set is resolved by the SkipList with 1 to N worker threads and by the radix tree.  Every
+	//   configuration must accept exactly the same transactions as the single threaded SkipList.  The second
+	//   data set gives every key a long shared prefix, like a tuple encoded subspace.
+	struct Config { const char* name; int threads; bool radixTree; bool shortKeysOnly; };
+	const Config configs[] = {
+		{ "SkipList, 1 thread", 1, false, false },
+		{ "SkipList, 2 threads", 2, false, true },
+		{ "SkipList, 4 threads", 4, false, true },
+		{ "SkipList, 8 threads", 8, false, true },
+		{ "Radix tree", 1, true, false },
+	};
+	const StringRef dataSetPrefixes[] = { StringRef(), LiteralStringRef("\x02" "application" "\x00\x02" "tenant" "\x00\x15\x07\x02" "table" "\x00\x02" "index" "\x00") };
+
+	for(StringRef prefix : dataSetPrefixes) {
+		Arena testDataArena;
+		VectorRef< VectorRef<KeyRangeRef> > testData;
+		testData.resize(testDataArena, 500);
+		for(int i=0; i<testData.size(); i++) {
+			testData[i].resize(testDataArena, 5000);
+			for(int j=0; j<testData[i].size(); j++) {
+				int key = g_random->randomInt(0, 20000000);
+				int key2 = key + 1 + g_random->randomInt(0, 10);
+				testData[i][j] = KeyRangeRef(
+					setK( testDataArena, key, prefix ),
+					setK( testDataArena, key2, prefix ) );
+			}
+		}
+		printf("Test data generated (%d)\n", g_random->randomInt(0,100000));
+		printf("  %d batches, %d/batch, %d byte key prefix\n", testData.size(), testData[0].size(), prefix.size());
+
+		vector<vector<int>> baselineNonConflict;
+		double baselineElapsed = 0;
+		for(const Config& config : configs) {
+			if (config.shortKeysOnly && prefix.size())
+				continue;
+			for(int c=0; c<skc.size(); c++)
+				skc[c]->clear();
+
+			printf("Running %s\n", config.name);
+			vector<vector<int>> nonConflict( testData.size() );
+			int tcount = 0, cranges = 0, entries = 0;
+			double elapsed = runConflictSetBatches( config.threads, config.radixTree, testData, nonConflict, tcount, cranges, entries );
+			if (!baselineNonConflict.size()) {
+				baselineNonConflict = nonConflict;
+				baselineElapsed = elapsed;
+			} else {
+				ASSERT( nonConflict == baselineNonConflict );
+			}
+
+			printf("New conflict set: %0.3f sec (%0.2fx)\n", elapsed, baselineElapsed/elapsed);
+			printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
+			printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
+
+			elapsed = g_detectConflicts.getValue();
+			printf("Detect only:      %0.3f sec\n", elapsed);
+			printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
+			printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
+
+			elapsed = g_checkRead.getValue() + g_merge.getValue();
+			printf("Structure only:   %0.3f sec\n", elapsed);
+			printf("                  %0.3f Mtransactions/sec\n", tcount/elapsed/1e6);
+			printf("                  %0.3f Mkeys/sec\n", cranges*2/elapsed/1e6);
+
+			printf("Performance counters:\n");
+			for(int c=0; c<skc.size(); c++) {
+				printf("%20s: %s\n", skc[c]->getMetric().name().c_str(), skc[c]->getMetric().formatted().c_str());
+			}
+
+			//showNumaStatus();
+
+			printf("%d entries in version history\n", entries);
+		}
+	}
 
 	/*start = timer();
 	vector<vector<int>> nonConflict2( testData.size() );
@@ -1541,11 +1609,90 @@ void skipListTest() {
 		}
 	}
 	printf("%d transactions accepted\n", atotal);
-	if (bminusa)
-		printf("ERROR: %d transactions unnecessarily rejected!\n", bminusa);
-	if (aminusb)
-		printf("ERROR: %d transactions incorrectly accepted!\n", aminusb);
+	ASSERT( !bminusa );  // transactions unnecessarily rejected
+	ASSERT( !aminusb );  // transactions incorrectly accepted
 		*/
 	//for(int i=0; i<testData.size(); i++)
 	//	printf("%d %d %d %d\n", i, nonConflict[i].size(), nonConflict2[i].size()-nonConflict[i].size(), nonConflict[i] != nonConflict2[i]);
 }
+
+static Key randomConflictTestKey() {
+	// A tiny alphabet and short lengths make keys that are empty, equal, or prefixes of one another common
+	static const char alphabet[] = { '\x00', '\x01', 'a', 'b', '\xfe' };
+	std::string s( g_random->randomInt(0, 6), '\x00' );
+	for(char& c : s)
+		c = alphabet[ g_random->randomInt(0, sizeof(alphabet)) ];
+	return Key( s );
+}
+
+// Checks ConflictRadixTree against SlowConflictSet on random writes, reads and incremental removal of old versions.
+//   Reads are only compared at versions no older than the last removeBefore(), as in the resolver.
+TEST_CASE("fdbserver/ConflictRadixTree/randomized") {
+	for(int run=0; run<20; run++) {
+		ConflictRadixTree tree;
+		SlowConflictSet slow;
+		slow.clear( 0 );
+		Version version = 0, oldestVersion = 0;
+		Key resumeKey;
+
+		for(int op=0; op<2000; op++) {
+			Key a = randomConflictTestKey(), b = randomConflictTestKey();
+			if (b < a) std::swap( a, b );
+			if (g_random->coinflip()) {
+				// A point key, or a range which may be empty
+				Standalone<VectorRef<KeyRangeRef>> clears;
+				Standalone<VectorRef<KeyValueRef>> sets;
+				version += g_random->randomInt(0, 3);
+				if (g_random->random01() < 0.3) {
+					sets.push_back_deep( sets.arena(), KeyValueRef( a, StringRef() ) );
+					tree.addRange( a, keyAfter(a), version );
+				} else {
+					if (a < b)
+						clears.push_back_deep( clears.arena(), KeyRangeRef( a, b ) );
+					tree.addRange( a, b, version );
+				}
+				slow.add( clears, sets, version );
+			} else if (g_random->random01() < 0.8) {
+				if (g_random->random01() < 0.3)
+					b = keyAfter(a);
+				if (!(a < b))
+					continue;
+				Version readVersion = g_random->randomInt64( oldestVersion, version+1 );
+				Standalone<VectorRef<KeyRangeRef>> reads;
+				reads.push_back_deep( reads.arena(), KeyRangeRef( a, b ) );
+				ASSERT( tree.anyNewer( a, b, readVersion ) == slow.is_conflict( reads, readVersion ) );
+			} else {
+				oldestVersion = g_random->randomInt64( oldestVersion, version+1 );
+				tree.removeBefore( oldestVersion, resumeKey, g_random->randomInt(1, 20) );
+			}
+		}
+	}
+	return Void();
+}
+
+// The resolver never uses worker threads in simulation, so check here that partitioning a batch across workers
+//   accepts exactly the same transactions as resolving it serially.  A small key space makes conflicts common.
+TEST_CASE("fdbserver/SkipList/parallelConflictDetection") {
+	Arena testDataArena;
+	VectorRef< VectorRef<KeyRangeRef> > testData;
+	testData.resize( testDataArena, 50 );
+	for(int i=0; i<testData.size(); i++) {
+		testData[i].resize( testDataArena, g_random->randomInt(2, 2000) );
+		for(int j=0; j<testData[i].size(); j++) {
+			int key = g_random->randomInt(0, 20000);
+			int key2 = key + 1 + g_random->randomInt(0, 10);
+			testData[i][j] = KeyRangeRef( setK( testDataArena, key ), setK( testDataArena, key2 ) );
+		}
+	}
+
+	vector<vector<int>> serialNonConflict( testData.size() );
+	int tcount = 0, cranges = 0, entries = 0;
+	runConflictSetBatches( 1, false, testData, serialNonConflict, tcount, cranges, entries );
+
+	for(int threadCount : { 2, 3, 4 }) {
+		vector<vector<int>> nonConflict( testData.size() );
+		runConflictSetBatches( threadCount, false, testData, nonConflict, tcount, cranges, entries );
+		ASSERT( nonConflict == serialNonConflict );
+	}
+	return Void();
+}
@@ -132,14 +132,28 @@ private:
 	IDiskQueue* queue;
 	UID dbgid;
 
-	void updateVersionSizes( const TLogQueueEntry& result, TLogData* tLog );
+	void updateVersionSizes( const TLogQueueEntry& result, TLogData* tLog, IDiskQueue::location start );
 
 	ACTOR static Future<TLogQueueEntry> readNext( TLogQueue* self, TLogData* tLog ) {
 		state TLogQueueEntry result;
 		state int zeroFillSize = 0;
 
 		loop {
-			Standalone<StringRef> h = wait( self->queue->readNext( sizeof(uint32_t) ) );
+			state IDiskQueue::location start = self->queue->getNextReadLocation();
+			state Standalone<StringRef> h;
+			if (start.lo < 0) {
+				// The queue doesn't know where reading begins until the first read, so find the location of the first byte by reading it alone
+				Standalone<StringRef> first = wait( self->queue->readNext( 1 ) );
+				start = IDiskQueue::location( self->queue->getNextReadLocation().lo - first.size() );
+				h = first;
+				if (h.size()) {
+					Standalone<StringRef> rest = wait( self->queue->readNext( sizeof(uint32_t) - 1 ) );
+					h = h.withSuffix( rest );
+				}
+			} else {
+				Standalone<StringRef> header = wait( self->queue->readNext( sizeof(uint32_t) ) );
+				h = header;
+			}
 			if (h.size() != sizeof(uint32_t)) {
 				if (h.size()) {
 					TEST( true );  // Zero fill within size field
@@ -165,7 +179,7 @@ private:
 				Arena a = e.arena();
 				ArenaReader ar( a, e.substr(0, payloadSize), IncludeVersion() );
 				ar >> result;
-				self->updateVersionSizes(result, tLog);
+				self->updateVersionSizes(result, tLog, start);
 				return result;
 			}
 		}
@@ -182,7 +196,9 @@ private:
 
 // Immutable keys
 static const KeyValueRef persistFormat( LiteralStringRef( "Format" ), LiteralStringRef("FoundationDB/LogServer/2/4") );
-static const KeyRangeRef persistFormatReadableRange( LiteralStringRef("FoundationDB/LogServer/2/3"), LiteralStringRef("FoundationDB/LogServer/2/5") );
+// Written instead while any generation spills by reference (SpillReference/ and TagMsgRef/, and a queue that is not popped past spilled data)
+static const KeyValueRef persistSpillReferenceFormat( LiteralStringRef( "Format" ), LiteralStringRef("FoundationDB/LogServer/2/5") );
+static const KeyRangeRef persistFormatReadableRange( LiteralStringRef("FoundationDB/LogServer/2/3"), LiteralStringRef("FoundationDB/LogServer/2/6") );
 static const KeyRangeRef persistRecoveryCountKeys = KeyRangeRef( LiteralStringRef( "DbRecoveryCount/" ), LiteralStringRef( "DbRecoveryCount0" ) );
 
 // Updated on updatePersistentData()
@@ -190,7 +206,9 @@ static const KeyRangeRef persistCurrentVersionKeys = KeyRangeRef( LiteralStringR
 static const KeyRangeRef persistKnownCommittedVersionKeys = KeyRangeRef( LiteralStringRef( "knownCommitted/" ), LiteralStringRef( "knownCommitted0" ) );
 static const KeyRangeRef persistUnrecoveredBeforeVersionKeys = KeyRangeRef( LiteralStringRef( "UnrecoveredBefore/" ), LiteralStringRef( "UnrecoveredBefore0" ) );
 static const KeyRangeRef persistLogRouterTagsKeys = KeyRangeRef( LiteralStringRef( "LogRouterTags/" ), LiteralStringRef( "LogRouterTags0" ) );
+static const KeyRangeRef persistSpillReferenceKeys = KeyRangeRef( LiteralStringRef( "SpillReference/" ), LiteralStringRef( "SpillReference0" ) );
 static const KeyRange persistTagMessagesKeys = prefixRange(LiteralStringRef("TagMsg/"));
+static const KeyRange persistTagMessageRefsKeys = prefixRange(LiteralStringRef("TagMsgRef/"));
 static const KeyRange persistTagPoppedKeys = prefixRange(LiteralStringRef("TagPop/"));
 
 static Key persistTagMessagesKey( UID id, Tag tag, Version version ) {
@@ -202,6 +220,16 @@ static Key persistTagMessagesKey( UID id, Tag tag, Version version ) {
 	return wr.toStringRef();
 }
 
+// Each key holds a batch of SpilledData for the tag, and is keyed by the last version in the batch
+static Key persistTagMessageRefsKey( UID id, Tag tag, Version version ) {
+	BinaryWriter wr( Unversioned() );
+	wr.serializeBytes(persistTagMessageRefsKeys.begin);
+	wr << id;
+	wr << tag;
+	wr << bigEndian64( version );
+	return wr.toStringRef();
+}
+
 static Key persistTagPoppedKey( UID id, Tag tag ) {
 	BinaryWriter wr(Unversioned());
 	wr.serializeBytes( persistTagPoppedKeys.begin );
@@ -233,9 +261,25 @@ static Version decodeTagMessagesKey( StringRef key ) {
 	return bigEndian64( BinaryReader::fromStringRef<Version>( stripTagMessagesKey(key), Unversioned() ) );
 }
 
+// When a TLog spills by reference, the messages for a tag are left in the DiskQueue and persistentData records where to find them
+struct SpilledData {
+	Version version;
+	IDiskQueue::location start, end;  // The bounds of the TLogQueueEntry for version in the DiskQueue
+	uint32_t mutationBytes;  // The size of the tag's messages in that entry
+
+	SpilledData() : version(invalidVersion), mutationBytes(0) {}
+	SpilledData( Version version, IDiskQueue::location start, IDiskQueue::location end, uint32_t mutationBytes ) : version(version), start(start), end(end), mutationBytes(mutationBytes) {}
+
+	template <class Ar>
+	void serialize(Ar& ar) {
+		ar & version & start & end & mutationBytes;
+	}
+};
+
 struct TLogData : NonCopyable {
 	AsyncTrigger newLogData;
-	Deque<UID> queueOrder;
+	Deque<UID> spillOrder;  // Generations of LogData in the order in which their messages were pushed to the queue, until they have been spilled
+	Deque<UID> popOrder;    // The same, until nothing in the queue is needed by them; the queue is only popped by the front of this
 	std::map<UID, Reference<struct LogData>> id_data;
 
 	UID dbgid;
@@ -289,11 +333,12 @@ struct LogData : NonCopyable, public ReferenceCounted<LogData> {
 		Version popped;				// see popped version tracking contract below
 		bool update_version_sizes;
 		bool unpoppedRecovered;
+		bool spillByValue;						// In a generation that spills by reference, this tag fell too far behind and is spilled by value instead
 		Tag tag;
 
-		TagData( Tag tag, Version popped, bool nothing_persistent, bool popped_recently, bool unpoppedRecovered ) : tag(tag), nothing_persistent(nothing_persistent), popped(popped), popped_recently(popped_recently), unpoppedRecovered(unpoppedRecovered), update_version_sizes(tag != txsTag) {}
+		TagData( Tag tag, Version popped, bool nothing_persistent, bool popped_recently, bool unpoppedRecovered ) : tag(tag), nothing_persistent(nothing_persistent), popped(popped), popped_recently(popped_recently), unpoppedRecovered(unpoppedRecovered), update_version_sizes(tag != txsTag), spillByValue(false) {}
 
-		TagData(TagData&& r) noexcept(true) : version_messages(std::move(r.version_messages)), nothing_persistent(r.nothing_persistent), popped_recently(r.popped_recently), popped(r.popped), update_version_sizes(r.update_version_sizes), tag(r.tag), unpoppedRecovered(r.unpoppedRecovered) {}
+		TagData(TagData&& r) noexcept(true) : version_messages(std::move(r.version_messages)), nothing_persistent(r.nothing_persistent), popped_recently(r.popped_recently), popped(r.popped), update_version_sizes(r.update_version_sizes), tag(r.tag), unpoppedRecovered(r.unpoppedRecovered), spillByValue(r.spillByValue) {}
 		void operator= (TagData&& r) noexcept(true) {
 			version_messages = std::move(r.version_messages);
 			nothing_persistent = r.nothing_persistent;
@@ -302,6 +347,7 @@ struct LogData : NonCopyable, public ReferenceCounted<LogData> {
 			update_version_sizes = r.update_version_sizes;
 			tag = r.tag;
 			unpoppedRecovered = r.unpoppedRecovered;
+			spillByValue = r.spillByValue;
 		}
 
 		// Erase messages not needed to update *from* versions >= before (thus, messages with toversion <= before)
@@ -336,7 +382,7 @@ struct LogData : NonCopyable, public ReferenceCounted<LogData> {
 		}
 	};
 
-	Map<Version, IDiskQueue::location> version_location;  // For the version of each entry that was push()ed, the end location of the serialized bytes
+	Map<Version, std::pair<IDiskQueue::location, IDiskQueue::location>> version_location;  // For the version of each entry that was push()ed, the begin and end locations of the serialized bytes
 
 	/*
 	Popped version tracking contract needed by log system to implement ILogCursor::popped():
@@ -407,12 +453,16 @@ struct LogData : NonCopyable, public ReferenceCounted<LogData> {
 	int8_t locality;
 	UID recruitmentID;
 
+	bool spillByReference;  // Whether updatePersistentData spills references to the messages in the queue, rather than the messages themselves
+	Version minReferencedVersion;  // When spilling by reference, the first version whose queue entry may be referenced by persistentData
+	std::multiset<Version> referencePeekVersions;  // The first versions being read from the queue by peeks of spilled data
+
 	explicit LogData(TLogData* tLogData, TLogInterface interf, Tag remoteTag, bool isPrimary, int logRouterTags, UID recruitmentID) : tLogData(tLogData), knownCommittedVersion(1), logId(interf.id()),
 			cc("TLog", interf.id().toString()), bytesInput("bytesInput", cc), bytesDurable("bytesDurable", cc), remoteTag(remoteTag), isPrimary(isPrimary), logRouterTags(logRouterTags), recruitmentID(recruitmentID),
 			logSystem(new AsyncVar<Reference<ILogSystem>>()), logRouterPoppedVersion(0), durableKnownCommittedVersion(0),
 			// These are initialized differently on init() or recovery
 			recoveryCount(), stopped(false), initialized(false), queueCommittingVersion(0), newPersistentDataVersion(invalidVersion), unrecoveredBefore(1), recoveredAt(1), unpoppedRecoveredTags(0),
-			logRouterPopToVersion(0), locality(tagLocalityInvalid)
+			logRouterPopToVersion(0), locality(tagLocalityInvalid), spillByReference(false), minReferencedVersion(0)
 	{
 		startRole(interf.id(), UID(), "TLog");
 
@@ -448,8 +498,11 @@ struct LogData : NonCopyable, public ReferenceCounted<LogData> {
 			tLogData->persistentData->clear( singleKeyRange(logIdKey.withPrefix(persistUnrecoveredBeforeVersionKeys.begin)) );
 			tLogData->persistentData->clear( singleKeyRange(logIdKey.withPrefix(persistLogRouterTagsKeys.begin)) );
 			tLogData->persistentData->clear( singleKeyRange(logIdKey.withPrefix(persistRecoveryCountKeys.begin)) );
+			tLogData->persistentData->clear( singleKeyRange(logIdKey.withPrefix(persistSpillReferenceKeys.begin)) );
 			Key msgKey = logIdKey.withPrefix(persistTagMessagesKeys.begin);
 			tLogData->persistentData->clear( KeyRangeRef( msgKey, strinc(msgKey) ) );
+			Key msgRefKey = logIdKey.withPrefix(persistTagMessageRefsKeys.begin);
+			tLogData->persistentData->clear( KeyRangeRef( msgRefKey, strinc(msgRefKey) ) );
 			Key poppedKey = logIdKey.withPrefix(persistTagPoppedKeys.begin);
 			tLogData->persistentData->clear( KeyRangeRef( poppedKey, strinc(poppedKey) ) );
 		}
@@ -466,9 +519,10 @@ void TLogQueue::push( T const& qe, Reference<LogData> logData ) {
 	wr << qe;
 	wr << uint8_t(1);
 	*(uint32_t*)wr.getData() = wr.getLength() - sizeof(uint32_t) - sizeof(uint8_t);
+	auto start = queue->getNextPushLocation();
 	auto loc = queue->push( wr.toStringRef() );
 	//TraceEvent("TLogQueueVersionWritten", dbgid).detail("Size", wr.getLength() - sizeof(uint32_t) - sizeof(uint8_t)).detail("Loc", loc);
-	logData->version_location[qe.version] = loc;
+	logData->version_location[qe.version] = std::make_pair(start, loc);
 }
 void TLogQueue::pop( Version upTo, Reference<LogData> logData ) {
 	// Keep only the given and all subsequent version numbers
@@ -483,13 +537,13 @@ void TLogQueue::pop( Version upTo, Reference<LogData> logData ) {
 		v.decrementNonEnd();
 	}
 
-	queue->pop( v->value );
+	queue->pop( v->value.second );
 	logData->version_location.erase( logData->version_location.begin(), v );  // ... and then we erase that previous version and all prior versions
 }
-void TLogQueue::updateVersionSizes( const TLogQueueEntry& result, TLogData* tLog ) {
+void TLogQueue::updateVersionSizes( const TLogQueueEntry& result, TLogData* tLog, IDiskQueue::location start ) {
 	auto it = tLog->id_data.find(result.id);
 	if(it != tLog->id_data.end()) {
-		it->second->version_location[result.version] = queue->getNextReadLocation();
+		it->second->version_location[result.version] = std::make_pair(start, queue->getNextReadLocation());
 	}
 }
 
@@ -522,6 +576,46 @@ ACTOR Future<Void> tLogLock( TLogData* self, ReplyPromise< TLogLockResult > repl
 	return Void();
 }
 
+// Appends the messages for tag from the queue entry for version, which was read back from the DiskQueue, in the form in which they are
+// spilled by value
+void appendTagMessagesFromQueueEntry( Reference<LogData> logData, Tag tag, Version version, Standalone<StringRef> const& entry, BinaryWriter& messages ) {
+	uint32_t payloadSize = *(uint32_t*)entry.begin();
+	ASSERT( entry.size() == sizeof(uint32_t) + payloadSize + sizeof(uint8_t) && entry[entry.size()-1] == 1 );
+
+	TLogQueueEntryRef qe;
+	ArenaReader rd( entry.arena(), entry.substr( sizeof(uint32_t), payloadSize ), IncludeVersion() );
+	rd >> qe;
+	ASSERT( qe.version == version && qe.id == logData->logId );
+
+	ArenaReader msgs( entry.arena(), qe.messages, Unversioned() );
+	int32_t messageLength;
+	uint32_t sub;
+	uint16_t tagCount;
+	while(!msgs.empty()) {
+		msgs.checkpoint();
+		msgs >> messageLength >> sub >> tagCount;
+		int matches = 0;
+		for(int i = 0; i < tagCount; i++) {
+			Tag t;
+			msgs >> t;
+			if(t.locality == tagLocalityLogRouter) {
+				if(!logData->logRouterTags) {
+					continue;
+				}
+				t.id = t.id % logData->logRouterTags;
+			}
+			if(t == tag) {
+				matches++;
+			}
+		}
+		msgs.rewind();
+		StringRef message = StringRef( (uint8_t const*)msgs.readBytes( messageLength + sizeof(messageLength) ), messageLength + sizeof(messageLength) );
+		for(int i = 0; i < matches; i++) {
+			messages.serializeBytes( message );
+		}
+	}
+}
+
 void updatePersistentPopped( TLogData* self, Reference<LogData> logData, Reference<LogData::TagData> data ) {
 	if (!data->popped_recently) return;
 	self->persistentData->set(KeyValueRef( persistTagPoppedKey(logData->logId, data->tag), persistTagPoppedValue(data->popped) ));
@@ -529,6 +623,13 @@ void updatePersistentPopped( TLogData* self, Reference<LogData> logData, Referen
 
 	if (data->nothing_persistent) return;
 
+	if (logData->spillByReference) {
+		// Batches that end before popped; a batch straddling it is cleared by a later pop
+		self->persistentData->clear( KeyRangeRef(
+			persistTagMessageRefsKey( logData->logId, data->tag, Version(0) ),
+			persistTagMessageRefsKey( logData->logId, data->tag, data->popped ) ) );
+	}
+	// Even a generation that spills by reference spills a tag that fell too far behind by value
 	self->persistentData->clear( KeyRangeRef(
 		persistTagMessagesKey( logData->logId, data->tag, Version(0) ),
 		persistTagMessagesKey( logData->logId, data->tag, data->popped ) ) );
@@ -536,6 +637,76 @@ void updatePersistentPopped( TLogData* self, Reference<LogData> logData, Referen
 		data->nothing_persistent = true;
 }
 
+// Generations of LogData share the queue, and it can only be popped on behalf of the oldest one that still needs its contents
+void popDiskQueue( TLogData* self, Reference<LogData> logData ) {
+	while(self->popOrder.size()) {
+		auto it = self->id_data.find(self->popOrder.front());
+		if(it != self->id_data.end() && (!it->second->stopped || it->second->persistentDataDurableVersion != it->second->version.get() ||
+				(it->second->spillByReference && (it->second->minReferencedVersion <= it->second->version.get() || it->second->referencePeekVersions.size())))) {
+			break;
+		}
+		self->popOrder.pop_front();
+	}
+
+	if(!self->popOrder.size() || self->popOrder.front() != logData->logId || self->queueCommitEnd.get() == 0) {
+		return;
+	}
+
+	Version upTo = logData->minReferencedVersion;
+	if(logData->referencePeekVersions.size()) {
+		upTo = std::min( upTo, *logData->referencePeekVersions.begin() );
+	}
+	self->persistentQueue->pop( upTo, logData ); // SOMEDAY: this can cause a slow task (~0.5ms), presumably from erasing too many versions. Should we limit the number of versions cleared at a time?
+}
+
+// The number of bytes of the queue, from the entry for version on, that can't be popped while version is referenced
+int64_t queueBytesFrom( TLogData* self, Reference<LogData> logData, Version version ) {
+	auto it = logData->version_location.lower_bound( version );
+	if(it == logData->version_location.end()) {
+		return 0;
+	}
+	return self->rawPersistentQueue->getNextPushLocation().lo - it->value.first.lo;
+}
+
+// A tag that is spilled by reference keeps the queue from being popped past the first version it hasn't popped, so a tag that isn't
+// popped for a long time would keep the whole queue.  Replaces the tag's references to versions from popped on with the messages
+// themselves, a batch at a time.  The caller spills the tag by value from then on.
+ACTOR Future<Void> spillTagByValue( TLogData* self, Reference<LogData> logData, Reference<LogData::TagData> tagData, Version popped ) {
+	state KeyRange refKeys = KeyRangeRef(
+		persistTagMessageRefsKey( logData->logId, tagData->tag, popped ),
+		persistTagMessageRefsKey( logData->logId, tagData->tag, logData->persistentDataVersion + 1 ) );
+	state std::vector<SpilledData> refs;
+	state std::vector<Future<Standalone<StringRef>>> reads;
+	loop {
+		Standalone<VectorRef<KeyValueRef>> kvs = wait( self->persistentData->readRange( refKeys, 1 ) );
+		if(!kvs.size()) {
+			return Void();
+		}
+
+		std::vector<SpilledData> batch;
+		BinaryReader rd( kvs[0].value, IncludeVersion() );
+		rd >> batch;
+		refs.clear();
+		reads.clear();
+		for(auto& sd : batch) {
+			if(sd.version >= popped) {
+				refs.push_back( sd );
+				reads.push_back( self->rawPersistentQueue->read( sd.start, sd.end ) );
+			}
+		}
+		((KeyRangeRef&)refKeys) = KeyRangeRef( keyAfter(kvs[0].key, refKeys.arena()), refKeys.end );
+		Void _ = wait( waitForAll(reads) );
+
+		// Peeks read references before values, so a peek that overlaps this sees each version at least once
+		for(int i = 0; i < refs.size(); i++) {
+			BinaryWriter wr( Unversioned() );
+			appendTagMessagesFromQueueEntry( logData, tagData->tag, refs[i].version, reads[i].get(), wr );
+			self->persistentData->set( KeyValueRef( persistTagMessagesKey( logData->logId, tagData->tag, refs[i].version ), wr.toStringRef() ) );
+		}
+		self->persistentData->clear( KeyRangeRef( persistTagMessageRefsKey( logData->logId, tagData->tag, Version(0) ), refKeys.begin ) );
+	}
+}
+
 ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logData, Version newPersistentDataVersion ) {
 	// PERSIST: Changes self->persistentDataVersion and writes and commits the relevant changes
 	ASSERT( newPersistentDataVersion <= logData->version.get() );
@@ -546,6 +717,7 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 	//TraceEvent("updatePersistentData", self->dbgid).detail("seq", newPersistentDataSeq);
 
 	state bool anyData = false;
+	state Version minReferencedVersion = newPersistentDataVersion + 1;
 
 	// For all existing tags
 	state int tag_locality = 0;
@@ -556,20 +728,43 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 			state Reference<LogData::TagData> tagData = logData->tag_data[tag_locality][tag_id];
 			if(tagData) {
 				state Version currentVersion = 0;
+				state std::vector<SpilledData> refs;
 				// Clear recently popped versions from persistentData if necessary
 				updatePersistentPopped( self, logData, tagData );
+				// Every reference to a version before the popped version we are about to make durable is cleared
+				state Version persistentPopped = tagData->popped;
+				refs.clear();
+				if(logData->spillByReference && !tagData->spillByValue && !tagData->nothing_persistent &&
+						queueBytesFrom( self, logData, persistentPopped ) > SERVER_KNOBS->TLOG_SPILL_REFERENCE_MAX_PINNED_BYTES) {
+					TEST(true); // TLog spilled a lagging tag by value
+					TraceEvent("TLogSpillTagByValue", logData->logId).detail("Tag", tagData->tag.toString()).detail("Popped", persistentPopped)
+						.detail("PinnedBytes", queueBytesFrom( self, logData, persistentPopped ));
+					Void _ = wait( spillTagByValue( self, logData, tagData, persistentPopped ) );
+					tagData->spillByValue = true;
+				}
 				// Transfer unpopped messages with version numbers less than newPersistentDataVersion to persistentData
 				state std::deque<std::pair<Version, LengthPrefixedStringRef>>::iterator msg = tagData->version_messages.begin();
 				while(msg != tagData->version_messages.end() && msg->first <= newPersistentDataVersion) {
 					currentVersion = msg->first;
 					anyData = true;
 					tagData->nothing_persistent = false;
-					BinaryWriter wr( Unversioned() );
 
-					for(; msg != tagData->version_messages.end() && msg->first == currentVersion; ++msg)
-						wr << msg->second.toStringRef();
+					if(logData->spillByReference && !tagData->spillByValue) {
+						uint32_t mutationBytes = 0;
+						for(; msg != tagData->version_messages.end() && msg->first == currentVersion; ++msg)
+							mutationBytes += msg->second.expectedSize();
+
+						auto location = logData->version_location.find( currentVersion );
+						ASSERT( location != logData->version_location.end() );
+						refs.push_back( SpilledData( currentVersion, location->value.first, location->value.second, mutationBytes ) );
+					} else {
+						BinaryWriter wr( Unversioned() );
+
+						for(; msg != tagData->version_messages.end() && msg->first == currentVersion; ++msg)
+							wr << msg->second.toStringRef();
 
-					self->persistentData->set( KeyValueRef( persistTagMessagesKey( logData->logId, tagData->tag, currentVersion ), wr.toStringRef() ) );
+						self->persistentData->set( KeyValueRef( persistTagMessagesKey( logData->logId, tagData->tag, currentVersion ), wr.toStringRef() ) );
+					}
 
 					Future<Void> f = yield(TaskUpdateStorage);
 					if(!f.isReady()) {
@@ -578,6 +773,13 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 					}
 				}
 
+				if(refs.size()) {
+					self->persistentData->set( KeyValueRef( persistTagMessageRefsKey( logData->logId, tagData->tag, refs.back().version ), BinaryWriter::toValue( refs, IncludeVersion() ) ) );
+				}
+				if(!tagData->nothing_persistent && !tagData->spillByValue) {
+					minReferencedVersion = std::min( minReferencedVersion, persistentPopped );
+				}
+
 				Void _ = wait(yield(TaskUpdateStorage));
 			}
 		}
@@ -593,7 +795,9 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 	// Now that the changes we made to persistentData are durable, erase the data we moved from memory and the queue, increase bytesDurable accordingly, and update persistentDataDurableVersion.
 
 	TEST(anyData);  // TLog moved data to persistentData
+	TEST(anyData && logData->spillByReference);  // TLog spilled references to the queue
 	logData->persistentDataDurableVersion = newPersistentDataVersion;
+	logData->minReferencedVersion = logData->spillByReference ? minReferencedVersion : newPersistentDataVersion + 1;
 
 	for(tag_locality = 0; tag_locality < logData->tag_data.size(); tag_locality++) {
 		for(tag_id = 0; tag_id < logData->tag_data[tag_locality].size(); tag_id++) {
@@ -623,8 +827,7 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 	ASSERT(logData->bytesDurable.getValue() <= logData->bytesInput.getValue());
 	ASSERT(self->bytesDurable <= self->bytesInput);
 
-	if( self->queueCommitEnd.get() > 0 )
-		self->persistentQueue->pop( newPersistentDataVersion+1, logData ); // SOMEDAY: this can cause a slow task (~0.5ms), presumably from erasing too many versions. Should we limit the number of versions cleared at a time?
+	popDiskQueue( self, logData );
 
 	return Void();
 }
@@ -633,16 +836,16 @@ ACTOR Future<Void> updatePersistentData( TLogData* self, Reference<LogData> logD
 // For this reason, they employ aggressive use of yields to avoid causing slow tasks that could introduce latencies for more important
 // work (e.g. commits).
 ACTOR Future<Void> updateStorage( TLogData* self ) {
-	while(self->queueOrder.size() && !self->id_data.count(self->queueOrder.front())) {
-		self->queueOrder.pop_front();
+	while(self->spillOrder.size() && !self->id_data.count(self->spillOrder.front())) {
+		self->spillOrder.pop_front();
 	}
 
-	if(!self->queueOrder.size()) {
+	if(!self->spillOrder.size()) {
 		Void _ = wait( delay(BUGGIFY ? SERVER_KNOBS->BUGGIFY_TLOG_STORAGE_MIN_UPDATE_INTERVAL : SERVER_KNOBS->TLOG_STORAGE_MIN_UPDATE_INTERVAL, TaskUpdateStorage) );
 		return Void();
 	}
 
-	state Reference<LogData> logData = self->id_data[self->queueOrder.front()];
+	state Reference<LogData> logData = self->id_data[self->spillOrder.front()];
 	state Version prevVersion = 0;
 	state Version nextVersion = 0;
 	state int totalSize = 0;
@@ -700,7 +903,7 @@ ACTOR Future<Void> updateStorage( TLogData* self ) {
 			}
 
 			if(logData->persistentDataDurableVersion == logData->version.get()) {
-				self->queueOrder.pop_front();
+				self->spillOrder.pop_front();
 			}
 			Void _ = wait( delay(0.0, TaskUpdateStorage) );
 		} else {
@@ -708,7 +911,7 @@ ACTOR Future<Void> updateStorage( TLogData* self ) {
 		}
 	}
 	else if(logData->initialized) {
-		ASSERT(self->queueOrder.size() == 1);
+		ASSERT(self->spillOrder.size() == 1);
 		state Map<Version, std::pair<int, int>>::iterator sizeItr = logData->version_sizes.begin();
 		while( totalSize < SERVER_KNOBS->UPDATE_STORAGE_BYTE_LIMIT && sizeItr != logData->version_sizes.end()
 				&& (logData->bytesInput.getValue() - logData->bytesDurable.getValue() - totalSize >= SERVER_KNOBS->TLOG_SPILL_THRESHOLD || sizeItr->value.first == 0) )
@@ -913,16 +1116,12 @@ ACTOR Future<Void> tLogPop( TLogData* self, TLogPopRequest req, Reference<LogDat
 	return Void();
 }
 
-void peekMessagesFromMemory( Reference<LogData> self, TLogPeekRequest const& req, BinaryWriter& messages, Version& endVersion ) {
-	ASSERT( !messages.getLength() );
-
-	auto& deque = get_version_messages(self, req.tag);
-	//TraceEvent("tLogPeekMem", self->dbgid).detail("Tag", printable(req.tag1)).detail("pDS", self->persistentDataSequence).detail("pDDS", self->persistentDataDurableSequence).detail("Oldest", map1.empty() ? 0 : map1.begin()->key ).detail("OldestMsgCount", map1.empty() ? 0 : map1.begin()->value.size());
-
-	Version begin = std::max( req.begin, self->persistentDataDurableVersion+1 );
+// Appends the messages in deque with versions >= begin to messages, stopping at a version boundary once DESIRED_TOTAL_BYTES have been
+// written.  The deque is sorted by version, so finding the starting point is a binary search and the rest is proportional to the output.
+void peekMessagesFromDeque( std::deque<std::pair<Version, LengthPrefixedStringRef>> const& deque, Version begin, BinaryWriter& messages, Version& endVersion ) {
 	auto it = std::lower_bound(deque.begin(), deque.end(), std::make_pair(begin, LengthPrefixedStringRef()), CompareFirst<std::pair<Version, LengthPrefixedStringRef>>());
 
-	Version currentVersion = -1;
+	Version currentVersion = begin - 1;
 	for(; it != deque.end(); ++it) {
 		if(it->first != currentVersion) {
 			if (messages.getLength() >= SERVER_KNOBS->DESIRED_TOTAL_BYTES) {
@@ -939,9 +1138,114 @@ void peekMessagesFromMemory( Reference<LogData> self, TLogPeekRequest const& req
 	}
 }
 
+void peekMessagesFromMemory( Reference<LogData> self, TLogPeekRequest const& req, BinaryWriter& messages, Version& endVersion ) {
+	auto& deque = get_version_messages(self, req.tag);
+	//TraceEvent("tLogPeekMem", self->dbgid).detail("Tag", printable(req.tag1)).detail("pDS", self->persistentDataSequence).detail("pDDS", self->persistentDataDurableSequence).detail("Oldest", map1.empty() ? 0 : map1.begin()->key ).detail("OldestMsgCount", map1.empty() ? 0 : map1.begin()->value.size());
+
+	peekMessagesFromDeque( deque, std::max( req.begin, self->persistentDataDurableVersion+1 ), messages, endVersion );
+}
+
+// A version of a tag's messages that a peek sends from persistentData, where it was spilled either by value or by reference
+struct SpilledVersion {
+	Version version;
+	StringRef value;
+	int read;  // The index of the read of the version's queue entry, or -1 if it was spilled by value
+
+	SpilledVersion( Version version, StringRef value, int read ) : version(version), value(value), read(read) {}
+};
+
+// Reads the messages for tag in [readBegin, readEnd) from a generation that spills by reference.  Most versions are referenced in the
+// queue, but those of a tag that fell too far behind are spilled by value (see spillTagByValue).  References are read before values,
+// so if the tag's references are replaced concurrently, each version is seen at least once.  Returns whether the read was cut
+// short, in which case endVersion is set to the first version not read.
+ACTOR Future<bool> peekMessagesFromQueue( TLogData* self, Reference<LogData> logData, Tag tag, Version readBegin, Version readEnd, BinaryWriter* messages, Version* endVersion ) {
+	if(messages->getLength() >= SERVER_KNOBS->DESIRED_TOTAL_BYTES) {
+		*endVersion = readBegin;
+		return true;
+	}
+
+	state Standalone<VectorRef<KeyValueRef>> refKvs = wait(
+		self->persistentData->readRange(KeyRangeRef(
+			persistTagMessageRefsKey(logData->logId, tag, readBegin),
+			persistTagMessageRefsKey(logData->logId, tag, readEnd)), SERVER_KNOBS->TLOG_SPILL_REFERENCE_MAX_BATCHES_PER_PEEK));
+	state int64_t valueLimit = SERVER_KNOBS->DESIRED_TOTAL_BYTES - messages->getLength();
+	state Standalone<VectorRef<KeyValueRef>> valueKvs = wait(
+		self->persistentData->readRange(KeyRangeRef(
+			persistTagMessagesKey(logData->logId, tag, readBegin),
+			persistTagMessagesKey(logData->logId, tag, readEnd)), SERVER_KNOBS->DESIRED_TOTAL_BYTES, valueLimit));
+
+	std::vector<SpilledData> refs;
+	for(auto& kv : refKvs) {
+		std::vector<SpilledData> batch;
+		BinaryReader rd( kv.value, IncludeVersion() );
+		rd >> batch;
+		for(auto& sd : batch) {
+			if(sd.version >= readBegin) {
+				refs.push_back(sd);
+			}
+		}
+	}
+
+	// Either read may have stopped early, and only the versions before both stopping points are complete
+	Version limitVersion = readEnd;
+	if(refKvs.size() == SERVER_KNOBS->TLOG_SPILL_REFERENCE_MAX_BATCHES_PER_PEEK && refs.size()) {
+		limitVersion = refs.back().version + 1;
+	}
+	if(valueKvs.size() && valueKvs.expectedSize() >= valueLimit) {
+		limitVersion = std::min( limitVersion, decodeTagMessagesKey(valueKvs.end()[-1].key) + 1 );
+	}
+
+	// Choose the versions to send in order, using a version's value if it has both
+	state std::vector<SpilledVersion> chosen;
+	state std::vector<Future<Standalone<StringRef>>> reads;
+	state bool limited = false;
+	int64_t bytes = messages->getLength();
+	int r = 0, v = 0;
+	while(true) {
+		bool haveRef = r < refs.size() && refs[r].version < limitVersion;
+		bool haveValue = v < valueKvs.size() && decodeTagMessagesKey(valueKvs[v].key) < limitVersion;
+		if(!haveRef && !haveValue) {
+			break;
+		}
+		Version version = !haveValue ? refs[r].version : haveRef ? std::min( refs[r].version, decodeTagMessagesKey(valueKvs[v].key) ) : decodeTagMessagesKey(valueKvs[v].key);
+		if(bytes >= SERVER_KNOBS->DESIRED_TOTAL_BYTES) {
+			*endVersion = version;
+			limited = true;
+			break;
+		}
+		if(haveValue && decodeTagMessagesKey(valueKvs[v].key) == version) {
+			chosen.push_back( SpilledVersion( version, valueKvs[v].value, -1 ) );
+			bytes += valueKvs[v].value.size();
+			v++;
+		} else {
+			chosen.push_back( SpilledVersion( version, StringRef(), reads.size() ) );
+			reads.push_back( self->rawPersistentQueue->read( refs[r].start, refs[r].end ) );
+			bytes += refs[r].mutationBytes;
+		}
+		if(haveRef && refs[r].version == version) {
+			r++;
+		}
+	}
+	if(!limited && limitVersion < readEnd) {
+		*endVersion = limitVersion;
+		limited = true;
+	}
+
+	Void _ = wait( waitForAll(reads) );
+
+	for(auto& sv : chosen) {
+		*messages << int32_t(-1) << sv.version;
+		if(sv.read < 0) {
+			messages->serializeBytes( sv.value );
+		} else {
+			appendTagMessagesFromQueueEntry( logData, tag, sv.version, reads[sv.read].get(), *messages );
+		}
+	}
+	return limited;
+}
+
 ACTOR Future<Void> tLogPeekMessages( TLogData* self, TLogPeekRequest req, Reference<LogData> logData ) {
 	state BinaryWriter messages(Unversioned());
-	state BinaryWriter messages2(Unversioned());
 	state int sequence = -1;
 	state UID peekId;
 
@@ -1009,30 +1313,62 @@ ACTOR Future<Void> tLogPeekMessages( TLogData* self, TLogPeekRequest req, Refere
 	//grab messages from disk
 	//TraceEvent("tLogPeekMessages", self->dbgid).detail("reqBeginEpoch", req.begin.epoch).detail("reqBeginSeq", req.begin.sequence).detail("epoch", self->epoch()).detail("persistentDataSeq", self->persistentDataSequence).detail("Tag1", printable(req.tag1)).detail("Tag2", printable(req.tag2));
 	if( req.begin <= logData->persistentDataDurableVersion ) {
-		// Just in case the durable version changes while we are waiting for the read, we grab this data from memory.  We may or may not actually send it depending on
-		// whether we get enough data from disk.
-		// SOMEDAY: Only do this if an initial attempt to read from disk results in insufficient data and the required data is no longer in memory
-		// SOMEDAY: Should we only send part of the messages we collected, to actually limit the size of the result?
-
-		peekMessagesFromMemory( logData, req, messages2, endVersion );
+		// Versions only leave memory after they are durable in persistentData, so if more versions become durable while we are reading,
+		// read those from disk as well rather than copying everything in memory up front in case it is needed.
+		state Version readBegin = req.begin;
+		state Version readEnd;
+		state bool limited = false;
+		if (logData->spillByReference) {
+			// The queue must not be popped past what we are about to read until we are done reading it
+			state std::multiset<Version>::iterator peekVersion = logData->referencePeekVersions.insert(req.begin);
+			try {
+				loop {
+					readEnd = logData->persistentDataDurableVersion + 1;
+					bool _limited = wait( peekMessagesFromQueue( self, logData, req.tag, readBegin, readEnd, &messages, &endVersion ) );
+					limited = _limited;
+					if (limited || logData->persistentDataDurableVersion + 1 == readEnd)
+						break;
 
-		Standalone<VectorRef<KeyValueRef>> kvs = wait(
-			self->persistentData->readRange(KeyRangeRef(
-				persistTagMessagesKey(logData->logId, req.tag, req.begin),
-				persistTagMessagesKey(logData->logId, req.tag, logData->persistentDataDurableVersion + 1)), SERVER_KNOBS->DESIRED_TOTAL_BYTES, SERVER_KNOBS->DESIRED_TOTAL_BYTES));
+					TEST(true); // TLog peek read references that became durable during the read
+					readBegin = readEnd;
+				}
+			} catch( Error &e ) {
+				logData->referencePeekVersions.erase(peekVersion);
+				throw;
+			}
+			logData->referencePeekVersions.erase(peekVersion);
+		} else {
+			loop {
+				readEnd = logData->persistentDataDurableVersion + 1;
+				state int64_t readLimit = SERVER_KNOBS->DESIRED_TOTAL_BYTES - messages.getLength();
+				Standalone<VectorRef<KeyValueRef>> kvs = wait(
+					self->persistentData->readRange(KeyRangeRef(
+						persistTagMessagesKey(logData->logId, req.tag, readBegin),
+						persistTagMessagesKey(logData->logId, req.tag, readEnd)), SERVER_KNOBS->DESIRED_TOTAL_BYTES, readLimit));
+
+				//TraceEvent("TLogPeekResults", self->dbgid).detail("ForAddress", req.reply.getEndpoint().address).detail("Tag1Results", s1).detail("Tag2Results", s2).detail("Tag1ResultsLim", kv1.size()).detail("Tag2ResultsLim", kv2.size()).detail("Tag1ResultsLast", kv1.size() ? printable(kv1[0].key) : "").detail("Tag2ResultsLast", kv2.size() ? printable(kv2[0].key) : "").detail("Limited", limited).detail("NextEpoch", next_pos.epoch).detail("NextSeq", next_pos.sequence).detail("NowEpoch", self->epoch()).detail("NowSeq", self->sequence.getNextSequence());
+
+				for (auto &kv : kvs) {
+					auto ver = decodeTagMessagesKey(kv.key);
+					messages << int32_t(-1) << ver;
+					messages.serializeBytes(kv.value);
+				}
 
-		//TraceEvent("TLogPeekResults", self->dbgid).detail("ForAddress", req.reply.getEndpoint().address).detail("Tag1Results", s1).detail("Tag2Results", s2).detail("Tag1ResultsLim", kv1.size()).detail("Tag2ResultsLim", kv2.size()).detail("Tag1ResultsLast", kv1.size() ? printable(kv1[0].key) : "").detail("Tag2ResultsLast", kv2.size() ? printable(kv2[0].key) : "").detail("Limited", limited).detail("NextEpoch", next_pos.epoch).detail("NextSeq", next_pos.sequence).detail("NowEpoch", self->epoch()).detail("NowSeq", self->sequence.getNextSequence());
+				if (kvs.expectedSize() >= readLimit) {
+					endVersion = decodeTagMessagesKey(kvs.end()[-1].key) + 1;
+					limited = true;
+					break;
+				}
+				if (logData->persistentDataDurableVersion + 1 == readEnd)
+					break;
 
-		for (auto &kv : kvs) {
-			auto ver = decodeTagMessagesKey(kv.key);
-			messages << int32_t(-1) << ver;
-			messages.serializeBytes(kv.value);
+				TEST(true); // TLog peek read versions that became durable during the read
+				readBegin = readEnd;
+			}
 		}
 
-		if (kvs.expectedSize() >= SERVER_KNOBS->DESIRED_TOTAL_BYTES)
-			endVersion = decodeTagMessagesKey(kvs.end()[-1].key) + 1;
-		else
-			messages.serializeBytes( messages2.toStringRef() );
+		if (!limited)
+			peekMessagesFromMemory( logData, req, messages, endVersion );
 	} else {
 		peekMessagesFromMemory( logData, req, messages, endVersion );
 		//TraceEvent("TLogPeekResults", self->dbgid).detail("ForAddress", req.reply.getEndpoint().address).detail("MessageBytes", messages.getLength()).detail("NextEpoch", next_pos.epoch).detail("NextSeq", next_pos.sequence).detail("NowSeq", self->sequence.getNextSequence());
@@ -1219,11 +1555,16 @@ ACTOR Future<Void> tLogCommit(
 ACTOR Future<Void> initPersistentState( TLogData* self, Reference<LogData> logData, std::vector<Tag> allTags ) {
 	// PERSIST: Initial setup of persistentData for a brand new tLog for a new database
 	IKeyValueStore *storage = self->persistentData;
-	storage->set( persistFormat );
+	bool anySpillByReference = false;
+	for(auto& it : self->id_data) {
+		anySpillByReference = anySpillByReference || it.second->spillByReference;
+	}
+	storage->set( anySpillByReference ? persistSpillReferenceFormat : persistFormat );
 	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistCurrentVersionKeys.begin), BinaryWriter::toValue(logData->version.get(), Unversioned()) ) ); 
 	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistKnownCommittedVersionKeys.begin), BinaryWriter::toValue(logData->knownCommittedVersion, Unversioned()) ) );
 	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistUnrecoveredBeforeVersionKeys.begin), BinaryWriter::toValue(logData->unrecoveredBefore, Unversioned()) ) );
 	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistLogRouterTagsKeys.begin), BinaryWriter::toValue(logData->logRouterTags, Unversioned()) ) );
+	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistSpillReferenceKeys.begin), BinaryWriter::toValue<int>(logData->spillByReference ? 1 : 0, Unversioned()) ) );
 	storage->set( KeyValueRef( BinaryWriter::toValue(logData->logId,Unversioned()).withPrefix(persistRecoveryCountKeys.begin), BinaryWriter::toValue(logData->recoveryCount, Unversioned()) ) );
 
 	for(auto tag : allTags) {
@@ -1606,12 +1947,13 @@ ACTOR Future<Void> restorePersistentState( TLogData* self, LocalityData locality
 	state Future<Standalone<VectorRef<KeyValueRef>>> fKnownCommitted = storage->readRange(persistKnownCommittedVersionKeys);
 	state Future<Standalone<VectorRef<KeyValueRef>>> fUnrecoveredBefore = storage->readRange(persistUnrecoveredBeforeVersionKeys);
 	state Future<Standalone<VectorRef<KeyValueRef>>> fLogRouterTags = storage->readRange(persistLogRouterTagsKeys);
+	state Future<Standalone<VectorRef<KeyValueRef>>> fSpillReference = storage->readRange(persistSpillReferenceKeys);
 	state Future<Standalone<VectorRef<KeyValueRef>>> fRecoverCounts = storage->readRange(persistRecoveryCountKeys);
 
 	// FIXME: metadata in queue?
 
 	Void _ = wait( waitForAll( (vector<Future<Optional<Value>>>(), fFormat ) ) );
-	Void _ = wait( waitForAll( (vector<Future<Standalone<VectorRef<KeyValueRef>>>>(), fVers, fKnownCommitted, fUnrecoveredBefore, fLogRouterTags, fRecoverCounts) ) );
+	Void _ = wait( waitForAll( (vector<Future<Standalone<VectorRef<KeyValueRef>>>>(), fVers, fKnownCommitted, fUnrecoveredBefore, fLogRouterTags, fSpillReference, fRecoverCounts) ) );
 
 	if (fFormat.get().present() && !persistFormatReadableRange.contains( fFormat.get().get() )) {
 		//FIXME: remove when we no longer need to test upgrades from 4.X releases
@@ -1661,6 +2003,13 @@ ACTOR Future<Void> restorePersistentState( TLogData* self, LocalityData locality
 		id_logRouterTags[ BinaryReader::fromStringRef<UID>(it.key.removePrefix(persistLogRouterTagsKeys.begin), Unversioned())] = BinaryReader::fromStringRef<int>( it.value, Unversioned() );
 	}
 
+	state std::set<UID> id_spillByReference;
+	for(auto it : fSpillReference.get()) {
+		if(BinaryReader::fromStringRef<int>( it.value, Unversioned() )) {
+			id_spillByReference.insert( BinaryReader::fromStringRef<UID>(it.key.removePrefix(persistSpillReferenceKeys.begin), Unversioned()) );
+		}
+	}
+
 	state std::map<UID, Version> id_knownCommitted;
 	for(auto it : fKnownCommitted.get()) {
 		id_knownCommitted[ BinaryReader::fromStringRef<UID>(it.key.removePrefix(persistKnownCommittedVersionKeys.begin), Unversioned())] = BinaryReader::fromStringRef<Version>( it.value, Unversioned() );
@@ -1694,6 +2043,7 @@ ACTOR Future<Void> restorePersistentState( TLogData* self, LocalityData locality
 		logData->unrecoveredBefore = id_unrecoveredBefore[id1];
 		logData->recoveredAt = logData->unrecoveredBefore;
 		logData->knownCommittedVersion = id_knownCommitted[id1];
+		logData->spillByReference = id_spillByReference.count(id1) > 0;
 		Version ver = BinaryReader::fromStringRef<Version>( fVers.get()[idx].value, Unversioned() );
 		logData->persistentDataVersion = ver;
 		logData->persistentDataDurableVersion = ver;
@@ -1737,7 +2087,10 @@ ACTOR Future<Void> restorePersistentState( TLogData* self, LocalityData locality
 			}
 			choose {
 				when( TLogQueueEntry qe = wait( self->persistentQueue->readNext(self) ) ) {
-					if(!self->queueOrder.size() || self->queueOrder.back() != qe.id) self->queueOrder.push_back(qe.id);
+					if(!self->spillOrder.size() || self->spillOrder.back() != qe.id) {
+						self->spillOrder.push_back(qe.id);
+						self->popOrder.push_back(qe.id);
+					}
 					if(qe.id != lastId) {
 						lastId = qe.id;
 						auto it = self->id_data.find(qe.id);
@@ -1876,8 +2229,10 @@ ACTOR Future<Void> tLogStart( TLogData* self, InitializeTLogRequest req, Localit
 	self->id_data[recruited.id()] = logData;
 	logData->locality = req.locality;
 	logData->recoveryCount = req.epoch;
+	logData->spillByReference = SERVER_KNOBS->TLOG_SPILL_REFERENCE != 0;
 	logData->removed = rejoinMasters(self, recruited, req.epoch, Future<Void>(Void()), req.isPrimary);
-	self->queueOrder.push_back(recruited.id());
+	self->spillOrder.push_back(recruited.id());
+	self->popOrder.push_back(recruited.id());
 
 	TraceEvent("TLogStart", logData->logId);
 	state Future<Void> updater;
@@ -2119,3 +2474,68 @@ TEST_CASE( "fdbserver/tlogserver/VersionMessagesOverheadFactor" ) {
 
 	return Void();
 }
+
+// Builds the per-tag message deques for a TLog serving many storage servers, where each version carries messages for only a few
+// tags, and measures peeks that start at random versions.  Results are checked against a linear scan of the same deque.
+TEST_CASE( "fdbserver/tlogserver/PeekManyTags" ) {
+	typedef std::deque<std::pair<Version, LengthPrefixedStringRef>> MessageDeque;
+
+	const int tagCount = 1000;
+	const int versionCount = 100000;
+	const int tagsPerVersion = 3;
+
+	Arena arena;
+	std::vector<MessageDeque> tags(tagCount);
+	int64_t messageCount = 0;
+	for(int v = 1; v <= versionCount; v++) {
+		for(int t = 0; t < tagsPerVersion; t++) {
+			int len = g_random->randomInt(16, 100);
+			uint32_t* m = (uint32_t*)new (arena) uint8_t[sizeof(uint32_t) + len];
+			*m = len;
+			memset( m+1, t, len );
+			tags[g_random->randomInt(0, tagCount)].push_back( std::make_pair( Version(v), LengthPrefixedStringRef(m) ) );
+			++messageCount;
+		}
+	}
+
+	// Correctness, including peeks that hit the byte limit
+	for(int i = 0; i < 1000; i++) {
+		MessageDeque const& deque = tags[g_random->randomInt(0, tagCount)];
+		Version begin = g_random->randomInt(0, versionCount+2);
+		Version endVersion = versionCount + 1;
+		BinaryWriter messages(Unversioned());
+		peekMessagesFromDeque( deque, begin, messages, endVersion );
+
+		BinaryWriter expected(Unversioned());
+		Version currentVersion = -1;
+		for(auto& m : deque) {
+			if(m.first < begin || m.first >= endVersion) continue;
+			if(m.first != currentVersion) {
+				currentVersion = m.first;
+				expected << int32_t(-1) << currentVersion;
+			}
+			expected << m.second.toStringRef();
+		}
+		ASSERT( messages.toStringRef() == expected.toStringRef() );
+	}
+
+	// Performance: most peeks are for the recent end of a tag's data, as they are from storage servers that are keeping up
+	for(double recentFraction : { 0.001, 0.1, 1.0 }) {
+		int peeks = 100000;
+		int64_t bytes = 0;
+		double start = timer();
+		for(int i = 0; i < peeks; i++) {
+			MessageDeque const& deque = tags[g_random->randomInt(0, tagCount)];
+			Version begin = versionCount - int(g_random->random01() * recentFraction * versionCount);
+			Version endVersion = versionCount + 1;
+			BinaryWriter messages(Unversioned());
+			peekMessagesFromDeque( deque, begin, messages, endVersion );
+			bytes += messages.getLength();
+		}
+		double elapsed = timer() - start;
+		printf("TLog peek from %d tags with %lld messages, begin within last %g of versions: %0.1f Kpeeks/sec, %0.1f MB/sec\n",
+			tagCount, messageCount, recentFraction, peeks / 1000.0 / elapsed, bytes / 1e6 / elapsed);
+	}
+
+	return Void();
+}
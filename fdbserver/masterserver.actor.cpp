@@ -23,6 +23,7 @@
 #include "fdbrpc/PerfMetric.h"
 #include "flow/Trace.h"
 #include "fdbrpc/FailureMonitor.h"
+#include "fdbrpc/Smoother.h"
 #include "fdbclient/NativeAPI.h"
 #include "fdbclient/Notified.h"
 #include "fdbclient/SystemData.h"
@@ -916,23 +917,32 @@ std::pair<KeyRangeRef, bool> findRange( CoalescedKeyRangeMap<int>& key_resolver,
 ACTOR Future<Void> resolutionBalancing(Reference<MasterData> self) {
 	state CoalescedKeyRangeMap<int> key_resolver;
 	key_resolver.insert(allKeys, 0);
+	// Each resolver samples conflict detection time over only the last SAMPLE_EXPIRATION_TIME, which is too noisy to balance on directly
+	state std::vector<Smoother> smoothedCpu( self->resolvers.size(), Smoother(SERVER_KNOBS->RESOLUTION_BALANCE_CPU_SMOOTHING) );
+	state double nextCpuBalanceTime = 0;
 	loop {
 		Void _ = wait(delay(SERVER_KNOBS->MIN_BALANCE_TIME, TaskResolutionMetrics));
 		while(self->resolverChanges.get().size())
 			Void _ = wait(self->resolverChanges.onChange());
-		state std::vector<Future<int64_t>> futures;
+		state std::vector<Future<ResolutionMetricsReply>> futures;
 		for (auto& p : self->resolvers)
 			futures.push_back(brokenPromiseToNever(p.metrics.getReply(ResolutionMetricsRequest(), TaskResolutionMetrics)));
 		Void _ = wait( waitForAll(futures) );
 		state IndexedSet<std::pair<int64_t, int>, NoMetric> metrics;
 
+		// Balancing on conflict detection time rather than range count also accounts for ranges that are more expensive to check than others
+		state bool useCpu = SERVER_KNOBS->RESOLUTION_BALANCE_ON_CPU;
 		int64_t total = 0;
 		for (int i = 0; i < futures.size(); i++) {
-			total += futures[i].get();
-			metrics.insert(std::make_pair(futures[i].get(), i), NoMetric());
-			//TraceEvent("ResolverMetric").detail("i", i).detail("metric", futures[i].get());
+			smoothedCpu[i].setTotal( futures[i].get().cpu );
+			int64_t load = useCpu ? (int64_t)smoothedCpu[i].smoothTotal() : futures[i].get().value;
+			total += load;
+			metrics.insert(std::make_pair(load, i), NoMetric());
+			//TraceEvent("ResolverMetric").detail("i", i).detail("metric", futures[i].get().value).detail("cpu", futures[i].get().cpu);
 		}
-		if( metrics.lastItem()->first - metrics.begin()->first > SERVER_KNOBS->MIN_BALANCE_DIFFERENCE ) {
+		// After a move the smoothed times take a while to reflect it, so moving again before then would overshoot and move back
+		if( metrics.lastItem()->first - metrics.begin()->first > (useCpu ? SERVER_KNOBS->MIN_BALANCE_CPU_DIFFERENCE : SERVER_KNOBS->MIN_BALANCE_DIFFERENCE) && (!useCpu || now() >= nextCpuBalanceTime) ) {
+			TEST(useCpu); // Balancing resolvers on conflict detection time
 			try {
 				state int src = metrics.lastItem()->second;
 				state int dest = metrics.begin()->second;
@@ -946,11 +956,12 @@ ACTOR Future<Void> resolutionBalancing(Reference<MasterData> self) {
 					req.front = range.second;
 					req.offset = amount;
 					req.range = range.first;
+					req.cpu = useCpu;
 
 					ResolutionSplitReply split = wait( brokenPromiseToNever(self->resolvers[metrics.lastItem()->second].split.getReply(req, TaskResolutionMetrics)) );
 					KeyRangeRef moveRange = range.second ? KeyRangeRef( range.first.begin, split.key ) : KeyRangeRef( split.key, range.first.end );
 					movedRanges.push_back_deep(movedRanges.arena(), ResolverMoveRef(moveRange, dest));
-					TraceEvent("MovingResolutionRange").detail("src", src).detail("dest", dest).detail("amount", amount).detail("startRange", printable(range.first)).detail("moveRange", printable(moveRange)).detail("used", split.used).detail("KeyResolverRanges", key_resolver.size());
+					TraceEvent("MovingResolutionRange").detail("src", src).detail("dest", dest).detail("amount", amount).detail("startRange", printable(range.first)).detail("moveRange", printable(moveRange)).detail("used", split.used).detail("cpu", useCpu).detail("KeyResolverRanges", key_resolver.size());
 					amount -= split.used;
 					if(moveRange != range.first || amount <= 0 )
 						break;
@@ -960,6 +971,8 @@ ACTOR Future<Void> resolutionBalancing(Reference<MasterData> self) {
 				//for(auto& it : key_resolver.ranges())
 				//	TraceEvent("KeyResolver").detail("range", printable(it.range())).detail("value", it.value());
 
+				if (useCpu)
+					nextCpuBalanceTime = now() + SERVER_KNOBS->RESOLUTION_BALANCE_CPU_HOLD_TIME;
 				self->resolverChangesVersion = self->version + 1;
 				for (auto& p : self->proxies)
 					self->resolverNeedingChanges.insert(p.id());
@@ -20,6 +20,7 @@
 
 #include "flow/actorcompiler.h"
 #include "NetworkTest.h"
+#include "Knobs.h"
 
 UID WLTOKEN_NETWORKTEST( -1, 2 );
 
@@ -60,7 +61,7 @@ ACTOR Future<Void> testClient( std::vector<NetworkTestInterface> interfs, int* s
 	state double lastTime = now();
 
 	loop {
-		NetworkTestReply rep = wait(  retryBrokenPromise(interfs[g_random->randomInt(0, interfs.size())].test, NetworkTestRequest( LiteralStringRef("."), 600000 ) ) );
+		NetworkTestReply rep = wait(  retryBrokenPromise(interfs[g_random->randomInt(0, interfs.size())].test, NetworkTestRequest( LiteralStringRef("."), SERVER_KNOBS->NETWORK_TEST_REPLY_SIZE ) ) );
 		(*sent)++;
 	}
 }
@@ -70,7 +71,7 @@ ACTOR Future<Void> logger( int* sent ) {
 	loop {
 		Void _ = wait( delay(1.0) );
 		auto spd = *sent / (now() - lastTime);
-		fprintf( stderr, "messages per second: %f\n", spd);
+		fprintf( stderr, "messages per second: %f (%f MB/s)\n", spd, spd * SERVER_KNOBS->NETWORK_TEST_REPLY_SIZE / 1e6);
 		lastTime = now();
 		*sent = 0;
 	}
@@ -150,7 +151,7 @@ ACTOR Future<Void> networkTestClient( std:: string testServers ) {
 	}
 
 	state std::vector<Future<Void>> clients;
-	for( int i = 0; i < 30; i++ )
+	for( int i = 0; i < SERVER_KNOBS->NETWORK_TEST_REQUEST_COUNT; i++ )
 		clients.push_back( testClient( interfs, &sent ) );
 	clients.push_back( logger( &sent ) );
 
@@ -48,6 +48,7 @@
 #include "RecoveryState.h"
 #include "LogProtocolMessage.h"
 #include "flow/TDMetric.actor.h"
+#include "flow/UnitTest.h"
 
 using std::make_pair;
 
@@ -142,8 +143,127 @@ struct ShardInfo : ReferenceCounted<ShardInfo>, NonCopyable {
 	}
 };
 
+// A memory-bounded cache of the rows getValueQ reads from the storage engine, including rows that are not present.  It
+// mirrors the engine: StorageServerDisk invalidates every key it sets or clears as mutations become durable.  A read
+// of a key with uncommitted writes may or may not see them (see the concurrency contract in IKeyValueStore.h), so such
+// keys are not cached until the commit that makes the writes visible has completed.
+class StorageRowCache : NonCopyable {
+public:
+	explicit StorageRowCache( int64_t capacity ) : capacity(capacity), bytes(0), lastTicket(0), commitsStarted(0), commitsEnded(0), writesSinceCommit(false) {}
+
+	bool enabled() const { return capacity > 0; }
+	int64_t getBytes() const { return bytes; }
+
+	// Returns true and sets value if key is cached
+	bool get( KeyRef key, Optional<Value>& value ) {
+		auto e = entries.find(key);
+		if (e == entries.end() || e->second.ticket) return false;
+		lru.splice( lru.end(), lru, e->second.lru );
+		value = e->second.value;
+		return true;
+	}
+
+	// Call before reading key from the storage engine, and pass the result to fill() when the read completes or the
+	// ticket to cancelRead() if it fails
+	int64_t beginRead( KeyRef key ) {
+		if (!enabled() || dirty[key] > commitsEnded) return 0;
+		auto e = entries.find(key);
+		if (e == entries.end()) {
+			e = entries.insert( std::make_pair(Key(key), Entry()) ).first;
+			e->second.lru = lru.insert( lru.end(), e->first );
+			bytes += entryBytes(e);
+		} else {
+			lru.splice( lru.end(), lru, e->second.lru );
+		}
+		e->second.ticket = ++lastTicket;
+		evict();
+		return lastTicket;
+	}
+
+	// Caches the result of a read unless key was written or evicted while it was being read
+	void fill( KeyRef key, int64_t ticket, Optional<Value> const& value ) {
+		if (!ticket) return;
+		auto e = entries.find(key);
+		if (e == entries.end() || e->second.ticket != ticket) return;
+		e->second.ticket = 0;
+		e->second.value = value;
+		bytes += value.present() ? value.get().size() : 0;
+		evict();
+	}
+
+	// Forgets a read begun with beginRead() that will not be filled
+	void cancelRead( KeyRef key, int64_t ticket ) {
+		if (!ticket) return;
+		auto e = entries.find(key);
+		if (e != entries.end() && e->second.ticket == ticket)
+			erase( e );
+	}
+
+	void invalidate( KeyRangeRef keys ) {
+		if (!enabled()) return;
+		keys = keys & allKeys;
+		if (keys.empty()) return;
+		dirty.insert( keys, commitsStarted+1 );
+		writesSinceCommit = true;
+		auto e = entries.lower_bound(keys.begin);
+		while (e != entries.end() && e->first < keys.end)
+			erase( e++ );
+	}
+
+	void invalidate( KeyRef key ) {
+		if (!enabled() || key >= allKeys.end) return;
+		dirty.insert( key, commitsStarted+1 );
+		writesSinceCommit = true;
+		auto e = entries.find(key);
+		if (e != entries.end())
+			erase( e );
+	}
+
+	// Writes invalidated before beginCommit() are visible to reads once the matching endCommit() is called
+	int64_t beginCommit() {
+		writesSinceCommit = false;
+		return ++commitsStarted;
+	}
+
+	void endCommit( int64_t commit ) {
+		commitsEnded = std::max( commitsEnded, commit );
+		if (commitsEnded == commitsStarted && !writesSinceCommit)
+			dirty.insert( allKeys, 0 );
+	}
+
+private:
+	struct Entry {
+		Optional<Value> value;
+		int64_t ticket;  // Nonzero while the value is being read
+		std::list<KeyRef>::iterator lru;
+		Entry() : ticket(0) {}
+	};
+	typedef std::map<Key, Entry>::iterator EntryIterator;
+
+	std::map<Key, Entry> entries;
+	std::list<KeyRef> lru;  // Keys of entries, least recently used first
+	CoalescedKeyRangeMap<int64_t> dirty;  // The commit after which each key was last written
+	int64_t capacity, bytes, lastTicket, commitsStarted, commitsEnded;
+	bool writesSinceCommit;
+
+	static int64_t entryBytes( EntryIterator e ) {
+		return e->first.size() + (e->second.value.present() ? e->second.value.get().size() : 0) + 64;
+	}
+
+	void erase( EntryIterator e ) {
+		bytes -= entryBytes(e);
+		lru.erase( e->second.lru );
+		entries.erase( e );
+	}
+
+	void evict() {
+		while (bytes > capacity && !lru.empty())
+			erase( entries.find(lru.front()) );
+	}
+};
+
 struct StorageServerDisk {
-	explicit StorageServerDisk( struct StorageServer* data, IKeyValueStore* storage ) : data(data), storage(storage) {}
+	explicit StorageServerDisk( struct StorageServer* data, IKeyValueStore* storage ) : rowCache(SERVER_KNOBS->STORAGE_ROW_CACHE_BYTES), cursorsReused(0), data(data), storage(storage), commitsEnded(0) {}
 
 	void makeNewStorageServerDurable();
 	bool makeVersionMutationsDurable( Version& prevStorageVersion, Version newStorageVersion, int64_t& bytesLeft );
@@ -156,7 +276,9 @@ struct StorageServerDisk {
 	void writeKeyValue( KeyValueRef kv );
 	void clearRange( KeyRangeRef keys );
 
-	Future<Void> commit() { return storage->commit(); }
+	Future<Void> commit() {
+		return endCommit( this, storage->commit(), rowCache.enabled() ? rowCache.beginCommit() : 0 );
+	}
 
 	// SOMEDAY: Put readNextKeyInclusive in IKeyValueStore
 	Future<Key> readNextKeyInclusive( KeyRef key ) { return readFirstKey(storage, KeyRangeRef(key, allKeys.end)); }
@@ -164,13 +286,58 @@ struct StorageServerDisk {
 	Future<Optional<Value>> readValuePrefix( KeyRef key, int maxLength, Optional<UID> debugID = Optional<UID>() ) { return storage->readValuePrefix(key, maxLength, debugID); }
 	Future<Standalone<VectorRef<KeyValueRef>>> readRange( KeyRangeRef keys, int rowLimit = 1<<30, int byteLimit = 1<<30 ) { return storage->readRange(keys, rowLimit, byteLimit); }
 
+	// A range read that stops at a limit can leave its cursor here with keepCursor(), so that a read continuing from
+	// where it stopped carries on from the rows the cursor has already read, and getCursor() sets reused.  Once a commit
+	// ends, rows read before it could be missing writes that are no longer in versionedData, so cursors are only kept
+	// until the next commit ends.
+	int64_t cursorGeneration() const { return commitsEnded; }
+	Reference<IKeyValueCursor> getCursor( KeyRangeRef keys, bool reverse, bool& reused ) {
+		// A cursor kept at k by a read of [b,e) can serve [k',e) for k' >= k, or [b,k') for k' <= k if reverse
+		int best = -1;
+		for(int i = 0; i < cursors.size(); i++) {
+			auto& c = cursors[i];
+			if (c.reverse != reverse) continue;
+			if (reverse ? c.keys.begin == keys.begin && keys.end <= c.keys.end && (best < 0 || c.keys.end < cursors[best].keys.end)
+			            : c.keys.end == keys.end && keys.begin >= c.keys.begin && (best < 0 || c.keys.begin > cursors[best].keys.begin))
+				best = i;
+		}
+		reused = best >= 0;
+		if (!reused)
+			return storage->readCursor( keys );
+		Reference<IKeyValueCursor> cursor = cursors[best].cursor;
+		cursors.erase( cursors.begin() + best );
+		++cursorsReused;
+		return cursor;
+	}
+	// remaining is the part of the range a continuation would read: [k,e), or [b,k) if reverse.  Returns true if the
+	// cursor was kept.
+	bool keepCursor( Reference<IKeyValueCursor> const& cursor, int64_t generation, KeyRangeRef remaining, bool reverse ) {
+		if (generation != commitsEnded || SERVER_KNOBS->STORAGE_CURSOR_CACHE_SIZE <= 0) return false;
+		if (cursors.size() >= SERVER_KNOBS->STORAGE_CURSOR_CACHE_SIZE)
+			cursors.erase( cursors.begin() );
+		cursors.push_back( KeptCursor( cursor, remaining, reverse ) );
+		return true;
+	}
+
 	KeyValueStoreType getKeyValueStoreType() { return storage->getType(); }
 	StorageBytes getStorageBytes() { return storage->getStorageBytes(); }
 
+	StorageRowCache rowCache;
+	int64_t cursorsReused;
+
 private:
 	struct StorageServer* data;
 	IKeyValueStore* storage;
 
+	struct KeptCursor {
+		Reference<IKeyValueCursor> cursor;
+		KeyRange keys;
+		bool reverse;
+		KeptCursor( Reference<IKeyValueCursor> const& cursor, KeyRangeRef keys, bool reverse ) : cursor(cursor), keys(keys), reverse(reverse) {}
+	};
+	std::vector<KeptCursor> cursors;		// oldest first
+	int64_t commitsEnded;
+
 	void writeMutations( MutationListRef mutations, Version debugVersion, const char* debugContext );
 
 	ACTOR static Future<Key> readFirstKey( IKeyValueStore* storage, KeyRangeRef range ) {
@@ -178,6 +345,15 @@ private:
 		if (r.size()) return r[0].key;
 		else return range.end;
 	}
+
+	ACTOR static Future<Void> endCommit( StorageServerDisk* self, Future<Void> commit, int64_t rowCacheCommit ) {
+		Void _ = wait( commit );
+		++self->commitsEnded;
+		self->cursors.clear();
+		if (rowCacheCommit)
+			self->rowCache.endCommit( rowCacheCommit );
+		return Void();
+	}
 };
 
 struct UpdateEagerReadInfo {
@@ -399,17 +575,20 @@ public:
 
 	struct Counters {
 		CounterCollection cc;
-		Counter allQueries, getKeyQueries, getValueQueries, getRangeQueries, finishedQueries, rowsQueried, bytesQueried;
+		Counter allQueries, getKeyQueries, getValueQueries, getValuesQueries, getRangeQueries, getRangeAggregateQueries, finishedQueries, rowsQueried, bytesQueried;
 		Counter bytesInput, bytesDurable, bytesFetched,
 			mutationBytes;  // Like bytesInput but without MVCC accounting
 		Counter updateBatches, updateVersions;
 		Counter loops;
+		Counter rowCacheHits, rowCacheMisses;
 
 		Counters(StorageServer* self)
 			: cc("StorageServer", self->thisServerID.toString()),
 			getKeyQueries("getKeyQueries", cc),
 			getValueQueries("getValueQueries",cc),
+			getValuesQueries("getValuesQueries", cc),
 			getRangeQueries("getRangeQueries", cc),
+			getRangeAggregateQueries("getRangeAggregateQueries", cc),
 			allQueries("QueryQueue", cc),
 			finishedQueries("finishedQueries", cc),
 			rowsQueried("rowsQueried", cc),
@@ -420,7 +599,9 @@ public:
 			mutationBytes("mutationBytes", cc),
 			updateBatches("updateBatches", cc),
 			updateVersions("updateVersions", cc),
-			loops("loops", cc)
+			loops("loops", cc),
+			rowCacheHits("rowCacheHits", cc),
+			rowCacheMisses("rowCacheMisses", cc)
 		{
 			specialCounter(cc, "lastTLogVersion", [self](){return self->lastTLogVersion; });
 			specialCounter(cc, "version", [self](){return self->version.get(); });
@@ -434,6 +615,8 @@ public:
 			specialCounter(cc, "QueryQueueMax", [self](){return self->getAndResetMaxQueryQueueSize(); });
 
 			specialCounter(cc, "bytesStored", [self](){return self->metrics.byteSample.getEstimate(allKeys); });
+			specialCounter(cc, "rowCacheBytes", [self](){return self->storage.rowCache.getBytes(); });
+			specialCounter(cc, "rangeCursorsReused", [self](){return self->storage.cursorsReused; });
 
 			specialCounter(cc, "kvstoreBytesUsed", [self](){ return self->storage.getStorageBytes().used; });
 			specialCounter(cc, "kvstoreBytesFree", [self](){ return self->storage.getStorageBytes().free; });
@@ -683,6 +866,7 @@ ACTOR Future<Version> waitForVersionNoTooOld( StorageServer* data, Version versi
 
 ACTOR Future<Void> getValueQ( StorageServer* data, GetValueRequest req ) {
 	state double startTime = timer();
+	state int64_t rowCacheTicket = 0;
 	try {
 		// Active load balancing runs at a very high priority (to obtain accurate queue lengths)
 		// so we need to downgrade here
@@ -714,19 +898,31 @@ ACTOR Future<Void> getValueQ( StorageServer* data, GetValueRequest req ) {
 			v = (Value)i->getValue();
 			path = 1;
 		} else if (!i || !i->isClearTo() || i->getEndKey() <= req.key) {
-			path = 2;
-			Optional<Value> vv = wait( data->storage.readValue( req.key, req.debugID ) );
-			// Validate that while we were reading the data we didn't lose the version or shard
-			if (version < data->storageVersion()) {
-				TEST(true); // transaction_too_old after readValue
-				throw transaction_too_old();
+			Optional<Value> cached;
+			if (data->storage.rowCache.get( req.key, cached )) {
+				++data->counters.rowCacheHits;
+				v = cached;
+				path = 3;
+			} else {
+				path = 2;
+				if (data->storage.rowCache.enabled())
+					++data->counters.rowCacheMisses;
+				rowCacheTicket = data->storage.rowCache.beginRead( req.key );
+				Optional<Value> vv = wait( data->storage.readValue( req.key, req.debugID ) );
+				// Validate that while we were reading the data we didn't lose the version or shard
+				if (version < data->storageVersion()) {
+					TEST(true); // transaction_too_old after readValue
+					throw transaction_too_old();
+				}
+				data->checkChangeCounter(changeCounter, req.key);
+				data->storage.rowCache.fill( req.key, rowCacheTicket, vv );
+				rowCacheTicket = 0;
+				v = vv;
 			}
-			data->checkChangeCounter(changeCounter, req.key);
-			v = vv;
 		}
 
 		debugMutation("ShardGetValue", version, MutationRef(MutationRef::DebugKey, req.key, v.present()?v.get():LiteralStringRef("<null>")));
-		debugMutation("ShardGetPath", version, MutationRef(MutationRef::DebugKey, req.key, path==0?LiteralStringRef("0"):path==1?LiteralStringRef("1"):LiteralStringRef("2")));
+		debugMutation("ShardGetPath", version, MutationRef(MutationRef::DebugKey, req.key, path==0?LiteralStringRef("0"):path==1?LiteralStringRef("1"):path==2?LiteralStringRef("2"):LiteralStringRef("3")));
 
 		/*
 		StorageMetrics m;
@@ -748,6 +944,7 @@ ACTOR Future<Void> getValueQ( StorageServer* data, GetValueRequest req ) {
 		req.reply.send(reply);
 	} catch (Error& e) {
 		if (e.code() == error_code_internal_error || e.code() == error_code_actor_cancelled) throw;
+		data->storage.rowCache.cancelRead( req.key, rowCacheTicket );
 		req.reply.sendError(e);
 	}
 
@@ -757,6 +954,117 @@ ACTOR Future<Void> getValueQ( StorageServer* data, GetValueRequest req ) {
 	return Void();
 };
 
+// Like getValueQ, but for many keys at one version: the version wait and the request overhead are paid once, and the
+// keys that have to come from the storage engine are read concurrently, a window of keys at a time.
+ACTOR Future<Void> getValuesQ( StorageServer* data, GetValuesRequest req ) {
+	state std::vector<int> diskReads;
+	state std::vector<int64_t> rowCacheTickets;
+	try {
+		++data->counters.getValuesQueries;
+		++data->counters.allQueries;
+		++data->readQueueSizeMetric;
+		data->maxQueryQueue = std::max<int>( data->maxQueryQueue, data->counters.allQueries.getValue() - data->counters.finishedQueries.getValue());
+
+		Void _ = wait( delay(0, TaskDefaultEndpoint) );
+
+		if( req.debugID.present() )
+			g_traceBatch.addEvent("GetValuesDebug", req.debugID.get().first(), "getValuesQ.DoRead");
+
+		state Version version = wait( waitForVersion( data, req.version ) );
+		if( req.debugID.present() )
+			g_traceBatch.addEvent("GetValuesDebug", req.debugID.get().first(), "getValuesQ.AfterVersion");
+
+		state uint64_t changeCounter = data->shardChangeCounter;
+		state int keyLimit = std::min<int>( req.keys.size(), SERVER_KNOBS->STORAGE_GET_VALUES_MAX_KEYS );
+		state std::vector<Optional<Value>> values;
+		state std::vector<Future<Optional<Value>>> diskValues;
+
+		// Like a range read, the reply stops once it holds limitBytes, and the client asks again for the keys it leaves out.
+		// Keys are looked up in order, so nothing is read for the keys after that point.
+		state GetValuesReply reply;
+		state int replyBytes = 0;
+		state int windowBegin;
+		state int windowEnd;
+		while (reply.keysRead < keyLimit && replyBytes < req.limitBytes) {
+			if (version < data->storageVersion()) {
+				TEST(true); // transaction_too_old between windows of getValuesQ
+				throw transaction_too_old();
+			}
+
+			windowBegin = reply.keysRead;
+			windowEnd = std::min( keyLimit, windowBegin + SERVER_KNOBS->STORAGE_GET_VALUES_READ_WINDOW );
+			values.assign( windowEnd - windowBegin, Optional<Value>() );
+			diskValues.clear();
+			diskReads.clear();
+
+			auto view = data->data().at(version);
+			for(int k = windowBegin; k < windowEnd; k++) {
+				KeyRef key = req.keys[k];
+				if (!data->shards[key]->isReadable())
+					throw wrong_shard_server();
+
+				auto i = view.lastLessOrEqual(key);
+				if (i && i->isValue() && i.key() == key) {
+					values[k - windowBegin] = (Value)i->getValue();
+				} else if (!i || !i->isClearTo() || i->getEndKey() <= key) {
+					if (data->storage.rowCache.get( key, values[k - windowBegin] )) {
+						++data->counters.rowCacheHits;
+					} else {
+						if (data->storage.rowCache.enabled())
+							++data->counters.rowCacheMisses;
+						diskReads.push_back(k);
+						rowCacheTickets.push_back( data->storage.rowCache.beginRead(key) );
+						diskValues.push_back( data->storage.readValue( key, req.debugID ) );
+					}
+				}
+			}
+
+			Void _ = wait( waitForAll(diskValues) );
+			if (diskReads.size()) {
+				// Validate that while we were reading the data we didn't lose the version or shard
+				if (version < data->storageVersion()) {
+					TEST(true); // transaction_too_old after readValue in getValuesQ
+					throw transaction_too_old();
+				}
+				for(int r = 0; r < diskReads.size(); r++) {
+					KeyRef key = req.keys[diskReads[r]];
+					data->checkChangeCounter(changeCounter, key);
+					data->storage.rowCache.fill( key, rowCacheTickets[r], diskValues[r].get() );
+					values[diskReads[r] - windowBegin] = diskValues[r].get();
+				}
+				rowCacheTickets.clear();
+			}
+
+			while (reply.keysRead < windowEnd && replyBytes < req.limitBytes) {
+				int k = reply.keysRead++;
+				Optional<Value> const& value = values[k - windowBegin];
+				if (value.present()) {
+					reply.data.push_back_deep( reply.arena, KeyValueRef(req.keys[k], value.get()) );
+					replyBytes += sizeof(KeyValueRef) + reply.data.back().expectedSize();
+					++data->counters.rowsQueried;
+					data->counters.bytesQueried += value.get().size();
+				}
+			}
+		}
+
+		if( req.debugID.present() )
+			g_traceBatch.addEvent("GetValuesDebug", req.debugID.get().first(), "getValuesQ.AfterRead");
+
+		reply.penalty = data->getPenalty();
+		req.reply.send(reply);
+	} catch (Error& e) {
+		if (e.code() == error_code_internal_error || e.code() == error_code_actor_cancelled) throw;
+		for(int r = 0; r < rowCacheTickets.size(); r++)
+			data->storage.rowCache.cancelRead( req.keys[diskReads[r]], rowCacheTickets[r] );
+		req.reply.sendError(e);
+	}
+
+	++data->counters.finishedQueries;
+	--data->readQueueSizeMetric;
+
+	return Void();
+}
+
 ACTOR Future<Void> watchValue_impl( StorageServer* data, WatchValueRequest req ) {
 	try {
 		if( req.debugID.present() )
@@ -914,19 +1222,27 @@ void merge( Arena& arena, VectorRef<KeyValueRef>& output, VectorRef<KeyValueRef>
 
 // readRange reads up to |limit| rows from the given range and version, combining data->storage and data->versionedData.
 // If limit>=0, it returns the first rows in the range (sorted ascending), otherwise the last rows (sorted descending).
+// If keepCursor, a read that stops at a limit leaves its storage cursor for a read continuing where it stopped.  If the
+// read was itself such a continuation, the cursor starts reading the rows for the next one.
 // readRange has O(|result|) + O(log |data|) cost
-ACTOR Future<GetKeyValuesReply> readRange( StorageServer* data, Version version, KeyRange range, int limit, int* pLimitBytes ) {
+ACTOR Future<GetKeyValuesReply> readRange( StorageServer* data, Version version, KeyRange range, int limit, int* pLimitBytes, bool keepCursor ) {
 	state GetKeyValuesReply result;
 	state StorageServer::VersionedData::ViewAtVersion view = data->data().at(version);
+	// The cursor must be taken after the view, so that the view has every write that its rows could be missing
+	state int64_t cursorGeneration = data->storage.cursorGeneration();
+	state bool reverse = limit < 0;
+	state int originalLimit = limit;
+	state int originalLimitBytes = *pLimitBytes;
+	state bool cursorReused = false;
+	state Reference<IKeyValueCursor> cursor = data->storage.getCursor( range, reverse, cursorReused );
 	state StorageServer::VersionedData::iterator vStart = view.end();
 	state StorageServer::VersionedData::iterator vEnd = view.end();
 	state KeyRef readBegin;
 	state KeyRef readEnd;
 	state Key readBeginTemp;
 	state int vCount;
+	state Standalone<VectorRef<KeyValueRef>> atStorageVersion;
 	//state UID rrid = g_random->randomUniqueID();
-	//state int originalLimit = limit;
-	//state int originalLimitBytes = *pLimitBytes;
 	//state bool track = rrid.first() == 0x1bc134c2f752187cLL;
 
 	// FIXME: Review pLimitBytes behavior
@@ -971,10 +1287,17 @@ ACTOR Future<GetKeyValuesReply> readRange( StorageServer* data, Version version,
 				++vEnd;
 			}
 
-			// Read the data on disk up to vEnd (or the end of the range)
+			// Read the data on disk up to vEnd (or the end of the range).  The cursor may read past vEnd, and the rows it
+			// returns after readEnd are left for the next iteration to seek back to.
 			readEnd = vEnd ? std::min( vEnd.key(), range.end ) : range.end;
-			Standalone<VectorRef<KeyValueRef>> atStorageVersion = wait(
-					data->storage.readRange( KeyRangeRef(readBegin, readEnd), limit, *pLimitBytes ) );
+			if (readBegin < readEnd) {
+				cursor->seek( readBegin );
+				Standalone<VectorRef<KeyValueRef>> fromCursor = wait( cursor->next( limit, *pLimitBytes ) );
+				int n = std::lower_bound( fromCursor.begin(), fromCursor.end(), readEnd, KeyValueRef::OrderByKey() ) - fromCursor.begin();
+				atStorageVersion = Standalone<VectorRef<KeyValueRef>>( fromCursor.slice( 0, n ), fromCursor.arena() );
+			} else {
+				atStorageVersion = Standalone<VectorRef<KeyValueRef>>();
+			}
 
 			/*if (track) {
 				printf("read [%s,%s): %d rows\n", printable(readBegin).c_str(), printable(readEnd).c_str(), atStorageVersion.size());
@@ -1073,7 +1396,14 @@ ACTOR Future<GetKeyValuesReply> readRange( StorageServer* data, Version version,
 			if (vEnd)
 				readBegin = std::max( readBegin, vEnd->isClearTo() ? vEnd->getEndKey() : vEnd.key() );
 
-			Standalone<VectorRef<KeyValueRef>> atStorageVersion = wait( data->storage.readRange( KeyRangeRef(readBegin, readEnd), limit ) );
+			if (readBegin < readEnd) {
+				cursor->seek( readEnd );
+				Standalone<VectorRef<KeyValueRef>> fromCursor = wait( cursor->prev( -limit ) );
+				int n = std::upper_bound( fromCursor.begin(), fromCursor.end(), readBegin, KeyValueRef::OrderByKeyBack() ) - fromCursor.begin();
+				atStorageVersion = Standalone<VectorRef<KeyValueRef>>( fromCursor.slice( 0, n ), fromCursor.arena() );
+			} else {
+				atStorageVersion = Standalone<VectorRef<KeyValueRef>>();
+			}
 			if (data->storageVersion() > version) throw transaction_too_old();
 
 			int prevSize = result.data.size();
@@ -1095,6 +1425,15 @@ ACTOR Future<GetKeyValuesReply> readRange( StorageServer* data, Version version,
 	}
 	result.more = limit == 0 || *pLimitBytes<=0;  // FIXME: Does this have to be exact?
 	result.version = version;
+	if (keepCursor && result.more && result.data.size()) {
+		// A continuation of a continuation is likely a scan that will go on, and will likely ask for as much again
+		KeyRef last = result.data.end()[-1].key;
+		KeyRange remaining = reverse ? KeyRangeRef( range.begin, last ) : KeyRangeRef( keyAfter(last), range.end );
+		if (data->storage.keepCursor( cursor, cursorGeneration, remaining, reverse ) && cursorReused) {
+			cursor->seek( reverse ? remaining.end : remaining.begin );
+			cursor->readAhead( reverse, std::abs(originalLimit), originalLimitBytes );
+		}
+	}
 	return result;
 }
 
@@ -1128,14 +1467,14 @@ ACTOR Future<Key> findKey( StorageServer* data, KeySelectorRef sel, Version vers
 	else
 		maxBytes = BUGGIFY ? SERVER_KNOBS->BUGGIFY_LIMIT_BYTES : SERVER_KNOBS->STORAGE_LIMIT_BYTES;
 
-	state GetKeyValuesReply rep = wait( readRange( data, version, forward ? KeyRangeRef(sel.getKey(), range.end) : KeyRangeRef(range.begin, keyAfter(sel.getKey())), (distance + skipEqualKey)*sign, &maxBytes ) );
+	state GetKeyValuesReply rep = wait( readRange( data, version, forward ? KeyRangeRef(sel.getKey(), range.end) : KeyRangeRef(range.begin, keyAfter(sel.getKey())), (distance + skipEqualKey)*sign, &maxBytes, false ) );
 	state bool more = rep.more && rep.data.size() != distance + skipEqualKey;
 
 	//If we get only one result in the reverse direction as a result of the data being too large, we could get stuck in a loop
 	if(more && !forward && rep.data.size() == 1) {
 		TEST(true); //Reverse key selector returned only one result in range read
 		maxBytes = std::numeric_limits<int>::max();
-		GetKeyValuesReply rep2 = wait( readRange( data, version, KeyRangeRef(range.begin, keyAfter(sel.getKey())), -2, &maxBytes ) );
+		GetKeyValuesReply rep2 = wait( readRange( data, version, KeyRangeRef(range.begin, keyAfter(sel.getKey())), -2, &maxBytes, false ) );
 		rep = rep2;
 		more = rep.more && rep.data.size() != distance + skipEqualKey;
 		ASSERT(rep.data.size() == 2 || !more);
@@ -1248,7 +1587,7 @@ ACTOR Future<Void> getKeyValues( StorageServer* data, GetKeyValuesRequest req )
 		} else {
 			state int remainingLimitBytes = req.limitBytes;
 
-			GetKeyValuesReply _r = wait( readRange(data, version, KeyRangeRef(begin, end), req.limit, &remainingLimitBytes) );
+			GetKeyValuesReply _r = wait( readRange(data, version, KeyRangeRef(begin, end), req.limit, &remainingLimitBytes, true) );
 			GetKeyValuesReply r = _r;
 
 			if( req.debugID.present() )
@@ -1268,12 +1607,77 @@ ACTOR Future<Void> getKeyValues( StorageServer* data, GetKeyValuesRequest req )
 				data->metrics.notify(r.data[i].key, m);
 			}*/
 
+			data->counters.rowsQueried += r.data.size();
+			data->counters.bytesQueried += req.limitBytes - remainingLimitBytes;
+
+			if (req.compressKeys)
+				r.encodeKeys();
 			r.penalty = data->getPenalty();
 			req.reply.send( r );
+		}
+	} catch (Error& e) {
+		if (e.code() == error_code_internal_error || e.code() == error_code_actor_cancelled) throw;
+		req.reply.sendError(e);
+	}
+
+	++data->counters.finishedQueries;
+	--data->readQueueSizeMetric;
+
+	return Void();
+}
 
+// Aggregates the rows of req.keys a range read at a time, so that only the aggregate is sent back.  A request stops after
+// STORAGE_AGGREGATE_LIMIT_BYTES of rows, well within the MVCC window, and the client continues after the last key.
+ACTOR Future<Void> getRangeAggregateQ( StorageServer* data, GetRangeAggregateRequest req ) {
+	++data->counters.getRangeAggregateQueries;
+	++data->counters.allQueries;
+	++data->readQueueSizeMetric;
+	data->maxQueryQueue = std::max<int>( data->maxQueryQueue, data->counters.allQueries.getValue() - data->counters.finishedQueries.getValue());
+
+	// Active load balancing runs at a very high priority (to obtain accurate queue lengths)
+	// so we need to downgrade here
+	Void _ = wait( delay(0, TaskDefaultEndpoint) );
+
+	try {
+		if( req.debugID.present() )
+			g_traceBatch.addEvent("TransactionDebug", req.debugID.get().first(), "storageserver.getRangeAggregate.Before");
+		state Version version = wait( waitForVersion( data, req.version ) );
+
+		state uint64_t changeCounter = data->shardChangeCounter;
+		auto sh = data->shards.intersectingRanges( req.keys );
+		for(auto i = sh.begin(); i != sh.end(); ++i)
+			if (!i->value()->isReadable())
+				throw wrong_shard_server();
+
+		state GetRangeAggregateReply reply;
+		state KeyRange remaining = req.keys;
+		state int64_t bytesLeft = SERVER_KNOBS->STORAGE_AGGREGATE_LIMIT_BYTES;
+		while (!remaining.empty()) {
+			state int limitBytes = BUGGIFY ? SERVER_KNOBS->BUGGIFY_LIMIT_BYTES : SERVER_KNOBS->STORAGE_LIMIT_BYTES;
+			GetKeyValuesReply r = wait( readRange( data, version, remaining, std::numeric_limits<int>::max(), &limitBytes, true ) );
+			int64_t bytesBefore = reply.aggregate.keyBytes + reply.aggregate.valueBytes;
+			reply.aggregate.add( r.data );
+			int64_t bytes = reply.aggregate.keyBytes + reply.aggregate.valueBytes - bytesBefore;
 			data->counters.rowsQueried += r.data.size();
-			data->counters.bytesQueried += req.limitBytes - remainingLimitBytes;
+			data->counters.bytesQueried += bytes;
+			bytesLeft -= bytes;
+
+			if (!r.more) break;
+			remaining = KeyRangeRef( keyAfter( r.data.back().key ), remaining.end );
+			if (bytesLeft <= 0) {
+				reply.more = !remaining.empty();
+				break;
+			}
+			// A range read may not have had to wait for anything
+			Void _ = wait( yield() );
 		}
+
+		data->checkChangeCounter( changeCounter, req.keys );
+		if( req.debugID.present() )
+			g_traceBatch.addEvent("TransactionDebug", req.debugID.get().first(), "storageserver.getRangeAggregate.AfterReadRange");
+
+		reply.penalty = data->getPenalty();
+		req.reply.send( reply );
 	} catch (Error& e) {
 		if (e.code() == error_code_internal_error || e.code() == error_code_actor_cancelled) throw;
 		req.reply.sendError(e);
@@ -2657,18 +3061,22 @@ void setAssignedStatus( StorageServer* self, KeyRangeRef keys, bool nowAssigned
 }
 
 void StorageServerDisk::clearRange( KeyRangeRef keys ) {
+	rowCache.invalidate(keys);
 	storage->clear(keys);
 }
 
 void StorageServerDisk::writeKeyValue( KeyValueRef kv ) {
+	rowCache.invalidate(kv.key);
 	storage->set( kv );
 }
 
 void StorageServerDisk::writeMutation( MutationRef mutation ) {
 	// FIXME: debugMutation(debugContext, debugVersion, *m);
 	if (mutation.type == MutationRef::SetValue) {
+		rowCache.invalidate(mutation.param1);
 		storage->set( KeyValueRef(mutation.param1, mutation.param2) );
 	} else if (mutation.type == MutationRef::ClearRange) {
+		rowCache.invalidate(KeyRangeRef(mutation.param1, mutation.param2));
 		storage->clear( KeyRangeRef(mutation.param1, mutation.param2) );
 	} else
 		ASSERT(false);
@@ -2678,8 +3086,10 @@ void StorageServerDisk::writeMutations( MutationListRef mutations, Version debug
 	for(auto m = mutations.begin(); m; ++m) {
 		debugMutation(debugContext, debugVersion, *m);
 		if (m->type == MutationRef::SetValue) {
+			rowCache.invalidate(m->param1);
 			storage->set( KeyValueRef(m->param1, m->param2) );
 		} else if (m->type == MutationRef::ClearRange) {
+			rowCache.invalidate(KeyRangeRef(m->param1, m->param2));
 			storage->clear( KeyRangeRef(m->param1, m->param2) );
 		}
 	}
@@ -3163,6 +3573,17 @@ ACTOR Future<Void> storageServerCore( StorageServer* self, StorageServerInterfac
 				else
 					actors.add( getValueQ( self, req ) );
 			}
+			when( GetValuesRequest req = waitNext(ssi.getValues.getFuture()) ) {
+				// Warning: This code is executed at extremely high priority (TaskLoadBalancedEndpoint), so downgrade before doing real work
+				if( req.debugID.present() )
+					g_traceBatch.addEvent("GetValuesDebug", req.debugID.get().first(), "storageServer.recieved");
+
+				actors.add( getValuesQ( self, req ) );
+			}
+			when( GetRangeAggregateRequest req = waitNext(ssi.getRangeAggregate.getFuture()) ) {
+				// Warning: This code is executed at extremely high priority (TaskLoadBalancedEndpoint), so downgrade before doing real work
+				actors.add( getRangeAggregateQ( self, req ) );
+			}
 			when( WatchValueRequest req = waitNext(ssi.watchValue.getFuture()) ) {
 				// TODO: fast load balancing?
 				// SOMEDAY: combine watches for the same key/value into a single watch
@@ -3460,3 +3881,104 @@ void versionedMapTest() {
 	printf("Memory used: %f MB\n",
 		 (after - before)/ 1e6);
 }
+
+TEST_CASE("fdbserver/StorageRowCache/readRacingWrite") {
+	StorageRowCache cache(1e6);
+	Optional<Value> v;
+	Key key = LiteralStringRef("k");
+
+	// A read that a write to its key overtakes, as when a mutation at the version being read becomes durable while
+	// the read is in flight, does not fill the cache with what it read
+	int64_t ticket = cache.beginRead(key);
+	ASSERT( ticket );
+	cache.invalidate(key);
+	cache.fill(key, ticket, Optional<Value>(LiteralStringRef("old")));
+	ASSERT( !cache.get(key, v) );
+
+	// Until the commit that writes the key completes, reads of it are not cached
+	ASSERT( !cache.beginRead(key) );
+	int64_t commit = cache.beginCommit();
+	ASSERT( !cache.beginRead(key) );
+	cache.endCommit(commit);
+
+	ticket = cache.beginRead(key);
+	ASSERT( ticket );
+	ASSERT( !cache.get(key, v) );  // Not while the read is in flight
+	cache.fill(key, ticket, Optional<Value>(LiteralStringRef("new")));
+	ASSERT( cache.get(key, v) && v == Optional<Value>(LiteralStringRef("new")) );
+
+	// A read that fails leaves nothing behind
+	Key other = LiteralStringRef("other");
+	ticket = cache.beginRead(other);
+	ASSERT( cache.getBytes() > 0 );
+	cache.cancelRead(other, ticket);
+	cache.fill(other, ticket, Optional<Value>());
+	ASSERT( !cache.get(other, v) );
+	cache.invalidate(key);
+	ASSERT( cache.getBytes() == 0 );
+
+	return Void();
+}
+
+TEST_CASE("fdbserver/StorageRowCache/rollback") {
+	StorageRowCache cache(1e6);
+	Optional<Value> v;
+	Key a = LiteralStringRef("a"), b = LiteralStringRef("b"), c = LiteralStringRef("c");
+
+	for(auto key : { a, b, c }) {
+		int64_t ticket = cache.beginRead(key);
+		cache.fill(key, ticket, key == b ? Optional<Value>() : Optional<Value>(key));
+	}
+	ASSERT( cache.get(b, v) && !v.present() );
+
+	// Undoing writes to [a,c), as when a fetch is rolled back and its keys are cleared from the storage engine, removes
+	// what was cached for them and keeps reads begun before the clear from caching what they read
+	int64_t ticket = cache.beginRead(LiteralStringRef("b2"));
+	int64_t commit = cache.beginCommit();
+	cache.invalidate(KeyRangeRef(a, c));
+	ASSERT( !cache.get(a, v) && !cache.get(b, v) );
+	ASSERT( cache.get(c, v) && v == Optional<Value>(c) );
+	cache.fill(LiteralStringRef("b2"), ticket, Optional<Value>(LiteralStringRef("rolled back")));
+	ASSERT( !cache.get(LiteralStringRef("b2"), v) );
+
+	// The clear was invalidated after beginCommit(), so it is not visible when that commit ends
+	cache.endCommit(commit);
+	ASSERT( !cache.beginRead(a) );
+	cache.endCommit(cache.beginCommit());
+	ASSERT( cache.beginRead(a) );
+
+	return Void();
+}
+
+TEST_CASE("fdbserver/StorageRowCache/eviction") {
+	const int64_t capacity = 2000;
+	StorageRowCache cache(capacity);
+	Optional<Value> v;
+	Key hot = LiteralStringRef("hot");
+	cache.fill(hot, cache.beginRead(hot), Optional<Value>(LiteralStringRef("value")));
+
+	int64_t pendingTicket = cache.beginRead(LiteralStringRef("pending"));
+	for(int i = 0; i < 1000; i++) {
+		Key key = StringRef(format("key%d", i));
+		cache.fill(key, cache.beginRead(key), Optional<Value>(Value(std::string(g_random->randomInt(0, 100), 'x'))));
+		ASSERT( cache.getBytes() <= capacity );
+		ASSERT( cache.get(hot, v) );  // Recently used, so never the least recently used entry
+	}
+	ASSERT( cache.getBytes() > capacity/2 );
+
+	// An entry evicted while it was being read is not filled
+	cache.fill(LiteralStringRef("pending"), pendingTicket, Optional<Value>());
+	ASSERT( !cache.get(LiteralStringRef("pending"), v) );
+	ASSERT( !cache.get(LiteralStringRef("key0"), v) );
+	ASSERT( cache.get(LiteralStringRef("key999"), v) );
+
+	// A value too large for the cache on its own is not kept
+	Key big = LiteralStringRef("big");
+	cache.fill(big, cache.beginRead(big), Optional<Value>(Value(std::string(capacity, 'x'))));
+	ASSERT( !cache.get(big, v) && cache.getBytes() <= capacity );
+
+	cache.invalidate(allKeys);
+	ASSERT( cache.getBytes() == 0 );
+
+	return Void();
+}
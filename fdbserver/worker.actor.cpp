@@ -594,6 +594,8 @@ ACTOR Future<Void> workerServer( Reference<ClusterConnectionFile> connFile, Refe
 
 				DUMPTOKEN(recruited.getVersion);
 				DUMPTOKEN(recruited.getValue);
+				DUMPTOKEN(recruited.getValues);
+				DUMPTOKEN(recruited.getRangeAggregate);
 				DUMPTOKEN(recruited.getKey);
 				DUMPTOKEN(recruited.getKeyValues);
 				DUMPTOKEN(recruited.getShardState);
@@ -745,6 +747,8 @@ ACTOR Future<Void> workerServer( Reference<ClusterConnectionFile> connFile, Refe
 
 					DUMPTOKEN(recruited.getVersion);
 					DUMPTOKEN(recruited.getValue);
+					DUMPTOKEN(recruited.getValues);
+					DUMPTOKEN(recruited.getRangeAggregate);
 					DUMPTOKEN(recruited.getKey);
 					DUMPTOKEN(recruited.getKeyValues);
 					DUMPTOKEN(recruited.getShardState);
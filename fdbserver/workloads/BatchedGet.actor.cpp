@@ -0,0 +1,198 @@
+/*
+ * BatchedGet.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/actorcompiler.h"
+#include "fdbrpc/ContinuousSample.h"
+#include "fdbclient/NativeAPI.h"
+#include "fdbclient/ReadYourWrites.h"
+#include "fdbserver/TesterInterface.h"
+#include "workloads.h"
+#include "BulkSetup.actor.h"
+
+// Compares reading keysPerTransaction random keys with one get() per key against a single getValues(), and checks
+// that getValues() returns exactly what get() does, including through a transaction's own uncommitted writes and atomic
+// operations.
+struct BatchedGetWorkload : KVWorkload {
+	double phaseDuration;
+	int keysPerTransaction;
+	bool runPerformance;
+	bool verified;
+
+	struct Phase {
+		std::string name;
+		int64_t transactions;
+		ContinuousSample<double> latencies;
+		Phase( std::string const& name ) : name(name), transactions(0), latencies(10000) {}
+	};
+	vector<Phase> phases;
+
+	BatchedGetWorkload(WorkloadContext const& wcx)
+		: KVWorkload(wcx), verified(true)
+	{
+		phaseDuration = getOption( options, LiteralStringRef("phaseDuration"), 10.0 );
+		keysPerTransaction = getOption( options, LiteralStringRef("keysPerTransaction"), 100 );
+		runPerformance = getOption( options, LiteralStringRef("runPerformance"), true );
+	}
+
+	virtual std::string description() { return "BatchedGet"; }
+
+	Standalone<KeyValueRef> operator()( uint64_t n ) {
+		return KeyValueRef( keyForIndex( n, false ), Value( std::string( maxValueBytes, 'v' ) ) );
+	}
+
+	virtual Future<Void> setup( Database const& cx ) {
+		return bulkSetup( cx, this, nodeCount, Promise<double>() );
+	}
+
+	virtual Future<Void> start( Database const& cx ) {
+		return _start( cx, this );
+	}
+
+	Standalone<VectorRef<KeyRef>> randomKeys() {
+		Standalone<VectorRef<KeyRef>> keys;
+		for( int i = 0; i < keysPerTransaction; i++ )
+			keys.push_back_deep( keys.arena(), getRandomKey( absentFrac ) );
+		return keys;
+	}
+
+	ACTOR static Future<Void> readKeys( Database cx, BatchedGetWorkload* self, Phase* phase, bool batched, double endTime ) {
+		loop {
+			state Transaction tr( cx );
+			state double start = now();
+			state Standalone<VectorRef<KeyRef>> keys = self->randomKeys();
+			if( start >= endTime )
+				return Void();
+			try {
+				if( batched ) {
+					Standalone<RangeResultRef> _ = wait( tr.getValues( keys ) );
+				} else {
+					state vector<Future<Optional<Value>>> values;
+					for( auto& k : keys )
+						values.push_back( tr.get( k ) );
+					Void _ = wait( waitForAll( values ) );
+				}
+				phase->latencies.addSample( now() - start );
+				++phase->transactions;
+			} catch( Error &e ) {
+				Void _ = wait( tr.onError(e) );
+			}
+		}
+	}
+
+	ACTOR static Future<Void> runPhase( Database cx, BatchedGetWorkload* self, Phase* phase, bool batched ) {
+		state double endTime = now() + self->phaseDuration;
+		state vector<Future<Void>> clients;
+		for( int c = 0; c < self->actorCount; c++ )
+			clients.push_back( readKeys( cx, self, phase, batched, endTime ) );
+		Void _ = wait( waitForAll( clients ) );
+		TraceEvent("BatchedGetPhase").detail("Phase", phase->name).detail("Transactions", phase->transactions)
+			.detail("Median", phase->latencies.median()).detail("P99", phase->latencies.percentile(0.99));
+		return Void();
+	}
+
+	// Reads the same keys with get() and getValues() in one transaction, after some random uncommitted writes. An atomic
+	// operation makes its key's value depend on the database, so getValues() has to read the key and apply the operation.
+	ACTOR static Future<Void> verify( Database cx, BatchedGetWorkload* self ) {
+		state ReadYourWritesTransaction tr( cx );
+		loop {
+			state Standalone<VectorRef<KeyRef>> keys = self->randomKeys();
+			try {
+				for( int i = 0; i < keys.size(); i++ ) {
+					double r = g_random->random01();
+					if( r < 0.1 )
+						tr.set( keys[i], LiteralStringRef("written") );
+					else if( r < 0.2 )
+						tr.clear( keys[i] );
+					else if( r < 0.3 ) {
+						static const MutationRef::Type ops[] = { MutationRef::AddValue, MutationRef::Or, MutationRef::ByteMax, MutationRef::AppendIfFits };
+						tr.atomicOp( keys[i], LiteralStringRef("\x01\x02\x03\x04"), ops[ g_random->randomInt(0, 4) ] );
+					}
+				}
+				// Repeated keys appear once in the result for each time they are asked for
+				if( keys.size() )
+					keys.push_back( keys.arena(), keys[ g_random->randomInt(0, keys.size()) ] );
+
+				// Either read may be the one that fetches a key from the database for the other
+				state bool batchFirst = g_random->coinflip();
+				state Future<Standalone<RangeResultRef>> batchRead;
+				if( batchFirst )
+					batchRead = tr.getValues( keys );
+				state vector<Future<Optional<Value>>> values;
+				for( auto& k : keys )
+					values.push_back( tr.get( k ) );
+				if( !batchFirst )
+					batchRead = tr.getValues( keys );
+				state Standalone<RangeResultRef> batch = wait( batchRead );
+				Void _ = wait( waitForAll( values ) );
+
+				int b = 0;
+				for( int i = 0; i < keys.size(); i++ ) {
+					if( !values[i].get().present() )
+						continue;
+					if( b >= batch.size() || batch[b].key != keys[i] || batch[b].value != values[i].get().get() ) {
+						TraceEvent(SevError, "BatchedGetMismatch").detail("Key", printable(keys[i]))
+							.detail("Expected", printable(values[i].get().get()))
+							.detail("Found", b < batch.size() ? printable(batch[b].key) : std::string("<end>"));
+						self->verified = false;
+						return Void();
+					}
+					b++;
+				}
+				if( b != batch.size() ) {
+					TraceEvent(SevError, "BatchedGetExtraResults").detail("Expected", b).detail("Found", batch.size());
+					self->verified = false;
+				}
+				return Void();
+			} catch( Error &e ) {
+				Void _ = wait( tr.onError(e) );
+			}
+		}
+	}
+
+	ACTOR static Future<Void> _start( Database cx, BatchedGetWorkload* self ) {
+		state int i = 0;
+		for(; i < 10; i++)
+			Void _ = wait( verify( cx, self ) );
+
+		if( self->runPerformance ) {
+			self->phases.reserve( 2 );
+			self->phases.push_back( Phase( "get" ) );
+			Void _ = wait( runPhase( cx, self, &self->phases.back(), false ) );
+			self->phases.push_back( Phase( "getValues" ) );
+			Void _ = wait( runPhase( cx, self, &self->phases.back(), true ) );
+		}
+		return Void();
+	}
+
+	virtual Future<bool> check( Database const& cx ) {
+		return verified;
+	}
+
+	virtual void getMetrics( vector<PerfMetric>& m ) {
+		for( auto& p : phases ) {
+			m.push_back( PerfMetric( p.name + " Transactions/sec", p.transactions / phaseDuration, false ) );
+			m.push_back( PerfMetric( p.name + " Keys/sec", p.transactions * keysPerTransaction / phaseDuration, false ) );
+			m.push_back( PerfMetric( p.name + " Median Latency (ms)", 1000 * p.latencies.median(), true ) );
+			m.push_back( PerfMetric( p.name + " 99% Latency (ms)", 1000 * p.latencies.percentile(0.99), true ) );
+		}
+	}
+};
+
+WorkloadFactory<BatchedGetWorkload> BatchedGetWorkloadFactory("BatchedGet");
@@ -31,12 +31,13 @@ struct ConflictRangeWorkload : TestWorkload {
 	int minOperationsPerTransaction,maxOperationsPerTransaction,maxKeySpace,maxOffset,minInitialAmount,maxInitialAmount;
 	double testDuration;
 	bool testReadYourWrites;
+	bool reportedConflictsCorrect;  // False once the ranges reported to a REPORT_CONFLICTING_KEYS transaction miss its conflict
 
 	vector<Future<Void>> clients;
 	PerfIntCounter withConflicts, withoutConflicts, retries;
 
 	ConflictRangeWorkload(WorkloadContext const& wcx)
-		: TestWorkload(wcx), withConflicts("WithConflicts"), withoutConflicts("withoutConflicts"), retries("Retries")
+		: TestWorkload(wcx), withConflicts("WithConflicts"), withoutConflicts("withoutConflicts"), retries("Retries"), reportedConflictsCorrect(true)
 	{
 		minOperationsPerTransaction = getOption( options, LiteralStringRef("minOperationsPerTransaction"), 2 );
 		maxOperationsPerTransaction = getOption( options, LiteralStringRef("minOperationsPerTransaction"), 4 );
@@ -58,7 +59,7 @@ struct ConflictRangeWorkload : TestWorkload {
 
 	virtual Future<bool> check( Database const& cx ) {
 		clients.clear();
-		return true;
+		return reportedConflictsCorrect;
 	}
 
 	virtual void getMetrics( vector<PerfMetric>& m ) {
@@ -91,6 +92,7 @@ struct ConflictRangeWorkload : TestWorkload {
 		state Standalone<StringRef> firstElement;
 
 		state std::set<int> clearedSet;
+		state std::set<int> tr2Keys;
 		state int clearedBegin;
 		state int clearedEnd;
 
@@ -177,9 +179,12 @@ struct ConflictRangeWorkload : TestWorkload {
 				if( self->testReadYourWrites ) {
 					trRYOW.setVersion( readVersion );
 					trRYOW.setOption( FDBTransactionOptions::READ_SYSTEM_KEYS );
+					trRYOW.setOption( FDBTransactionOptions::REPORT_CONFLICTING_KEYS );
 				} else
 					tr3.setVersion( readVersion );
 
+				tr2Keys.clear();
+
 				//Do random operations in one of the transactions and commit.
 				//Either do all sets in locations without existing data or all clears in locations with data.
 				for(i = 0; i < g_random->randomInt(self->minOperationsPerTransaction,self->maxOperationsPerTransaction+1); i++) {
@@ -189,6 +194,7 @@ struct ConflictRangeWorkload : TestWorkload {
 							if( !insertedSet.count( proposedKey ) ) {
 								TraceEvent("ConflictRangeSet").detail("Key",proposedKey);
 								insertedSet.insert( proposedKey );
+								tr2Keys.insert( proposedKey );
 								tr2.set(StringRef(format( "%010d", proposedKey )),g_random->randomUniqueID().toString());
 								break;
 							}
@@ -200,6 +206,7 @@ struct ConflictRangeWorkload : TestWorkload {
 							if( insertedSet.count( proposedKey ) ) {
 								TraceEvent("ConflictRangeClear").detail("Key",proposedKey);
 								insertedSet.erase( proposedKey );
+								tr2Keys.insert( proposedKey );
 								tr2.clear(StringRef(format( "%010d", proposedKey )));
 								break;
 							}
@@ -230,6 +237,27 @@ struct ConflictRangeWorkload : TestWorkload {
 				if( foundConflict ) {
 					//If the commit fails, do the getRange again and check that the results are different from the first execution.
 					if( self->testReadYourWrites ) {
+						//tr2 is the only writer, so at least one of the reported conflicting ranges must contain a key it wrote.
+						//They are read after onError(), which resets the transaction for the retry but keeps them.
+						{
+							state KeyRef conflictingKeysPrefix = LiteralStringRef("\xff\xff/conflicting_keys/");
+							Void _ = wait( trRYOW.onError( not_committed() ) );
+							Standalone<RangeResultRef> conflictingKeys = wait( trRYOW.getRange( KeyRangeRef( conflictingKeysPrefix, LiteralStringRef("\xff\xff/conflicting_keys0") ), CLIENT_KNOBS->TOO_MANY ) );
+							bool wellFormed = conflictingKeys.size() % 2 == 0;
+							bool foundWrite = false;
+							for( int k = 0; wellFormed && k < conflictingKeys.size(); k += 2 ) {
+								wellFormed = conflictingKeys[k].value == LiteralStringRef("1") && conflictingKeys[k+1].value == LiteralStringRef("0");
+								KeyRangeRef conflictingRange( conflictingKeys[k].key.removePrefix( conflictingKeysPrefix ), conflictingKeys[k+1].key.removePrefix( conflictingKeysPrefix ) );
+								for( int key : tr2Keys )
+									foundWrite = foundWrite || conflictingRange.contains( StringRef( format( "%010d", key ) ) );
+							}
+							if( !wellFormed || !foundWrite ) {
+								TraceEvent(SevError, "ConflictRangeReportedKeysError").detail("ConflictingKeys", conflictingKeys.size()).detail("WrittenKeys", tr2Keys.size()).detail("WellFormed", wellFormed);
+								self->reportedConflictsCorrect = false;
+							}
+						}
+
+
 						tr1.clear( KeyRangeRef( StringRef( format( "%010d", clearedBegin ) ), StringRef( format( "%010d", clearedEnd ) ) ) );
 						Void _ = wait( tr1.commit() );
 						tr1 = Transaction(cx);
@@ -28,6 +28,7 @@ struct CycleWorkload : TestWorkload {
 	int actorCount, nodeCount;
 	double testDuration, transactionsPerSecond, minExpectedTransactionsPerSecond;
 	Key		keyPrefix;
+	bool	useCachedReadVersion;
 
 	vector<Future<Void>> clients;
 	PerfIntCounter transactions, retries, tooOldRetries, commitFailedRetries;
@@ -44,6 +45,7 @@ struct CycleWorkload : TestWorkload {
 		nodeCount = getOption(options, LiteralStringRef("nodeCount"), transactionsPerSecond * clientCount);
 		keyPrefix = getOption(options, LiteralStringRef("keyPrefix"), LiteralStringRef(""));
 		minExpectedTransactionsPerSecond = transactionsPerSecond * getOption(options, LiteralStringRef("expectedRate"), 0.7);
+		useCachedReadVersion = getOption(options, LiteralStringRef("useCachedReadVersion"), false);
 	}
 
 	virtual std::string description() { return "CycleWorkload"; }
@@ -100,6 +102,8 @@ struct CycleWorkload : TestWorkload {
 				state Transaction tr(cx);
 				while (true) {
 					try {
+						if (self->useCachedReadVersion)
+							tr.setOption( FDBTransactionOptions::USE_CACHED_READ_VERSION );
 						// Reverse next and next^2 node
 						Optional<Value> v = wait( tr.get( self->key(r) ) );
 						if (!v.present()) self->badRead("r", r, tr);
@@ -0,0 +1,144 @@
+/*
+ * RangeAggregate.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/actorcompiler.h"
+#include "fdbclient/NativeAPI.h"
+#include "fdbserver/TesterInterface.h"
+#include "workloads.h"
+#include "BulkSetup.actor.h"
+
+// Checks getRangeAggregate() against aggregating the rows returned by getRange() at the same read version, while other
+// clients set and clear keys so that the aggregates include rows that are not yet durable on the storage servers.
+struct RangeAggregateWorkload : KVWorkload {
+	double testDuration;
+	int64_t rangesChecked, rowsChecked;
+	bool verified;
+
+	RangeAggregateWorkload(WorkloadContext const& wcx)
+		: KVWorkload(wcx), rangesChecked(0), rowsChecked(0), verified(true)
+	{
+		testDuration = getOption( options, LiteralStringRef("testDuration"), 10.0 );
+	}
+
+	virtual std::string description() { return "RangeAggregate"; }
+
+	Standalone<KeyValueRef> operator()( uint64_t n ) {
+		return KeyValueRef( keyForIndex( n, false ), randomValue() );
+	}
+
+	Value randomValue() {
+		return Value( std::string( g_random->randomInt( minValueBytes, maxValueBytes+1 ), 'v' ) );
+	}
+
+	virtual Future<Void> setup( Database const& cx ) {
+		return bulkSetup( cx, this, nodeCount, Promise<double>() );
+	}
+
+	virtual Future<Void> start( Database const& cx ) {
+		return _start( cx, this );
+	}
+
+	KeyRange randomRange() {
+		int64_t a = g_random->randomInt64( 0, nodeCount+1 ), b = g_random->randomInt64( 0, nodeCount+1 );
+		if( g_random->random01() < 0.1 )
+			b = a+1;
+		if( a > b ) std::swap( a, b );
+		return KeyRangeRef( keyForIndex( a, false ), b < nodeCount ? keyForIndex( b, false ) : normalKeys.end );
+	}
+
+	ACTOR static Future<Void> writer( Database cx, RangeAggregateWorkload* self, double endTime ) {
+		loop {
+			state Transaction tr( cx );
+			if( now() >= endTime )
+				return Void();
+			try {
+				for( int i = 0; i < 10; i++ ) {
+					int64_t n = g_random->randomInt64( 0, self->nodeCount );
+					Key key = self->keyForIndex( n, false );
+					if( g_random->coinflip() )
+						tr.set( key, self->randomValue() );
+					else if( g_random->random01() < 0.9 )
+						tr.clear( key );
+					else
+						tr.clear( KeyRangeRef( key, self->keyForIndex( n + g_random->randomInt( 1, 10 ), false ) ) );
+				}
+				Void _ = wait( tr.commit() );
+			} catch( Error &e ) {
+				Void _ = wait( tr.onError(e) );
+			}
+		}
+	}
+
+	ACTOR static Future<Void> checker( Database cx, RangeAggregateWorkload* self, double endTime ) {
+		loop {
+			state Transaction tr( cx );
+			state KeyRange keys = self->randomRange();
+			if( now() >= endTime )
+				return Void();
+			try {
+				state Future<RangeAggregate> aggregate = tr.getRangeAggregate( keys );
+				state Standalone<RangeResultRef> rows = wait( tr.getRange( keys, CLIENT_KNOBS->TOO_MANY ) );
+				RangeAggregate found = wait( aggregate );
+				ASSERT( !rows.more );
+
+				RangeAggregate expected;
+				expected.add( rows );
+				if( found.rows != expected.rows || found.keyBytes != expected.keyBytes || found.valueBytes != expected.valueBytes ||
+					found.firstKey != expected.firstKey || found.lastKey != expected.lastKey )
+				{
+					TraceEvent(SevError, "RangeAggregateMismatch").detail("Begin", printable(keys.begin)).detail("End", printable(keys.end))
+						.detail("Version", tr.getReadVersion().get())
+						.detail("Rows", found.rows).detail("ExpectedRows", expected.rows)
+						.detail("KeyBytes", found.keyBytes).detail("ExpectedKeyBytes", expected.keyBytes)
+						.detail("ValueBytes", found.valueBytes).detail("ExpectedValueBytes", expected.valueBytes)
+						.detail("FirstKey", printable(found.firstKey)).detail("ExpectedFirstKey", printable(expected.firstKey))
+						.detail("LastKey", printable(found.lastKey)).detail("ExpectedLastKey", printable(expected.lastKey));
+					self->verified = false;
+				}
+				++self->rangesChecked;
+				self->rowsChecked += expected.rows;
+			} catch( Error &e ) {
+				Void _ = wait( tr.onError(e) );
+			}
+		}
+	}
+
+	ACTOR static Future<Void> _start( Database cx, RangeAggregateWorkload* self ) {
+		state double endTime = now() + self->testDuration;
+		state vector<Future<Void>> clients;
+		for( int c = 0; c < self->actorCount; c++ ) {
+			clients.push_back( writer( cx, self, endTime ) );
+			clients.push_back( checker( cx, self, endTime ) );
+		}
+		Void _ = wait( waitForAll( clients ) );
+		return Void();
+	}
+
+	virtual Future<bool> check( Database const& cx ) {
+		return verified;
+	}
+
+	virtual void getMetrics( vector<PerfMetric>& m ) {
+		m.push_back( PerfMetric( "Ranges Checked", rangesChecked, false ) );
+		m.push_back( PerfMetric( "Rows Checked", rowsChecked, false ) );
+	}
+};
+
+WorkloadFactory<RangeAggregateWorkload> RangeAggregateWorkloadFactory("RangeAggregate");
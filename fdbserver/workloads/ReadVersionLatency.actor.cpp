@@ -0,0 +1,130 @@
+/*
+ * ReadVersionLatency.actor.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flow/actorcompiler.h"
+#include "fdbrpc/ContinuousSample.h"
+#include "fdbclient/NativeAPI.h"
+#include "fdbclient/ManagementAPI.h"
+#include "fdbserver/TesterInterface.h"
+#include "workloads.h"
+
+// Measures GRV latency and throughput, optionally once for each of several proxy counts (proxyCounts=1,2,4,8,16).
+// Client 0 reconfigures the database and generates all of the load, so the phases don't need to be coordinated.
+struct ReadVersionLatencyWorkload : TestWorkload {
+	double phaseDuration;
+	int actorsPerClient;
+	vector<int> proxyCounts;
+
+	struct Phase {
+		int proxies;
+		int64_t requests;
+		ContinuousSample<double> latencies;
+		Phase( int proxies ) : proxies(proxies), requests(0), latencies(10000) {}
+	};
+	vector<Phase> phases;
+
+	ReadVersionLatencyWorkload(WorkloadContext const& wcx)
+		: TestWorkload(wcx)
+	{
+		phaseDuration = getOption( options, LiteralStringRef("phaseDuration"), 10.0 );
+		actorsPerClient = getOption( options, LiteralStringRef("actorsPerClient"), 64 );
+		for( auto& p : getOption( options, LiteralStringRef("proxyCounts"), vector<std::string>() ) )
+			proxyCounts.push_back( atoi( p.c_str() ) );
+	}
+
+	virtual std::string description() { return "ReadVersionLatency"; }
+
+	virtual Future<Void> setup( Database const& cx ) {
+		return Void();
+	}
+
+	virtual Future<Void> start( Database const& cx ) {
+		if( clientId == 0 )
+			return _start( cx, this );
+		return Void();
+	}
+
+	ACTOR static Future<Void> getReadVersions( Database cx, Phase* phase, double endTime ) {
+		loop {
+			state Transaction tr( cx );
+			state double start = now();
+			if( start >= endTime )
+				return Void();
+			try {
+				Version _ = wait( tr.getReadVersion() );
+				phase->latencies.addSample( now() - start );
+				++phase->requests;
+			} catch( Error &e ) {
+				Void _ = wait( tr.onError(e) );
+			}
+		}
+	}
+
+	ACTOR static Future<Void> setProxyCount( Database cx, int proxies ) {
+		ConfigurationResult::Type _ = wait( changeConfig( cx, format("proxies=%d", proxies) ) );
+		loop {
+			Reference<ProxyInfo> current = cx->getMasterProxies();
+			if( current && current->size() == proxies )
+				break;
+			Void _ = wait( cx->onMasterProxiesChanged() );
+		}
+		// Let the new proxies finish recovery before measuring them
+		Void _ = wait( delay( 1.0 ) );
+		return Void();
+	}
+
+	ACTOR static Future<Void> _start( Database cx, ReadVersionLatencyWorkload* self ) {
+		state int i = 0;
+		if( self->proxyCounts.empty() )
+			self->proxyCounts.push_back( 0 );
+		self->phases.reserve( self->proxyCounts.size() );
+		for(; i < self->proxyCounts.size(); i++) {
+			if( self->proxyCounts[i] > 0 )
+				Void _ = wait( setProxyCount( cx, self->proxyCounts[i] ) );
+			self->phases.push_back( Phase( self->proxyCounts[i] ) );
+
+			state double endTime = now() + self->phaseDuration;
+			state vector<Future<Void>> clients;
+			for( int c = 0; c < self->actorsPerClient; c++ )
+				clients.push_back( getReadVersions( cx, &self->phases.back(), endTime ) );
+			Void _ = wait( waitForAll( clients ) );
+			TraceEvent("ReadVersionLatencyPhase").detail("Proxies", self->proxyCounts[i]).detail("Requests", self->phases.back().requests)
+				.detail("Median", self->phases.back().latencies.median()).detail("P99", self->phases.back().latencies.percentile(0.99));
+		}
+		return Void();
+	}
+
+	virtual Future<bool> check( Database const& cx ) {
+		return true;
+	}
+
+	virtual void getMetrics( vector<PerfMetric>& m ) {
+		for( auto& p : phases ) {
+			std::string prefix = p.proxies ? format("%d proxies ", p.proxies) : std::string();
+			m.push_back( PerfMetric( prefix + "GRV/sec", p.requests / phaseDuration, false ) );
+			m.push_back( PerfMetric( prefix + "Mean Latency (ms)", 1000 * p.latencies.mean(), true ) );
+			m.push_back( PerfMetric( prefix + "Median Latency (ms)", 1000 * p.latencies.median(), true ) );
+			m.push_back( PerfMetric( prefix + "99% Latency (ms)", 1000 * p.latencies.percentile(0.99), true ) );
+			m.push_back( PerfMetric( prefix + "Max Latency (ms)", 1000 * p.latencies.max(), true ) );
+		}
+	}
+};
+
+WorkloadFactory<ReadVersionLatencyWorkload> ReadVersionLatencyWorkloadFactory("ReadVersionLatency");
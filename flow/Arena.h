@@ -390,6 +390,10 @@ private:
 
 extern std::string format(const char* form, ...);
 
+// Byte string comparison kernels, defined in StringCompare.cpp (see StringCompare.h)
+int compareBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen );
+bool lessBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen );
+
 #pragma pack( push, 4 )
 class StringRef {
 public:
@@ -475,9 +479,7 @@ public:
 	int expectedSize() const { return size(); }
 
 	int compare( StringRef const& other ) const {
-		int c = memcmp( begin(), other.begin(), std::min( size(), other.size() ) );
-		if (c!=0) return c;
-		return size() - other.size();
+		return compareBytes( begin(), size(), other.begin(), other.size() );
 	}
 
 	// Removes bytes from begin up to and including the sep string, returns StringRef of the part before sep
@@ -546,19 +548,31 @@ inline bool operator == (const StringRef& lhs, const StringRef& rhs ) {
 	return lhs.size() == rhs.size() && !memcmp(lhs.begin(), rhs.begin(), lhs.size());
 }
 inline bool operator < ( const StringRef& lhs, const StringRef& rhs ) {
-	int c = memcmp( lhs.begin(), rhs.begin(), std::min(lhs.size(), rhs.size()) );
-	if (c!=0) return c<0;
-	return lhs.size() < rhs.size();
+	return lessBytes( lhs.begin(), lhs.size(), rhs.begin(), rhs.size() );
 }
 inline bool operator > ( const StringRef& lhs, const StringRef& rhs ) {
-	int c = memcmp( lhs.begin(), rhs.begin(), std::min(lhs.size(), rhs.size()) );
-	if (c!=0) return c>0;
-	return lhs.size() > rhs.size();
+	return lessBytes( rhs.begin(), rhs.size(), lhs.begin(), lhs.size() );
 }
 inline bool operator != (const StringRef& lhs, const StringRef& rhs ) { return !(lhs==rhs); }
 inline bool operator <= ( const StringRef& lhs, const StringRef& rhs ) { return !(lhs>rhs); }
 inline bool operator >= ( const StringRef& lhs, const StringRef& rhs ) { return !(lhs<rhs); }
 
+// Three way comparison returning <0, 0 or >0, for StringRef and the types (Key, Standalone<StringRef>, ...)
+// that convert to it.
+template <class A, class B>
+inline typename std::enable_if<std::is_convertible<A, StringRef>::value && std::is_convertible<B, StringRef>::value, int>::type
+compare( A const& lhs, B const& rhs ) { return StringRef(lhs).compare(rhs); }
+
+// The search paths of the ordered containers use this so that arriving at an equal element costs one comparison
+// rather than a < in each direction.  It calls a compare() found for the element types if there is one, and
+// otherwise falls back to <.
+template <class A, class B>
+inline auto threeWayCompareImpl( A const& lhs, B const& rhs, int ) -> decltype( compare(lhs, rhs) ) { return compare(lhs, rhs); }
+template <class A, class B>
+inline int threeWayCompareImpl( A const& lhs, B const& rhs, long ) { return lhs < rhs ? -1 : rhs < lhs ? 1 : 0; }
+template <class A, class B>
+inline int threeWayCompare( A const& lhs, B const& rhs ) { return threeWayCompareImpl(lhs, rhs, 0); }
+
 // This trait is used by VectorRef to determine if it should just memcpy the vector contents.
 // FIXME:  VectorRef really should use std::is_trivially_copyable for this BUT that is not implemented
 // in gcc c++0x so instead we will use this custom trait which defaults to std::is_trivial, which
@@ -26,6 +26,7 @@
 #include "FastAlloc.h"
 #include "Trace.h"
 #include "Error.h"
+#include "Arena.h"
 
 #include <deque>
 #include <vector>
@@ -262,6 +263,15 @@ bool operator<(MapPair<Key, Value> const& l, CompatibleWithKey const& r) { retur
 template <class Key, class Value, class CompatibleWithKey>
 bool operator<(CompatibleWithKey const& l, MapPair<Key, Value> const& r) { return l < r.key; }
 
+template <class Key, class Value>
+int compare(MapPair<Key, Value> const& l, MapPair<Key, Value> const& r) { return threeWayCompare(l.key, r.key); }
+
+template <class Key, class Value, class CompatibleWithKey>
+int compare(MapPair<Key, Value> const& l, CompatibleWithKey const& r) { return threeWayCompare(l.key, r); }
+
+template <class Key, class Value, class CompatibleWithKey>
+int compare(CompatibleWithKey const& l, MapPair<Key, Value> const& r) { return threeWayCompare(l, r.key); }
+
 template <class Key, class Value, class Pair = MapPair<Key,Value>, class Metric=NoMetric >
 class Map {
 public:
@@ -607,8 +617,9 @@ typename IndexedSet<T,Metric>::iterator IndexedSet<T,Metric>::insert(T_&& data,
 	int d; // direction
 	// traverse to find insert point
 	while (true){
-		d = t->data < data;
-		if (!d && !(data < t->data)) {	// t->data == data
+		int c = threeWayCompare(t->data, data);
+		d = c < 0;
+		if (c == 0) {	// t->data == data
 			Node *returnNode = t;
 			if(replaceExisting) {
 				t->data = std::forward<T_>(data);
@@ -693,10 +704,11 @@ int IndexedSet<T,Metric>::insert(const std::vector<std::pair<T,Metric>>& dataVec
 			// traverse to find insert point
 			bool foundNode = false;
 			while (true){
-				d = t->data < data;
+				int c = threeWayCompare(t->data, data);
+				d = c < 0;
 				if (!d)
 					blockEnd = t;
-				if (!d && !(data < t->data)) {	// t->data == data
+				if (c == 0) {	// t->data == data
 					Node *returnNode = t;
 					if(replaceExisting) {
 						num_inserted++;
@@ -988,10 +1000,10 @@ template <class Key>
 typename IndexedSet<T,Metric>::iterator IndexedSet<T,Metric>::find(const Key &key) const {
 	Node* t = root;
 	while (t){
-		int d = t->data < key;
-		if (!d && !(key < t->data)) // t->data == key
+		int c = threeWayCompare(t->data, key);
+		if (c == 0) // t->data == key
 			return iterator(t);
-		t = t->child[d];
+		t = t->child[c < 0];
 	}
 	return end();
 }
@@ -68,11 +68,18 @@ FlowKnobs::FlowKnobs(bool randomize, bool isSimulated) {
 	init( BUGGIFY_SIM_PAGE_CACHE_4K,                           1e6 );
 	init( BUGGIFY_SIM_PAGE_CACHE_64K,                          1e6 );
 	init( MAX_EVICT_ATTEMPTS,                                  100 ); if( randomize && BUGGIFY ) MAX_EVICT_ATTEMPTS = 2;
+	init( CACHE_EVICTION_POLICY,                          "random" ); if( randomize && BUGGIFY ) CACHE_EVICTION_POLICY = "2q";
+	init( CACHE_2Q_IN_FRACTION,                               0.25 ); // Share of the cache for pages read once, which are evicted first
+	init( CACHE_2Q_OUT_FRACTION,                               0.5 ); // Pages evicted from that share are remembered, in proportion to the cache size, so that rereading them promotes them
 
 	//AsyncFileKAIO
 	init( MAX_OUTSTANDING,                                      64 );
 	init( MIN_SUBMIT,                                           10 );
 
+	//AsyncFileIOUring
+	init( IO_URING_ENABLED,                                      0 ); // Use io_uring instead of KAIO for unbuffered files, if the kernel supports it
+	init( IO_URING_QUEUE_DEPTH,                                128 );
+
 	init( PAGE_WRITE_CHECKSUM_HISTORY,                           0 ); if( randomize && BUGGIFY ) PAGE_WRITE_CHECKSUM_HISTORY = 10000000;
 
 	//AsyncFileNonDurable
@@ -89,6 +96,12 @@ FlowKnobs::FlowKnobs(bool randomize, bool isSimulated) {
 	//Net2 and FlowTransport
 	init( MIN_COALESCE_DELAY,                                10e-6 ); if( randomize && BUGGIFY ) MIN_COALESCE_DELAY = 0;
 	init( MAX_COALESCE_DELAY,                                20e-6 ); if( randomize && BUGGIFY ) MAX_COALESCE_DELAY = 0;
+	init( COALESCE_ADAPTIVE,                                     1 ); if( randomize && BUGGIFY ) COALESCE_ADAPTIVE = 0;
+	init( MAX_ADAPTIVE_COALESCE_DELAY,                      500e-6 ); if( randomize && BUGGIFY ) MAX_ADAPTIVE_COALESCE_DELAY = 5e-3;
+	init( COALESCE_RTT_FRACTION,                              0.05 );
+	init( COALESCE_TARGET_PACKETS,                               8 );
+	init( COALESCE_MAX_BYTES,                              64<<10 ); if( randomize && BUGGIFY ) COALESCE_MAX_BYTES = g_random->randomInt(100, 10000);
+	init( COALESCE_RATE_FOLDING_TIME,                         0.01 );
 	init( SLOW_LOOP_CUTOFF,                          15.0 / 1000.0 );
 	init( SLOW_LOOP_SAMPLING_RATE,                             0.1 );
 	init( TSC_YIELD_TIME,                                  1000000 );
@@ -96,7 +109,15 @@ FlowKnobs::FlowKnobs(bool randomize, bool isSimulated) {
 	//Network
 	init( PACKET_LIMIT,                                  100LL<<20 );
 	init( PACKET_WARNING,                                  2LL<<20 );  // 2MB packet warning quietly allows for 1MB system messages
+	init( MIN_PACKET_BUFFER_BYTES,                         64<<10 ); if( randomize && BUGGIFY ) MIN_PACKET_BUFFER_BYTES = 4096;
+	init( MIN_PACKET_BUFFER_FREE_BYTES,                       4096 ); if( randomize && BUGGIFY ) MIN_PACKET_BUFFER_FREE_BYTES = 1;
+	init( MAX_PACKET_BUFFER_PRESIZE_BYTES,                 1<<20 ); if( randomize && BUGGIFY ) MAX_PACKET_BUFFER_PRESIZE_BYTES = 4096;
 	init( TIME_OFFSET_LOGGING_INTERVAL,                       60.0 );
+	init( PACKET_COMPRESSION_ENABLED,                            0 ); if( randomize && BUGGIFY ) PACKET_COMPRESSION_ENABLED = 1;
+	init( PACKET_COMPRESSION_MIN_BYTES,                    32<<10 ); if( randomize && BUGGIFY ) PACKET_COMPRESSION_MIN_BYTES = g_random->randomInt(20, 2000);
+	init( PACKET_COMPRESSION_MAX_BYTES,                     1<<20 ); if( randomize && BUGGIFY ) PACKET_COMPRESSION_MAX_BYTES = 64<<10;
+	init( PACKET_COMPRESSION_LEVEL,                              1 ); if( randomize && BUGGIFY ) PACKET_COMPRESSION_LEVEL = g_random->randomInt(1, 10);
+	init( PACKET_COMPRESSION_MIN_SAVINGS,                    0.125 ); if( randomize && BUGGIFY ) PACKET_COMPRESSION_MIN_SAVINGS = 0;
 
 	//Sim2
 	init( MIN_OPEN_TIME,                                    0.0002 );
@@ -139,6 +160,10 @@ FlowKnobs::FlowKnobs(bool randomize, bool isSimulated) {
 	init( SECOND_REQUEST_MULTIPLIER_DECAY,                 0.00025 );
 	init( SECOND_REQUEST_BUDGET_GROWTH,                       0.05 );
 	init( SECOND_REQUEST_MAX_BUDGET,                         100.0 );
+	init( HEDGE_LATENCY_PERCENTILE,                           0.95 ); if( randomize && BUGGIFY ) HEDGE_LATENCY_PERCENTILE = g_random->coinflip() ? 0.0 : 0.5;
+	init( HEDGE_MIN_LATENCY_SAMPLES,                            20 );
+	init( HEDGE_MAX_LATENCY_SAMPLES,                          1000 ); if( randomize && BUGGIFY ) HEDGE_MAX_LATENCY_SAMPLES = 50;
+	init( LOAD_BALANCE_DISTANT_LOAD_MARGIN,                   10.0 ); if( randomize && BUGGIFY ) LOAD_BALANCE_DISTANT_LOAD_MARGIN = g_random->coinflip() ? 0.5 : 1e9;
 	init( ALTERNATIVES_FAILURE_RESET_TIME,                     5.0 );
 	init( ALTERNATIVES_FAILURE_MAX_DELAY,                      1.0 );
 	init( ALTERNATIVES_FAILURE_MIN_DELAY,                     0.05 );
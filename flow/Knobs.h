@@ -88,11 +88,18 @@ public:
 	int64_t BUGGIFY_SIM_PAGE_CACHE_4K;
 	int64_t BUGGIFY_SIM_PAGE_CACHE_64K;
 	int MAX_EVICT_ATTEMPTS;
+	std::string CACHE_EVICTION_POLICY; // "random", "2q"
+	double CACHE_2Q_IN_FRACTION;
+	double CACHE_2Q_OUT_FRACTION;
 
 	//AsyncFileKAIO
 	int MAX_OUTSTANDING;
 	int MIN_SUBMIT;
 
+	//AsyncFileIOUring
+	int IO_URING_ENABLED;
+	int IO_URING_QUEUE_DEPTH;
+
 	int PAGE_WRITE_CHECKSUM_HISTORY;
 
 	//AsyncFileNonDurable
@@ -109,6 +116,12 @@ public:
 	//Net2
 	double MIN_COALESCE_DELAY;
 	double MAX_COALESCE_DELAY;
+	int COALESCE_ADAPTIVE;
+	double MAX_ADAPTIVE_COALESCE_DELAY;
+	double COALESCE_RTT_FRACTION;
+	int COALESCE_TARGET_PACKETS;
+	int COALESCE_MAX_BYTES;
+	double COALESCE_RATE_FOLDING_TIME;
 	double SLOW_LOOP_CUTOFF;
 	double SLOW_LOOP_SAMPLING_RATE;
 	int64_t TSC_YIELD_TIME;
@@ -117,7 +130,15 @@ public:
 	//Network
 	int64_t PACKET_LIMIT;
 	int64_t PACKET_WARNING;  // 2MB packet warning quietly allows for 1MB system messages
+	int MIN_PACKET_BUFFER_BYTES;
+	int MIN_PACKET_BUFFER_FREE_BYTES;  // connectionReader starts a new buffer when there is less space than this for the next read
+	int MAX_PACKET_BUFFER_PRESIZE_BYTES;  // The most connectionReader allocates on the strength of a packet's advertised length before its bytes arrive
 	double TIME_OFFSET_LOGGING_INTERVAL;
+	int PACKET_COMPRESSION_ENABLED;
+	int PACKET_COMPRESSION_MIN_BYTES;
+	int PACKET_COMPRESSION_MAX_BYTES;  // Larger packets are sent uncompressed, which bounds the time the network thread spends on one
+	int PACKET_COMPRESSION_LEVEL;
+	double PACKET_COMPRESSION_MIN_SAVINGS;  // Send compressed only if that saves at least this fraction of the packet
 
 	//Sim2
 	//FIMXE: more parameters could be factored out
@@ -161,6 +182,10 @@ public:
 	double SECOND_REQUEST_MULTIPLIER_DECAY;
 	double SECOND_REQUEST_BUDGET_GROWTH;
 	double SECOND_REQUEST_MAX_BUDGET;
+	double HEDGE_LATENCY_PERCENTILE;  // 0 disables percentile based hedging
+	int HEDGE_MIN_LATENCY_SAMPLES;
+	int HEDGE_MAX_LATENCY_SAMPLES;
+	double LOAD_BALANCE_DISTANT_LOAD_MARGIN;  // How much less loaded a more distant alternative must be to be used instead of the closest ones
 	double ALTERNATIVES_FAILURE_RESET_TIME;
 	double ALTERNATIVES_FAILURE_MAX_DELAY;
 	double ALTERNATIVES_FAILURE_MIN_DELAY;
@@ -33,6 +33,7 @@
 
 #include "ActorCollection.h"
 #include "ThreadSafeQueue.h"
+#include "TaskQueue.h"
 #include "ThreadHelper.actor.h"
 #include "TDMetric.actor.h"
 #include "AsioReactor.h"
@@ -51,7 +52,7 @@ using namespace boost::asio::ip;
 // These impact both communications and the deserialization of certain database and IKeyValueStore keys
 //                                                 xyzdev
 //                                                 vvvv
-uint64_t currentProtocolVersion        = 0x0FDB00A560010001LL;
+uint64_t currentProtocolVersion        = 0x0FDB00A560020001LL;
 uint64_t compatibleProtocolVersionMask = 0xffffffffffff0000LL;
 uint64_t minValidProtocolVersion       = 0x0FDB00A200060001LL;
 
@@ -105,11 +106,9 @@ public:
 };
 
 struct OrderedTask {
-	int64_t priority;
 	int taskID;
 	Task *task;
-	OrderedTask(int64_t priority, int taskID, Task* task) : priority(priority), taskID(taskID), task(task) {}
-	bool operator < (OrderedTask const& rhs) const { return priority < rhs.priority; }
+	OrderedTask(int taskID, Task* task) : taskID(taskID), task(task) {}
 };
 
 thread_local INetwork* thread_network = 0;
@@ -163,7 +162,6 @@ public:
 	int64_t tsc_begin, tsc_end;
 	double taskBegin;
 	int currentTaskID;
-	uint64_t tasksIssued;
 	TDMetricCollection tdmetrics;
 	double currentTime;
 	bool stopped;
@@ -175,22 +173,16 @@ public:
 	int lastMinTaskID;
 	double priorityTimer[NetworkMetrics::PRIORITY_BINS];
 
-	std::priority_queue<OrderedTask, std::vector<OrderedTask>> ready;
+	ReadyQueue<Task*> ready;
 	ThreadSafeQueue<OrderedTask> threadReady;
-
-	struct DelayedTask : OrderedTask {
-		double at;
-		DelayedTask(double at, int64_t priority, int taskID, Task* task) : at(at), OrderedTask(priority, taskID, task) {}
-		bool operator < (DelayedTask const& rhs) const { return at > rhs.at; } // Ordering is reversed for priority_queue
-	};
-	std::priority_queue<DelayedTask, std::vector<DelayedTask>> timers;
+	TimerWheel<Task*> timers;
 
 	void checkForSlowTask(int64_t tscBegin, int64_t tscEnd, double duration, int64_t priority);
 	bool check_yield(int taskId, bool isRunLoop);
 	void processThreadReady();
 	void trackMinPriority( int minTaskID, double now );
 	void stopImmediately() {
-		stopped=true; decltype(ready) _1; ready.swap(_1); decltype(timers) _2; timers.swap(_2);
+		stopped=true; ready.clear(); timers.clear();
 	}
 
 	Future<Void> timeOffsetLogger;
@@ -480,7 +472,7 @@ Net2::Net2(NetworkAddress localAddress, bool useThreadPool, bool useMetrics)
 	  reactor(this),
 	  tcpResolver(reactor.ios),
 	  stopped(false),
-	  tasksIssued(0),
+	  timers(timer_monotonic()),
 	  // Until run() is called, yield() will always yield
 	  tsc_begin(0), tsc_end(0), taskBegin(0), currentTaskID(TaskDefaultYield),
 	  lastMinTaskID(0),
@@ -585,7 +577,7 @@ void Net2::run() {
 		if (b) {
 			sleepTime = 1e99;
 			if (!timers.empty())
-				sleepTime = timers.top().at - timer_monotonic();  // + 500e-6?
+				sleepTime = timers.nextDeadline() - timer_monotonic();  // + 500e-6?
 		}
 
 		awakeMetric = false;
@@ -601,11 +593,10 @@ void Net2::run() {
 			TraceEvent("SomewhatSlowRunLoopTop").detail("Elapsed", now - nnow);
 
 		if (sleepTime) trackMinPriority( 0, now );
-		while (!timers.empty() && timers.top().at < now) {
+		timers.expire( now, [this](int taskID, Task* task) {
 			++countTimers;
-			ready.push( timers.top() );
-			timers.pop();
-		}
+			ready.push( taskID, task );
+		} );
 
 		processThreadReady();
 
@@ -617,10 +608,10 @@ void Net2::run() {
 
 		while (!ready.empty()) {
 			++countTasks;
-			currentTaskID = ready.top().taskID;
+			currentTaskID = ready.topTaskID();
 			priorityMetric = currentTaskID;
 			minTaskID = std::min(minTaskID, currentTaskID);
-			Task* task = ready.top().task;
+			Task* task = ready.top();
 			ready.pop();
 
 			try {
@@ -710,9 +701,8 @@ void Net2::processThreadReady() {
 	while (true) {
 		Optional<OrderedTask> t = threadReady.pop();
 		if (!t.present()) break;
-		t.get().priority -= ++tasksIssued;
 		ASSERT( t.get().task != 0 );
-		ready.push( t.get() );
+		ready.push( t.get().taskID, t.get().task );
 	}
 }
 
@@ -755,7 +745,7 @@ bool Net2::check_yield( int taskID, bool isRunLoop ) {
 	processThreadReady();
 
 	if (taskID == TaskDefaultYield) taskID = currentTaskID;
-	if (!ready.empty() && ready.top().priority > (int64_t(taskID)<<32))  {
+	if (!ready.empty() && ready.topTaskID() > taskID)  {
 		return true;
 	}
 
@@ -798,7 +788,7 @@ Future<class Void> Net2::yield( int taskID ) {
 Future<Void> Net2::delay( double seconds, int taskId ) {
 	if (seconds <= 0.) {
 		PromiseTask* t = new PromiseTask;
-		this->ready.push( OrderedTask( (int64_t(taskId)<<32)-(++tasksIssued), taskId, t) );
+		this->ready.push( taskId, t );
 		return t->promise.getFuture();
 	}
 	if (seconds >= 4e12)  // Intervals that overflow an int64_t in microseconds (more than 100,000 years) are treated as infinite
@@ -806,20 +796,19 @@ Future<Void> Net2::delay( double seconds, int taskId ) {
 
 	double at = now() + seconds;
 	PromiseTask* t = new PromiseTask;
-	this->timers.push( DelayedTask( at, (int64_t(taskId)<<32)-(++tasksIssued), taskId, t ) );
+	this->timers.add( at, taskId, t );
 	return t->promise.getFuture();
 }
 
 void Net2::onMainThread(Promise<Void>&& signal, int taskID) {
 	if (stopped) return;
 	PromiseTask* p = new PromiseTask( std::move(signal) );
-	int64_t priority = int64_t(taskID)<<32;
 
 	if ( thread_network == this )
 	{
-		this->ready.push( OrderedTask( priority-(++tasksIssued), taskID, p ) );
+		this->ready.push( taskID, p );
 	} else {
-		if (threadReady.push( OrderedTask( priority, taskID, p ) ))
+		if (threadReady.push( OrderedTask( taskID, p ) ))
 			reactor.wake();
 	}
 }
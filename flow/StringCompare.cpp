@@ -0,0 +1,340 @@
+/*
+ * StringCompare.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StringCompare.h"
+#include "Arena.h"
+#include "IRandom.h"
+#include "UnitTest.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#ifdef _WIN32
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// The word at a time fallback
+static int commonPrefixLengthScalar( const uint8_t* a, const uint8_t* b, int length ) {
+	int i = 0;
+	for(; i + 8 <= length; i += 8) {
+		uint64_t x, y;
+		memcpy( &x, a+i, 8 );
+		memcpy( &y, b+i, 8 );
+		if (x != y) return i + (lowestSetBit64( x^y ) >> 3);
+	}
+	if (i < length) {
+		// Re-examine the last 8 bytes rather than finishing byte by byte; the overlap is already known to match
+		uint64_t x, y;
+		memcpy( &x, a+length-8, 8 );
+		memcpy( &y, b+length-8, 8 );
+		if (x != y) return length - 8 + (lowestSetBit64( x^y ) >> 3);
+	}
+	return length;
+}
+
+// Bit i is set if a[i] != b[i], for the 16 or 32 bytes at a and b
+static inline uint32_t differenceMask16( const uint8_t* a, const uint8_t* b ) {
+	__m128i x = _mm_loadu_si128( (const __m128i*)a );
+	__m128i y = _mm_loadu_si128( (const __m128i*)b );
+	return ~(uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( x, y ) ) & 0xffff;
+}
+
+TARGET_AVX2 static inline uint32_t differenceMask32( const uint8_t* a, const uint8_t* b ) {
+	__m256i x = _mm256_loadu_si256( (const __m256i*)a );
+	__m256i y = _mm256_loadu_si256( (const __m256i*)b );
+	return ~(uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( x, y ) );
+}
+
+// pcmpestri would do this in one instruction, but it is slower than a byte compare and movemask on every CPU we run on.
+// The last two blocks are combined into one mask so that the final comparison takes a single branch.
+static int commonPrefixLengthSSE( const uint8_t* a, const uint8_t* b, int length ) {
+	int i = 0;
+	for(; length - i > 32; i += 16) {
+		uint32_t ne = differenceMask16( a+i, b+i );
+		if (ne) return i + lowestSetBit( ne );
+	}
+	int tail = length - i - 16;
+	uint32_t ne = differenceMask16( a+i, b+i ) | (differenceMask16( a+length-16, b+length-16 ) << tail);
+	return ne ? i + lowestSetBit( ne ) : length;
+}
+
+TARGET_AVX2 static int commonPrefixLengthAVX2( const uint8_t* a, const uint8_t* b, int length ) {
+	int i = 0;
+	for(; length - i > 64; i += 32) {
+		uint32_t ne = differenceMask32( a+i, b+i );
+		if (ne) return i + lowestSetBit( ne );
+	}
+	int tail = length - i - 32;
+	uint64_t ne = differenceMask32( a+i, b+i ) | ((uint64_t)differenceMask32( a+length-32, b+length-32 ) << tail);
+	return ne ? i + lowestSetBit64( ne ) : length;
+}
+
+static bool isAvx2Supported() {
+	uint32_t eax, ebx, ecx, edx;
+#ifdef _WIN32
+	int info[4];
+	__cpuid( info, 0 );
+	if (info[0] < 7) return false;
+	__cpuid( info, 1 );
+	ecx = info[2];
+#else
+	if (__get_cpuid_max( 0, NULL ) < 7) return false;
+	__cpuid_count( 1, 0, eax, ebx, ecx, edx );
+#endif
+	// The OS must have enabled saving of the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+	if (!(ecx & (1<<27)) || !(ecx & (1<<28))) return false;
+#ifdef _WIN32
+	uint64_t xcr0 = _xgetbv( 0 );
+#else
+	uint32_t xlo, xhi;
+	__asm__ volatile ( "xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0) );
+	uint64_t xcr0 = ((uint64_t)xhi << 32) | xlo;
+#endif
+	if ((xcr0 & 6) != 6) return false;
+#ifdef _WIN32
+	__cpuidex( info, 7, 0 );
+	ebx = info[1];
+#else
+	__cpuid_count( 7, 0, eax, ebx, ecx, edx );
+#endif
+	return (ebx & (1<<5)) != 0;
+}
+
+typedef int (*CommonPrefixLengthFn)( const uint8_t* a, const uint8_t* b, int length );
+
+struct StringCompareDispatch {
+	StringCompareImpl impl;
+	CommonPrefixLengthFn commonPrefixLengthLong;
+};
+
+static bool selectImpl( StringCompareDispatch& d, StringCompareImpl impl ) {
+	if (impl == StringCompareImpl::Auto)
+		impl = isAvx2Supported() ? StringCompareImpl::AVX2 : StringCompareImpl::SSE;
+	switch (impl) {
+		case StringCompareImpl::Scalar: d.commonPrefixLengthLong = commonPrefixLengthScalar; break;
+		case StringCompareImpl::SSE: d.commonPrefixLengthLong = commonPrefixLengthSSE; break;
+		case StringCompareImpl::AVX2:
+			if (!isAvx2Supported()) return false;
+			d.commonPrefixLengthLong = commonPrefixLengthAVX2;
+			break;
+		default: return false;
+	}
+	d.impl = impl;
+	return true;
+}
+
+// A function local static, so that the CPU is probed exactly once (thread safely) and comparisons made by
+// other static initializers still see a usable implementation
+static StringCompareDispatch& dispatch() {
+	static StringCompareDispatch d = [](){
+		StringCompareDispatch d;
+		selectImpl( d, StringCompareImpl::Auto );
+		return d;
+	}();
+	return d;
+}
+
+bool setStringCompareImpl( StringCompareImpl impl ) {
+	return selectImpl( dispatch(), impl );
+}
+
+StringCompareImpl getStringCompareImpl() {
+	return dispatch().impl;
+}
+
+const char* getStringCompareImplName( StringCompareImpl impl ) {
+	switch (impl) {
+		case StringCompareImpl::Auto: return "auto";
+		case StringCompareImpl::Scalar: return "scalar";
+		case StringCompareImpl::SSE: return "sse";
+		case StringCompareImpl::AVX2: return "avx2";
+		default: return "unknown";
+	}
+}
+
+// Strings longer than this go through the implementation selected above
+enum { STRING_COMPARE_INLINE_MAX = 32 };
+
+// Short strings are handled with two overlapping loads, which (x86 being little endian) find the first differing
+// byte as the lowest set bit of the difference.  Every x86-64 CPU has SSE2, so that much needs no dispatch.
+int commonPrefixLength( const uint8_t* a, const uint8_t* b, int length ) {
+	if (length > STRING_COMPARE_INLINE_MAX)
+		return dispatch().commonPrefixLengthLong( a, b, length );
+	if (length >= 16) {
+		uint32_t ne = differenceMask16( a, b ) | (differenceMask16( a+length-16, b+length-16 ) << (length-16));
+		return ne ? lowestSetBit( ne ) : length;
+	}
+	if (length >= 8) {
+		uint64_t x, y;
+		memcpy( &x, a, 8 );
+		memcpy( &y, b, 8 );
+		if (x != y) return lowestSetBit64( x^y ) >> 3;
+		memcpy( &x, a+length-8, 8 );
+		memcpy( &y, b+length-8, 8 );
+		if (x != y) return length - 8 + (lowestSetBit64( x^y ) >> 3);
+		return length;
+	}
+	if (length >= 4) {
+		uint32_t x, y;
+		memcpy( &x, a, 4 );
+		memcpy( &y, b, 4 );
+		if (x != y) return lowestSetBit( x^y ) >> 3;
+		memcpy( &x, a+length-4, 4 );
+		memcpy( &y, b+length-4, 4 );
+		if (x != y) return length - 4 + (lowestSetBit( x^y ) >> 3);
+		return length;
+	}
+	int i = 0;
+	while (i < length && a[i] == b[i]) i++;
+	return i;
+}
+
+int compareBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen ) {
+	int len = aLen < bLen ? aLen : bLen;
+	int i = commonPrefixLength( a, b, len );
+	if (i < len) return a[i] < b[i] ? -1 : 1;
+	return aLen < bLen ? -1 : aLen > bLen;
+}
+
+bool lessBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen ) {
+	int len = aLen < bLen ? aLen : bLen;
+	int i = commonPrefixLength( a, b, len );
+	if (i < len) return a[i] < b[i];
+	return aLen < bLen;
+}
+
+static int sign( int x ) { return x < 0 ? -1 : x > 0; }
+
+static int memcmpCompare( StringRef a, StringRef b ) {
+	int c = memcmp( a.begin(), b.begin(), std::min( a.size(), b.size() ) );
+	if (c != 0) return sign(c);
+	return sign( a.size() - b.size() );
+}
+
+static bool memcmpLess( StringRef const& a, StringRef const& b ) { return memcmpCompare( a, b ) < 0; }
+static bool kernelLess( StringRef const& a, StringRef const& b ) { return a < b; }
+
+static const StringCompareImpl allImpls[] = { StringCompareImpl::Scalar, StringCompareImpl::SSE, StringCompareImpl::AVX2 };
+
+TEST_CASE("flow/StringCompare/matches memcmp") {
+	StringCompareImpl original = getStringCompareImpl();
+	Arena arena;
+	for(auto impl : allImpls) {
+		if (!setStringCompareImpl( impl )) continue;
+		for(int i=0; i<20000; i++) {
+			int aLen = g_random->randomInt(0, g_random->random01() < 0.5 ? 20 : 200);
+			int bLen = g_random->random01() < 0.3 ? aLen : g_random->randomInt(0, aLen + 20);
+			uint8_t* a = new (arena) uint8_t[aLen];
+			uint8_t* b = new (arena) uint8_t[bLen];
+			for(int j=0; j<aLen; j++) a[j] = g_random->randomInt(0, 256);
+			memcpy( b, a, std::min(aLen, bLen) );
+			for(int j=aLen; j<bLen; j++) b[j] = g_random->randomInt(0, 256);
+			if (g_random->random01() < 0.8 && bLen)
+				b[g_random->randomInt(0, bLen)] = g_random->randomInt(0, 256);
+
+			StringRef sa( a, aLen ), sb( b, bLen );
+			int expected = memcmpCompare( sa, sb );
+			ASSERT( compareBytes( a, aLen, b, bLen ) == expected );
+			ASSERT( compareBytes( b, bLen, a, aLen ) == -expected );
+			ASSERT( lessBytes( a, aLen, b, bLen ) == (expected < 0) );
+			ASSERT( sign( sa.compare(sb) ) == expected );
+			ASSERT( (sa < sb) == (expected < 0) );
+			ASSERT( (sa > sb) == (expected > 0) );
+
+			int len = std::min(aLen, bLen);
+			int prefix = 0;
+			while (prefix < len && a[prefix] == b[prefix]) prefix++;
+			ASSERT( commonPrefixLength( a, b, len ) == prefix );
+		}
+	}
+	setStringCompareImpl( original );
+	return Void();
+}
+
+// Sorts and searches keys shaped like tuple encoded index entries, which share a long prefix and
+// differ only in their last few bytes, with each implementation and with plain memcmp.
+TEST_CASE("flow/StringCompare/performance") {
+	StringCompareImpl original = getStringCompareImpl();
+	const StringRef prefixes[] = {
+		StringRef(),
+		LiteralStringRef("\x02" "application" "\x00\x02" "tenant" "\x00\x15\x07\x02" "table" "\x00\x02" "index" "\x00"),
+		LiteralStringRef("\x02" "application" "\x00\x02" "tenant" "\x00\x15\x07\x02" "table" "\x00\x02" "index" "\x00"
+						 "\x02" "com.example.inventory.warehouse" "\x00\x02" "stock_by_region" "\x00")
+	};
+
+	for(auto prefix : prefixes) {
+		Arena arena;
+		std::vector<StringRef> keys;
+		for(int i=0; i<100000; i++) {
+			uint8_t* k = new (arena) uint8_t[prefix.size() + 6];
+			memcpy( k, prefix.begin(), prefix.size() );
+			uint8_t* s = k + prefix.size();
+			s[0] = 0x02;
+			for(int j=1; j<5; j++) s[j] = g_random->randomInt('a', 'z'+1);
+			s[5] = 0x00;
+			keys.push_back( StringRef( k, prefix.size() + 6 ) );
+		}
+		std::vector<StringRef> probes = keys;
+		g_random->randomShuffle( probes );
+
+		// Every implementation must order the benchmark keys exactly as the scalar one does
+		ASSERT( setStringCompareImpl( StringCompareImpl::Scalar ) );
+		std::vector<StringRef> scalarSorted = keys;
+		std::sort( scalarSorted.begin(), scalarSorted.end(), kernelLess );
+		std::vector<int> scalarResults;
+		for(int i=0; i<keys.size(); i++)
+			scalarResults.push_back( compareBytes( keys[i].begin(), keys[i].size(), probes[i].begin(), probes[i].size() ) );
+
+		printf("StringCompare: %d byte prefix\n", prefix.size());
+		for(int impl = -1; impl < 3; impl++) {
+			if (impl >= 0 && !setStringCompareImpl( allImpls[impl] )) continue;
+			bool (*less)( StringRef const&, StringRef const& ) = impl < 0 ? memcmpLess : kernelLess;
+
+			std::vector<StringRef> sorted = keys;
+			double start = timer();
+			std::sort( sorted.begin(), sorted.end(), less );
+			double sortTime = timer() - start;
+
+			start = timer();
+			int found = 0;
+			for(auto& p : probes)
+				found += std::binary_search( sorted.begin(), sorted.end(), p, less );
+			double searchTime = timer() - start;
+			ASSERT( found == probes.size() );
+
+			ASSERT( sorted == scalarSorted );
+			if (impl >= 0) {
+				for(int i=0; i<keys.size(); i++)
+					ASSERT( compareBytes( keys[i].begin(), keys[i].size(), probes[i].begin(), probes[i].size() ) == scalarResults[i] );
+			}
+
+			printf("  %-7s %0.1f Ksort/sec  %0.1f Kfind/sec\n", impl < 0 ? "memcmp" : getStringCompareImplName( allImpls[impl] ),
+				sorted.size() / 1000.0 / sortTime, probes.size() / 1000.0 / searchTime);
+		}
+	}
+
+	setStringCompareImpl( original );
+	return Void();
+}
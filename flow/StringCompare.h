@@ -0,0 +1,73 @@
+/*
+ * StringCompare.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_STRINGCOMPARE_H
+#define FLOW_STRINGCOMPARE_H
+#pragma once
+
+#include <stdint.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+// Byte string comparison kernels shared by StringRef and the ordered key structures built on it
+// (IndexedSet, VersionedMap, the resolver's SkipList).  Keys in those structures are usually tuple
+// encoded and share long prefixes, so the interesting work is finding the first differing byte.
+// Short strings are compared with a few overlapping loads; longer ones 16 or 32 bytes at a time by an
+// implementation chosen from the CPU's capabilities the first time one is needed.  The SIMD code is
+// all in StringCompare.cpp, so that nothing including this (or Arena.h) needs the intrinsic headers.
+
+enum class StringCompareImpl { Auto, Scalar, SSE, AVX2 };
+
+// Forces a particular implementation of commonPrefixLength() for long strings (Auto picks the best one
+// the CPU supports).  Intended for tests and benchmarks; returns false if the CPU lacks support.
+bool setStringCompareImpl( StringCompareImpl impl );
+StringCompareImpl getStringCompareImpl();
+const char* getStringCompareImplName( StringCompareImpl impl );
+
+// Returns the number of leading bytes that a[0..length) and b[0..length) have in common
+int commonPrefixLength( const uint8_t* a, const uint8_t* b, int length );
+
+// Three way comparison with the same ordering as memcmp followed by a length comparison.  Returns -1, 0 or 1.
+int compareBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen );
+
+bool lessBytes( const uint8_t* a, int aLen, const uint8_t* b, int bLen );
+
+inline int lowestSetBit( uint32_t x ) {
+#ifdef _WIN32
+	unsigned long i;
+	_BitScanForward( &i, x );
+	return i;
+#else
+	return __builtin_ctz( x );
+#endif
+}
+
+inline int lowestSetBit64( uint64_t x ) {
+#ifdef _WIN32
+	unsigned long i;
+	_BitScanForward64( &i, x );
+	return i;
+#else
+	return __builtin_ctzll( x );
+#endif
+}
+
+#endif
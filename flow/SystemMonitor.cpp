@@ -123,7 +123,19 @@ SystemStatistics customSystemMonitor(std::string eventName, StatisticsState *sta
 				.detail("N2_WriteProbes", netData.countWriteProbes - statState->networkState.countWriteProbes)
 				.detail("N2_PacketsRead", netData.countPacketsReceived - statState->networkState.countPacketsReceived)
 				.detail("N2_PacketsGenerated", netData.countPacketsGenerated - statState->networkState.countPacketsGenerated)
-				.detail("N2_WouldBlock", netData.countWouldBlock - statState->networkState.countWouldBlock);
+				.detail("N2_WouldBlock", netData.countWouldBlock - statState->networkState.countWouldBlock)
+				.detail("N2_WriteBatches", netData.countWriteBatches - statState->networkState.countWriteBatches)
+				.detail("N2_WriteBatchesFull", netData.countWriteBatchesFull - statState->networkState.countWriteBatchesFull)
+				.detail("N2_PacketsCompressed", netData.countPacketsCompressed - statState->networkState.countPacketsCompressed)
+				.detail("N2_PacketsIncompressible", netData.countPacketsIncompressible - statState->networkState.countPacketsIncompressible)
+				.detail("N2_PacketsDecompressed", netData.countPacketsDecompressed - statState->networkState.countPacketsDecompressed)
+				.detail("N2_BytesSavedByCompression", netData.bytesSavedByCompression - statState->networkState.bytesSavedByCompression)
+				.detail("N2_CompressionSeconds", (netData.compressionMicroseconds - statState->networkState.compressionMicroseconds) / 1e6)
+				.detail("N2_DecompressionSeconds", (netData.decompressionMicroseconds - statState->networkState.decompressionMicroseconds) / 1e6);
+
+			int64_t packetsGenerated = netData.countPacketsGenerated - statState->networkState.countPacketsGenerated;
+			if (packetsGenerated)
+				n.detail("N2_WriteCallsPerPacket", double(netData.countWrites - statState->networkState.countWrites) / packetsGenerated);
 
 			for (int i = 0; i<NetworkMetrics::SLOW_EVENT_BINS; i++)
 				if (int c = g_network->networkMetrics.countSlowEvents[i] - statState->networkMetricsState.countSlowEvents[i])
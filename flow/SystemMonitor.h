@@ -76,6 +76,14 @@ struct NetworkData {
 	int64_t countConnEstablished;
 	int64_t countConnClosedWithError;
 	int64_t countConnClosedWithoutError;
+	int64_t countWriteBatches;
+	int64_t countWriteBatchesFull;
+	int64_t countPacketsCompressed;
+	int64_t countPacketsIncompressible;
+	int64_t countPacketsDecompressed;
+	int64_t bytesSavedByCompression;
+	int64_t compressionMicroseconds;
+	int64_t decompressionMicroseconds;
 
 	void init() {
 		auto getValue = [] (StringRef name) -> int64_t {
@@ -109,6 +117,14 @@ struct NetworkData {
 		countConnEstablished = getValue(LiteralStringRef("Net2.CountConnEstablished"));
 		countConnClosedWithError = getValue(LiteralStringRef("Net2.CountConnClosedWithError"));
 		countConnClosedWithoutError = getValue(LiteralStringRef("Net2.CountConnClosedWithoutError"));
+		countWriteBatches = getValue(LiteralStringRef("Net2.CountWriteBatches"));
+		countWriteBatchesFull = getValue(LiteralStringRef("Net2.CountWriteBatchesFull"));
+		countPacketsCompressed = getValue(LiteralStringRef("Net2.CountPacketsCompressed"));
+		countPacketsIncompressible = getValue(LiteralStringRef("Net2.CountPacketsIncompressible"));
+		countPacketsDecompressed = getValue(LiteralStringRef("Net2.CountPacketsDecompressed"));
+		bytesSavedByCompression = getValue(LiteralStringRef("Net2.BytesSavedByCompression"));
+		compressionMicroseconds = getValue(LiteralStringRef("Net2.CompressionMicroseconds"));
+		decompressionMicroseconds = getValue(LiteralStringRef("Net2.DecompressionMicroseconds"));
 		countFileLogicalWrites = getValue(LiteralStringRef("AsyncFile.CountLogicalWrites"));
 		countFileLogicalReads = getValue(LiteralStringRef("AsyncFile.CountLogicalReads"));
 		countAIOSubmit = getValue(LiteralStringRef("AsyncFile.CountAIOSubmit"));
@@ -0,0 +1,188 @@
+/*
+ * TaskQueue.cpp
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TaskQueue.h"
+#include "IRandom.h"
+#include "UnitTest.h"
+#include "network.h"
+#include <queue>
+#include <set>
+
+// The priority queue ordering the run loop used before ReadyQueue: task ID first, then FIFO
+struct HeapTask {
+	int64_t priority;
+	int taskID, item;
+	HeapTask( int taskID, int64_t seq, int item ) : priority( (int64_t(taskID)<<32) - seq ), taskID(taskID), item(item) {}
+	bool operator < ( HeapTask const& r ) const { return priority < r.priority; }
+};
+
+static const int commonTaskIDs[] = { TaskWriteSocket, TaskReadSocket, TaskDefaultPromiseEndpoint, TaskDefaultOnMainThread,
+	TaskDefaultDelay, TaskDefaultYield, TaskDiskRead, TaskDefaultEndpoint, TaskUpdateStorage, TaskTLogCommit,
+	TaskProxyGetConsistentReadVersion, TaskLowPriority };
+
+TEST_CASE("flow/TaskQueue/ReadyQueue") {
+	ReadyQueue<int> q;
+	std::priority_queue<HeapTask> ref;
+	int64_t seq = 0;
+	int items = 0;
+
+	for(int i=0; i<200000; i++) {
+		if (ref.empty() || g_random->random01() < 0.52) {
+			int taskID;
+			if (g_random->random01() < 0.01)
+				taskID = g_random->randomInt(TaskMinPriority, TaskMaxPriority);  // a task ID not seen before, usually
+			else
+				taskID = commonTaskIDs[ g_random->randomInt(0, sizeof(commonTaskIDs)/sizeof(commonTaskIDs[0])) ];
+			q.push( taskID, items );
+			ref.push( HeapTask(taskID, ++seq, items) );
+			items++;
+		} else {
+			ASSERT( q.topTaskID() == ref.top().taskID && q.top() == ref.top().item );
+			q.pop();
+			ref.pop();
+		}
+		ASSERT( q.size() == ref.size() );
+	}
+	q.clear();
+	ASSERT( q.empty() );
+	q.push( TaskDefaultYield, 1 );
+	q.push( TaskWriteSocket, 2 );
+	ASSERT( q.topTaskID() == TaskWriteSocket && q.top() == 2 );
+
+	return Void();
+}
+
+TEST_CASE("flow/TaskQueue/TimerWheel") {
+	double now = g_random->random01() * 1e6;
+	TimerWheel<int> w(now);
+	std::set<std::pair<double,int>> ref;
+	int items = 0;
+
+	for(int i=0; i<100000; i++) {
+		double r = g_random->random01();
+		if (r < 0.6) {
+			double d = r < 0.3 ? g_random->random01() * 0.001 :
+			           r < 0.5 ? g_random->random01() * 1.0 :
+			           r < 0.59 ? g_random->random01() * 10000.0 :
+			           g_random->random01() * 3e6;  // past the top level of the wheel
+			w.add( now + d, items % 100, items );
+			ref.insert( std::make_pair(now + d, items) );
+			items++;
+		} else {
+			double r2 = g_random->random01();
+			now += r2 < 0.9 ? g_random->random01() * 0.002 :
+			       r2 < 0.999 ? g_random->random01() * 10 :
+			       g_random->random01() * 1e6;
+			double last = 0;
+			w.expire( now, [&](int taskID, int item) {
+				ASSERT( ref.size() && ref.begin()->second == item && ref.begin()->first < now && taskID == item % 100 );
+				ASSERT( ref.begin()->first >= last );
+				last = ref.begin()->first;
+				ref.erase( ref.begin() );
+			} );
+			ASSERT( ref.empty() || ref.begin()->first >= now );
+		}
+		ASSERT( w.size() == ref.size() );
+		ASSERT( ref.empty() ? w.nextDeadline() == 1e99 : w.nextDeadline() <= ref.begin()->first );
+	}
+
+	// Sleeping until nextDeadline() must always make progress
+	int wakeups = 0;
+	while (!ref.empty()) {
+		now = std::max( now, w.nextDeadline() ) + 1e-6;
+		w.expire( now, [&](int taskID, int item) {
+			ASSERT( ref.begin()->second == item );
+			ref.erase( ref.begin() );
+		} );
+		ASSERT( ++wakeups < 1000000 );
+	}
+	ASSERT( w.empty() );
+
+	return Void();
+}
+
+TEST_CASE("flow/perf/TaskQueue") {
+	const int N = 10000000;
+	const int nTaskIDs = sizeof(commonTaskIDs)/sizeof(commonTaskIDs[0]);
+	std::vector<int> taskIDs;
+	for(int i=0; i<1<<16; i++)
+		taskIDs.push_back( commonTaskIDs[ g_random->randomInt(0, 3) ? g_random->randomInt(0, 3) : g_random->randomInt(0, nTaskIDs) ] );
+
+	// A steady state of about a thousand ready tasks
+	{
+		std::priority_queue<HeapTask> heap;
+		int64_t seq = 0;
+		double start = timer();
+		for(int i=0; i<N; i++) {
+			heap.push( HeapTask(taskIDs[i&0xffff], ++seq, i) );
+			if (i >= 1000) heap.pop();
+		}
+		printf("ready tasks, binary heap: %0.1f M/sec\n", N / 1e6 / (timer() - start));
+	}
+	{
+		ReadyQueue<int> q;
+		double start = timer();
+		for(int i=0; i<N; i++) {
+			q.push( taskIDs[i&0xffff], i );
+			if (i >= 1000) q.pop();
+		}
+		printf("ready tasks, bucket queue: %0.1f M/sec\n", N / 1e6 / (timer() - start));
+	}
+
+	// A steady state of about 100k pending delays of up to a second, time advancing 100us per 10 delays
+	std::vector<double> delays;
+	for(int i=0; i<1<<16; i++)
+		delays.push_back( g_random->random01() );
+	{
+		struct HeapTimer {
+			double at; int item;
+			bool operator < ( HeapTimer const& r ) const { return at > r.at; }
+		};
+		std::priority_queue<HeapTimer> heap;
+		double now = 0, start = timer();
+		int64_t fired = 0;
+		for(int i=0; i<N; i++) {
+			heap.push( HeapTimer{ now + delays[i&0xffff], i } );
+			if (i % 10 == 9) {
+				now += 1e-4;
+				while (!heap.empty() && heap.top().at < now) {
+					heap.pop();
+					fired++;
+				}
+			}
+		}
+		printf("delays, binary heap: %0.1f M/sec (%lld fired)\n", N / 1e6 / (timer() - start), (long long)fired);
+	}
+	{
+		TimerWheel<int> w(0);
+		double now = 0, start = timer();
+		int64_t fired = 0;
+		for(int i=0; i<N; i++) {
+			w.add( now + delays[i&0xffff], 0, i );
+			if (i % 10 == 9) {
+				now += 1e-4;
+				w.expire( now, [&fired](int, int) { fired++; } );
+			}
+		}
+		printf("delays, timer wheel: %0.1f M/sec (%lld fired)\n", N / 1e6 / (timer() - start), (long long)fired);
+	}
+
+	return Void();
+}
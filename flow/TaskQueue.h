@@ -0,0 +1,309 @@
+/*
+ * TaskQueue.h
+ *
+ * This source file is part of the FoundationDB open source project
+ *
+ * Copyright 2013-2018 Apple Inc. and the FoundationDB project authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOW_TASKQUEUE_H
+#define FLOW_TASKQUEUE_H
+#pragma once
+
+#include "Error.h"
+#include "Deque.h"
+#include "StringCompare.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// The run loop's queue of ready tasks.  Tasks with a higher task ID run first, and tasks with the same task ID run in
+// the order they were pushed.  Task IDs come from a small, mostly fixed set (see network.h), so rather than a heap
+// each distinct task ID gets a FIFO bucket, and a bitmap of non-empty buckets finds the highest priority work.
+// Buckets are created the first time a task ID is seen and are never removed.
+template <class T>
+class ReadyQueue {
+public:
+	ReadyQueue() : count(0), first(0), lastTaskID(0), lastBucket(-1) {}
+
+	bool empty() const { return !count; }
+	size_t size() const { return count; }
+
+	void push( int taskID, T const& item ) {
+		int b = bucketFor(taskID);
+		if (buckets[b].empty())
+			nonEmpty[b>>6] |= uint64_t(1) << (b&63);
+		buckets[b].push_back(item);
+		first = std::min(first, b);
+		++count;
+	}
+
+	// Pre: !empty()
+	int topTaskID() const { return taskIDs[first]; }
+	T const& top() const { return buckets[first].front(); }
+	void pop() {
+		buckets[first].pop_front();
+		--count;
+		if (buckets[first].empty()) {
+			nonEmpty[first>>6] &= ~(uint64_t(1) << (first&63));
+			first = nextNonEmpty(first);
+		}
+	}
+
+	void clear() {
+		for(auto& b : buckets)
+			b.clear();
+		std::fill(nonEmpty.begin(), nonEmpty.end(), 0);
+		count = 0;
+		first = buckets.size();
+	}
+
+private:
+	std::vector<int> taskIDs;					// in decreasing order
+	std::vector<Deque<T>> buckets;				// buckets[i] holds the tasks with taskIDs[i]
+	std::vector<uint64_t> nonEmpty;				// bit i is set iff !buckets[i].empty()
+	size_t count;
+	int first;									// the first non-empty bucket, or buckets.size()
+	int lastTaskID, lastBucket;					// most tasks are pushed with the same task ID as the last one
+
+	int bucketFor( int taskID ) {
+		if (taskID == lastTaskID && lastBucket >= 0)
+			return lastBucket;
+		auto it = std::lower_bound( taskIDs.begin(), taskIDs.end(), taskID, std::greater<int>() );
+		int b = it - taskIDs.begin();
+		if (it == taskIDs.end() || *it != taskID)
+			addBucket(b, taskID);
+		lastTaskID = taskID;
+		lastBucket = b;
+		return b;
+	}
+
+	void addBucket( int b, int taskID ) {
+		taskIDs.insert( taskIDs.begin() + b, taskID );
+		buckets.insert( buckets.begin() + b, Deque<T>() );
+		nonEmpty.assign( (buckets.size()+63)/64, 0 );
+		for(int i=0; i<buckets.size(); i++)
+			if (!buckets[i].empty())
+				nonEmpty[i>>6] |= uint64_t(1) << (i&63);
+		first = nextNonEmpty(0);
+	}
+
+	// Returns the first non-empty bucket at or after b, or buckets.size()
+	int nextNonEmpty( int b ) const {
+		for(int w = b>>6; w < nonEmpty.size(); w++) {
+			uint64_t bits = nonEmpty[w];
+			if (w == b>>6)
+				bits &= ~uint64_t(0) << (b&63);
+			if (bits)
+				return (w<<6) + lowestSetBit64(bits);
+		}
+		return buckets.size();
+	}
+};
+
+// A hierarchical timer wheel for the run loop's delays.  Time is divided into ticks of 1/TICKS_PER_SECOND seconds.
+// Timers due in the next 256 ticks are kept in level 0, one slot per tick; each further level covers 256 times the
+// span of the level below it, and its slots are cascaded down a level as time reaches them.  Timers too far away for
+// the top level wait in an overflow list, which is re-examined every time the top level cascades.
+//
+// Adding a timer is O(1).  expire() fires timers in order of their deadline, and only fires a timer once the given
+// time is strictly later than its deadline, so timers never fire early; ticks only decide which timers are examined.
+template <class T>
+class TimerWheel {
+public:
+	enum { LEVELS = 4, SLOT_BITS = 8, SLOTS = 1<<SLOT_BITS, WORDS = SLOTS/64, TICKS_PER_SECOND = 4096 };
+
+	struct Timer {
+		double at;
+		int taskID;
+		T item;
+		Timer( double at, int taskID, T const& item ) : at(at), taskID(taskID), item(item) {}
+		bool operator < ( Timer const& r ) const { return at < r.at; }
+	};
+
+	explicit TimerWheel( double now ) : currentTick(tickOf(now)), count(0) { clear(); }
+
+	bool empty() const { return !count; }
+	size_t size() const { return count; }
+
+	void add( double at, int taskID, T const& item ) {
+		place( Timer(at, taskID, item), std::max(tickOf(at), currentTick) );
+		++count;
+	}
+
+	// Calls fire(taskID, item) for every timer with at < now, in order of at
+	template <class F>
+	void expire( double now, F const& fire ) {
+		uint64_t nowTick = tickOf(now);
+		due.clear();
+		while (currentTick < nowTick) {
+			if (!count) {
+				currentTick = nowTick;
+				break;
+			}
+
+			// When the lower levels are empty there is nothing to fire until the next slot of a higher level
+			int level = 0;
+			while (level < LEVELS-1 && !levelCount[level])
+				++level;
+			if (level) {
+				uint64_t next = (currentTick | ((uint64_t(1) << (SLOT_BITS*level)) - 1)) + 1;
+				if (next > nowTick) {
+					currentTick = nowTick;
+					break;
+				}
+				currentTick = next;
+				cascade();
+				continue;
+			}
+
+			takeSlot( currentTick & (SLOTS-1) );
+			if ((++currentTick & (SLOTS-1)) == 0)
+				cascade();
+		}
+
+		// The current tick has only partly elapsed
+		auto& s = slots[0][currentTick & (SLOTS-1)];
+		if (!s.empty()) {
+			int kept = 0;
+			for(int i=0; i<s.size(); i++) {
+				if (s[i].at < now)
+					due.push_back(s[i]);
+				else
+					s[kept++] = s[i];
+			}
+			levelCount[0] -= s.size() - kept;
+			s.resize( kept, s[0] );
+			if (!kept) clearOccupied( 0, currentTick & (SLOTS-1) );
+		}
+
+		count -= due.size();
+		std::stable_sort( due.begin(), due.end() );
+		for(auto& t : due)
+			fire( t.taskID, t.item );
+		due.clear();
+	}
+
+	// Returns a time no later than the earliest timer's deadline, or 1e99 if there are no timers.  The time is exact
+	// when the earliest timer is in level 0; otherwise it is when that timer's slot will be cascaded.
+	double nextDeadline() const {
+		if (!count) return 1e99;
+		double next = 1e99;
+
+		int s = nextOccupied( 0, currentTick & (SLOTS-1) );
+		if (s >= 0)
+			for(auto& t : slots[0][s])
+				next = std::min(next, t.at);
+
+		for(int level=1; level<LEVELS; level++) {
+			if (!levelCount[level]) continue;
+			uint64_t base = currentTick >> (SLOT_BITS*level);
+			s = nextOccupied( level, (base+1) & (SLOTS-1) );
+			uint64_t slotBase = base + 1 + ((s - (base+1)) & (SLOTS-1));
+			next = std::min(next, double(slotBase << (SLOT_BITS*level)) / TICKS_PER_SECOND);
+		}
+
+		if (overflow.size()) {
+			uint64_t topSpan = uint64_t(1) << (SLOT_BITS*(LEVELS-1));
+			next = std::min(next, double((currentTick | (topSpan-1)) + 1) / TICKS_PER_SECOND);
+		}
+		return next;
+	}
+
+	void clear() {
+		for(int level=0; level<LEVELS; level++) {
+			for(int s=0; s<SLOTS; s++)
+				slots[level][s].clear();
+			for(int w=0; w<WORDS; w++)
+				occupied[level][w] = 0;
+			levelCount[level] = 0;
+		}
+		overflow.clear();
+		count = 0;
+	}
+
+private:
+	std::vector<Timer> slots[LEVELS][SLOTS];
+	uint64_t occupied[LEVELS][WORDS];
+	size_t levelCount[LEVELS];
+	std::vector<Timer> overflow;
+	std::vector<Timer> due, cascading;
+	uint64_t currentTick;				// every timer in the wheel is due at or after this tick
+	size_t count;
+
+	static uint64_t tickOf( double t ) { return t > 0 ? uint64_t(t * TICKS_PER_SECOND) : 0; }
+
+	void place( Timer const& t, uint64_t tick ) {
+		uint64_t delta = tick - currentTick;
+		for(int level=0; level<LEVELS; level++) {
+			if (delta < (uint64_t(1) << (SLOT_BITS*(level+1)))) {
+				int s = (tick >> (SLOT_BITS*level)) & (SLOTS-1);
+				slots[level][s].push_back(t);
+				occupied[level][s>>6] |= uint64_t(1) << (s&63);
+				++levelCount[level];
+				return;
+			}
+		}
+		overflow.push_back(t);
+	}
+
+	void takeSlot( int s ) {
+		auto& v = slots[0][s];
+		if (v.empty()) return;
+		due.insert( due.end(), v.begin(), v.end() );
+		levelCount[0] -= v.size();
+		v.clear();
+		clearOccupied( 0, s );
+	}
+
+	// Called when currentTick reaches a multiple of SLOTS: redistributes the slots of the higher levels that begin here
+	void cascade() {
+		for(int level=1; level<LEVELS; level++) {
+			int s = (currentTick >> (SLOT_BITS*level)) & (SLOTS-1);
+			redistribute( slots[level][s] );
+			levelCount[level] -= cascading.size();
+			clearOccupied( level, s );
+			if (s && level < LEVELS-1) return;
+		}
+		// The top level has moved on by a slot, so some overflow timers may now fit
+		redistribute( overflow );
+	}
+
+	void redistribute( std::vector<Timer>& v ) {
+		cascading.clear();
+		std::swap( cascading, v );
+		for(auto& t : cascading)
+			place( t, std::max(tickOf(t.at), currentTick) );
+	}
+
+	void clearOccupied( int level, int s ) { occupied[level][s>>6] &= ~(uint64_t(1) << (s&63)); }
+
+	// Returns the first occupied slot of the level at or after slot s, wrapping around, or -1
+	int nextOccupied( int level, int s ) const {
+		for(int i=0; i<=WORDS; i++) {
+			int w = ((s>>6) + i) % WORDS;
+			uint64_t bits = occupied[level][w];
+			if (i == 0)
+				bits &= ~uint64_t(0) << (s&63);
+			else if (i == WORDS)
+				bits &= ~(~uint64_t(0) << (s&63));
+			if (bits)
+				return (w<<6) + lowestSetBit64(bits);
+		}
+		return -1;
+	}
+};
+
+#endif